@@ -32,8 +32,6 @@ use base 'Xacobeo::Plugin';
 use strict;
 use warnings;
 
-use Xacobeo::Document;
-
 our $VERSION = '0.03';
 
 
@@ -82,14 +80,13 @@ sub load_from_clipboard {
 	my $selection = Gtk2::Gdk::Atom->new('CLIPBOARD');
 	my $clipboard = Gtk2::Clipboard->get($selection);
 	
-	# Get the xml from clipboard
-	my $xml = $clipboard->wait_for_text;
-	return unless defined $xml;
-	
-	# Load the temporary xml file
-	my $document = Xacobeo::Document->new_from_string($xml, 'xml');
-	$window->set_title('clipboard');
-	$window->load_document($document);
+	# Get the xml from clipboard, the text is given once it's available and the
+	# document is parsed in the background: the main loop is never blocked
+	$clipboard->request_text(sub {
+		my ($clipboard, $xml) = @_;
+		return unless defined $xml;
+		$window->load_string($xml, 'clipboard');
+	});
 }
 
 
@@ -26,6 +26,57 @@ The following properties are defined:
 
 The root directory where the application has been installed.
 
+=head2 xpath-timeout
+
+The maximal number of seconds that an XPath query can run. A value of 0
+disables the timeout.
+
+=head2 xpath-max-results
+
+The maximal number of nodes that an XPath query can return. A value of 0
+disables the limit.
+
+=head2 xpath-preview-size
+
+The number of nodes displayed by the preview of an XPath query while it's being
+typed. A value of 0 disables the preview.
+
+=head2 xpath-attribute-index-size
+
+The memory (in megabytes) used by the indexes of the attribute values. The
+values of an attribute are indexed the first time that the attribute is used in
+a search. A value of 0 disables these indexes.
+
+=head2 xpath-text-index-size
+
+The memory (in megabytes) that the index of the text can use. The text of a
+document is indexed in the background when the document is loaded, the index
+is dropped if it needs more memory. A value of 0 disables the index.
+
+=head2 xpath-result-cache-size
+
+The memory (in megabytes) used for caching the nodes found by the XPath queries.
+Running again a query on the same document returns the cached nodes. A value of
+0 disables the cache.
+
+The XPath settings can be changed in the group I<XPath> (keys I<timeout>,
+I<max-results>, I<preview-size>, I<attribute-index-size>, I<text-index-size>
+and I<result-cache-size>) of the file
+F<$XDG_CONFIG_HOME/xacobeo/xacobeo.conf>.
+
+=head2 records-window-threshold
+
+The size (in megabytes) from which a document made of records is opened by
+windows: the records are indexed once and only a window of records is parsed
+at a time. A value of 0 disables the windows.
+
+=head2 records-window-size
+
+The number of records parsed by a window.
+
+The records settings can be changed in the group I<Records> (keys
+I<window-threshold> and I<window-size>) of the same file.
+
 =head1 METHODS
 
 The following methods are available:
@@ -38,6 +89,7 @@ use warnings;
 use FindBin;
 use File::Spec::Functions;
 use File::BaseDir;
+use File::Path qw(mkpath);
 
 use Xacobeo::GObject;
 
@@ -49,6 +101,70 @@ Xacobeo::GObject->register_package('Glib::Object' =>
 			"The root folder of the application's installation",
 			['readable', 'writable', 'construct-only'],
 		),
+
+		Glib::ParamSpec->double(
+			'xpath-timeout',
+			"XPath timeout",
+			"The maximal number of seconds that an XPath query can run",
+			0, 24 * 60 * 60, 60,
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->uint(
+			'xpath-max-results',
+			"XPath max results",
+			"The maximal number of nodes that an XPath query can return",
+			0, 2**31 - 1, 1_000_000,
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->uint(
+			'xpath-preview-size',
+			"XPath preview size",
+			"The number of nodes displayed by the preview of an XPath query",
+			0, 10_000, 20,
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->uint(
+			'xpath-attribute-index-size',
+			"XPath attribute index size",
+			"The memory (in MB) used by the indexes of the attribute values",
+			0, 4096, 64,
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->uint(
+			'xpath-text-index-size',
+			"XPath text index size",
+			"The memory (in MB) that the index of the text can use",
+			0, 4096, 256,
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->uint(
+			'xpath-result-cache-size',
+			"XPath result cache size",
+			"The memory (in MB) used for caching the results of the XPath queries",
+			0, 4096, 32,
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->uint(
+			'records-window-threshold',
+			"Records window threshold",
+			"The size (in MB) from which a document made of records is opened by windows",
+			0, 2**31 - 1, 1024,
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->uint(
+			'records-window-size',
+			"Records window size",
+			"The number of records parsed by a window",
+			1, 1_000_000, 1000,
+			['readable', 'writable'],
+		),
 	],
 );
 
@@ -75,6 +191,46 @@ sub init {
 	$dir ||= find_app_folder();
 
 	$INSTANCE = $class->SUPER::new(dir => $dir);
+	$INSTANCE->load_settings();
+	return $INSTANCE;
+}
+
+
+#
+# Loads the user's settings from the configuration file (if there's one).
+#
+sub load_settings {
+	my $self = shift;
+
+	my $file = catfile($XDG->config_home, 'xacobeo', 'xacobeo.conf');
+	return unless -e $file;
+
+	my $keyfile = Glib::KeyFile->new();
+	eval {
+		$keyfile->load_from_file($file, 'none');
+		1;
+	} or do {
+		warn "Can't read $file: $@";
+		return;
+	};
+
+	my %settings = (
+		'timeout'              => ['xpath-timeout', 'get_double'],
+		'max-results'          => ['xpath-max-results', 'get_integer'],
+		'preview-size'         => ['xpath-preview-size', 'get_integer'],
+		'attribute-index-size' => ['xpath-attribute-index-size', 'get_integer'],
+		'text-index-size'      => ['xpath-text-index-size', 'get_integer'],
+		'result-cache-size'    => ['xpath-result-cache-size', 'get_integer'],
+		'window-threshold'     => ['records-window-threshold', 'get_integer', 'Records'],
+		'window-size'          => ['records-window-size', 'get_integer', 'Records'],
+	);
+	while (my ($key, $setting) = each %settings) {
+		my ($property, $getter, $group) = @{ $setting };
+		$group ||= 'XPath';
+		next unless $keyfile->has_group($group) and $keyfile->has_key($group, $key);
+		my $value = $keyfile->$getter($group, $key);
+		$self->set($property => $value) if $value >= 0;
+	}
 }
 
 
@@ -122,6 +278,33 @@ sub share_file {
 }
 
 
+=head2 cache_file
+
+Returns the path of a file in the application's cache directory
+(F<$XDG_CACHE_HOME/xacobeo>). The folder of the file is created if needed.
+
+Parameters:
+
+=over
+
+=item * @path
+
+The path parts relative to the cache directory.
+
+=back
+
+=cut
+
+sub cache_file {
+	my $self = shift;
+	my @path = @_;
+	my $name = pop @path;
+	my $folder = catdir($XDG->cache_home, 'xacobeo', @path);
+	mkpath($folder) unless -d $folder;
+	return catfile($folder, $name);
+}
+
+
 =head2 app_name
 
 Returns the application's name.
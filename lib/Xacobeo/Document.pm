@@ -55,6 +55,36 @@ The XPath conext to be used with the document.
 
 An hashref with the namespaces registered in the document.
 
+=head2 index
+
+The native index of the document (used for resolving the paths of the nodes).
+
+=head2 text-index
+
+The trigram index of the text of the document (used for substring searches).
+It's only created by L</build_text_index>.
+
+=head2 dataguide
+
+The summary of the structure of the document (an instance of
+L<Xacobeo::XS::DataGuide>), used for completing the XPath expressions and for
+displaying the structure of the document.
+
+=head2 analysis
+
+The information collected when the document was loaded (an instance of
+L<Xacobeo::XS::Analysis>), see L</statistics>.
+
+=head2 result-cache
+
+The cache of the node sets returned by the queries (an instance of
+L<Xacobeo::XS::ResultCache>).
+
+=head2 generation
+
+The number of times that the document was modified, see L</changed>. The cached
+results are only valid for the generation that produced them.
+
 =head1 METHODS
 
 The package defines the following methods:
@@ -67,8 +97,12 @@ use warnings;
 use XML::LibXML qw(XML_XML_NS);
 use Data::Dumper;
 use Carp qw(croak);
+use Encode qw(is_utf8);
 
 use Xacobeo::I18n;
+use Xacobeo::XS;
+use Xacobeo::Timer;
+use Xacobeo::Utils qw(isa_dom_nodelist isa_nodeset);
 use Xacobeo::GObject;
 
 Xacobeo::GObject->register_package('Glib::Object' =>
@@ -108,35 +142,90 @@ Xacobeo::GObject->register_package('Glib::Object' =>
 			"The namespaces used in the document",
 			['readable', 'writable'],
 		),
+
+		Glib::ParamSpec->scalar(
+			'index',
+			"Document index",
+			"The native index of the document",
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->scalar(
+			'text-index',
+			"Document text index",
+			"The trigram index of the text of the document",
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->scalar(
+			'dataguide',
+			"Document DataGuide",
+			"The summary of the paths of the document",
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->scalar(
+			'analysis',
+			"Document analysis",
+			"The information collected when the document was loaded",
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->scalar(
+			'result-cache',
+			"Document result cache",
+			"The cache of the results of the XPath queries",
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->scalar(
+			'generation',
+			"Document generation",
+			"The number of times that the document was modified",
+			['readable', 'writable'],
+		),
 	],
 );
 
 
+# The compiled XPath expressions shared by all documents
+my $XPATH_CACHE = Xacobeo::XS::XPathCache->new(64);
+
+# The default memory limit of the result cache of a document
+my $RESULT_CACHE_SIZE = 32 * 1024 * 1024;
+
+
 =head2 new_from_file
 
 Creates a new instance from a file (an URI should also be valid).
 
 Parameters:
 
-	$source: the source of the document, this can be a filename or an URI.
-	$type:   the type of document: C<xml> or C<html>.
+	$source:   the source of the document, this can be a filename or an URI.
+	$type:     the type of document: C<xml> or C<html>.
+	$progress: optional callback called with the number of bytes parsed and the
+	           size of the file while the file is parsed. It's only called for
+	           the XML files parsed natively.
 
 =cut
 
 sub new_from_file {
-	my ($class, $source, $type) = @_;
+	my ($class, $source, $type, $progress) = @_;
 	if (! (defined $source && defined $type)) {
 		croak 'Usage: ', __PACKAGE__, '->new_from_file($source, $type)'
 	}
 
 	# Parse the document
 	my $parser = _construct_xml_parser();
-	my $document_node;
+	my ($document_node, $analysis);
 	if (! defined $type) {
 		croak __("Parameter 'type' must be defined");
 	}
 	elsif ($type eq 'xml') {
-		$document_node = $parser->parse_file($source);
+		# The document is analyzed while it's parsed, XML::LibXML is used for the
+		# sources that can't be parsed natively (URIs, missing files, etc)
+		$analysis = Xacobeo::XS::Analysis->parse_file($source, $progress);
+		$document_node = $analysis ? $analysis->document : $parser->parse_file($source);
 	}
 	elsif ($type eq 'html') {
 		$document_node = $parser->parse_html_file($source);
@@ -146,6 +235,7 @@ sub new_from_file {
 		source       => $source,
 		type         => $type,
 		documentNode => $document_node,
+		analysis     => $analysis,
 	);
 
 	return $self;
@@ -171,12 +261,15 @@ sub new_from_string {
 
 	# Parse the document
 	my $parser = _construct_xml_parser();
-	my $document_node;
+	my ($document_node, $analysis);
 	if (! defined $type) {
 		croak __("Parameter 'type' must be defined");
 	}
 	elsif ($type eq 'xml') {
-		$document_node = $parser->parse_string($content);
+		# Only the bytes can be parsed natively, XML::LibXML takes care of the
+		# character strings
+		$analysis = Xacobeo::XS::Analysis->parse_string($content) unless is_utf8($content);
+		$document_node = $analysis ? $analysis->document : $parser->parse_string($content);
 	}
 	elsif ($type eq 'html') {
 		$document_node = $parser->parse_html_string($content);
@@ -186,6 +279,123 @@ sub new_from_string {
 		source       => 'string',
 		type         => $type,
 		documentNode => $document_node,
+		analysis     => $analysis,
+	);
+
+	return $self;
+}
+
+
+=head2 new_from_loader
+
+Creates a new instance from a document loaded by chunks, the parse is completed.
+
+Parameters:
+
+	$loader: the loader that parsed the document (an instance of
+	         L<Xacobeo::XS::Loader>).
+	$source: the source of the document.
+
+=cut
+
+sub new_from_loader {
+	my ($class, $loader, $source) = @_;
+	if (! (defined $loader && defined $source)) {
+		croak 'Usage: ', __PACKAGE__, '->new_from_loader($loader, $source)'
+	}
+
+	my $analysis = $loader->finish or croak __("The document is empty");
+
+	my $self = $class->new(
+		source       => $source,
+		type         => 'xml',
+		documentNode => $analysis->document,
+		analysis     => $analysis,
+	);
+
+	return $self;
+}
+
+
+=head2 parse_async
+
+Starts parsing and analyzing an XML document in a background thread and returns
+the job (an instance of C<Xacobeo::XS::ParseJob>) doing it or undef if the
+source can't be parsed natively (an URI, an empty file, etc), the document has
+to be loaded with L</new_from_file> then. The job has to be polled until it's
+finished, the document is then created with L</new_from_job>. See
+L<Xacobeo::XS/PARSE JOBS>.
+
+Parameters:
+
+	$source:   the source of the document, a filename or C<-> for the standard
+	           input.
+	$previews: if true copies of the part of the document already parsed are
+	           made while the parse goes on.
+
+=cut
+
+sub parse_async {
+	my ($class, $source, $previews) = @_;
+	if (! defined $source) {
+		croak 'Usage: ', __PACKAGE__, '->parse_async($source)'
+	}
+
+	if ($source eq '-') {
+		return Xacobeo::XS::ParseJob->new_from_fd(fileno(STDIN), $previews ? 1 : 0);
+	}
+	return Xacobeo::XS::ParseJob->new_from_file($source, $previews ? 1 : 0);
+}
+
+
+=head2 parse_string_async
+
+Starts parsing and analyzing an XML document given as a string in a background
+thread and returns the job (an instance of C<Xacobeo::XS::ParseJob>) doing it.
+See L</parse_async>.
+
+Parameters:
+
+	$content: the contents of the document, the string is copied.
+
+=cut
+
+sub parse_string_async {
+	my ($class, $content) = @_;
+	if (! defined $content) {
+		croak 'Usage: ', __PACKAGE__, '->parse_string_async($content)'
+	}
+
+	return Xacobeo::XS::ParseJob->new_from_string($content);
+}
+
+
+=head2 new_from_job
+
+Creates a new instance from a document parsed in a background thread. The job
+has to be done.
+
+Parameters:
+
+	$job:    the job that parsed the document (an instance of
+	         C<Xacobeo::XS::ParseJob>).
+	$source: the source of the document.
+
+=cut
+
+sub new_from_job {
+	my ($class, $job, $source) = @_;
+	if (! (defined $job && defined $source)) {
+		croak 'Usage: ', __PACKAGE__, '->new_from_job($job, $source)'
+	}
+
+	my $analysis = $job->result or croak $job->error || __("The document is empty");
+
+	my $self = $class->new(
+		source       => $source,
+		type         => 'xml',
+		documentNode => $analysis->document,
+		analysis     => $analysis,
 	);
 
 	return $self;
@@ -221,15 +431,38 @@ sub new {
 
 	my $self = $class->SUPER::new(@_);
 
-	# Find the namespaces
+	# Walk the document once, the namespaces, the index and the summary of the
+	# paths are collected at the same time. The documents parsed natively were
+	# already analyzed by the parser.
 	my $document_node = $self->documentNode;
-	my $namespaces = _get_all_namespaces($document_node);
+	my $analysis = $self->analysis;
+	if (! $analysis && $document_node) {
+		$analysis = Xacobeo::XS::Analysis->new($document_node);
+	}
+
+	# Find the namespaces
+	my $namespaces = $analysis ? $analysis->namespaces : _get_all_namespaces($document_node);
 	$self->namespaces($namespaces);
 
 	# Create the XPath context
 	my $xpath_context = $self->_create_xpath_context();
 	$self->xpath($xpath_context);
 
+	if ($analysis) {
+		$self->analysis($analysis);
+
+		# The index used for resolving the paths of the nodes
+		$self->index($analysis->take_index);
+
+		# The summary of the paths (DataGuide)
+		$self->dataguide($analysis->take_dataguide);
+
+		# The results of the queries already made
+		my $result_cache = Xacobeo::XS::ResultCache->new($document_node, $RESULT_CACHE_SIZE);
+		$self->result_cache($result_cache);
+	}
+	$self->generation(0);
+
 	return $self;
 }
 
@@ -278,24 +511,543 @@ sub find {
 	my ($self, $xpath) = @_;
 	croak __("Document node is missing") unless defined $self->documentNode;
 
-	my $result;
+	# The simple queries are answered by the index
+	my $result = $self->find_indexed($xpath);
+	if (defined $result) {
+		return isa_nodeset($result) ? $result->slice(0, $result->size) : $result;
+	}
+
+	$result = $self->find_cached($xpath);
+	return $result->slice(0, $result->size) if defined $result;
+
 	eval {
-		$result = $self->xpath->find($xpath, $self->documentNode);
+		$result = $self->xpath->find($self->_compile($xpath), $self->documentNode);
 		1;
 	} or croak $@;
 
+	# The nodes found are cached for the next evaluations
+	if (isa_dom_nodelist($result) and $self->result_cache) {
+		my $set = Xacobeo::XS::NodeSet->new_from_list($self->documentNode, $result);
+		$self->cache_result($xpath, $set) if defined $set;
+	}
+
 	return $result;
 }
 
 
+=head2 find_indexed
+
+Answers the given XPath query with the indexes of the element names and of the
+attribute values. Only the simple queries (C<//name>,
+C<//name[@attribute='value']>, C<//*[@attribute='value']> and their C<count()>)
+are supported, for any other query C<undef> is returned. See
+L<Xacobeo::XS/INDEX>.
+
+Once the text index is built (see L</build_text_index>) the substring searches
+C<//text()[contains(., 'text')]> and C<//@*[contains(., 'text')]> are answered
+too. See L<Xacobeo::XS/TEXT INDEX>.
+
+The node sets are returned as a C<Xacobeo::XS::NodeSet>.
+
+Parameters:
+
+	$xpath: the XPath expression to execute.
+
+=cut
+
+sub find_indexed {
+	my ($self, $xpath) = @_;
+
+	if (my $index = $self->index) {
+		my $result = $index->find($xpath);
+		return $result if defined $result;
+	}
+
+	# The substring searches are answered by the text index once it's built
+	my $text_index = $self->{text_index} or return;
+	return $text_index->find($xpath);
+}
+
+
+=head2 find_async
+
+Starts the evaluation of the given XPath query in a background thread and
+returns the job (an instance of C<Xacobeo::XS::XPathJob>) evaluating it. The
+job has to be polled until it's finished. See L<Xacobeo::XS/XPATH JOBS>.
+
+Parameters:
+
+	$xpath:       the XPath expression to execute.
+	$timeout:     the number of seconds after which the evaluation is stopped
+	              (0 for no timeout).
+	$max_results: the maximal number of nodes that can be returned (0 for no
+	              limit).
+
+=cut
+
+sub find_async {
+	my ($self, $xpath, $timeout, $max_results) = @_;
+	croak __("Document node is missing") unless defined $self->documentNode;
+
+	return Xacobeo::XS::XPathJob->new(
+		$self->documentNode,
+		$xpath,
+		$self->namespaces,
+		$timeout || 0,
+		$max_results || 0,
+	);
+}
+
+
+=head2 explain_async
+
+Starts the explanation of the given XPath query in a background thread and
+returns the job (an instance of C<Xacobeo::XS::XPathJob>) explaining it. Once
+done the result of the job is the same as the one of L</explain>.
+
+Parameters:
+
+	$xpath:   the XPath expression to explain.
+	$timeout: the number of seconds after which the explanation is stopped
+	          (0 for no timeout).
+
+=cut
+
+sub explain_async {
+	my ($self, $xpath, $timeout) = @_;
+	croak __("Document node is missing") unless defined $self->documentNode;
+
+	return Xacobeo::XS::XPathJob->new_explain(
+		$self->documentNode,
+		$xpath,
+		$self->namespaces,
+		$timeout || 0,
+	);
+}
+
+
+=head2 find_handle
+
+Runs the given XPath query and returns the nodes found as a
+C<Xacobeo::XS::NodeSet>. Unlike L</find> the nodes are not converted to Perl
+objects; the node set can be counted and sliced without creating a Perl object
+per node. See L<Xacobeo::XS/NODE SETS>.
+
+The nodes found are kept in the cache of the results, running the same query
+again returns the cached nodes (see L</find_cached>).
+
+If the query doesn't return nodes its value is returned as done by L</find>.
+
+This method croaks if the expression can't be evaluated.
+
+Parameters:
+
+	$xpath: the XPath expression to execute.
+
+=cut
+
+sub find_handle {
+	my ($self, $xpath) = @_;
+	croak __("Document node is missing") unless defined $self->documentNode;
+
+	my $set = $self->find_indexed($xpath);
+	return $set if isa_nodeset($set);
+
+	$set = $self->find_cached($xpath);
+	return $set if defined $set;
+
+	$set = Xacobeo::XS::NodeSet->find($self->documentNode, $xpath, $self->namespaces);
+	if (defined $set) {
+		$self->cache_result($xpath, $set);
+		return $set;
+	}
+
+	# Not a node set or an error
+	return $self->find($xpath);
+}
+
+
+=head2 find_cached
+
+Returns the nodes found by a previous evaluation of the given XPath query as a
+C<Xacobeo::XS::NodeSet> or C<undef> if the result is not in the cache. The
+results are stored by L</find>, L</find_handle> and L</cache_result>.
+
+Parameters:
+
+	$xpath: the XPath expression.
+
+=cut
+
+sub find_cached {
+	my ($self, $xpath) = @_;
+	my $result_cache = $self->result_cache or return;
+	return $result_cache->lookup($xpath, $self->generation);
+}
+
+
+=head2 cache_result
+
+Stores the nodes found by an XPath query (a C<Xacobeo::XS::NodeSet>) in the
+cache of the results. The next evaluations of the same query are answered by
+L</find_cached> until the document is changed.
+
+Parameters:
+
+	$xpath: the XPath expression evaluated.
+	$set:   the nodes found.
+
+=cut
+
+sub cache_result {
+	my ($self, $xpath, $set) = @_;
+	my $result_cache = $self->result_cache or return;
+	return $result_cache->store($xpath, $self->generation, $set);
+}
+
+
+=head2 changed
+
+Tells the document that its nodes were modified. The generation of the document
+is incremented and the cached results of the queries are discarded.
+
+=cut
+
+sub changed {
+	my $self = shift;
+	$self->generation($self->generation + 1);
+	return;
+}
+
+
+=head2 find_by_attribute
+
+Returns the elements having an attribute with the given value as a
+C<Xacobeo::XS::NodeSet>. This is the same as the XPath query
+C<//*[@name='value']> but the lookup is done through the index of the attribute
+values when possible.
+
+This method croaks if the name of the attribute is not valid.
+
+Parameters:
+
+	$name:  the name of the attribute, it can have a prefix.
+	$value: the value of the attribute.
+
+=cut
+
+sub find_by_attribute {
+	my ($self, $name, $value) = @_;
+	croak __("Document node is missing") unless defined $self->documentNode;
+
+	if (my $index = $self->index) {
+		my $set = $index->find_attribute($name, $value);
+		return $set if defined $set;
+	}
+
+	# The index can't be used, go through the XPath engine
+	my $xpath = sprintf '//*[@%s=%s]', $name, _xpath_literal($value);
+	return $self->find_handle($xpath);
+}
+
+
+=head2 union
+
+Returns the nodes found in any of the given node sets (C<Xacobeo::XS::NodeSet>,
+see L</find_handle>) as a new node set in document order, as done by the XPath
+operator C<|>. The sets are merged natively using the position of the elements
+computed by the index.
+
+Parameters:
+
+	@sets: the node sets to merge.
+
+=cut
+
+sub union {
+	my ($self, @sets) = @_;
+	return $self->_merge_sets(union => @sets);
+}
+
+
+=head2 intersect
+
+Returns the nodes found in all the given node sets as a new node set in
+document order. This is useful for comparing the results of different queries.
+
+Parameters:
+
+	@sets: the node sets to intersect.
+
+=cut
+
+sub intersect {
+	my ($self, @sets) = @_;
+	return $self->_merge_sets(intersect => @sets);
+}
+
+
+=head2 sort_nodes
+
+Sorts the nodes of a C<Xacobeo::XS::NodeSet> in document order and removes the
+duplicates. The set is modified.
+
+Parameters:
+
+	$set: the node set to sort.
+
+=cut
+
+sub sort_nodes {
+	my ($self, $set) = @_;
+	croak 'Usage: $document->sort_nodes($set)' unless isa_nodeset($set);
+	croak __("Document node is missing") unless defined $self->index;
+
+	$self->index->sort($set);
+	return $set;
+}
+
+
+#
+# Merges the node sets pairwise with the given operation of the index (union or
+# intersect).
+#
+sub _merge_sets {
+	my ($self, $operation, @sets) = @_;
+	croak "Usage: \$document->$operation(\@sets)" if ! @sets || grep { ! isa_nodeset($_) } @sets;
+	croak __("Document node is missing") unless defined $self->index;
+
+	my $index = $self->index;
+	my ($result, @others) = @sets;
+	$index->sort($result) unless @others;
+	foreach my $other (@others) {
+		$result = $index->$operation($result, $other);
+		croak __("The node sets belong to different documents") unless defined $result;
+	}
+
+	return $result;
+}
+
+
+=head2 build_text_index
+
+Starts building the trigram index of the text of the document in a background
+thread and returns it (an instance of C<Xacobeo::XS::TextIndex>). The index is
+built only once, the next calls return the same index. See
+L<Xacobeo::XS/TEXT INDEX>.
+
+Parameters:
+
+=over
+
+=item $limit
+
+The maximal number of bytes used by the index (optional). The index is dropped
+if it needs more memory and the searches go through the XPath engine.
+
+=back
+
+=cut
+
+sub build_text_index {
+	my ($self, $limit) = @_;
+	return unless defined $self->documentNode;
+
+	my $text_index = $self->{text_index};
+	if (! $text_index) {
+		my @preorder = $self->analysis ? ($self->analysis->preorder) : ();
+		$text_index = Xacobeo::XS::TextIndex->new($self->documentNode, $limit || 0, @preorder);
+		$self->text_index($text_index);
+	}
+
+	return $text_index;
+}
+
+
+=head2 search_text
+
+Returns the elements having a text node or an attribute that contains the given
+text as a C<Xacobeo::XS::NodeSet>. The search is answered by the text index if
+it's built, otherwise the document is searched through the XPath engine.
+
+Parameters:
+
+	$text: the text to search.
+
+=cut
+
+sub search_text {
+	my ($self, $text) = @_;
+	croak __("Document node is missing") unless defined $self->documentNode;
+
+	if (my $text_index = $self->{text_index}) {
+		my $set = $text_index->search($text);
+		return $set if defined $set;
+	}
+
+	my $literal = _xpath_literal($text);
+	return $self->find_handle("//*[text()[contains(., $literal)] or \@*[contains(., $literal)]]");
+}
+
+
+=head2 preview
+
+Returns the first nodes matched by the given XPath query as a
+L<XML::LibXML::NodeList> or C<undef> if the query can't be previewed. Only the
+simple paths that can be streamed are previewed, see
+L<Xacobeo::XS/get_xpath_preview>.
+
+Parameters:
+
+	$xpath:  the XPath expression to execute.
+	$max:    the maximal number of nodes to return.
+	$visits: the maximal number of nodes walked (optional).
+
+=cut
+
+sub preview {
+	my ($self, $xpath, $max, $visits) = @_;
+	return unless defined $self->documentNode;
+	return Xacobeo::XS->get_xpath_preview($self->documentNode, $xpath, $self->namespaces, $max, $visits);
+}
+
+
+=head2 explain
+
+Explains the evaluation of the given XPath query step by step, see
+L<Xacobeo::XS/explain_xpath>. Returns an array ref of rows [label, count,
+seconds], the last row is the evaluation of the whole query. The queries that
+can't be split in steps are explained with a single row.
+
+This method croaks if the expression can't be evaluated.
+
+Parameters:
+
+	$xpath: the XPath expression to explain.
+
+=cut
+
+sub explain {
+	my ($self, $xpath) = @_;
+	croak __("Document node is missing") unless defined $self->documentNode;
+
+	my $explanation = Xacobeo::XS->explain_xpath($self->documentNode, $xpath, $self->namespaces);
+	return $explanation if defined $explanation;
+
+	# A query that isn't a location path is evaluated as a whole
+	my $timer = Xacobeo::Timer->start();
+	my $result = $self->find_handle($xpath);
+	$timer->stop();
+
+	my $count = isa_nodeset($result) ? $result->size : isa_dom_nodelist($result) ? $result->size : 1;
+	return [ [ $xpath, $count, $timer->elapsed ] ];
+}
+
+
+=head2 statistics
+
+Returns the statistics of the document as it was loaded in a hashref with the
+number of C<elements>, C<attributes>, C<texts>, C<comments>,
+C<processing_instructions> and C<ids>, the maximal C<depth>, the number of
+elements at each depth (C<depths>, an arrayref starting at the root element) and
+the time C<elapsed> while collecting them. Returns C<undef> if the document has
+no document node.
+
+=cut
+
+sub statistics {
+	my $self = shift;
+	my $analysis = $self->analysis or return;
+	return $analysis->statistics;
+}
+
+
+=head2 find_id
+
+Returns the element that has the given ID (an attribute C<xml:id> or declared
+as an ID by the DTD) or C<undef> if there's no such element. The IDs are the
+ones found when the document was loaded.
+
+Parameters:
+
+	$id: the value of the ID.
+
+=cut
+
+sub find_id {
+	my ($self, $id) = @_;
+	my $analysis = $self->analysis or return;
+	return $analysis->find_id($id);
+}
+
+
+=head2 is_ancestor
+
+Returns true if the first node is an ancestor of the second one. The answer is
+given by the preorder mirror of the document built when it was loaded, without
+walking up the tree.
+
+Parameters:
+
+	$ancestor: the ancestor node.
+
+	$node: the descendant node.
+
+=cut
+
+sub is_ancestor {
+	my ($self, $ancestor, $node) = @_;
+	my $analysis = $self->analysis or return;
+	return $analysis->preorder->is_ancestor($ancestor, $node);
+}
+
+
+=head2 find_node
+
+Returns the node matching the given path or C<undef> if there's no such node.
+
+The paths generated by L<Xacobeo::XS/get_node_path> (C</a/b[3]/c>) are
+resolved by walking the document directly, which is much faster than running an
+XPath query. Any other expression is evaluated as XPath and the first node found
+is returned.
+
+This method croaks if the expression can't be evaluated.
+
+Parameters:
+
+	$path: the path of the node.
+
+=cut
+
+sub find_node {
+	my ($self, $path) = @_;
+	croak __("Document node is missing") unless defined $self->documentNode;
+
+	if (my $index = $self->index) {
+		my $node = $index->resolve_path($path);
+		if (defined $node) {
+			return $node || undef;
+		}
+	}
+
+	# The path is not supported by the index
+	my $result = $self->find($path);
+	if (isa_dom_nodelist($result)) {
+		return $result->get_node(1);
+	}
+
+	return;
+}
+
+
 =head2 validate
 
 Validates the syntax of the given XPath query. The syntax is validated within a
 context that has the same namespaces as the ones defined in the current XML
 document.
 
-B<NOTE>: This method can't validate if undefined functions or variables are
-used.
+The calls to undefined functions are reported as errors. B<NOTE>: This method
+can't validate if undefined variables are used.
 
 Parameters:
 
@@ -305,17 +1057,26 @@ Parameters:
 
 sub validate {
 	my ($self, $xpath) = @_;
+	return if defined $self->get_error_offset($xpath);
+	return 1;
+}
 
-	# Validate the XPath expression in an empty document, this is a performance
-	# trick. If the XPath expression is something insane '//*' we don't want to
-	# take for ever just for a validation.
-	my $empty = XML::LibXML->createDocument();
-	eval {
-		$self->xpath->find($xpath, $empty);
-		1;
-	} or return;
 
-	return 1;
+=head2 get_error_offset
+
+Returns the position (in characters) of the syntax error in the given XPath
+query or C<undef> if the query is valid. The query is only compiled, it's never
+evaluated, thus the time taken doesn't depend on the size of the document.
+
+Parameters:
+
+	$xpath: the XPath expression to validate.
+
+=cut
+
+sub get_error_offset {
+	my ($self, $xpath) = @_;
+	return Xacobeo::XS->get_xpath_error_offset($xpath, $self->namespaces);
 }
 
 
@@ -342,7 +1103,35 @@ sub get_prefixed_name {
 
 
 #
-# Creates and setups the internal XML parser to use by this instance.
+# Returns the compiled version of the given XPath expression. The expression is
+# returned as it is if it can't be compiled, this way XML::LibXML will report
+# the error.
+#
+sub _compile {
+	my ($self, $xpath) = @_;
+	return $XPATH_CACHE->compile($xpath, $self->namespaces) || $xpath;
+}
+
+
+#
+# Returns the given string as an XPath literal. XPath has no escape sequences,
+# thus a string with both kinds of quotes is built with concat().
+#
+sub _xpath_literal {
+	my ($string) = @_;
+
+	return "'$string'" if index($string, "'") == -1;
+	return qq("$string") if index($string, '"') == -1;
+
+	my @parts = map { "'$_'" } split /'/, $string, -1;
+	return 'concat(' . join(q{, "'", }, @parts) . ')';
+}
+
+
+#
+# Creates and setups the internal XML parser to use by this instance. The
+# options have to match the ones of the native loader (see xs/loader.c) as both
+# parsers are used for loading the XML documents.
 #
 sub _construct_xml_parser {
 
@@ -368,8 +1157,24 @@ sub _construct_xml_parser {
 #
 # The prefixes are returned in an hash ref of type ($uri => $prefix).
 #
+# The namespace declarations are read natively, see
+# Xacobeo::XS::get_namespaces(). The implementation through XPath below is kept
+# as the reference of the prefixes assigned.
+#
 sub _get_all_namespaces {
 	my ($node) = @_;
+	return Xacobeo::XS->get_namespaces($node) if $node;
+	return _get_all_namespaces_xpath($node);
+}
+
+
+#
+# Finds every namespace declared in the document through the XPath query
+# './/namespace::*'. This is slow since each element returns all the namespaces
+# in its scope.
+#
+sub _get_all_namespaces_xpath {
+	my ($node) = @_;
 
 	# Find the namespaces ($uri -> $prefix)
 	my %seen = (
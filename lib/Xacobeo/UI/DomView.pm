@@ -65,6 +65,7 @@ use Gtk2;
 use Xacobeo::I18n;
 use Xacobeo::XS;
 use Xacobeo::Document;
+use Xacobeo::Utils qw(isa_dom_element);
 
 use Xacobeo::GObject;
 
@@ -345,6 +346,55 @@ sub load_node {
 }
 
 
+=head2 select_node
+
+Selects the given element in the tree view. The rows leading to the element are
+expanded and the element is scrolled into view.
+
+Returns a true value if the element could be selected.
+
+Parameters:
+
+=over
+
+=item * $node
+
+The element to select; an instance of L<XML::LibXML::Element>.
+
+=back
+
+=cut
+
+sub select_node {
+	my $self = shift;
+	my ($node) = @_;
+
+	# The tree has only the elements, find the position of the element and of each
+	# ancestor among their sibling elements.
+	my @indices;
+	for (my $current = $node; isa_dom_element($current); $current = $current->parentNode) {
+		my $index = 0;
+		for (my $sibling = $current->previousSibling; $sibling; $sibling = $sibling->previousSibling) {
+			++$index if isa_dom_element($sibling);
+		}
+		unshift @indices, $index;
+	}
+	return unless @indices;
+
+	# The root element is always the first row
+	$indices[0] = 0;
+
+	my $path = Gtk2::TreePath->new_from_indices(@indices);
+	$self->get_model->get_iter($path) or return;
+
+	$self->expand_to_path($path);
+	$self->get_selection->select_path($path);
+	$self->scroll_to_cell($path, undef, TRUE, 0.5, 0.0);
+
+	return 1;
+}
+
+
 #
 # Adds a text column to the tree view
 #
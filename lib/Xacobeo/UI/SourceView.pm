@@ -33,6 +33,20 @@ The document being displayed.
 
 The namespaces registered in the document.
 
+=head2 page-size
+
+The maximal number of results displayed at once when the view displays a
+C<Xacobeo::XS::NodeSet>. Defaults to 1000.
+
+=head1 SIGNALS
+
+=head2 page-changed
+
+Emitted each time that a node is loaded. The parameters are the offset of the
+first result displayed, the number of results displayed and the total number of
+results. The results are only paged when displaying a C<Xacobeo::XS::NodeSet>;
+for any other node the signal is emitted with zeros.
+
 =head1 METHODS
 
 The following methods are available:
@@ -55,6 +69,7 @@ use Gtk2::SourceView2;
 
 use Xacobeo::Utils qw(
 	isa_dom_nodelist
+	isa_nodeset
 	isa_dom_boolean
 	isa_dom_number
 	isa_dom_literal
@@ -84,7 +99,23 @@ Xacobeo::GObject->register_package('Gtk2::SourceView2::View' =>
 			"The namespaces in the main document.",
 			['readable', 'writable'],
 		),
+
+		Glib::ParamSpec->uint(
+			'page-size',
+			"Page size",
+			"The number of results displayed at once",
+			1, 1_000_000, 1000,
+			['readable', 'writable'],
+		),
 	],
+
+	signals => {
+		'page-changed' => {
+			flags       => ['run-last'],
+			# Parameters:   Offset,        Count,         Total
+			param_types => ['Glib::UInt', 'Glib::UInt', 'Glib::UInt'],
+		},
+	},
 );
 
 
@@ -97,6 +128,15 @@ sub INIT_INSTANCE {
 	my $buffer = _create_buffer();
 	$self->set_buffer($buffer);
 	$self->set_editable(FALSE);
+
+	$self->signal_connect('populate-popup' => \&callback_populate_popup);
+
+	# The matches of a search are highlighted only in the region displayed
+	$self->signal_connect('set-scroll-adjustments' => sub {
+		my ($self, $hadjustment, $vadjustment) = @_;
+		return unless $vadjustment;
+		$vadjustment->signal_connect('value-changed' => sub { $self->_queue_highlight() });
+	});
 }
 
 
@@ -190,6 +230,8 @@ Parameters:
 =item * $node
 
 The node to be loaded into the editor; an instance of L<XML::LibXML::Node>.
+The results of an XPath query can also be given as a C<Xacobeo::XS::NodeSet>,
+in which case only the first page of results is displayed (see L</show_page>).
 
 =back
 
@@ -199,6 +241,196 @@ sub load_node {
 	my $self = shift;
 	my ($node) = @_;
 
+	# Keep the node, the context menu needs it
+	$self->{node} = $node;
+	$self->{offset} = 0;
+	$self->_render();
+}
+
+
+=head2 show_page
+
+Displays the page of results that starts at the given offset. This only has an
+effect when the view displays a C<Xacobeo::XS::NodeSet>.
+
+Parameters:
+
+=over
+
+=item * $offset
+
+The position of the first result to display.
+
+=back
+
+=cut
+
+sub show_page {
+	my $self = shift;
+	my ($offset) = @_;
+
+	my $node = $self->{node};
+	return unless isa_nodeset($node);
+
+	my $size = $node->size;
+	$offset = $size - 1 if $offset >= $size;
+	$offset = 0 if $offset < 0;
+	$self->{offset} = $offset;
+	$self->_render();
+}
+
+
+=head2 find_text
+
+Finds all the occurrences of the given text in the text displayed and returns
+the number of matches. The whole text is scanned at once (in parallel) but the
+matches are only highlighted in the region displayed, the other matches are
+highlighted when the text is scrolled. See L<Xacobeo::XS/TEXT SEARCH>.
+
+The first match after the cursor is selected.
+
+This method croaks if the regular expression is invalid.
+
+Parameters:
+
+=over
+
+=item * $pattern
+
+The text to find.
+
+=item * $is_regex
+
+If true the pattern is a regular expression (Perl compatible).
+
+=back
+
+=cut
+
+sub find_text {
+	my $self = shift;
+	my ($pattern, $is_regex) = @_;
+
+	$self->clear_search();
+
+	my $buffer = $self->get_buffer;
+	my $search = Xacobeo::XS::TextSearch->new($buffer, $pattern, $is_regex ? TRUE : FALSE);
+	$self->{search} = $search;
+
+	$self->find_next(TRUE, TRUE);
+	$self->_highlight();
+
+	return $search->size;
+}
+
+
+=head2 find_next
+
+Selects the next match of the current search and scrolls to it. The search wraps
+around the end of the text. Returns the position of the match or C<undef> if
+there's no match.
+
+Parameters:
+
+=over
+
+=item * $forward
+
+If false the previous match is selected instead.
+
+=item * $include_cursor
+
+If true a match starting at the cursor can be selected, otherwise the search
+starts after the current selection.
+
+=back
+
+=cut
+
+sub find_next {
+	my $self = shift;
+	my ($forward, $include_cursor) = @_;
+
+	my $search = $self->{search} or return;
+	my $buffer = $self->get_buffer;
+
+	# Start after the current match (if any)
+	my ($start, $end) = $buffer->get_selection_bounds;
+	$start ||= $buffer->get_iter_at_mark($buffer->get_insert);
+	$end ||= $start;
+	my $offset = $forward && ! $include_cursor ? $end->get_offset : $start->get_offset;
+
+	my $i = $search->find($offset, $forward ? TRUE : FALSE);
+	return if $i < 0;
+
+	my ($match_start, $match_end) = $search->get_match($i);
+	$buffer->select_range(
+		$buffer->get_iter_at_offset($match_start),
+		$buffer->get_iter_at_offset($match_end),
+	);
+	$self->scroll_to_mark($buffer->get_insert, 0.25, FALSE, 0.0, 0.5);
+
+	return $i;
+}
+
+
+=head2 clear_search
+
+Removes the highlighting of the current search.
+
+=cut
+
+sub clear_search {
+	my $self = shift;
+	delete $self->{search} or return;
+
+	my $buffer = $self->get_buffer;
+	$buffer->remove_tag_by_name('search_match', $buffer->get_bounds);
+}
+
+
+#
+# Highlights the matches of the current search once the view is idle; the
+# scrolling can emit many events.
+#
+sub _queue_highlight {
+	my $self = shift;
+	return unless $self->{search};
+	$self->{highlight_source} ||= Glib::Idle->add(sub {
+		delete $self->{highlight_source};
+		$self->_highlight();
+		return FALSE;
+	});
+}
+
+
+#
+# Highlights the matches of the current search in the region displayed.
+#
+sub _highlight {
+	my $self = shift;
+	my $search = $self->{search} or return;
+
+	my $rect = $self->get_visible_rect;
+	my ($start) = $self->get_line_at_y($rect->y);
+	my ($end) = $self->get_line_at_y($rect->y + $rect->height);
+	$end->forward_to_line_end();
+
+	$search->highlight($self->get_buffer, 'search_match', $start->get_offset, $end->get_offset);
+}
+
+
+#
+# Displays the current node into the editor.
+#
+sub _render {
+	my $self = shift;
+	my $node = $self->{node};
+	my @page = (0, 0, 0);
+
+	# The matches of a search are only valid for the text searched
+	delete $self->{search};
+
 	# It's faster to disconnect the buffer from the view and to reconnect it back
 	my $buffer = $self->get_buffer;
 	$self->set_buffer(Gtk2::SourceView2::Buffer->new(undef));
@@ -212,6 +444,15 @@ sub load_node {
 	elsif ($node->isa('Xacobeo::Error')) {
 		_buffer_add($buffer, error => $node->message);
 	}
+	elsif (isa_nodeset($node)) {
+		# Only the current page is displayed, the Perl nodes are never created
+		my $total = $node->size;
+		my $offset = $self->{offset};
+		my $count = $self->get('page-size');
+		$count = $total - $offset if $offset + $count > $total;
+		$node->render($buffer, $offset, $count, $self->namespaces);
+		@page = ($offset, $count, $total);
+	}
 	elsif (isa_dom_nodelist($node)) {
 		my @children = $node->get_nodelist;
 		my $count = scalar @children;
@@ -271,15 +512,59 @@ sub load_node {
 
 	# Scroll to the beginning
 	$self->scroll_to_iter($buffer->get_start_iter, 0.0, FALSE, 0.0, 0.0);
+
+	$self->signal_emit('page-changed' => @page);
 }
 
 
 sub clear {
 	my $self = shift;
+	delete $self->{node};
+	delete $self->{search};
 	$self->get_buffer->set_text('');
 }
 
 
+=head2 do_copy_xpaths
+
+Copies the XPath of all the nodes being displayed into the clipboard. One path
+is copied per line.
+
+=cut
+
+sub do_copy_xpaths {
+	my $self = shift;
+
+	my $nodes = $self->{node};
+	$nodes = $nodes->slice(0, $nodes->size) if isa_nodeset($nodes);
+	return unless isa_dom_nodelist($nodes);
+
+	my @paths = grep { defined } Xacobeo::XS->get_node_paths($nodes, $self->namespaces);
+	my $text = join "\n", @paths;
+	foreach my $selection (qw(SELECTION_CLIPBOARD SELECTION_PRIMARY)) {
+		my $clipboard = Gtk2::Clipboard->get(Gtk2::Gdk->$selection);
+		$clipboard->set_text($text);
+	}
+}
+
+
+#
+# Adds an entry for copying the XPath of the results into the context menu.
+#
+sub callback_populate_popup {
+	my ($self, $menu) = @_;
+
+	my $item = Gtk2::MenuItem->new(__("Copy XPath of all results"));
+	my $node = $self->{node};
+	$item->set_sensitive(isa_dom_nodelist($node) || isa_nodeset($node) ? TRUE : FALSE);
+	$item->signal_connect(activate => sub { $self->do_copy_xpaths() });
+
+	$menu->append(Gtk2::SeparatorMenuItem->new());
+	$menu->append($item);
+	$menu->show_all();
+}
+
+
 #
 # Adds the given text at the end of the buffer. The text is added with a tag
 # which can be used for performing syntax highlighting.
@@ -405,6 +690,10 @@ sub _create_tag_table {
 		background => 'yellow',
 	);
 
+	_add_tag($tag_table, search_match =>
+		background => 'orange',
+	);
+
 	return $tag_table;
 }
 
@@ -25,6 +25,14 @@ The following properties are defined:
 
 The context id for the default messages.
 
+=head2 cancel-button
+
+The button used for cancelling the task in progress.
+
+=head2 progress-bar
+
+The bar showing the progress of the task in progress.
+
 =head1 METHODS
 
 The following methods are available:
@@ -53,6 +61,22 @@ Xacobeo::GObject->register_package('Gtk2::Statusbar' =>
 			"The context id for the default status messages",
 			['readable', 'writable', 'construct-only'],
 		),
+
+		Glib::ParamSpec->object(
+			'cancel-button',
+			"Cancel button",
+			"The button cancelling the task in progress",
+			'Gtk2::Button',
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->object(
+			'progress-bar',
+			"Progress bar",
+			"The bar showing the progress of the task in progress",
+			'Gtk2::ProgressBar',
+			['readable', 'writable'],
+		),
 	],
 );
 
@@ -65,6 +89,19 @@ sub new {
 	my $id = $self->get_context_id('default');
 	$self->context_id($id);
 
+	# The cancel button is only visible while a task is running
+	my $button = Gtk2::Button->new_from_stock('gtk-cancel');
+	$button->set_relief('none');
+	$button->set_no_show_all(TRUE);
+	$self->pack_end($button, FALSE, FALSE, 0);
+	$self->cancel_button($button);
+
+	# The progress bar is also only visible while a task is running
+	my $bar = Gtk2::ProgressBar->new();
+	$bar->set_no_show_all(TRUE);
+	$self->pack_end($bar, FALSE, FALSE, 0);
+	$self->progress_bar($bar);
+
 	return $self;
 }
 
@@ -123,6 +160,103 @@ sub displayf {
 }
 
 
+=head2 show_cancel
+
+Shows a button that cancels the task in progress.
+
+Parameters:
+
+=over
+
+=item * $callback
+
+The code to invoke when the button is clicked.
+
+=back
+
+=cut
+
+sub show_cancel {
+	my $self = shift;
+	my ($callback) = @_;
+
+	$self->hide_cancel();
+
+	my $button = $self->cancel_button;
+	$self->{cancel_handler} = $button->signal_connect(clicked => sub { $callback->() });
+	$button->show();
+}
+
+
+=head2 hide_cancel
+
+Hides the button that cancels the task in progress.
+
+=cut
+
+sub hide_cancel {
+	my $self = shift;
+
+	my $button = $self->cancel_button;
+	if (my $handler = delete $self->{cancel_handler}) {
+		$button->signal_handler_disconnect($handler);
+	}
+	$button->hide();
+}
+
+
+=head2 show_progress
+
+Shows the progress of the task in progress. The progress is usually reported
+while the main loop is blocked, the bar is thus redrawn right away.
+
+Parameters:
+
+=over
+
+=item * $fraction
+
+The fraction of the task done, between 0 and 1. If the fraction is unknown
+(C<undef>) the bar pulses instead.
+
+=item * $text
+
+The text to display in the bar.
+
+=back
+
+=cut
+
+sub show_progress {
+	my $self = shift;
+	my ($fraction, $text) = @_;
+
+	my $bar = $self->progress_bar;
+	if (defined $fraction) {
+		$bar->set_fraction($fraction);
+	}
+	else {
+		$bar->pulse();
+	}
+	$bar->set_text($text);
+	$bar->show();
+
+	Gtk2::Gdk::Window->process_all_updates();
+}
+
+
+=head2 hide_progress
+
+Hides the bar showing the progress of the task in progress.
+
+=cut
+
+sub hide_progress {
+	my $self = shift;
+	$self->progress_bar->hide();
+}
+
+
 # A true value
 1;
 
@@ -38,6 +38,11 @@ The UI Manager used by this widget.
 
 The widget displaying the namespaces of the current document.
 
+=head2 structure-view
+
+The widget displaying the structure of the current document (the distinct paths
+of the elements).
+
 =head2 xpath-entry
 
 The entry where the XPath expression will be edited.
@@ -80,7 +85,11 @@ use Data::Dumper;
 use Glib qw(TRUE FALSE);
 use Gtk2;
 use Gtk2::SimpleList;
+use Gtk2::Ex::Entry::Pango;
 use Carp;
+use Time::HiRes qw(time);
+use Digest::MD5 qw(md5_hex);
+use File::Spec;
 
 use Xacobeo;
 use Xacobeo::UI::SourceView;
@@ -88,17 +97,25 @@ use Xacobeo::UI::DomView;
 use Xacobeo::UI::Statusbar;
 use Xacobeo::UI::XPathEntry;
 use Xacobeo::Document;
+use Xacobeo::XS;
 use Xacobeo::GObject;
 use Xacobeo::I18n;
 use Xacobeo::Timer;
 use Xacobeo::Error;
 use Xacobeo::Utils qw{
 	isa_dom_nodelist
+	isa_nodeset
 	escape_xml_text
 	scrollify
 };
 
 
+# The preview of an XPath query waits until the typing pauses (milliseconds) and
+# gives up after walking this many nodes
+my $PREVIEW_DELAY = 300;
+my $PREVIEW_VISITS = 100_000;
+
+
 Xacobeo::GObject->register_package('Gtk2::Window' =>
 	properties => [
 		Glib::ParamSpec->object(
@@ -132,6 +149,21 @@ Xacobeo::GObject->register_package('Gtk2::Window' =>
 			['readable', 'writable'],
 		),
 
+		Glib::ParamSpec->object(
+			'structure-view',
+			"Structure View",
+			"The widget displaying the structure of the current document",
+			'Gtk2::TreeView',
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->scalar(
+			'explain-view',
+			"Explain View",
+			"The widget displaying the explanation of an XPath query",
+			['readable', 'writable'],
+		),
+
 		Glib::ParamSpec->object(
 			'xpath-entry',
 			"XPath Entry",
@@ -140,6 +172,22 @@ Xacobeo::GObject->register_package('Gtk2::Window' =>
 			['readable', 'writable'],
 		),
 
+		Glib::ParamSpec->object(
+			'attribute-entry',
+			"Attribute Entry",
+			"The entry where the attribute searched (name=value) is edited",
+			'Gtk2::Ex::Entry::Pango',
+			['readable', 'writable'],
+		),
+
+		Glib::ParamSpec->object(
+			'text-entry',
+			"Text Entry",
+			"The entry where the text searched is edited",
+			'Gtk2::Ex::Entry::Pango',
+			['readable', 'writable'],
+		),
+
 		Glib::ParamSpec->object(
 			'statusbar',
 			"Statusbar",
@@ -172,6 +220,14 @@ Xacobeo::GObject->register_package('Gtk2::Window' =>
 			['readable', 'writable'],
 		),
 
+		Glib::ParamSpec->object(
+			'explain-button',
+			"Explain Button",
+			"The button explaining a search step by step",
+			'Gtk2::Button',
+			['readable', 'writable'],
+		),
+
 		Glib::ParamSpec->object(
 			'conf',
 			"Configuration",
@@ -223,6 +279,11 @@ sub new {
 	$self->auto_connect(xpath_entry => 'activate', \&callback_execute_xpath);
 	$self->auto_connect(evaluate_button => 'activate', \&callback_execute_xpath);
 	$self->auto_connect(evaluate_button => 'clicked', \&callback_execute_xpath);
+	$self->auto_connect(explain_button => 'clicked', \&callback_explain_xpath);
+
+	$self->auto_connect(attribute_entry => 'activate', \&callback_find_attribute);
+	$self->auto_connect(text_entry => 'activate', \&callback_search_text);
+	$self->auto_connect(structure_view => 'row-activated', \&callback_structure_activated);
 
 	return $self;
 }
@@ -276,11 +337,54 @@ sub callback_xpath_changed {
 	my ($entry, $xpath, $is_valid) = @_;
 
 	$self->evaluate_button->set_sensitive($is_valid);
+	$self->explain_button->set_sensitive($is_valid);
+
+	# The preview is made once the typing pauses
+	$self->cancel_preview();
+	return unless $is_valid;
+	$self->{xpath_preview_source} = Glib::Timeout->add($PREVIEW_DELAY, sub {
+		delete $self->{xpath_preview_source};
+		$self->preview_xpath($xpath);
+		return FALSE;
+	});
+}
+
+
+#
+# Displays the first results of the XPath expression being typed. Only the
+# expressions that can be streamed are previewed, the others have to be
+# executed. The walk of the document is limited, a query that matches few nodes
+# of a big document is not previewed.
+#
+sub preview_xpath {
+	my $self = shift;
+	my ($xpath) = @_;
+
+	my $max = $self->conf->get('xpath-preview-size') or return;
+	my $document = $self->source_view->document or return;
+
+	# Don't hide the results of the query being executed
+	return if $self->{xpath_job};
+
+	my $preview = $document->preview($xpath, $max, $PREVIEW_VISITS);
+	if (! defined $preview) {
+		$self->statusbar->display(__("No preview"));
+		return;
+	}
+
+	my $count = $preview->size;
+	my $format = $count < $max
+		? __n("Preview: %d result", "Preview: %d results", $count)
+		: __("Preview: first %d results")
+	;
+	$self->statusbar->displayf($format, $count);
+	$self->display_results($preview);
 }
 
 
 #
-# Execute the XPath expression on the current document.
+# Execute the XPath expression on the current document. The expression is
+# evaluated in a background thread and the UI is kept responsive.
 #
 sub callback_execute_xpath {
 	my $self = shift;
@@ -290,28 +394,250 @@ sub callback_execute_xpath {
 	my $xpath = $self->xpath_entry->get_text();
 	my $document = $self->source_view->document or return;
 
+	# Only one query can run at the time
+	$self->cancel_preview();
+	$self->cancel_xpath();
+
+	# The simple queries are answered right away by the index and the queries
+	# already made by the cache of the results
+	my $timer = Xacobeo::Timer->start();
+	my $result = $document->find_indexed($xpath);
+	$result = $document->find_cached($xpath) unless defined $result;
+	if (defined $result) {
+		$timer->stop();
+		$self->display_xpath_result($result, $timer->elapsed);
+		return;
+	}
+
+	my $job = $document->find_async(
+		$xpath,
+		$self->conf->get('xpath-timeout'),
+		$self->conf->get('xpath-max-results'),
+	) or return;
+	$self->{xpath_job} = $job;
+
+	$self->statusbar->display(__("Evaluating the XPath query"));
+	$self->statusbar->show_cancel(sub { $job->cancel });
+	$self->{xpath_job_source} = Glib::Timeout->add(100, sub {
+		return $self->callback_poll_xpath($job, $document, $xpath);
+	});
+}
+
+
+#
+# Explains the XPath query step by step: the number of nodes selected by each
+# step and predicate and the time spent are displayed in the explain tab. The
+# steps are evaluated in a background thread, as the queries, and the
+# explanation can be cancelled.
+#
+sub callback_explain_xpath {
+	my $self = shift;
+
+	return unless $self->xpath_entry->is_valid;
+
+	my $xpath = $self->xpath_entry->get_text();
+	my $document = $self->source_view->document or return;
+
+	# Only one query can run at the time
+	$self->cancel_preview();
+	$self->cancel_xpath();
+
+	my $job = $document->explain_async($xpath, $self->conf->get('xpath-timeout')) or return;
+	$self->{xpath_job} = $job;
+
+	$self->statusbar->display(__("Explaining the XPath query"));
+	$self->statusbar->show_cancel(sub { $job->cancel });
+	$self->{xpath_job_source} = Glib::Timeout->add(100, sub {
+		return $self->callback_poll_explain($job);
+	});
+}
+
+
+#
+# Checks if the explanation of the XPath query is done. Returns TRUE while the
+# query is explained.
+#
+sub callback_poll_explain {
+	my $self = shift;
+	my ($job) = @_;
+
+	my $state = $job->poll;
+	if ($state eq 'running') {
+		my $format = __("Explaining the XPath query: %0.1fs, %d nodes visited");
+		$self->statusbar->displayf($format, $job->elapsed, $job->progress);
+		return TRUE;
+	}
+
+	delete $self->{xpath_job};
+	delete $self->{xpath_job_source};
+	$self->statusbar->hide_cancel();
+
+	if ($state eq 'done') {
+		@{ $self->explain_view->{data} } = map {
+			my ($label, $count, $elapsed) = @{ $_ };
+			[ $label, $count, sprintf '%.3f', $elapsed * 1000 ];
+		} @{ $job->result };
+
+		$self->statusbar->displayf(__("XPath query explained in %0.3fs"), $job->elapsed);
+		my $notebook = $self->notebook;
+		$notebook->set_current_page($notebook->page_num($self->explain_view->get_parent));
+	}
+	elsif ($state eq 'error') {
+		$self->statusbar->display(__("XPath query issued an error"));
+		$self->display_results(Xacobeo::Error->new(xpath => $job->error));
+	}
+	elsif ($state eq 'timeout') {
+		$self->statusbar->displayf(__("XPath query stopped after %0.1fs"), $job->elapsed);
+	}
+	else {
+		$self->statusbar->display(__("XPath query cancelled"));
+	}
+
+	return FALSE;
+}
+
+
+#
+# Finds the elements having the attribute typed in the attribute entry. The
+# search is given as "name=value" and is answered by the index of the attribute
+# values.
+#
+sub callback_find_attribute {
+	my $self = shift;
+
+	my $document = $self->source_view->document or return;
+	my ($name, $value) = split /=/, $self->attribute_entry->get_text, 2;
+	return unless defined $value;
+	$name =~ s/^\s+|\s+$//g;
+	$name =~ s/^@//;
+
+	$self->display_search(sub { $document->find_by_attribute($name, $value) });
+}
+
+
+#
+# Finds the elements having a text node or an attribute that contains the text
+# typed in the text entry.
+#
+sub callback_search_text {
+	my $self = shift;
+
+	my $document = $self->source_view->document or return;
+	my $text = $self->text_entry->get_text;
+	return unless length $text;
+
+	$self->display_search(sub { $document->search_text($text) });
+}
+
+
+#
+# Runs a search done by the given code and displays its results and the time
+# that it took.
+#
+sub display_search {
+	my $self = shift;
+	my ($code) = @_;
+
+	$self->cancel_xpath();
+
 	my $timer = Xacobeo::Timer->start();
 	my $result;
-	my $find_successful = eval {
-		$result = $document->find($xpath);
+	eval {
+		$result = $code->();
 		1;
+	} or do {
+		$self->statusbar->display(__("XPath query issued an error"));
+		$self->display_results(Xacobeo::Error->new(xpath => $@));
+		return;
 	};
-	my $error = $@;
 	$timer->stop();
 
-	if ($find_successful) {
-		my $count = isa_dom_nodelist($result) ? $result->size : 1;
-		my $format = __n("Found %d result in %0.3fs", "Found %d results in %0.3fs", $count);
-		$self->statusbar->displayf($format, $count, $timer->elapsed);
+	$self->display_xpath_result($result, $timer->elapsed);
+}
+
+
+#
+# Checks if the XPath query running in the background is done. Returns TRUE
+# while the query is running.
+#
+sub callback_poll_xpath {
+	my $self = shift;
+	my ($job, $document, $xpath) = @_;
+
+	my $state = $job->poll;
+	if ($state eq 'running') {
+		my $format = __("Evaluating the XPath query: %0.1fs, %d nodes visited");
+		$self->statusbar->displayf($format, $job->elapsed, $job->progress);
+		return TRUE;
 	}
-	else {
-		$result = Xacobeo::Error->new(xpath => $error);
+
+	delete $self->{xpath_job};
+	delete $self->{xpath_job_source};
+	$self->statusbar->hide_cancel();
+
+	if ($state eq 'done') {
+		my $result = $job->result;
+		$document->cache_result($xpath, $result) if isa_nodeset($result);
+		$self->display_xpath_result($result, $job->elapsed);
+	}
+	elsif ($state eq 'error') {
 		$self->statusbar->display(__("XPath query issued an error"));
+		$self->display_results(Xacobeo::Error->new(xpath => $job->error));
+	}
+	elsif ($state eq 'timeout') {
+		$self->statusbar->displayf(__("XPath query stopped after %0.1fs"), $job->elapsed);
 	}
+	elsif ($state eq 'limit') {
+		$self->statusbar->displayf(
+			__("XPath query returned more than %d nodes"),
+			$self->conf->get('xpath-max-results')
+		);
+	}
+	else {
+		$self->statusbar->display(__("XPath query cancelled"));
+	}
+
+	return FALSE;
+}
+
 
-	# Display the results
+#
+# Displays the result of an XPath query and the time that it took.
+#
+sub display_xpath_result {
+	my $self = shift;
+	my ($result, $elapsed) = @_;
+
+	# The node sets are counted without creating the Perl nodes
+	my $count = (isa_dom_nodelist($result) || isa_nodeset($result)) ? $result->size : 1;
+	my $format = __n("Found %d result in %0.3fs", "Found %d results in %0.3fs", $count);
+	$self->statusbar->displayf($format, $count, $elapsed);
 	$self->display_results($result);
+}
+
 
+#
+# Cancels the preview of the XPath query being typed (if any).
+#
+sub cancel_preview {
+	my $self = shift;
+	my $source = delete $self->{xpath_preview_source} or return;
+	Glib::Source->remove($source);
+}
+
+
+#
+# Cancels the XPath query running in the background (if any).
+#
+sub cancel_xpath {
+	my $self = shift;
+
+	my $job = delete $self->{xpath_job} or return;
+	$job->cancel();
+	if (my $source = delete $self->{xpath_job_source}) {
+		Glib::Source->remove($source);
+	}
+	$self->statusbar->hide_cancel();
 }
 
 
@@ -331,13 +657,24 @@ sub display_results {
 Load a new file into the application. The new document will be parsed and
 displayed in the window.
 
+The XML documents are parsed in a background thread while the window stays
+responsive, the document displayed can still be browsed and queried until the
+new one replaces it. When the window has no document yet the part of a big
+document already parsed is displayed while the rest is parsed.
+
+A huge document made of records (see the setting I<records-window-threshold> of
+L<Xacobeo::Conf>) is opened by windows: the offsets of its records are indexed
+once, the index is kept in the cache, and only a window of records is parsed.
+The windows are browsed with the pager under the DOM view, which also goes
+straight to the window of a given record.
+
 Parameters:
 
 =over
 
 =item * $file
 
-The file to load.
+The file to load, C<-> loads the standard input.
 
 =item * $type
 
@@ -353,27 +690,35 @@ sub load_file {
 	my ($self, $file, $type) = @_;
 	$type ||= 'xml';
 
+	$self->cancel_load();
+	$self->close_records();
+	if ($type eq 'xml') {
+		return if $self->open_records($file);
+		return if $self->load_file_async($file);
+	}
+
 	my $timer = Xacobeo::Timer->start();
 
-	# Parse the content
+	# Parse the content, the progress is displayed in the statusbar
 	my $t_load = Xacobeo::Timer->start(__('Load document'));
 	my $document;
 	eval {
-		$document = Xacobeo::Document->new_from_file($file, $type);
+		$document = Xacobeo::Document->new_from_file($file, $type, $self->load_progress_callback());
 		1;
 	} or do {
 		my $error = $@;
+		$self->statusbar->hide_progress();
 		$self->statusbar->display(
 			__x("Can't read {file}: {error}", file => $file, error => $error)
 		);
 		return;
 	};
 	undef $t_load;
+	$self->statusbar->hide_progress();
 
 
 	# Fill the widgets
-	$self->set_title($file);
-	$self->load_document($document);
+	$self->display_document($document);
 
 
 	# Show the timers
@@ -393,6 +738,330 @@ sub load_file {
 }
 
 
+=head2 load_string
+
+Load a new XML document given as a string into the application. The document is
+parsed in a background thread, see L</load_file>.
+
+Parameters:
+
+=over
+
+=item * $content
+
+The contents of the document.
+
+=item * $source
+
+The source of the document, it's displayed as the title of the window. Defaults
+to I<string>.
+
+=back
+
+=cut
+
+sub load_string {
+	# Arguments
+	my ($self, $content, $source) = @_;
+	$source = 'string' unless defined $source;
+
+	$self->cancel_load();
+	$self->close_records();
+	my $job = Xacobeo::Document->parse_string_async($content);
+	$self->start_load($job, $source);
+}
+
+
+#
+# Parses a file in the background, see load_file(). Returns false if the file
+# can't be parsed in the background.
+#
+sub load_file_async {
+	my ($self, $file) = @_;
+
+	my $previews = ! $self->dom_view->document;
+	my $job = Xacobeo::Document->parse_async($file, $previews) or return;
+	$self->start_load($job, $file);
+
+	return 1;
+}
+
+
+#
+# Opens a huge document by windows of records. The records are indexed in the
+# background (or the index is taken from the cache) and the first window is
+# then displayed. Returns false if the document is not opened by windows.
+#
+sub open_records {
+	my ($self, $file) = @_;
+
+	my $threshold = $self->conf->get('records-window-threshold');
+	return unless $threshold and -f $file and -s _ >= $threshold * 1024 * 1024;
+
+	my $path = $self->conf->cache_file('records', md5_hex(File::Spec->rel2abs($file)) . '.index');
+	my $index = Xacobeo::XS::RecordIndex->new($file, $path) or return;
+
+	my $load = {
+		index    => $index,
+		source   => $file,
+		progress => $self->load_progress_callback(),
+	};
+	$self->{load} = $load;
+
+	$self->statusbar->display(__x("Indexing {file}", file => $file));
+	$self->statusbar->show_cancel(sub { $index->cancel });
+	$load->{timeout} = Glib::Timeout->add(100, sub {
+		return $self->callback_poll_index($load);
+	});
+
+	return 1;
+}
+
+
+#
+# Checks if the index of the records is built. Returns TRUE while the records
+# are indexed. A document that is not made of records is loaded as a whole.
+#
+sub callback_poll_index {
+	my ($self, $load) = @_;
+	my $index = $load->{index};
+
+	my $state = $index->poll;
+	if ($state eq 'running') {
+		$load->{progress}->($index->progress, $index->size);
+		return TRUE;
+	}
+
+	# The main loop removes the timeout since FALSE is returned
+	delete $load->{timeout};
+	$self->cancel_load();
+
+	if ($state eq 'cancelled') {
+		$self->statusbar->display(__("Load cancelled"));
+		return FALSE;
+	}
+
+	if ($state ne 'done' || ! $index->count) {
+		$self->load_file_async($load->{source}) or $self->statusbar->display(
+			__x("Can't read {file}: {error}", file => $load->{source}, error => $index->error)
+		);
+		return FALSE;
+	}
+
+	$self->{records} = {
+		index  => $index,
+		source => $load->{source},
+		first  => 0,
+	};
+	$self->show_records(0);
+
+	return FALSE;
+}
+
+
+#
+# Parses and displays the window of records that starts at the given record
+# (counted from 0).
+#
+sub show_records {
+	my ($self, $first) = @_;
+	my $records = $self->{records} or return;
+	my $index = $records->{index};
+
+	my $size = $self->conf->get('records-window-size');
+	my $count = $index->count;
+	$first = $count - 1 if $first >= $count;
+	$first = 0 if $first < 0;
+
+	my $window = $index->window($first, $size);
+	if (! defined $window) {
+		$self->statusbar->display(
+			__x("Can't read the records of {file}", file => $records->{source})
+		);
+		return;
+	}
+	$records->{first} = $first;
+
+	my $last = $first + $size < $count ? $first + $size : $count;
+	my $source = __x(
+		"{file} (records {first} to {last} of {count})",
+		file  => $records->{source},
+		first => $first + 1,
+		last  => $last,
+		count => $count,
+	);
+
+	$self->cancel_load();
+	$self->start_load(Xacobeo::Document->parse_string_async($window), $source);
+	$self->{records_pager}->($first, $last, $count);
+}
+
+
+#
+# Leaves the windows of records, if any.
+#
+sub close_records {
+	my $self = shift;
+	delete $self->{records} or return;
+	$self->{records_pager}->();
+}
+
+
+#
+# Follows a document parsed in the background: the progress is displayed in the
+# statusbar and the job is polled by the main loop until it's done, the document
+# is then displayed. The load can be cancelled from the statusbar.
+#
+sub start_load {
+	my ($self, $job, $source) = @_;
+
+	my $load = {
+		job      => $job,
+		source   => $source,
+		progress => $self->load_progress_callback(),
+	};
+	$self->{load} = $load;
+
+	$self->statusbar->display(__x("Loading {file}", file => $source));
+	$self->statusbar->show_cancel(sub { $job->cancel });
+	$load->{timeout} = Glib::Timeout->add(100, sub {
+		return $self->callback_poll_load($load);
+	});
+}
+
+
+#
+# Checks if the document parsed in the background is done. Returns TRUE while
+# the document is parsed.
+#
+sub callback_poll_load {
+	my ($self, $load) = @_;
+	my $job = $load->{job};
+
+	my $state = $job->poll;
+	if ($state eq 'running') {
+		$load->{progress}->($job->progress, $job->size);
+
+		# A running query is not interrupted, the preview waits for the next poll
+		if (! $self->{xpath_job} and my $preview = $job->take_preview) {
+			$self->display_document(
+				Xacobeo::Document->new(source => $load->{source}, type => 'xml', documentNode => $preview)
+			);
+		}
+		return TRUE;
+	}
+
+	# The main loop removes the timeout since FALSE is returned
+	delete $load->{timeout};
+	$self->cancel_load();
+
+	if ($state eq 'cancelled') {
+		$self->statusbar->display(__("Load cancelled"));
+		return FALSE;
+	}
+
+	my $document;
+	eval {
+		$document = Xacobeo::Document->new_from_job($job, $load->{source});
+		1;
+	} or do {
+		my $error = $@;
+		$self->statusbar->display(
+			__x("Can't read {file}: {error}", file => $load->{source}, error => $error)
+		);
+		return FALSE;
+	};
+	$self->display_document($document);
+
+	my $format = __n(
+		"Document loaded in %.3f second",
+		"Document loaded in %.3f seconds",
+		int($job->elapsed),
+	);
+	$self->statusbar->displayf($format, $job->elapsed);
+
+	return FALSE;
+}
+
+
+#
+# Stops following the document parsed in the background, if any. The parse is
+# cancelled and the document displayed is kept.
+#
+sub cancel_load {
+	my $self = shift;
+
+	my $load = delete $self->{load} or return;
+	($load->{job} || $load->{index})->cancel();
+	if (my $timeout = delete $load->{timeout}) {
+		Glib::Source->remove($timeout);
+	}
+	$self->statusbar->hide_cancel();
+	$self->statusbar->hide_progress();
+}
+
+
+#
+# Displays a new document. The node selected stays selected if the document has
+# the same source as the document displayed (it's reloaded).
+#
+sub display_document {
+	my ($self, $document) = @_;
+
+	my $selected_path;
+	my $previous = $self->dom_view->document;
+	if ($previous && defined $previous->source && $previous->source eq $document->source) {
+		if (my $selected = $self->dom_view->get_selected_node) {
+			$selected_path = Xacobeo::XS->get_node_path($selected, $previous->namespaces);
+		}
+	}
+
+	$self->set_title($document->source);
+	$self->load_document($document);
+
+	if (defined $selected_path) {
+		my $node = eval { $document->find_node($selected_path) };
+		$self->dom_view->select_node($node) if $node;
+	}
+}
+
+
+#
+# Returns a callback that displays the progress of the parse of a document in
+# the statusbar with an estimation of the time left. The statusbar is refreshed
+# at most 10 times per second. When the size of the document is unknown the
+# number of bytes parsed is displayed instead.
+#
+sub load_progress_callback {
+	my $self = shift;
+
+	my $start = time;
+	my $refreshed = 0;
+	return sub {
+		my ($consumed, $total) = @_;
+
+		my $now = time;
+		return if $now - $refreshed < 0.1 || ! $consumed;
+		$refreshed = $now;
+
+		if (! $total) {
+			$self->statusbar->show_progress(
+				undef,
+				sprintf(__("%.1f MB"), $consumed / (1024 * 1024))
+			);
+			return;
+		}
+
+		my $fraction = $total ? $consumed / $total : 1;
+		my $left = ($now - $start) * ($total - $consumed) / $consumed;
+		$self->statusbar->show_progress(
+			$fraction,
+			sprintf(__("%d%%, %.0fs left"), $fraction * 100, $left)
+		);
+	};
+}
+
+
 =head2 load_document
 
 Load a new document into the application. The document will be parsed and
@@ -415,6 +1084,21 @@ sub load_document {
 	my ($self, $document) = @_;
 
 	my ($node, $namespaces) = $document ? ($document->documentNode, $document->namespaces) : (undef, {});
+
+	# The results of a running query would belong to the previous document
+	$self->cancel_xpath();
+
+	# The indexes of the attribute values are built on demand within this limit
+	if ($document and my $index = $document->index) {
+		$index->set_attribute_limit($self->conf->get('xpath-attribute-index-size') * 1024 * 1024);
+	}
+	if ($document and my $result_cache = $document->result_cache) {
+		$result_cache->set_limit($self->conf->get('xpath-result-cache-size') * 1024 * 1024);
+	}
+
+	# The substring searches are slow, index the text in the background
+	my $text_index_size = $self->conf->get('xpath-text-index-size');
+	$document->build_text_index($text_index_size * 1024 * 1024) if $document and $text_index_size;
 	
 	# Update the text widget
 	my $t_syntax = Xacobeo::Timer->start(__('Syntax Highlight'));
@@ -441,6 +1125,54 @@ sub load_document {
 		push @namespaces, [$prefix, $uri];
 	}
 	@{ $self->namespaces_view->{data} } = @namespaces;
+
+	# Populate the structure view
+	$self->load_structure($document);
+}
+
+
+#
+# Fills the structure view with the summary of the paths of the document. The
+# rows are in preorder, the parent of a row is the last row seen one level up.
+#
+sub load_structure {
+	my ($self, $document) = @_;
+
+	my $structure_view = $self->structure_view;
+	my $store = $structure_view->get_model;
+
+	# Detach the model while it's being filled
+	$structure_view->set_model(undef);
+	$store->clear();
+
+	my $dataguide = $document ? $document->dataguide : undef;
+	my @parents = (undef);
+	foreach my $row ($dataguide ? @{ $dataguide->summary } : ()) {
+		my ($depth, $name, $count, $attributes) = @{ $row };
+		my $iter = $store->append($parents[$depth - 1]);
+		$store->set($iter, 0 => $name, 1 => $count, 2 => $attributes);
+		$parents[$depth] = $iter;
+	}
+
+	$structure_view->set_model($store);
+	$structure_view->expand_to_path(Gtk2::TreePath->new_first) if $store->get_iter_first;
+}
+
+
+#
+# Called when a path of the structure view is activated, the XPath expression
+# selecting the elements at that path is displayed in the XPath entry.
+#
+sub callback_structure_activated {
+	my ($self, $view, $path) = @_;
+
+	my $store = $view->get_model;
+	my @names;
+	for (my $iter = $store->get_iter($path); $iter; $iter = $store->iter_parent($iter)) {
+		unshift @names, $store->get($iter, 0);
+	}
+
+	$self->set_xpath(join '', map { "/$_" } @names);
 }
 
 
@@ -565,6 +1297,7 @@ sub _create_ui_manager {
 	my $active_entries = [
 		# Top level
 		[ 'FileMenu',  undef, __("_File") ],
+		[ 'EditMenu',  undef, __("_Edit") ],
 		[ 'HelpMenu',  undef, __("_Help") ],
 
 
@@ -587,6 +1320,16 @@ sub _create_ui_manager {
 		],
 
 
+		[
+			'EditFind',
+			'gtk-find',
+			__("_Find"),
+			'<control>F',
+			__("Find text in the document"),
+			sub { $self->do_show_find_bar() }
+		],
+
+
 		[
 			'HelpAbout',
 			'gtk-about',
@@ -614,6 +1357,11 @@ sub _create_ui_manager {
 		</menu>
 
 
+		<menu action='EditMenu'>
+			<menuitem action='EditFind'/>
+		</menu>
+
+
 		<placeholder name="ExtraMenu"/>
 
 
@@ -656,6 +1404,27 @@ sub _create_search_bar {
 	$button->set_sensitive(FALSE);
 	$hbox->pack_start($button, FALSE, TRUE, 0);
 	
+	$button = Gtk2::Button->new(__("Explain"));
+	$self->explain_button($button);
+	$button->set_sensitive(FALSE);
+	$hbox->pack_start($button, FALSE, TRUE, 0);
+	
+	my $attribute_entry = Gtk2::Ex::Entry::Pango->new();
+	$self->attribute_entry($attribute_entry);
+	$markup = sprintf '<span color="grey" size="smaller">%s</span>',
+		escape_xml_text(__("Find by attribute: name=value"))
+	;
+	$attribute_entry->set_empty_markup($markup);
+	$hbox->pack_start($attribute_entry, FALSE, TRUE, 0);
+	
+	my $text_entry = Gtk2::Ex::Entry::Pango->new();
+	$self->text_entry($text_entry);
+	$markup = sprintf '<span color="grey" size="smaller">%s</span>',
+		escape_xml_text(__("Search text..."))
+	;
+	$text_entry->set_empty_markup($markup);
+	$hbox->pack_start($text_entry, FALSE, TRUE, 0);
+	
 	return $hbox;
 }
 
@@ -668,7 +1437,10 @@ sub _create_main_content {
 	# Left part - Tree view
 	my $dom_view = Xacobeo::UI::DomView->new();
 	$self->dom_view($dom_view);
-	$hpaned->pack1(scrollify($dom_view, 200), FALSE, TRUE);
+	my $dom_box = Gtk2::VBox->new(FALSE, 0);
+	$dom_box->pack_start(scrollify($dom_view, 200), TRUE, TRUE, 0);
+	$dom_box->pack_start($self->_create_records_pager(), FALSE, FALSE, 0);
+	$hpaned->pack1($dom_box, FALSE, TRUE);
 
 
 	# Rigth part - VPaned [Source view | Notebook(Results, Namespaces)]
@@ -679,7 +1451,10 @@ sub _create_main_content {
 	$self->source_view($source_view);
 	$source_view->set_show_line_numbers(TRUE);
 	$source_view->set_highlight_current_line(TRUE);
-	$vpaned->pack1(scrollify($source_view, -1, 400), FALSE, TRUE);
+	my $source_box = Gtk2::VBox->new(FALSE, 0);
+	$source_box->pack_start(scrollify($source_view, -1, 400), TRUE, TRUE, 0);
+	$source_box->pack_start($self->_create_find_bar(), FALSE, FALSE, 0);
+	$vpaned->pack1($source_box, FALSE, TRUE);
 	
 	
 	# Notebook with the results view and the namespaces view
@@ -689,8 +1464,11 @@ sub _create_main_content {
 
 	my $results_view = Xacobeo::UI::SourceView->new();
 	$self->results_view($results_view);
+	my $results_box = Gtk2::VBox->new(FALSE, 0);
+	$results_box->pack_start(scrollify($results_view), TRUE, TRUE, 0);
+	$results_box->pack_start($self->_create_results_pager(), FALSE, FALSE, 0);
 	$notebook->append_page(
-		scrollify($results_view),
+		$results_box,
 		Gtk2::Label->new(__("Results"))
 	);
 	
@@ -703,11 +1481,242 @@ sub _create_main_content {
 		scrollify($namespaces_view),
 		Gtk2::Label->new(__("Namespaces"))
 	);
+
+	# The structure of the document: element, count, attributes
+	my $structure_view = Gtk2::TreeView->new(
+		Gtk2::TreeStore->new('Glib::String', 'Glib::Uint', 'Glib::String')
+	);
+	$self->structure_view($structure_view);
+	my $column = 0;
+	foreach my $title (__('Element'), __('Count'), __('Attributes')) {
+		$structure_view->append_column(
+			Gtk2::TreeViewColumn->new_with_attributes(
+				$title, Gtk2::CellRendererText->new(), text => $column++
+			)
+		);
+	}
+	$notebook->append_page(
+		scrollify($structure_view),
+		Gtk2::Label->new(__("Structure"))
+	);
+
+	# The explanation of an XPath query: step, nodes selected, time
+	my $explain_view = Gtk2::SimpleList->new(
+		__('Step')      => 'text',
+		__('Nodes')     => 'int',
+		__('Time (ms)') => 'text',
+	);
+	$self->explain_view($explain_view);
+	$notebook->append_page(
+		scrollify($explain_view),
+		Gtk2::Label->new(__("Explain"))
+	);
 	
 	return $hpaned;
 }
 
 
+#
+# Creates the bar used for finding text in the source view. The bar is hidden
+# until the user asks for it (Ctrl+F).
+#
+sub _create_find_bar {
+	my $self = shift;
+
+	my $bar = Gtk2::HBox->new(FALSE, 5);
+	$bar->set_no_show_all(TRUE);
+	$self->{find_bar} = $bar;
+
+	my $entry = Gtk2::Entry->new();
+	$self->{find_entry} = $entry;
+	my $regex = Gtk2::CheckButton->new(__("Regular expression"));
+	my $previous = Gtk2::Button->new_from_stock('gtk-go-up');
+	my $next = Gtk2::Button->new_from_stock('gtk-go-down');
+	my $label = Gtk2::Label->new();
+	my $close = Gtk2::Button->new();
+	$close->set_relief('none');
+	$close->add(Gtk2::Image->new_from_stock('gtk-close', 'menu'));
+
+	$bar->pack_start(Gtk2::Label->new(__("Find:")), FALSE, FALSE, 0);
+	$bar->pack_start($entry, TRUE, TRUE, 0);
+	$bar->pack_start($regex, FALSE, FALSE, 0);
+	$bar->pack_start($previous, FALSE, FALSE, 0);
+	$bar->pack_start($next, FALSE, FALSE, 0);
+	$bar->pack_start($label, FALSE, FALSE, 0);
+	$bar->pack_end($close, FALSE, FALSE, 0);
+	$_->show_all for $bar->get_children;
+
+	my $source_view = $self->source_view;
+	my $searched = '';
+	my $find = sub {
+		my ($forward) = @_;
+
+		# A new search is started when the pattern changes, otherwise move to the
+		# next match
+		my $pattern = $entry->get_text;
+		my $key = ($regex->get_active ? 'regex:' : 'text:') . $pattern;
+		if ($key ne $searched or ! $source_view->{search}) {
+			$searched = $key;
+			my $count;
+			eval {
+				$count = $source_view->find_text($pattern, $regex->get_active);
+				1;
+			} or do {
+				$label->set_text(__("Invalid regular expression"));
+				return;
+			};
+			$label->set_text(sprintf __n("%d match", "%d matches", $count), $count);
+			return;
+		}
+
+		$source_view->find_next($forward);
+	};
+
+	$entry->signal_connect(activate => sub { $find->(TRUE) });
+	$next->signal_connect(clicked => sub { $find->(TRUE) });
+	$previous->signal_connect(clicked => sub { $find->(FALSE) });
+	$regex->signal_connect(toggled => sub { $find->(TRUE) if length $entry->get_text });
+	$close->signal_connect(clicked => sub { $self->do_hide_find_bar() });
+	$entry->signal_connect('key-press-event' => sub {
+		my (undef, $event) = @_;
+		if (Gtk2::Gdk->keyval_name($event->keyval) eq 'Escape') {
+			$self->do_hide_find_bar();
+			return TRUE;
+		}
+		return FALSE;
+	});
+
+	return $bar;
+}
+
+
+#
+# Shows the bar for finding text in the source view.
+#
+sub do_show_find_bar {
+	my $self = shift;
+	$self->{find_bar}->show();
+	$self->{find_entry}->grab_focus();
+}
+
+
+#
+# Hides the bar for finding text and removes the highlighting of the matches.
+#
+sub do_hide_find_bar {
+	my $self = shift;
+	$self->{find_bar}->hide();
+	$self->source_view->clear_search();
+}
+
+
+#
+# Creates the bar used for paging through the results of an XPath query. The bar
+# is only visible when the results don't fit in a single page.
+#
+sub _create_results_pager {
+	my $self = shift;
+
+	my $pager = Gtk2::HBox->new(FALSE, 5);
+	$pager->set_no_show_all(TRUE);
+
+	my $previous = Gtk2::Button->new_from_stock('gtk-go-back');
+	my $next = Gtk2::Button->new_from_stock('gtk-go-forward');
+	my $label = Gtk2::Label->new();
+	$pager->pack_start($previous, FALSE, FALSE, 0);
+	$pager->pack_start($label, TRUE, TRUE, 0);
+	$pager->pack_start($next, FALSE, FALSE, 0);
+	$_->show for $previous, $label, $next;
+
+	my $results_view = $self->results_view;
+	my $page_size = $results_view->get('page-size');
+	my $current = 0;
+	$previous->signal_connect(clicked => sub {
+		$results_view->show_page($current - $page_size);
+	});
+	$next->signal_connect(clicked => sub {
+		$results_view->show_page($current + $page_size);
+	});
+
+	$results_view->signal_connect('page-changed' => sub {
+		my (undef, $offset, $count, $total) = @_;
+		$current = $offset;
+		if ($count >= $total) {
+			$pager->hide();
+			return;
+		}
+
+		$label->set_text(
+			sprintf __("Results %d to %d of %d"), $offset + 1, $offset + $count, $total
+		);
+		$previous->set_sensitive($offset > 0 ? TRUE : FALSE);
+		$next->set_sensitive($offset + $count < $total ? TRUE : FALSE);
+		$pager->show();
+	});
+
+	return $pager;
+}
+
+
+#
+# Creates the pager of the windows of records. The pager is hidden unless a
+# document is opened by windows, it's updated through $self->{records_pager}
+# with the window displayed (no arguments hide the pager). Besides the previous
+# and the next windows any record can be reached by typing its number.
+#
+sub _create_records_pager {
+	my $self = shift;
+
+	my $pager = Gtk2::HBox->new(FALSE, 5);
+	$pager->set_no_show_all(TRUE);
+
+	my $previous = Gtk2::Button->new_from_stock('gtk-go-back');
+	my $next = Gtk2::Button->new_from_stock('gtk-go-forward');
+	my $label = Gtk2::Label->new();
+	my $goto_label = Gtk2::Label->new(__("Go to record:"));
+	my $goto = Gtk2::SpinButton->new_with_range(1, 1, 1);
+	$goto->set_numeric(TRUE);
+	$pager->pack_start($previous, FALSE, FALSE, 0);
+	$pager->pack_start($label, TRUE, TRUE, 0);
+	$pager->pack_start($goto_label, FALSE, FALSE, 0);
+	$pager->pack_start($goto, FALSE, FALSE, 0);
+	$pager->pack_start($next, FALSE, FALSE, 0);
+	$_->show for $previous, $label, $goto_label, $goto, $next;
+
+	$previous->signal_connect(clicked => sub {
+		my $records = $self->{records} or return;
+		$self->show_records($records->{first} - $self->conf->get('records-window-size'));
+	});
+	$next->signal_connect(clicked => sub {
+		my $records = $self->{records} or return;
+		$self->show_records($records->{first} + $self->conf->get('records-window-size'));
+	});
+	$goto->signal_connect(activate => sub {
+		$goto->update();
+		$self->show_records($goto->get_value_as_int - 1);
+	});
+
+	$self->{records_pager} = sub {
+		my ($first, $last, $count) = @_;
+		if (! $count) {
+			$pager->hide();
+			return;
+		}
+
+		$label->set_text(
+			sprintf __("Records %d to %d of %d"), $first + 1, $last, $count
+		);
+		$goto->set_range(1, $count);
+		$goto->set_value($first + 1);
+		$previous->set_sensitive($first > 0 ? TRUE : FALSE);
+		$next->set_sensitive($last < $count ? TRUE : FALSE);
+		$pager->show();
+	};
+
+	return $pager;
+}
+
+
 # A true value
 1;
 
@@ -31,6 +31,9 @@ L<Gtk2::Ex::Entry::Pango>.
 The widget validates the text in realtime. In order to support validation for
 namespaces a document has to be set first.
 
+The next step of an absolute path is completed with the names of the elements
+and of the attributes found in the document (see L<Xacobeo::XS::DataGuide>).
+
 =head1 PROPERTIES
 
 The following properties are defined:
@@ -98,11 +101,39 @@ Xacobeo::GObject->register_package('Gtk2::Ex::Entry::Pango' =>
 sub INIT_INSTANCE {
 	my $self = shift;
 
+	# The completions have to be updated before the completion reacts to the
+	# changes and before the validation, which stops the signal when the
+	# expression is not valid (an incomplete path like '/a/' isn't valid).
+	$self->signal_connect('changed' => \&callback_complete);
+	$self->set_completion(_create_completion());
+
 	$self->signal_connect('changed' => \&callback_changed);
 	$self->set_sensitive(FALSE);
 }
 
 
+#
+# Creates the completion of the entry. The model has the completed expressions
+# and the number of nodes that they select.
+#
+sub _create_completion {
+	my $completion = Gtk2::EntryCompletion->new();
+	$completion->set_model(Gtk2::ListStore->new('Glib::String', 'Glib::Uint'));
+	$completion->set_text_column(0);
+	$completion->set_minimum_key_length(1);
+
+	# The completions are computed for the current text, they all match
+	$completion->set_match_func(sub { return TRUE; });
+
+	my $cell = Gtk2::CellRendererText->new();
+	$cell->set(foreground => 'grey');
+	$completion->pack_start($cell, FALSE);
+	$completion->add_attribute($cell, text => 1);
+
+	return $completion;
+}
+
+
 =head2 set_document
 
 Sets a the widget's document. A document is needed in order to provide the
@@ -129,6 +160,21 @@ sub set_document {
 }
 
 
+sub callback_complete {
+	my ($self) = @_;
+
+	my $model = $self->get_completion->get_model;
+	$model->clear();
+
+	my $document = $self->document or return;
+	my $dataguide = $document->dataguide or return;
+
+	foreach my $completion (@{ $dataguide->complete($self->get_text) }) {
+		$model->set($model->append, 0 => $completion->[0], 1 => $completion->[1]);
+	}
+}
+
+
 sub callback_changed {
 	my ($self) = @_;
 
@@ -137,11 +183,15 @@ sub callback_changed {
 
 	my $is_valid = FALSE;
 	if ($document && $xpath) {
-		$is_valid = $document->validate($xpath);
+		my $offset = $document->get_error_offset($xpath);
+		$is_valid = defined $offset ? FALSE : TRUE;
 		if (! $is_valid) {
-			# Mark the XPath expression as wrong
-			my $escaped = Glib::Markup::escape_text($xpath);
-			my $markup = "<span underline='error' underline_color='red'>$escaped</span>";
+			# Mark the XPath expression as wrong starting where the error was found. If
+			# the expression is incomplete the last character is marked.
+			$offset = length($xpath) - 1 if $offset >= length $xpath;
+			my $valid = Glib::Markup::escape_text(substr $xpath, 0, $offset);
+			my $error = Glib::Markup::escape_text(substr $xpath, $offset);
+			my $markup = "$valid<span underline='error' underline_color='red'>$error</span>";
 			$self->set_markup($markup);
 			$self->signal_stop_emission_by_name('changed');
 		}
@@ -50,6 +50,7 @@ our @EXPORT_OK = qw(
 	isa_dom_element
 	isa_dom_attr
 	isa_dom_nodelist
+	isa_nodeset
 	isa_dom_text
 	isa_dom_comment
 	isa_dom_literal
@@ -78,6 +79,7 @@ our %EXPORT_TAGS = (
 			isa_dom_element
 			isa_dom_attr
 			isa_dom_nodelist
+			isa_nodeset
 			isa_dom_text
 			isa_dom_comment
 			isa_dom_literal
@@ -265,6 +267,30 @@ sub isa_dom_nodelist {
 
 
 
+=head2 isa_nodeset
+
+Returns true if the node is a native node set (instance of
+C<Xacobeo::XS::NodeSet>).
+
+Parameters:
+
+=over
+
+=item * $node
+
+The node to check.
+
+=back
+
+=cut
+
+sub isa_nodeset {
+	my ($node) = @_;
+	return defined $node ? $node->isa('Xacobeo::XS::NodeSet') : 0;
+}
+
+
+
 =head2 isa_dom_text
 
 Returns true if the node is a DOM C<Text> (instance of
@@ -168,6 +168,876 @@ sub get_node_path {
 }
 
 
+
+=head2 get_node_paths
+
+Returns the unique XPath paths of all the nodes in the given list. The paths are
+the same as the ones returned by L</get_node_path> but they are computed in a
+single pass, which is much faster for big node lists.
+
+The paths are returned in the same order as the nodes. Entries that are not
+nodes (such as namespaces) get an C<undef> path.
+
+Parameters:
+
+=over
+
+=item * $nodes
+
+The nodes for which the paths have to be computed. Must be an instance of
+L<XML::LibXML::NodeList> or an array ref of L<XML::LibXML::Node>.
+
+=item * $namespaces
+
+The namespaces declared in the document. Must be an hash ref where the keys are
+the URIs and the values the prefixes of the namespaces.
+
+=back
+
+=cut
+
+sub get_node_paths {
+	my $class = shift;
+	my ($nodes, $namespaces) = @_;
+	my $paths = xacobeo_get_node_paths($nodes, $namespaces);
+	return @{ $paths };
+}
+
+
+=head2 get_namespaces
+
+Returns the namespaces declared in the subtree of the given
+L<XML::LibXML::Node> in an hash ref where the keys are the URIs and the values
+the prefixes of the namespaces. Each prefix is unique: the first prefix seen for
+a namespace is used and the namespaces without a prefix are given one (C<ns>,
+C<ns1>, C<ns2>, etc). The namespace of the prefix C<xml> is always returned.
+
+The namespaces are the same as the ones found through the XPath query
+C<.//namespace::*> but the declarations are read in a single pass without
+creating a Perl object per namespace in scope of each element.
+
+Parameters:
+
+=over
+
+=item * $node
+
+The node where the search starts, usually the document node.
+
+=back
+
+=cut
+
+sub get_namespaces {
+	my $class = shift;
+	my ($node) = @_;
+	return xacobeo_get_namespaces($node);
+}
+
+
+
+=head2 get_xpath_error_offset
+
+Checks the syntax of an XPath expression without evaluating it. Returns the
+position (in characters) of the syntax error or C<undef> if the expression is
+valid. The use of a prefix that's not in the namespaces and the calls to
+undefined functions are reported as errors.
+
+Parameters:
+
+=over
+
+=item * $xpath
+
+The XPath expression to check.
+
+=item * $namespaces
+
+The namespaces declared in the document. Must be an hash ref where the keys are
+the URIs and the values the prefixes of the namespaces.
+
+=back
+
+=cut
+
+sub get_xpath_error_offset {
+	my $class = shift;
+	my ($xpath, $namespaces) = @_;
+	my $offset = xacobeo_xpath_get_error_offset($xpath, $namespaces);
+	return $offset < 0 ? undef : $offset;
+}
+
+
+=head2 get_xpath_preview
+
+Returns the first nodes matched by an XPath expression as a
+L<XML::LibXML::NodeList>. The document is only walked until enough nodes are
+found, which makes this method much faster than a full evaluation on big
+documents.
+
+Only the expressions that libxml2 can stream are supported: absolute paths made
+of element and attribute names, wildcards and C<//> (ex: C</a//b/@c>, C<//a |
+//b>). For any other expression C<undef> is returned and the expression has to
+be evaluated normally.
+
+The walk can be limited to a number of nodes, in which case C<undef> is also
+returned when the limit is reached before enough nodes are found. This keeps the
+preview fast when the nodes are rare in a big document.
+
+Parameters:
+
+=over
+
+=item * $document
+
+The document to search; an instance of L<XML::LibXML::Document>.
+
+=item * $xpath
+
+The XPath expression to evaluate.
+
+=item * $namespaces
+
+The namespaces declared in the document. Must be an hash ref where the keys are
+the URIs and the values the prefixes of the namespaces.
+
+=item * $max
+
+The maximal number of nodes to return.
+
+=item * $visits
+
+The maximal number of nodes (elements and attributes) walked. Optional, by
+default the whole document can be walked.
+
+=back
+
+=cut
+
+sub get_xpath_preview {
+	my $class = shift;
+	my ($document, $xpath, $namespaces, $max, $visits) = @_;
+	return xacobeo_xpath_preview($document, $xpath, $namespaces, $max, $visits || 0);
+}
+
+
+=head2 explain_xpath
+
+Explains the evaluation of an XPath expression. Each location step of the
+expression is evaluated on the nodes selected by the previous step and each
+predicate is applied separately. Each step and each predicate is compiled once.
+
+The explanation is returned as an array ref of rows, one for each step or
+predicate, and a last row for the evaluation of the whole expression. Each row
+is an array ref with the label of the step, the number of nodes selected and the
+time spent in seconds. The time of a predicate is the extra time taken by the
+step because of the predicate.
+
+Only location paths and unions of location paths can be explained. For any other
+expression or if the evaluation fails C<undef> is returned.
+
+Parameters:
+
+=over
+
+=item * $document
+
+The document to search; an instance of L<XML::LibXML::Document>.
+
+=item * $xpath
+
+The XPath expression to explain.
+
+=item * $namespaces
+
+The namespaces declared in the document. Must be an hash ref where the keys are
+the URIs and the values the prefixes of the namespaces.
+
+=back
+
+=cut
+
+sub explain_xpath {
+	my $class = shift;
+	my ($document, $xpath, $namespaces) = @_;
+	return xacobeo_xpath_explain($document, $xpath, $namespaces);
+}
+
+
+=head1 ANALYSIS
+
+The package C<Xacobeo::XS::Analysis> collects the information needed when a
+document is loaded in a single walk of the document. Each element feeds the
+namespaces, the index of the element names, the DataGuide, the table of the IDs,
+the preorder mirror and the statistics at the same time:
+
+	my $analysis = Xacobeo::XS::Analysis->new($document);
+	my $namespaces = $analysis->namespaces;
+	my $index = $analysis->take_index;
+	my $guide = $analysis->take_dataguide;
+
+The analysis can also be done by the parser while the document is built, the
+document is then not walked at all:
+
+	my $analysis = Xacobeo::XS::Analysis->parse_file($filename);
+	my $document = $analysis->document;
+
+=head2 Xacobeo::XS::Analysis->new
+
+Analyzes the given L<XML::LibXML::Document>. The document is kept alive as long
+as the analysis exists.
+
+=head2 Xacobeo::XS::Analysis->parse_file
+
+Parses the given file with the same options as the parser of
+L<Xacobeo::Document> and analyzes the document while it's built. Returns
+C<undef> if the file can't be parsed natively (it's not a local file or it has
+no document), the file has to be parsed with L<XML::LibXML> then.
+
+The file is mapped in memory and given to the parser by chunks. If a callback
+is given as second argument it's called after each chunk with the number of
+bytes parsed and the size of the file:
+
+	my $analysis = Xacobeo::XS::Analysis->parse_file($filename, sub {
+		my ($consumed, $total) = @_;
+		printf "%d%%\n", 100 * $consumed / $total;
+	});
+
+=head2 Xacobeo::XS::Analysis->parse_string
+
+Same as C<parse_file> but the document is parsed from a string of bytes.
+
+=head2 $analysis->document
+
+Returns the L<XML::LibXML::Document> analyzed.
+
+=head2 $analysis->namespaces
+
+Returns the namespaces of the document, they are the same as the ones returned
+by L</get_namespaces>.
+
+=head2 $analysis->take_index
+
+Returns the index built by the walk (a C<Xacobeo::XS::Index>), it's the same as
+the one created by C<Xacobeo::XS::Index-E<gt>new> with the namespaces of the
+analysis. The index can only be taken once, the next calls return C<undef>.
+
+=head2 $analysis->take_dataguide
+
+Returns the summary of the paths built by the walk (a
+C<Xacobeo::XS::DataGuide>), it's the same as the one created by
+C<Xacobeo::XS::DataGuide-E<gt>new> with the namespaces of the analysis. The
+summary can only be taken once, the next calls return C<undef>.
+
+=head2 $analysis->statistics
+
+Returns an hashref with the number of C<elements>, C<attributes>, C<texts>,
+C<comments>, C<processing_instructions> and C<ids>, the maximal C<depth>, the
+number of elements at each depth (C<depths>) and the time C<elapsed> by the
+walk in seconds (by the parse when the document was analyzed by the parser).
+
+=head2 $analysis->find_id
+
+Returns the element that has the given ID or C<undef> if there's no such
+element.
+
+=head2 $analysis->preorder
+
+Returns the preorder mirror of the document built by the walk (a
+C<Xacobeo::XS::Preorder>). The index taken from the analysis numbers the
+elements with the positions of the mirror.
+
+=head1 LOADER
+
+The package C<Xacobeo::XS::Loader> parses and analyzes a document given by
+chunks, for instance as it's read from a pipe. The part of the document parsed
+so far can be copied while the rest is still being parsed:
+
+	my $loader = Xacobeo::XS::Loader->new($filename);
+	while (sysread $handle, my $chunk, 65536) {
+		$loader->push($chunk) or last;
+		my $head = $loader->snapshot;
+	}
+	my $analysis = $loader->finish;
+
+=head2 Xacobeo::XS::Loader->new
+
+Creates a new loader. The optional filename is used for the URL of the document
+and for resolving its DTD.
+
+=head2 $loader->push
+
+Parses the given chunk of bytes. Returns false once the parser stopped (it can't
+recover from an error) or when the parse was completed.
+
+=head2 $loader->snapshot
+
+Returns a copy (an L<XML::LibXML::Document>) of the part of the document parsed
+so far or C<undef> if the root element wasn't parsed yet. The copy doesn't
+change when more chunks are parsed.
+
+=head2 $loader->finish
+
+Completes the parse and returns the analysis of the document (an
+C<Xacobeo::XS::Analysis>) or C<undef> if there's no document.
+
+=head1 PARSE JOBS
+
+The package C<Xacobeo::XS::ParseJob> parses and analyzes a document in a worker
+thread. The main thread polls the job, for instance from a timeout of the main
+loop, and takes the analysis once the job is done:
+
+	my $job = Xacobeo::XS::ParseJob->new_from_file($filename);
+	while ($job->poll eq 'running') {
+		printf "%d of %d bytes\n", $job->progress, $job->size;
+	}
+	my $analysis = $job->result;
+
+The worker never touches Perl data: the Perl wrapper of the document is created
+by the thread that calls C<result>.
+
+=head2 Xacobeo::XS::ParseJob->new_from_file
+
+Starts parsing the given file. Returns C<undef> if the file can't be parsed
+natively (it's not a local file or it's empty). If the optional flag C<previews>
+is true copies of the part of the document parsed are made while the parse goes
+on, once 1 MB is parsed and each time the size doubles, up to 64 MB.
+
+A file made of records (a root element with a long list of children, like a
+log or an export) is parsed by several threads: a prescan finds the boundaries
+of the records, the records are parsed by chunks in parallel and the chunks are
+spliced under the root. The document is the same as the one of a serial parse,
+line numbers and IDs included. The optional parameter C<threads> gives the
+number of threads; with C<0> (the default) a file of 16 MB or more is parsed
+with a thread per processor, with C<1> the parse is always serial. A parallel
+parse makes no previews, so a file is parsed serially when C<previews> is true.
+A file that has a DOCTYPE or whose encoding is not
+a superset of ASCII is parsed serially.
+
+=head2 Xacobeo::XS::ParseJob->new_from_string
+
+Starts parsing the given string, the string is copied. A character string is
+parsed as UTF-8, the encoding declared by the document is ignored.
+
+=head2 Xacobeo::XS::ParseJob->new_from_fd
+
+Starts parsing the document read from the given file descriptor (a pipe, the
+standard input, etc) until the end of the stream. The file descriptor is not
+closed. The optional flag C<previews> is the same as for C<new_from_file>.
+
+=head2 $job->poll
+
+Returns the state of the job: C<running>, C<done>, C<error> or C<cancelled>.
+
+=head2 $job->cancel
+
+Requests the job to stop, the parse stops at the next chunk.
+
+=head2 $job->elapsed
+
+Returns the number of seconds spent by the job.
+
+=head2 $job->progress
+
+Returns the number of bytes parsed so far.
+
+=head2 $job->size
+
+Returns the size of the document in bytes or 0 if it's unknown (the document is
+read from a stream).
+
+=head2 $job->error
+
+Returns the error message of a job that failed or C<undef>.
+
+=head2 $job->take_preview
+
+Returns the last copy (an L<XML::LibXML::Document>) of the part of the document
+parsed that was made since the previous call or C<undef>.
+
+=head2 $job->result
+
+Returns the analysis of the document (an C<Xacobeo::XS::Analysis>) once the job
+is done or C<undef>.
+
+=head1 RECORD INDEXES
+
+The package C<Xacobeo::XS::RecordIndex> gives random access to the records of a
+huge document made of records (a root element with a long list of children).
+The byte offsets of the records are found once by a worker thread, with the
+prescan of the parallel parse, and stored in a side file. Any window of records
+can then be read without parsing what's before it:
+
+	my $index = Xacobeo::XS::RecordIndex->new($filename, $path);
+	while ($index->poll eq 'running') {
+		printf "%d of %d bytes\n", $index->progress, $index->size;
+	}
+	my $xml = $index->window(7_340_112, 100);
+
+Neither the document nor the index is loaded in memory, only the bytes of the
+window are read.
+
+=head2 Xacobeo::XS::RecordIndex->new
+
+Opens the index of the given file stored in the file C<path>. If the index is
+missing or if the file changed since (its size, its modification time to the
+nanosecond or its inode) the index is built by a worker thread. Returns
+C<undef> if the file is not a local file.
+
+=head2 $index->poll
+
+Returns the state of the index: C<running>, C<done>, C<error> (the document is
+not a list of records or the index can't be written) or C<cancelled>.
+
+=head2 $index->cancel
+
+Requests the build of the index to stop.
+
+=head2 $index->elapsed
+
+Returns the number of seconds spent building the index.
+
+=head2 $index->progress
+
+Returns the number of bytes of the document scanned so far.
+
+=head2 $index->size
+
+Returns the size of the document in bytes.
+
+=head2 $index->error
+
+Returns the error message of an index that couldn't be built or C<undef>.
+
+=head2 $index->count
+
+Returns the number of records or 0 while the index is not built.
+
+=head2 $index->window
+
+Returns a small document (a string of bytes) with the records C<first> to
+C<first + count - 1> (counted from 0) wrapped by the prolog, the root and the
+epilog of the document, or C<undef> if there's no such record.
+
+=head1 PREORDER
+
+The package C<Xacobeo::XS::Preorder> mirrors the nodes of a document in flat
+arrays indexed by their position in document order: the type, the depth, the
+name, the position of the parent and the size of the subtree of each node. The
+walks that only need this information scan the arrays instead of following the
+pointers of the tree.
+
+	my $preorder = Xacobeo::XS::Preorder->new($document);
+	my $size = $preorder->get_subtree_size($document->documentElement);
+
+The mirror is a snapshot, it has to be rebuilt when the document is modified.
+
+=head2 Xacobeo::XS::Preorder->new
+
+Builds the mirror of the given L<XML::LibXML::Document>. The document is kept
+alive as long as the mirror exists.
+
+=head2 $preorder->size
+
+Returns the number of nodes in the mirror (the attributes are not included).
+
+=head2 $preorder->get_position
+
+Returns the position of the given node in document order (starting at 0) or
+C<undef> if the node is not in the mirror.
+
+=head2 $preorder->get_subtree_size
+
+Returns the number of nodes under the given node or C<undef> if the node is
+not in the mirror.
+
+=head2 $preorder->is_ancestor
+
+Returns true if the first node is an ancestor of the second one. The ancestors
+of an attribute are its element and the ancestors of the element.
+
+=head1 INDEX
+
+The package C<Xacobeo::XS::Index> provides a native index of a document. The
+index is used for resolving the paths returned by L</get_node_path> without
+going through the XPath engine:
+
+	my $index = Xacobeo::XS::Index->new($document, $namespaces);
+	my $node = $index->resolve_path('/html/body/div[2]/p');
+
+=head2 Xacobeo::XS::Index->new
+
+Creates a new index for the given L<XML::LibXML::Document>. The namespaces are
+given in an hash ref where the keys are the URIs and the values the prefixes of
+the namespaces. The document is kept alive as long as the index exists.
+
+=head2 $index->resolve_path
+
+Returns the node matching a path of the form C</a/p:b[3]/c>. Each step is
+resolved through a positional index of the siblings, thus the cost is
+proportional to the depth of the node.
+
+If no node matches the path then a false value is returned. If the path is not
+supported (it uses more than the syntax above or it matches more than one node)
+then C<undef> is returned and the path has to be evaluated as XPath.
+
+=head2 $index->find
+
+Evaluates the simple XPath expressions that can be answered by the indexes of
+the element names and of the attribute values, without going through the XPath
+engine. The supported expressions are C<//name>, C<//name[@attribute='value']>,
+C<//*[@attribute='value']> and the C<count()> of these expressions; the names
+can have a prefix.
+
+Returns a C<Xacobeo::XS::NodeSet> with the elements in document order or an
+L<XML::LibXML::Number> for C<count()>. If the expression is not supported
+C<undef> is returned and the expression has to be evaluated normally.
+
+=head2 $index->find_attribute
+
+Returns the elements having an attribute with the given value, this is the same
+as the expression C<//*[@name='value']>. The name of the attribute can have a
+prefix.
+
+The values of an attribute are indexed the first time that the attribute is
+searched. Returns a C<Xacobeo::XS::NodeSet> or C<undef> if the index of the
+attribute can't be built (it would exceed the memory limit).
+
+=head2 $index->set_attribute_limit
+
+Sets the maximal number of bytes used by the indexes of the attribute values.
+The indexes used the least recently are discarded when the limit is reached. The
+default limit is 64 MB.
+
+=head2 $index->sort
+
+Sorts the nodes of a C<Xacobeo::XS::NodeSet> in document order and removes the
+duplicates. The index numbers the elements in document order when it's built;
+the position of each node is computed once from these numbers instead of
+walking the tree for each comparison.
+
+=head2 $index->union
+
+Returns the nodes that are in any of the two given C<Xacobeo::XS::NodeSet> as a
+new node set in document order. The sets are sorted (see C<sort>)
+and merged in a single pass. Returns C<undef> if the sets belong to different
+documents.
+
+=head2 $index->intersect
+
+Returns the nodes that are in both given node sets as a new node set in document
+order. Returns C<undef> if the sets belong to different documents.
+
+=head1 XPATH CACHE
+
+The package C<Xacobeo::XS::XPathCache> keeps the most recently used XPath
+expressions in their compiled form:
+
+	my $cache = Xacobeo::XS::XPathCache->new(64);
+	my $compiled = $cache->compile('//x:a[@href]', $namespaces);
+	my $nodes = $context->find($compiled || '//x:a[@href]', $document);
+
+=head2 Xacobeo::XS::XPathCache->new
+
+Creates a new cache that holds up to the given number of expressions. Once the
+cache is full the least recently used expression is discarded.
+
+=head2 $cache->compile
+
+Returns the given expression compiled (an instance of
+L<XML::LibXML::XPathExpression>). The expressions are cached by their string
+and by the namespaces used (an hash ref where the keys are the URIs and the
+values the prefixes of the namespaces).
+
+If the expression can't be compiled then C<undef> is returned.
+
+=head1 RESULT CACHE
+
+The package C<Xacobeo::XS::ResultCache> keeps the nodes found by the XPath
+queries made on a document. The nodes are stored as plain arrays without Perl
+objects and are keyed by the expression (without its superfluous white space)
+and by the generation of the document:
+
+	my $cache = Xacobeo::XS::ResultCache->new($document, 32 * 1024 * 1024);
+	$cache->store('//x:a[@href]', $generation, $set);
+	my $set = $cache->lookup('//x:a [@href]', $generation);
+
+=head2 Xacobeo::XS::ResultCache->new
+
+Creates a new cache for the results of the queries made on the given
+L<XML::LibXML::Document>. The results use at most the given number of bytes.
+The document is kept alive as long as the cache exists.
+
+=head2 $cache->lookup
+
+Returns the nodes stored for the given expression and generation of the
+document as a new C<Xacobeo::XS::NodeSet> or C<undef> if the result is not in
+the cache. Asking for a newer generation discards all the results stored.
+
+=head2 $cache->store
+
+Stores the nodes found (a C<Xacobeo::XS::NodeSet>) by the given expression on
+the given generation of the document. The results used the least recently are
+discarded to make room for the new one. Returns false if the result can't be
+cached: it's too big, it belongs to another document or it has namespace nodes.
+
+=head2 $cache->set_limit
+
+Sets the maximal number of bytes used by the results.
+
+=head2 $cache->clear
+
+Discards all the results stored.
+
+=head1 XPATH JOBS
+
+The package C<Xacobeo::XS::XPathJob> evaluates an XPath expression in a worker
+thread. The job is polled from the main loop until it's finished:
+
+	my $job = Xacobeo::XS::XPathJob->new($document, $xpath, $namespaces, $timeout, $max_nodes);
+	Glib::Timeout->add(100, sub {
+		my $state = $job->poll;
+		return TRUE if $state eq 'running';
+		my $result = $job->result;
+		...
+		return FALSE;
+	});
+
+The expressions of the form C<//step[predicate]>, where the step selects
+children or attributes (ex: C<//trade[amount E<gt> 1000]>), are evaluated in
+parallel when the root of the document has many child elements: the children
+of the root are split in ranges that are evaluated by separate threads and the
+nodes found are merged in document order.
+
+=head2 Xacobeo::XS::XPathJob->new
+
+Starts the evaluation of an expression on a L<XML::LibXML::Document>. The
+namespaces are given in an hash ref where the keys are the URIs and the values
+the prefixes of the namespaces. The evaluation is stopped once it runs for more
+than C<$timeout> seconds and node sets with more than C<$max_nodes> nodes are
+discarded. A value of 0 disables a limit. A parallel evaluation stops as soon
+as it found more than C<$max_nodes> nodes, a serial evaluation is checked once
+it's over. An optional last parameter gives the maximal number of threads of a
+parallel evaluation, by default one thread per processor.
+
+The document must not be modified while the job is running.
+
+=head2 Xacobeo::XS::XPathJob->new_explain
+
+Starts the explanation of an expression step by step, as done by
+L</explain_xpath>. The parameters are the same as for C<new> up to the timeout.
+An expression that can't be split in steps is explained by a single row with its
+evaluation. The result of the job is the array ref of rows.
+
+=head2 $job->poll
+
+Returns the state of the job: I<running>, I<done>, I<error>, I<cancelled>,
+I<timeout> or I<limit> (too many results).
+
+=head2 $job->cancel
+
+Stops the evaluation. Stopping the evaluation of an expression requires
+libxml2 2.9.11 or later, with older versions the evaluation runs until its end
+and the result is discarded.
+
+=head2 $job->elapsed
+
+Returns the number of seconds spent evaluating the expression.
+
+=head2 $job->progress
+
+Returns the number of operations performed so far by the XPath engine (roughly
+the number of nodes visited).
+
+=head2 $job->error
+
+Returns the error message of a job that failed.
+
+=head2 $job->result
+
+Returns the result of a job that's done. The result is the same as the one
+returned by L<XML::LibXML::XPathContext/find> except for the node sets which are
+returned as a C<Xacobeo::XS::NodeSet> (see L</NODE SETS>). The result of an
+explanation is an array ref of rows [label, count, seconds].
+
+=head1 NODE SETS
+
+The package C<Xacobeo::XS::NodeSet> keeps the nodes found by an XPath query in
+their native form. The Perl nodes are only created for the nodes requested,
+this allows to count and to page through results that have millions of nodes.
+
+	my $set = Xacobeo::XS::NodeSet->find($document, $xpath, $namespaces);
+	printf "Found %d nodes\n", $set->size;
+	my $page = $set->slice(0, 100);
+
+The node set keeps the document alive. The document must not be modified while
+the node set exists.
+
+=head2 Xacobeo::XS::NodeSet->new_from_list
+
+Creates a node set from the nodes of a L<XML::LibXML::Document> given as a
+L<XML::LibXML::NodeList> or an array ref, the order of the list is kept.
+Returns C<undef> if an entry is not a node of the document (a namespace, a node
+of another document, etc).
+
+=head2 Xacobeo::XS::NodeSet->find
+
+Evaluates an expression on a L<XML::LibXML::Document> and returns the nodes
+found. The namespaces are given in an hash ref where the keys are the URIs and
+the values the prefixes of the namespaces.
+
+Returns C<undef> if the expression can't be evaluated or if it doesn't return a
+node set.
+
+=head2 $set->size
+
+Returns the number of nodes in the set. No Perl node is created.
+
+=head2 $set->slice
+
+Returns the nodes in the range C<[$offset, $offset + $count)> as a
+L<XML::LibXML::NodeList>. The range is clamped to the size of the set.
+
+=head2 $set->render
+
+Displays the nodes in the range C<[$offset, $offset + $count)> into a
+L<Gtk2::TextBuffer>, as done by L</load_text_buffer>. Each node is preceded by
+its position in the set. The parameters are the buffer, the offset, the count
+and the namespaces.
+
+=head1 TEXT INDEX
+
+The package C<Xacobeo::XS::TextIndex> provides a trigram index of the text
+nodes and of the attribute values of a document. The index answers substring
+searches without scanning the whole document: only the nodes having all the
+trigrams of the text searched are verified.
+
+The index is built in a background thread and has to be polled until it's
+ready:
+
+	my $text_index = Xacobeo::XS::TextIndex->new($document);
+	...
+	if ($text_index->poll eq 'ready') {
+		my $set = $text_index->search('foo');
+	}
+
+=head2 Xacobeo::XS::TextIndex->new
+
+Creates a new text index for the given L<XML::LibXML::Document> and starts
+building it in a background thread. The document is kept alive as long as the
+index exists. The optional second argument is the maximal number of bytes used
+by the index, 0 (the default) for no limit. If the preorder mirror of the
+document is given as a third argument the nodes are taken from the mirror
+instead of walking the document.
+
+=head2 $text_index->poll
+
+Returns the state of the index: I<building>, I<ready>, I<cancelled> or I<limit>
+(the index exceeded its memory limit and was dropped, it can't be searched).
+
+=head2 $text_index->wait
+
+Blocks until the index is built.
+
+=head2 $text_index->elapsed
+
+Returns the number of seconds spent building the index.
+
+=head2 $text_index->search
+
+Returns the elements having a text node or an attribute that contains the given
+text as a C<Xacobeo::XS::NodeSet>. This is the same as the XPath expression
+C<//*[text()[contains(., 'text')] or @*[contains(., 'text')]]>. Returns
+C<undef> if the index is not ready.
+
+=head2 $text_index->find
+
+Evaluates the XPath expressions C<//text()[contains(., 'text')]>,
+C<//@*[contains(., 'text')]> and their C<count()> through the index. Returns
+C<undef> if the expression is not supported or if the index is not ready, in
+which case the expression has to be evaluated normally.
+
+=head1 TEXT SEARCH
+
+The package C<Xacobeo::XS::TextSearch> finds all the occurrences of a string or
+of a regular expression in a L<Gtk2::TextBuffer>. The text is split in chunks
+that are scanned in parallel (one thread per processor) and the matches are
+kept as character offsets. The matches are highlighted on demand, usually only
+in the region of the buffer that's displayed:
+
+	my $search = Xacobeo::XS::TextSearch->new($buffer, $pattern, $is_regex);
+	printf "Found %d matches\n", $search->size;
+	$search->highlight($buffer, 'search_match', $start, $end);
+
+=head2 Xacobeo::XS::TextSearch->new
+
+Finds the matches of the pattern in the buffer. The pattern is a plain string
+unless C<$is_regex> is true, in which case it's a Perl compatible regular
+expression (see GRegex). The matches don't overlap. Croaks if the regular
+expression is invalid.
+
+An optional fourth parameter gives the maximal number of threads that scan the
+text, by default one thread per processor.
+
+=head2 $search->size
+
+Returns the number of matches.
+
+=head2 $search->find
+
+Returns the position of the first match starting at the given character offset
+or after it. If the second parameter is false the position of the last match
+starting before the offset is returned instead. The search wraps around the
+text; C<-1> is returned if there are no matches.
+
+=head2 $search->get_match
+
+Returns the character offsets (start, end) of the match at the given position.
+
+=head2 $search->highlight
+
+Applies a tag to the matches within the given range of characters. The
+parameters are the buffer, the name of the tag, the start and the end of the
+range. The tag is first removed from the range.
+
+=head1 DATAGUIDE
+
+The package C<Xacobeo::XS::DataGuide> is a summary of the structure of a
+document (a DataGuide): each distinct path of element names starting at the
+root is kept once with the number of elements found at that path and the names
+of the attributes seen there. The summary is built in a single walk and its size
+only depends on the variety of the paths, not on the size of the document:
+
+	my $guide = Xacobeo::XS::DataGuide->new($document_node, $namespaces);
+	foreach my $row (@{ $guide->summary }) {
+		my ($depth, $name, $count, $attributes) = @{ $row };
+		print '  ' x $depth, "$name ($count) $attributes\n";
+	}
+
+=head2 Xacobeo::XS::DataGuide->new
+
+Builds the summary of the document. The namespaces are the ones registered by
+the application (key: URI, value: prefix), they are used for naming the
+elements and the attributes.
+
+=head2 $guide->summary
+
+Returns the paths in document order as an arrayref. Each path is an arrayref
+with: the depth (1 for the root element), the name of the element, the number of
+elements found at that path and the attributes with their count
+(C<"id (12), name (3)">).
+
+=head2 $guide->complete
+
+Returns the completions of the last step of an absolute XPath expression
+(C</a/b/> or C<//a/@i>). Each completion is an arrayref with the expression
+where the last step is completed and the number of nodes it selects. Predicates
+are ignored while following the path; an empty list is returned for the
+expressions that can't be completed.
+
+=cut
+
+
 __PACKAGE__->bootstrap;
 
 
@@ -3,7 +3,7 @@
 use strict;
 use warnings;
 
-use Test::More tests => 2;
+use Test::More tests => 8;
 
 use FindBin;
 use lib "$FindBin::Bin";
@@ -20,7 +20,15 @@ use File::Slurp qw(slurp);
 use Encode 'decode';
 
 
-exit tests() unless caller;
+exit main() unless caller;
+
+
+sub main {
+	tests();
+	test_node_paths();
+	test_text_search();
+	return 0;
+}
 
 
 sub tests {
@@ -63,6 +71,55 @@ sub tests {
 }
 
 
+sub test_node_paths {
+	my $filename = File::Spec->catfile($FindBin::Bin, File::Spec->updir, 'tests', 'SVG.svg');
+	my $document = Xacobeo::Document->new_from_file($filename, 'xml');
+	my $namespaces = $document->namespaces;
+
+	my $nodes = $document->find('//node()');
+	my @expected = map { Xacobeo::XS->get_node_path($_, $namespaces) } $nodes->get_nodelist;
+	my @got = Xacobeo::XS->get_node_paths($nodes, $namespaces);
+	is_deeply(\@got, \@expected, "Batch paths are the same as the single paths");
+}
+
+
+sub test_text_search {
+	my $filename = File::Spec->catfile($FindBin::Bin, File::Spec->updir, 'tests', 'sample.xml');
+	my $document = Xacobeo::Document->new_from_file($filename, 'xml');
+
+	my $textview = Xacobeo::UI::SourceView->new();
+	$textview->set_document($document);
+	$textview->load_node($document->documentNode);
+	my $buffer = $textview->get_buffer;
+	my $text = $buffer->get_text($buffer->get_start_iter, $buffer->get_end_iter, TRUE);
+
+	my $search = Xacobeo::XS::TextSearch->new($buffer, 'News', FALSE);
+	my $count = () = $text =~ /News/g;
+	is($search->size, $count, "Text search finds all the matches");
+	is_deeply([$search->get_match(0)], [index($text, 'News'), index($text, 'News') + 4], "Text search offsets");
+
+	$search = Xacobeo::XS::TextSearch->new($buffer, '<[A-Z]\\w+', TRUE);
+	$count = () = $text =~ /<[A-Z]\w+/g;
+	is($search->size, $count, "Regex search finds all the matches");
+
+	# A text big enough to be scanned by several threads, the words are cut at
+	# the start of the chunks
+	$text = join '', map { ('ab' x 400) . substr('abcdefg', 0, $_ % 7) . "\n" } 1 .. 4_000;
+	$buffer = Gtk2::TextBuffer->new();
+	$buffer->set_text($text);
+	foreach my $pattern (['aba', FALSE, qr/aba/], ['\\w{7}', TRUE, qr/\w{7}/]) {
+		my ($string, $is_regex, $regex) = @$pattern;
+		my @expected;
+		while ($text =~ /$regex/g) {
+			push @expected, [ $-[0], $+[0] ];
+		}
+		$search = Xacobeo::XS::TextSearch->new($buffer, $string, $is_regex, 4);
+		my @got = map { [ $search->get_match($_) ] } 0 .. $search->size - 1;
+		is_deeply(\@got, \@expected, "Search of '$string' by several threads");
+	}
+}
+
+
 sub expected {
 	my ($file) = @_;
 	$file .= '.expected';
@@ -3,10 +3,12 @@
 use strict;
 use warnings;
 
-use Test::More tests => 53;
+use Test::More tests => 142;
 use Test::Exception;
 use Data::Dumper;
 use Carp;
+use File::Slurp qw(slurp);
+use File::Temp qw(tempfile);
 
 BEGIN {
 	use_ok('Xacobeo::Document');
@@ -33,6 +35,19 @@ sub main {
 
 	test_empty_document();
 	test_empty_pi_document();
+
+	test_index();
+	test_text_index();
+	test_dataguide();
+	test_node_set_operations();
+	test_explain();
+	test_result_cache();
+	test_native_namespaces();
+	test_analysis();
+	test_parse_job();
+	test_records_parse();
+	test_record_index();
+	test_partitioned_xpath();
 	
 	return 0;
 }
@@ -116,6 +131,13 @@ sub test_without_namespaces {
 	# This is fine
 	$got = $document->validate('/xkbConfigRegistry');
 	ok($got, 'Validate XPath query');
+
+	# Position of the syntax errors
+	is($document->get_error_offset('/html//a[@href'), 14, 'Syntax error at the end');
+	is($document->get_error_offset('/html//a]/b'), 8, 'Syntax error in the middle');
+	ok(! $document->validate('//x:a'), 'Undefined namespace is invalid');
+	is($document->get_error_offset('//a[foo(.)]'), 4, 'Undefined function is invalid');
+	ok($document->validate('//a[. mod (2)] and (//b)'), 'Operators before a parenthesis are not functions');
 }
 
 
@@ -207,6 +229,46 @@ sub test_namespaces2 {
 	# Try to find all nodes in the default namespace
 	$got = $document->find('//ns:*');
 	is($got->size, 9, "Got 9 in the default namespace");
+
+
+	# Resolve the paths of the nodes
+	$got = $document->find_node('/Beers/ns:table/ns:tr/ns:td[3]/details/pro');
+	is($got->textContent, 'Wonderful hop, light alcohol, good summer beer', 'Resolved a node path');
+
+	$got = $document->find_node('/Beers/ns:table/ns:th/ns:td[2]');
+	ok($got->isSameNode($document->find('//ns:th/ns:td')->get_node(2)), 'Resolved a node path with a position');
+
+	$got = $document->find_node('/Beers/ns:table/ns:th/ns:td[4]');
+	is($got, undef, 'No node for a position out of range');
+
+	$got = $document->find_node('/Beers/table');
+	is($got, undef, 'No node for an element in the wrong namespace');
+
+	$got = $document->find_node('//ns:th/ns:td[last()]');
+	is($got->textContent, 'Description', 'Resolved an XPath expression');
+
+
+	# Native node sets
+	$got = $document->find_handle('//ns:*');
+	is($got->size, 9, "Node set has 9 nodes");
+	is_deeply(
+		[ map { $_->localname } $got->slice(7, 5)->get_nodelist ],
+		[ qw(td td) ],
+		'Node set slice is clamped'
+	);
+	is($got->slice(9, 1)->size, 0, 'Empty node set slice');
+	is($document->find_handle('count(//ns:*)')->value, 9, 'Node set falls back to find');
+
+
+	# Preview of the first results
+	$got = $document->preview('/Beers/ns:table//ns:td | //details/*', 5);
+	is_deeply(
+		[ map { $_->localname } $got->get_nodelist ],
+		[ qw(td td td td td) ],
+		'Preview of the first nodes'
+	);
+	is($document->preview('//ns:td[1]', 5), undef, 'No preview for a predicate');
+	is($document->preview('//ns:td', 5, 3), undef, 'No preview past the nodes walked');
 }
 
 
@@ -366,3 +428,408 @@ sub test_empty_pi_document {
 	my @child = $root->childNodes;
 	is(scalar(@child), 0);
 }
+
+
+# Checks that the queries answered by the index return the same results as
+# libxml2. The queries are built from the elements and attributes of each
+# document of the corpus.
+sub test_index {
+
+	my $document = Xacobeo::Document->new_from_file("$FOLDER/beers.xml", 'xml');
+	isa_ok($document->find_indexed('//ns:td'), 'Xacobeo::XS::NodeSet');
+
+	foreach my $file (qw(beers.xml countries.xml namespaces.xml sample.xml stocks.xml xorg.xml SVG.svg)) {
+		my $document = Xacobeo::Document->new_from_file("$FOLDER/$file", 'xml');
+
+		my %queries;
+		foreach my $element ($document->documentNode->findnodes('//*')) {
+			my $name = $document->get_prefixed_name($element);
+			$queries{"//$name"} = 1;
+			foreach my $attribute ($element->attributes) {
+				next unless $attribute->isa('XML::LibXML::Attr');
+				my $value = $attribute->value;
+				next if $value =~ /'/ && $value =~ /"/;
+				my $quote = $value =~ /'/ ? '"' : "'";
+				my $attribute_name = $document->get_prefixed_name($attribute);
+				$queries{"//${name}[\@$attribute_name=$quote$value$quote]"} = 1;
+				$queries{"//*[\@$attribute_name=$quote$value$quote]"} = 1;
+			}
+		}
+		$queries{"//not-there"} = 1;
+		$queries{"count($_)"} = 1 for keys %queries;
+
+		my @failed;
+		foreach my $query (sort keys %queries) {
+			my $indexed = $document->find_indexed($query);
+			my $expected = $document->xpath->find($query, $document->documentNode);
+			push @failed, $query unless same_result($document->find($query), $expected);
+			push @failed, "$query (index)" unless defined $indexed;
+		}
+
+		is_deeply(\@failed, [], "Index answers the queries of $file like libxml2");
+	}
+
+
+	# Search by attribute, with and without the index of the attribute values
+	$document = Xacobeo::Document->new_from_file("$FOLDER/SVG.svg", 'xml');
+	my $expected = $document->xpath->find('//*[@id="base"]', $document->documentNode);
+	my $set = $document->find_by_attribute(id => 'base');
+	ok(same_result($set->slice(0, $set->size), $expected), "Find by attribute");
+
+	$document->index->set_attribute_limit(0);
+	$set = $document->find_by_attribute(id => 'base');
+	ok(same_result($set->slice(0, $set->size), $expected), "Find by attribute without index");
+
+	$set = $document->find_by_attribute(id => q{it's "quoted"});
+	is($set->size, 0, "Find by attribute with both quotes");
+}
+
+
+sub test_text_index {
+
+	my $document = Xacobeo::Document->new_from_file("$FOLDER/xorg.xml", 'xml');
+	my $expected = $document->search_text('German');
+	ok($expected->size > 0, "Search text without the text index");
+
+	my $text_index = $document->build_text_index();
+	isa_ok($text_index, 'Xacobeo::XS::TextIndex');
+	$text_index->wait();
+
+	my $set = $document->search_text('German');
+	ok(same_result($set->slice(0, $set->size), $expected->slice(0, $expected->size)), "Search text with the text index");
+
+	my $query = q{//text()[contains(., 'ger')]};
+	$set = $document->find_indexed($query);
+	ok(same_result($set->slice(0, $set->size), $document->xpath->find($query, $document->documentNode)), "Text index answers contains()");
+
+	# An index over its memory limit is dropped
+	$text_index = Xacobeo::XS::TextIndex->new($document->documentNode, 1024);
+	$text_index->wait();
+	is($text_index->poll, 'limit', "Text index over its limit");
+	is($text_index->search('German'), undef, "Text index over its limit can't be searched");
+}
+
+
+sub test_dataguide {
+
+	my $document = Xacobeo::Document->new_from_file("$FOLDER/countries.xml", 'xml');
+	my $dataguide = $document->dataguide;
+	isa_ok($dataguide, 'Xacobeo::XS::DataGuide');
+
+	# Each path is counted once
+	my $summary = $dataguide->summary;
+	my ($root) = @{ $summary };
+	is_deeply([ @{ $root }[0 .. 2] ], [1, 'ISO_3166_2', 1], "DataGuide root element");
+
+	my $xpath = $document->xpath;
+	is_deeply($dataguide->complete('/'), [ ['/ISO_3166_2', 1] ], "Complete the root element");
+
+	my $completions = $dataguide->complete('//c');
+	my $count = $xpath->findvalue('count(//country)', $document->documentNode);
+	is_deeply($completions->[0], ['//country', $count], "Complete a descendant");
+}
+
+
+sub test_node_set_operations {
+
+	my $document = Xacobeo::Document->new_from_file("$FOLDER/sample.xml", 'xml');
+	my $xpath = $document->xpath;
+	my $node = $document->documentNode;
+
+	my $elements = $document->find_handle('//p');
+	my $texts = $document->find_handle('//text()');
+	my $set = $document->union($texts, $elements);
+	ok(same_result($set->slice(0, $set->size), $xpath->find('//p | //text()', $node)), "Union in document order");
+
+	$set = $document->intersect($document->find_handle('//node()'), $document->find_handle('//p/text() | //@*'));
+	ok(same_result($set->slice(0, $set->size), $xpath->find('//p/text()', $node)), "Intersection");
+
+	# The same nodes twice
+	$set = $document->union($texts, $texts);
+	is($set->size, $texts->size, "Union removes the duplicates");
+
+	# Elements, attributes, text nodes and comments in a mixed order
+	my $query = '//* | //@* | //text() | //comment()';
+	my @nodes = $xpath->findnodes($query, $node);
+	my @mixed = (reverse(@nodes[grep { $_ % 2 } 0 .. $#nodes]), @nodes[grep { ! ($_ % 2) } 0 .. $#nodes]);
+	$set = Xacobeo::XS::NodeSet->new_from_list($node, \@mixed);
+	$document->sort_nodes($set);
+	ok(same_result($set->slice(0, $set->size), $xpath->find($query, $node)), "Sort nodes");
+}
+
+
+sub test_explain {
+
+	my $document = Xacobeo::Document->new_from_file("$FOLDER/sample.xml", 'xml');
+
+	my $explanation = $document->explain('//*[1]');
+	is_deeply(
+		[ map { [ @{ $_ }[0, 1] ] } @{ $explanation } ],
+		[
+			[ '//',     42 ],
+			[ '*',      11 ],
+			[ '[1]',     2 ],
+			[ '//*[1]',  2 ],
+		],
+		"Explain the steps and the predicates"
+	);
+
+	$explanation = $document->explain('/*/* | //comment()');
+	is_deeply(
+		[ map { $_->[0] } @{ $explanation } ],
+		[ '/*', '/*', '| //', 'comment()', '/*/* | //comment()' ],
+		"Explain an union"
+	);
+
+	# Not a location path
+	$explanation = $document->explain('count(//*)');
+	is_deeply(
+		[ map { [ @{ $_ }[0, 1] ] } @{ $explanation } ],
+		[ [ 'count(//*)', 1 ] ],
+		"Explain an expression as a whole"
+	);
+
+	# Explained in a background thread
+	foreach my $xpath ('//*[1]', 'count(//*)') {
+		my $job = $document->explain_async($xpath);
+		select undef, undef, undef, 0.01 while $job->poll eq 'running';
+		is_deeply(
+			[ map { [ @{ $_ }[0, 1] ] } @{ $job->result } ],
+			[ map { [ @{ $_ }[0, 1] ] } @{ $document->explain($xpath) } ],
+			"Explain $xpath in the background"
+		);
+	}
+}
+
+
+sub test_result_cache {
+
+	my $document = Xacobeo::Document->new_from_file("$FOLDER/sample.xml", 'xml');
+	my $xpath = $document->xpath;
+	my $node = $document->documentNode;
+
+	ok(! defined $document->find_cached('//p/text()'), "Result not cached");
+
+	my $set = $document->find_handle('//p/text()');
+	my $cached = $document->find_cached(' //p / text() ');
+	ok(same_result($cached->slice(0, $cached->size), $xpath->find('//p/text()', $node)), "Result cached");
+
+	$document->changed();
+	ok(! defined $document->find_cached('//p/text()'), "Result discarded when the document changes");
+
+	my $list = $document->find('//p/text()');
+	$cached = $document->find_cached('//p/text()');
+	ok(defined $cached && same_result($cached->slice(0, $cached->size), $list), "Result of find() cached");
+}
+
+
+# Compares the namespaces found natively with the ones found through XPath.
+sub test_native_namespaces {
+
+	foreach my $file (qw(SVG.svg beers.xml countries.xml namespaces.xml sample.xml stocks.xml xorg.xml)) {
+		my $document = Xacobeo::Document->new_from_file("$FOLDER/$file", 'xml');
+		my $node = $document->documentNode;
+		is_deeply(
+			Xacobeo::XS->get_namespaces($node),
+			Xacobeo::Document::_get_all_namespaces_xpath($node),
+			"Same namespaces in $file"
+		);
+	}
+
+	# Start from a nested element, the namespaces in scope are also found
+	my $document = Xacobeo::Document->new_from_file("$FOLDER/namespaces.xml", 'xml');
+	my ($node) = $document->documentNode->documentElement->getChildrenByTagName('*');
+	is_deeply(
+		Xacobeo::XS->get_namespaces($node),
+		Xacobeo::Document::_get_all_namespaces_xpath($node),
+		"Same namespaces from a nested element"
+	);
+
+	# Many copies of the same declarations
+	my $root = XML::LibXML->load_xml(location => "$FOLDER/SVG.svg")->documentElement;
+	my $big = XML::LibXML::Document->new();
+	$big->setDocumentElement($big->createElement('copies'));
+	$big->documentElement->appendChild($root->cloneNode(1)) for 1 .. 50;
+	is_deeply(
+		Xacobeo::XS->get_namespaces($big),
+		Xacobeo::Document::_get_all_namespaces_xpath($big),
+		"Same namespaces in a scaled document"
+	);
+}
+
+
+# The structures built by the single walk are the same as the ones built apart.
+sub test_analysis {
+
+	my $document = Xacobeo::Document->new_from_file("$FOLDER/SVG.svg", 'xml');
+	my $node = $document->documentNode;
+	my $namespaces = $document->namespaces;
+	is_deeply($namespaces, Xacobeo::XS->get_namespaces($node), "Analysis namespaces");
+	is_deeply(
+		$document->dataguide->summary,
+		Xacobeo::XS::DataGuide->new($node, $namespaces)->summary,
+		"Analysis DataGuide"
+	);
+	ok(! defined $document->analysis->take_index, "Index taken once");
+
+	my $statistics = $document->statistics;
+	is($statistics->{elements}, $node->findvalue('count(//*)'), "Elements counted");
+	is($statistics->{attributes}, $node->findvalue('count(//@*)'), "Attributes counted");
+	is($statistics->{depth}, scalar @{ $statistics->{depths} }, "Depth histogram");
+
+	my $root = $node->documentElement;
+	my $preorder = $document->analysis->preorder;
+	is($preorder->get_subtree_size($root), $root->findvalue('count(.//node())'), "Subtree size of the root");
+	my ($leaf) = $root->findnodes('(//*[not(*)])[last()]');
+	ok($document->is_ancestor($root, $leaf), "Root is an ancestor");
+	ok(! $document->is_ancestor($leaf, $root), "Leaf is not an ancestor");
+
+	$document = Xacobeo::Document->new_from_string('<r><a xml:id="x1"/><b xml:id="x2"/></r>', 'xml');
+	is($document->find_id('x2')->nodeName, 'b', "Element found by ID");
+
+	my $analysis = Xacobeo::XS::Analysis->parse_file("$FOLDER/SVG.svg");
+	is(
+		$analysis->document->toString,
+		XML::LibXML->new()->parse_file("$FOLDER/SVG.svg")->toString,
+		"Document built by the parser"
+	);
+	is($analysis->statistics->{elements}, $statistics->{elements}, "Elements counted by the parser");
+	ok(! defined Xacobeo::XS::Analysis->parse_file("$FOLDER/missing.xml"), "Missing file not parsed");
+
+	my @progress;
+	Xacobeo::XS::Analysis->parse_file("$FOLDER/SVG.svg", sub { @progress = @_ });
+	is_deeply(\@progress, [ -s "$FOLDER/SVG.svg", -s "$FOLDER/SVG.svg" ], "Progress of the parse");
+
+	# A document given by chunks
+	my $content = slurp("$FOLDER/xorg.xml");
+	my $loader = Xacobeo::XS::Loader->new("$FOLDER/xorg.xml");
+	$loader->push(substr $content, 0, length($content) / 2);
+	my $head = $loader->snapshot;
+	$loader->push(substr $content, length($content) / 2);
+	$document = Xacobeo::Document->new_from_loader($loader, "$FOLDER/xorg.xml");
+	my $expected = XML::LibXML->new()->parse_file("$FOLDER/xorg.xml");
+	is($document->documentNode->toString, $expected->toString, "Document loaded by chunks");
+	ok(
+		$head->findvalue('count(//*)') > 0 && $head->findvalue('count(//*)') < $expected->findvalue('count(//*)'),
+		"Head of the document"
+	);
+	is($document->statistics->{elements}, $expected->findvalue('count(//*)'), "Elements counted by chunks");
+}
+
+
+sub test_parse_job {
+
+	# Parsed in a background thread
+	my $job = Xacobeo::Document->parse_async("$FOLDER/xorg.xml");
+	select undef, undef, undef, 0.01 while $job->poll eq 'running';
+	my $document = Xacobeo::Document->new_from_job($job, "$FOLDER/xorg.xml");
+	my $expected = XML::LibXML->new()->parse_file("$FOLDER/xorg.xml");
+	is($document->documentNode->toString, $expected->toString, "Document parsed in the background");
+
+	# The characters are parsed as UTF-8 whatever the encoding declared
+	$job = Xacobeo::Document->parse_string_async(qq{<?xml version="1.0" encoding="ISO-8859-1"?><r>\x{e9}\x{263a}</r>});
+	select undef, undef, undef, 0.01 while $job->poll eq 'running';
+	$document = Xacobeo::Document->new_from_job($job, 'string');
+	is($document->documentNode->documentElement->textContent, "\x{e9}\x{263a}", "Characters parsed in the background");
+
+	# A stream without data is cancelled
+	pipe my $reader, my $writer or die "Can't create a pipe: $!";
+	$job = Xacobeo::XS::ParseJob->new_from_fd(fileno($reader));
+	$job->cancel();
+	select undef, undef, undef, 0.01 while $job->poll eq 'running';
+	is($job->poll, 'cancelled', "Parse cancelled");
+}
+
+
+sub test_records_parse {
+
+	# A list of records parsed by several threads
+	my $filename = records_file();
+	my $job = Xacobeo::XS::ParseJob->new_from_file($filename, 0, 4);
+	select undef, undef, undef, 0.01 while $job->poll eq 'running';
+	my $document = Xacobeo::Document->new_from_job($job, $filename);
+	my $expected = XML::LibXML->new()->parse_file($filename);
+	is($document->documentNode->toString, $expected->toString, "Records parsed by threads");
+
+	my @lines = map { $_->line_number } $document->documentNode->findnodes('//node()');
+	my @expected_lines = map { $_->line_number } $expected->findnodes('//node()');
+	is_deeply(\@lines, \@expected_lines, "Line numbers of the records");
+	is($document->documentNode->getElementById('e4321')->getAttributeNS('urn:a', 'n'), '4321 ">"', "IDs of the records");
+}
+
+
+sub test_record_index {
+
+	# The records indexed and read by windows
+	my $filename = records_file();
+	my (undef, $path) = tempfile(UNLINK => 1);
+	my $index = Xacobeo::XS::RecordIndex->new($filename, $path);
+	select undef, undef, undef, 0.01 while $index->poll eq 'running';
+	is($index->count, 5_000, "Records indexed");
+
+	my $window = XML::LibXML->new()->parse_string($index->window(4_320, 2));
+	is_deeply(
+		[ map { $_->getAttributeNS(XML_XML_NS, 'id') } $window->documentElement->childNodes->grep(sub { $_->nodeType == 1 }) ],
+		[ 'e4321', 'e4322' ],
+		"Window of records"
+	);
+
+	$index = Xacobeo::XS::RecordIndex->new($filename, $path);
+	is($index->poll, 'done', "Index reused");
+}
+
+
+sub test_partitioned_xpath {
+
+	# The queries //step are split by the children of the root and evaluated by
+	# several threads
+	my $xml = qq{<?xml version="1.0"?>\n<?top?><!-- top --><root id="r" n="0">};
+	foreach my $i (1 .. 600) {
+		$xml .= qq{<x id="x$i"><x id="y$i">text $i</x>tail $i</x>};
+		$xml .= qq{<!-- c$i --><?pi $i?>text $i} if $i % 3 == 0;
+	}
+	$xml .= qq{</root><!-- end -->};
+	my $document = XML::LibXML->new()->parse_string($xml);
+
+	foreach my $xpath ('//x[1]', '//@id', '//text()') {
+		my $job = Xacobeo::XS::XPathJob->new($document, $xpath, {}, 0, 0, 4);
+		select undef, undef, undef, 0.01 while $job->poll eq 'running';
+		my $set = $job->result;
+		ok(
+			same_result($set->slice(0, $set->size), $document->findnodes($xpath)),
+			"Query $xpath evaluated by several threads"
+		);
+	}
+}
+
+
+# Returns true if both XPath results are the same.
+sub same_result {
+	my ($got, $expected) = @_;
+
+	if ($expected->isa('XML::LibXML::NodeList')) {
+		return 0 unless $got->isa('XML::LibXML::NodeList') && $got->size == $expected->size;
+		foreach my $i (1 .. $expected->size) {
+			return 0 unless $got->get_node($i)->isSameNode($expected->get_node($i));
+		}
+		return 1;
+	}
+
+	return ref $got eq ref $expected && $got->value == $expected->value;
+}
+
+
+# Returns the name of a temporary file with a list of 5000 records.
+sub records_file {
+	my ($fh, $filename) = tempfile(UNLINK => 1);
+	print $fh qq{<?xml version="1.0"?>\n<!-- records -->\n<feed xmlns="urn:feed" xmlns:a="urn:a">\n};
+	foreach my $i (1 .. 5_000) {
+		print $fh qq{  <entry xml:id="e$i" a:n='$i "&gt;"'>\n};
+		print $fh qq{    <title>Entry $i &amp; <![CDATA[<b>]]></title><!-- </entry> -->\n};
+		print $fh qq{    <a:extra xmlns:x="urn:x$i" x:y="1">\nline\n</a:extra>\n} if $i % 7 == 0;
+		print $fh qq{  </entry>\n};
+	}
+	print $fh qq{</feed>\n<?done?>\n};
+	close $fh;
+	return $filename;
+}
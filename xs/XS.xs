@@ -7,6 +7,19 @@
 #include <gtk2perl.h>
 
 #include "code.h"
+#include "index.h"
+#include "xpath.h"
+#include "job.h"
+#include "parsejob.h"
+#include "recordindex.h"
+#include "nodeset.h"
+#include "textindex.h"
+#include "search.h"
+#include "dataguide.h"
+#include "resultcache.h"
+#include "namespaces.h"
+#include "analysis.h"
+#include "preorder.h"
 #include "libxml.h"
 
 
@@ -33,6 +46,826 @@ xacobeo_get_node_path(node, namespaces)
 	HV            *namespaces
 
 
+SV*
+xacobeo_get_node_paths(nodes, namespaces)
+	AV            *nodes
+	HV            *namespaces
+
+
+SV*
+xacobeo_get_namespaces(node)
+	xmlNodePtr    node
+
+
 gchar*
 xacobeo_get_node_mark(node)
 	xmlNodePtr    node
+
+
+gint
+xacobeo_xpath_get_error_offset(expression, namespaces)
+	const gchar   *expression
+	HV            *namespaces
+
+
+SV*
+xacobeo_xpath_preview(document, expression, namespaces, max, visits = 0)
+	SV            *document
+	const gchar   *expression
+	HV            *namespaces
+	guint         max
+	guint         visits
+
+
+SV*
+xacobeo_xpath_explain(document, expression, namespaces)
+	SV            *document
+	const gchar   *expression
+	HV            *namespaces
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::Index		PREFIX = xacobeo_index_
+
+
+XacobeoIndex*
+xacobeo_index_new(CLASS, document, namespaces)
+	char          *CLASS
+	SV            *document
+	HV            *namespaces
+	CODE:
+		RETVAL = xacobeo_index_new(document, namespaces);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+SV*
+xacobeo_index_resolve_path(index, path)
+	XacobeoIndex  *index
+	const gchar   *path
+
+
+SV*
+xacobeo_index_find(index, expression)
+	XacobeoIndex  *index
+	const gchar   *expression
+
+
+SV*
+xacobeo_index_find_attribute(index, name, value)
+	XacobeoIndex  *index
+	const gchar   *name
+	const gchar   *value
+
+
+void
+xacobeo_index_set_attribute_limit(index, limit)
+	XacobeoIndex  *index
+	gulong         limit
+
+
+void
+xacobeo_index_sort(index, set)
+	XacobeoIndex    *index
+	XacobeoNodeSet  *set
+
+
+SV*
+xacobeo_index_union(index, set, other)
+	XacobeoIndex    *index
+	XacobeoNodeSet  *set
+	XacobeoNodeSet  *other
+
+
+SV*
+xacobeo_index_intersect(index, set, other)
+	XacobeoIndex    *index
+	XacobeoNodeSet  *set
+	XacobeoNodeSet  *other
+
+
+void
+xacobeo_index_DESTROY(index)
+	XacobeoIndex  *index
+	CODE:
+		xacobeo_index_free(index);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::Analysis		PREFIX = xacobeo_analysis_
+
+
+XacobeoAnalysis*
+xacobeo_analysis_new(CLASS, document)
+	char          *CLASS
+	SV            *document
+	CODE:
+		RETVAL = xacobeo_analysis_new(document);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+XacobeoAnalysis*
+xacobeo_analysis_parse_file(CLASS, filename, progress = NULL)
+	char          *CLASS
+	const gchar   *filename
+	SV            *progress
+	CODE:
+		RETVAL = xacobeo_analysis_parse_file(filename, progress);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+XacobeoAnalysis*
+xacobeo_analysis_parse_string(CLASS, string)
+	char          *CLASS
+	SV            *string
+	PREINIT:
+		STRLEN length;
+		const gchar *buffer;
+	CODE:
+		buffer = SvPV(string, length);
+		RETVAL = xacobeo_analysis_parse_string(buffer, length);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+SV*
+xacobeo_analysis_document(analysis)
+	XacobeoAnalysis  *analysis
+
+
+SV*
+xacobeo_analysis_namespaces(analysis)
+	XacobeoAnalysis  *analysis
+
+
+SV*
+xacobeo_analysis_take_index(analysis)
+	XacobeoAnalysis  *analysis
+
+
+SV*
+xacobeo_analysis_take_dataguide(analysis)
+	XacobeoAnalysis  *analysis
+
+
+SV*
+xacobeo_analysis_preorder(analysis)
+	XacobeoAnalysis  *analysis
+
+
+SV*
+xacobeo_analysis_statistics(analysis)
+	XacobeoAnalysis  *analysis
+
+
+SV*
+xacobeo_analysis_find_id(analysis, id)
+	XacobeoAnalysis  *analysis
+	const gchar      *id
+
+
+void
+xacobeo_analysis_DESTROY(analysis)
+	XacobeoAnalysis  *analysis
+	CODE:
+		xacobeo_analysis_free(analysis);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::Loader		PREFIX = xacobeo_analysis_loader_
+
+
+XacobeoAnalysisLoader*
+xacobeo_analysis_loader_new(CLASS, filename = NULL)
+	char          *CLASS
+	const gchar   *filename
+	CODE:
+		RETVAL = xacobeo_analysis_loader_new(filename);
+	OUTPUT:
+		RETVAL
+
+
+gboolean
+xacobeo_analysis_loader_push(loader, chunk)
+	XacobeoAnalysisLoader  *loader
+	SV                     *chunk
+	PREINIT:
+		STRLEN length;
+		const gchar *buffer;
+	CODE:
+		buffer = SvPV(chunk, length);
+		RETVAL = xacobeo_analysis_loader_push(loader, buffer, length);
+	OUTPUT:
+		RETVAL
+
+
+SV*
+xacobeo_analysis_loader_snapshot(loader)
+	XacobeoAnalysisLoader  *loader
+
+
+SV*
+xacobeo_analysis_loader_finish(loader)
+	XacobeoAnalysisLoader  *loader
+
+
+void
+xacobeo_analysis_loader_DESTROY(loader)
+	XacobeoAnalysisLoader  *loader
+	CODE:
+		xacobeo_analysis_loader_free(loader);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::ParseJob		PREFIX = xacobeo_parse_job_
+
+
+XacobeoParseJob*
+xacobeo_parse_job_new_from_file(CLASS, filename, previews = FALSE, threads = 0)
+	char          *CLASS
+	const gchar   *filename
+	gboolean      previews
+	guint         threads
+	CODE:
+		RETVAL = xacobeo_parse_job_new_from_file(filename, previews, threads);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+XacobeoParseJob*
+xacobeo_parse_job_new_from_string(CLASS, content)
+	char          *CLASS
+	SV            *content
+	CODE:
+		RETVAL = xacobeo_parse_job_new_from_string(content);
+	OUTPUT:
+		RETVAL
+
+
+XacobeoParseJob*
+xacobeo_parse_job_new_from_fd(CLASS, fd, previews = FALSE)
+	char          *CLASS
+	gint          fd
+	gboolean      previews
+	CODE:
+		RETVAL = xacobeo_parse_job_new_from_fd(fd, previews);
+	OUTPUT:
+		RETVAL
+
+
+const gchar*
+xacobeo_parse_job_poll(job)
+	XacobeoParseJob  *job
+
+
+void
+xacobeo_parse_job_cancel(job)
+	XacobeoParseJob  *job
+
+
+gdouble
+xacobeo_parse_job_elapsed(job)
+	XacobeoParseJob  *job
+
+
+gdouble
+xacobeo_parse_job_progress(job)
+	XacobeoParseJob  *job
+
+
+gdouble
+xacobeo_parse_job_size(job)
+	XacobeoParseJob  *job
+
+
+const gchar*
+xacobeo_parse_job_error(job)
+	XacobeoParseJob  *job
+
+
+SV*
+xacobeo_parse_job_take_preview(job)
+	XacobeoParseJob  *job
+
+
+SV*
+xacobeo_parse_job_result(job)
+	XacobeoParseJob  *job
+
+
+void
+xacobeo_parse_job_DESTROY(job)
+	XacobeoParseJob  *job
+	CODE:
+		xacobeo_parse_job_free(job);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::RecordIndex		PREFIX = xacobeo_record_index_
+
+
+XacobeoRecordIndex*
+xacobeo_record_index_new(CLASS, filename, path)
+	char          *CLASS
+	const gchar   *filename
+	const gchar   *path
+	CODE:
+		RETVAL = xacobeo_record_index_new(filename, path);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+const gchar*
+xacobeo_record_index_poll(index)
+	XacobeoRecordIndex  *index
+
+
+void
+xacobeo_record_index_cancel(index)
+	XacobeoRecordIndex  *index
+
+
+gdouble
+xacobeo_record_index_elapsed(index)
+	XacobeoRecordIndex  *index
+
+
+gdouble
+xacobeo_record_index_progress(index)
+	XacobeoRecordIndex  *index
+
+
+gdouble
+xacobeo_record_index_size(index)
+	XacobeoRecordIndex  *index
+
+
+const gchar*
+xacobeo_record_index_error(index)
+	XacobeoRecordIndex  *index
+
+
+guint
+xacobeo_record_index_count(index)
+	XacobeoRecordIndex  *index
+
+
+SV*
+xacobeo_record_index_window(index, first, count)
+	XacobeoRecordIndex  *index
+	guint               first
+	guint               count
+
+
+void
+xacobeo_record_index_DESTROY(index)
+	XacobeoRecordIndex  *index
+	CODE:
+		xacobeo_record_index_free(index);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::Preorder		PREFIX = xacobeo_preorder_
+
+
+XacobeoPreorder*
+xacobeo_preorder_new(CLASS, document)
+	char          *CLASS
+	SV            *document
+	CODE:
+		RETVAL = xacobeo_preorder_new(document);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+guint
+xacobeo_preorder_size(preorder)
+	XacobeoPreorder  *preorder
+	CODE:
+		RETVAL = preorder->size;
+	OUTPUT:
+		RETVAL
+
+
+SV*
+xacobeo_preorder_get_position(preorder, node)
+	XacobeoPreorder  *preorder
+	xmlNodePtr       node
+	CODE:
+		gint position = xacobeo_preorder_position(preorder, node);
+		RETVAL = position < 0 ? &PL_sv_undef : newSViv(position);
+	OUTPUT:
+		RETVAL
+
+
+SV*
+xacobeo_preorder_get_subtree_size(preorder, node)
+	XacobeoPreorder  *preorder
+	xmlNodePtr       node
+	CODE:
+		gint position = xacobeo_preorder_position(preorder, node);
+		if (node == (xmlNodePtr) preorder->doc) {
+			RETVAL = newSVuv(preorder->size);
+		}
+		else {
+			RETVAL = position < 0 ? &PL_sv_undef : newSVuv(preorder->sizes[position]);
+		}
+	OUTPUT:
+		RETVAL
+
+
+gboolean
+xacobeo_preorder_is_ancestor(preorder, ancestor, node)
+	XacobeoPreorder  *preorder
+	xmlNodePtr       ancestor
+	xmlNodePtr       node
+
+
+void
+xacobeo_preorder_DESTROY(preorder)
+	XacobeoPreorder  *preorder
+	CODE:
+		xacobeo_preorder_unref(preorder);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::XPathCache		PREFIX = xacobeo_xpath_cache_
+
+
+XacobeoXPathCache*
+xacobeo_xpath_cache_new(CLASS, size)
+	char          *CLASS
+	guint         size
+	CODE:
+		RETVAL = xacobeo_xpath_cache_new(size);
+	OUTPUT:
+		RETVAL
+
+
+SV*
+xacobeo_xpath_cache_compile(cache, expression, namespaces)
+	XacobeoXPathCache  *cache
+	const gchar        *expression
+	HV                 *namespaces
+
+
+void
+xacobeo_xpath_cache_DESTROY(cache)
+	XacobeoXPathCache  *cache
+	CODE:
+		xacobeo_xpath_cache_free(cache);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::ResultCache		PREFIX = xacobeo_result_cache_
+
+
+XacobeoResultCache*
+xacobeo_result_cache_new(CLASS, document, limit)
+	char          *CLASS
+	SV            *document
+	gulong        limit
+	CODE:
+		RETVAL = xacobeo_result_cache_new(document, limit);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+SV*
+xacobeo_result_cache_lookup(cache, expression, generation)
+	XacobeoResultCache  *cache
+	const gchar         *expression
+	guint               generation
+
+
+gboolean
+xacobeo_result_cache_store(cache, expression, generation, set)
+	XacobeoResultCache  *cache
+	const gchar         *expression
+	guint               generation
+	XacobeoNodeSet      *set
+
+
+void
+xacobeo_result_cache_set_limit(cache, limit)
+	XacobeoResultCache  *cache
+	gulong              limit
+
+
+void
+xacobeo_result_cache_clear(cache)
+	XacobeoResultCache  *cache
+
+
+void
+xacobeo_result_cache_DESTROY(cache)
+	XacobeoResultCache  *cache
+	CODE:
+		xacobeo_result_cache_free(cache);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::XPathJob		PREFIX = xacobeo_xpath_job_
+
+
+XacobeoXPathJob*
+xacobeo_xpath_job_new(CLASS, document, expression, namespaces, timeout, max_nodes, threads = 0)
+	char          *CLASS
+	SV            *document
+	const gchar   *expression
+	HV            *namespaces
+	gdouble       timeout
+	guint         max_nodes
+	guint         threads
+	CODE:
+		RETVAL = xacobeo_xpath_job_new(document, expression, namespaces, timeout, max_nodes, threads);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+XacobeoXPathJob*
+xacobeo_xpath_job_new_explain(CLASS, document, expression, namespaces, timeout)
+	char          *CLASS
+	SV            *document
+	const gchar   *expression
+	HV            *namespaces
+	gdouble       timeout
+	CODE:
+		RETVAL = xacobeo_xpath_job_new_explain(document, expression, namespaces, timeout);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+const gchar*
+xacobeo_xpath_job_poll(job)
+	XacobeoXPathJob  *job
+
+
+void
+xacobeo_xpath_job_cancel(job)
+	XacobeoXPathJob  *job
+
+
+gdouble
+xacobeo_xpath_job_elapsed(job)
+	XacobeoXPathJob  *job
+
+
+gulong
+xacobeo_xpath_job_progress(job)
+	XacobeoXPathJob  *job
+
+
+const gchar*
+xacobeo_xpath_job_error(job)
+	XacobeoXPathJob  *job
+
+
+SV*
+xacobeo_xpath_job_result(job)
+	XacobeoXPathJob  *job
+
+
+void
+xacobeo_xpath_job_DESTROY(job)
+	XacobeoXPathJob  *job
+	CODE:
+		xacobeo_xpath_job_free(job);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::NodeSet		PREFIX = xacobeo_nodeset_
+
+
+XacobeoNodeSet*
+xacobeo_nodeset_new_from_list(CLASS, document, nodes)
+	char          *CLASS
+	SV            *document
+	AV            *nodes
+	CODE:
+		RETVAL = xacobeo_nodeset_new_from_list(document, nodes);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+XacobeoNodeSet*
+xacobeo_nodeset_find(CLASS, document, expression, namespaces)
+	char          *CLASS
+	SV            *document
+	const gchar   *expression
+	HV            *namespaces
+	CODE:
+		RETVAL = xacobeo_nodeset_find(document, expression, namespaces);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+gint
+xacobeo_nodeset_size(set)
+	XacobeoNodeSet  *set
+
+
+SV*
+xacobeo_nodeset_slice(set, offset, count)
+	XacobeoNodeSet  *set
+	gint            offset
+	gint            count
+
+
+void
+xacobeo_nodeset_render(set, buffer, offset, count, namespaces)
+	XacobeoNodeSet  *set
+	GtkTextBuffer   *buffer
+	gint            offset
+	gint            count
+	HV              *namespaces
+
+
+void
+xacobeo_nodeset_DESTROY(set)
+	XacobeoNodeSet  *set
+	CODE:
+		xacobeo_nodeset_free(set);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::TextIndex		PREFIX = xacobeo_text_index_
+
+
+XacobeoTextIndex*
+xacobeo_text_index_new(CLASS, document, limit = 0, preorder = NULL)
+	char             *CLASS
+	SV               *document
+	gulong            limit
+	XacobeoPreorder  *preorder
+	CODE:
+		RETVAL = xacobeo_text_index_new(document, limit, preorder);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+const gchar*
+xacobeo_text_index_poll(index)
+	XacobeoTextIndex  *index
+
+
+void
+xacobeo_text_index_wait(index)
+	XacobeoTextIndex  *index
+
+
+gdouble
+xacobeo_text_index_elapsed(index)
+	XacobeoTextIndex  *index
+
+
+SV*
+xacobeo_text_index_search(index, text)
+	XacobeoTextIndex  *index
+	const gchar       *text
+
+
+SV*
+xacobeo_text_index_find(index, expression)
+	XacobeoTextIndex  *index
+	const gchar       *expression
+
+
+void
+xacobeo_text_index_DESTROY(index)
+	XacobeoTextIndex  *index
+	CODE:
+		xacobeo_text_index_free(index);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::TextSearch		PREFIX = xacobeo_text_search_
+
+
+XacobeoTextSearch*
+xacobeo_text_search_new(CLASS, buffer, pattern, is_regex, threads = 0)
+	char          *CLASS
+	GtkTextBuffer *buffer
+	const gchar   *pattern
+	gboolean      is_regex
+	guint         threads
+	PREINIT:
+		gchar *error = NULL;
+	CODE:
+		RETVAL = xacobeo_text_search_new(buffer, pattern, is_regex, threads, &error);
+		if (RETVAL == NULL) {
+			SV *message = sv_2mortal(newSVpv(error, 0));
+			g_free(error);
+			croak("%" SVf, SVfARG(message));
+		}
+	OUTPUT:
+		RETVAL
+
+
+gint
+xacobeo_text_search_size(search)
+	XacobeoTextSearch  *search
+
+
+gint
+xacobeo_text_search_find(search, offset, forward)
+	XacobeoTextSearch  *search
+	gint               offset
+	gboolean           forward
+
+
+void
+xacobeo_text_search_get_match(search, i)
+	XacobeoTextSearch  *search
+	gint               i
+	PREINIT:
+		gint start;
+		gint end;
+	PPCODE:
+		xacobeo_text_search_get_match(search, i, &start, &end);
+		if (start < 0) {
+			XSRETURN_EMPTY;
+		}
+		EXTEND(SP, 2);
+		mPUSHi(start);
+		mPUSHi(end);
+
+
+void
+xacobeo_text_search_highlight(search, buffer, tag, start, end)
+	XacobeoTextSearch  *search
+	GtkTextBuffer      *buffer
+	const gchar        *tag
+	gint               start
+	gint               end
+
+
+void
+xacobeo_text_search_DESTROY(search)
+	XacobeoTextSearch  *search
+	CODE:
+		xacobeo_text_search_free(search);
+
+
+MODULE = Xacobeo::XS		PACKAGE = Xacobeo::XS::DataGuide		PREFIX = xacobeo_dataguide_
+
+
+XacobeoDataGuide*
+xacobeo_dataguide_new(CLASS, document, namespaces)
+	char          *CLASS
+	SV            *document
+	HV            *namespaces
+	CODE:
+		RETVAL = xacobeo_dataguide_new(document, namespaces);
+		if (RETVAL == NULL) {
+			XSRETURN_UNDEF;
+		}
+	OUTPUT:
+		RETVAL
+
+
+SV*
+xacobeo_dataguide_summary(guide)
+	XacobeoDataGuide  *guide
+
+
+SV*
+xacobeo_dataguide_complete(guide, expression)
+	XacobeoDataGuide  *guide
+	const gchar       *expression
+
+
+void
+xacobeo_dataguide_DESTROY(guide)
+	XacobeoDataGuide  *guide
+	CODE:
+		xacobeo_dataguide_free(guide);
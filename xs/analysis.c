@@ -0,0 +1,778 @@
+//
+// Analysis of a document in a single walk.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "analysis.h"
+#include "namespaces.h"
+#include "loader.h"
+#include "logger.h"
+#include "libxml.h"
+
+#include <libxml/valid.h>
+
+
+//
+// The state of the walk: the namespaces found and the paths of the summary
+// where the children of the elements being visited go. The first path is the
+// root of the summary. The path of the last element added is kept until the
+// element is opened. When the document is parsed the progress of the parse is
+// given to a Perl callback, if any.
+//
+typedef struct _AnalysisWalk {
+	XacobeoAnalysis *analysis;
+	XacobeoNamespaceList *namespaces;
+	GPtrArray *paths;
+	DataGuideNode *path;
+	guint position;
+	SV *progress;
+} AnalysisWalk;
+
+
+//
+// An analysis done while the document is given to the parser by chunks. The
+// timer only runs while the parser works. The document is kept once the parse
+// is closed until the analysis is finished.
+//
+struct _XacobeoAnalysisLoader {
+	XacobeoLoader *loader;
+	AnalysisWalk walk;
+	GTimer *timer;
+	xmlDoc *doc;
+	gboolean fed;
+};
+
+
+//
+// Function prototypes
+//
+static XacobeoAnalysis* my_analysis_begin     (xmlDoc *doc, AnalysisWalk *walk);
+static void             my_analysis_walk      (XacobeoAnalysis *analysis, AnalysisWalk *walk);
+static void             my_analysis_end       (XacobeoAnalysis *analysis, AnalysisWalk *walk, SV *document);
+static XacobeoAnalysis* my_analysis_parsed    (xmlDoc *doc, AnalysisWalk *walk, gboolean fed, GTimer *timer);
+static void             my_analysis_abort     (AnalysisWalk *walk);
+static void             my_add_node           (XacobeoAnalysis *analysis, AnalysisWalk *walk, xmlNode *node);
+static void             my_add_element        (XacobeoAnalysis *analysis, AnalysisWalk *walk, xmlNode *element);
+static void             my_open_element       (XacobeoAnalysis *analysis, AnalysisWalk *walk);
+static void             my_close_element      (XacobeoAnalysis *analysis, AnalysisWalk *walk);
+static void             my_add_id             (XacobeoAnalysis *analysis, xmlNode *element, xmlAttr *attr);
+static void             my_hook_start         (xmlDoc *doc, gpointer data);
+static void             my_hook_open          (xmlNode *element, gpointer data);
+static void             my_hook_node          (xmlNode *node, gpointer data);
+static void             my_hook_close         (xmlNode *element, gpointer data);
+static void             my_hook_progress      (goffset consumed, goffset total, gpointer data);
+
+
+// The hooks that analyze a document while it's parsed
+static const XacobeoLoaderHooks ANALYSIS_HOOKS = {
+	.start = my_hook_start,
+	.open  = my_hook_open,
+	.node  = my_hook_node,
+	.close = my_hook_close,
+	.progress = my_hook_progress,
+};
+
+
+
+//
+// Analyzes the given document. The document is walked once, without recursion,
+// and each node is visited only once: the namespaces, the preorder mirror, the
+// index, the DataGuide, the ID table and the statistics are all built by the
+// same walk. This replaces a walk per structure and keeps the nodes in the
+// cache while they are analyzed.
+//
+// The analysis has to be freed with xacobeo_analysis_free().
+//
+XacobeoAnalysis* xacobeo_analysis_new (SV *document) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL) {
+		WARN("Document has no node");
+		return NULL;
+	}
+
+	GTimer *timer = g_timer_new();
+
+	AnalysisWalk walk;
+	XacobeoAnalysis *analysis = my_analysis_begin(node->doc, &walk);
+	my_analysis_walk(analysis, &walk);
+	my_analysis_end(analysis, &walk, document);
+
+	analysis->elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+	INFO("Analyzed %lu elements in %.3fs", analysis->elements, analysis->elapsed);
+
+	return analysis;
+}
+
+
+
+//
+// Parses the given file and analyzes the document while it's built: the
+// structures are fed by the parser, without walking the document afterwards.
+// The document is then available through xacobeo_analysis_document(). If the
+// parser recovers from an error in a way that the analysis can't follow the
+// document is walked once parsed.
+//
+// The progress callback, if given, is called with the number of bytes parsed
+// and the size of the file while the file is parsed.
+//
+// Returns NULL if the file can't be parsed natively (it's not a local file or
+// there's no document), the caller has to parse the file by other means.
+//
+XacobeoAnalysis* xacobeo_analysis_parse_file (const gchar *filename, SV *progress) {
+	GTimer *timer = g_timer_new();
+
+	AnalysisWalk walk = {
+		.analysis = NULL,
+		.progress = progress && SvOK(progress) ? progress : NULL,
+	};
+	gboolean fed;
+	xmlDoc *doc = xacobeo_loader_parse_file(filename, &ANALYSIS_HOOKS, &walk, &fed);
+
+	return my_analysis_parsed(doc, &walk, fed, timer);
+}
+
+
+
+//
+// Parses the given string and analyzes the document while it's built, see
+// xacobeo_analysis_parse_file().
+//
+XacobeoAnalysis* xacobeo_analysis_parse_string (const gchar *buffer, gsize size) {
+	GTimer *timer = g_timer_new();
+
+	AnalysisWalk walk = { .analysis = NULL };
+	gboolean fed;
+	xmlDoc *doc = xacobeo_loader_parse_memory(buffer, size, &ANALYSIS_HOOKS, &walk, &fed);
+
+	return my_analysis_parsed(doc, &walk, fed, timer);
+}
+
+
+
+//
+// Creates a loader that analyzes a document given by chunks while it's parsed,
+// see xacobeo_analysis_parse_file(). The filename is used for the URL of the
+// document and for resolving the DTD, it can be NULL.
+//
+// The loader has to be freed with xacobeo_analysis_loader_free().
+//
+XacobeoAnalysisLoader* xacobeo_analysis_loader_new (const gchar *filename) {
+	XacobeoAnalysisLoader *loader = g_new0(XacobeoAnalysisLoader, 1);
+	loader->loader = xacobeo_loader_new(filename, &ANALYSIS_HOOKS, &loader->walk);
+	loader->timer = g_timer_new();
+	g_timer_stop(loader->timer);
+	return loader;
+}
+
+
+
+//
+// Sets the encoding of the document, see xacobeo_loader_set_encoding().
+//
+void xacobeo_analysis_loader_set_encoding (XacobeoAnalysisLoader *loader, const gchar *encoding) {
+	if (loader->loader) {
+		xacobeo_loader_set_encoding(loader->loader, encoding);
+	}
+}
+
+
+
+//
+// Parses the next bytes of the document. Returns FALSE once the parser stopped
+// or the parse was completed, the bytes are then ignored.
+//
+gboolean xacobeo_analysis_loader_push (XacobeoAnalysisLoader *loader, const gchar *buffer, gsize size) {
+	if (loader->loader == NULL) {
+		return FALSE;
+	}
+
+	g_timer_continue(loader->timer);
+	gboolean parsing = xacobeo_loader_push(loader->loader, buffer, size);
+	g_timer_stop(loader->timer);
+
+	return parsing;
+}
+
+
+
+//
+// Returns a copy of the part of the document parsed so far or NULL if the root
+// element wasn't parsed yet. The copy doesn't change while the parse goes on.
+// This function doesn't involve Perl.
+//
+// The copy has to be freed with xmlFreeDoc().
+//
+xmlDoc* xacobeo_analysis_loader_copy (XacobeoAnalysisLoader *loader) {
+	if (loader->loader == NULL) {
+		return NULL;
+	}
+
+	xmlDoc *doc = xacobeo_loader_peek(loader->loader);
+	if (doc == NULL || xmlDocGetRootElement(doc) == NULL) {
+		return NULL;
+	}
+
+	return xmlCopyDoc(doc, 1);
+}
+
+
+
+//
+// Returns a copy of the part of the document parsed so far (an
+// XML::LibXML::Document) or undef if the root element wasn't parsed yet, see
+// xacobeo_analysis_loader_copy().
+//
+SV* xacobeo_analysis_loader_snapshot (XacobeoAnalysisLoader *loader) {
+	xmlDoc *copy = xacobeo_analysis_loader_copy(loader);
+	if (copy == NULL) {
+		return &PL_sv_undef;
+	}
+
+	return PmmNodeToSv((xmlNode *) copy, NULL);
+}
+
+
+
+//
+// Completes the parse without finishing the analysis, the remaining work
+// doesn't involve Perl. This way the parse can be done by a worker thread and
+// the analysis finished by the thread that runs Perl. Returns FALSE if there's
+// no document.
+//
+gboolean xacobeo_analysis_loader_close (XacobeoAnalysisLoader *loader) {
+	if (loader->loader == NULL) {
+		return loader->doc != NULL;
+	}
+
+	g_timer_continue(loader->timer);
+	loader->doc = xacobeo_loader_finish(loader->loader, &loader->fed);
+	loader->loader = NULL;
+	g_timer_stop(loader->timer);
+
+	return loader->doc != NULL;
+}
+
+
+
+//
+// Gives to the loader a document parsed by other means instead of the chunks
+// (see records.c), the document is walked right away. Like
+// xacobeo_analysis_loader_close() this doesn't involve Perl. The loader takes
+// the ownership of the document.
+//
+void xacobeo_analysis_loader_take (XacobeoAnalysisLoader *loader, xmlDoc *doc) {
+
+	g_timer_continue(loader->timer);
+	my_analysis_abort(&loader->walk);
+	if (loader->loader) {
+		xacobeo_loader_free(loader->loader);
+		loader->loader = NULL;
+	}
+	if (loader->doc) {
+		xmlFreeDoc(loader->doc);
+	}
+
+	my_analysis_walk(my_analysis_begin(doc, &loader->walk), &loader->walk);
+	loader->doc = doc;
+	loader->fed = TRUE;
+	g_timer_stop(loader->timer);
+}
+
+
+
+//
+// Completes the parse. Returns the analysis of the document (an
+// Xacobeo::XS::Analysis) or undef if there's no document.
+//
+SV* xacobeo_analysis_loader_finish (XacobeoAnalysisLoader *loader) {
+	if (loader->timer == NULL) {
+		return &PL_sv_undef;
+	}
+	xacobeo_analysis_loader_close(loader);
+
+	g_timer_continue(loader->timer);
+	XacobeoAnalysis *analysis = my_analysis_parsed(loader->doc, &loader->walk, loader->fed, loader->timer);
+	loader->doc = NULL;
+	loader->timer = NULL;
+	if (analysis == NULL) {
+		return &PL_sv_undef;
+	}
+
+	return sv_setref_pv(newSV(0), "Xacobeo::XS::Analysis", analysis);
+}
+
+
+
+//
+// Frees the loader. The document is dropped if the analysis wasn't finished.
+//
+void xacobeo_analysis_loader_free (XacobeoAnalysisLoader *loader) {
+	if (loader == NULL) {
+		return;
+	}
+
+	// The analysis refers to the nodes, it goes first
+	my_analysis_abort(&loader->walk);
+	if (loader->loader) {
+		xacobeo_loader_free(loader->loader);
+	}
+	if (loader->doc) {
+		xmlFreeDoc(loader->doc);
+	}
+	if (loader->timer) {
+		g_timer_destroy(loader->timer);
+	}
+	g_free(loader);
+}
+
+
+
+//
+// Frees the analysis. The index and the DataGuide are freed only if they were
+// not taken. The document is not freed by this function, it's only released.
+//
+void xacobeo_analysis_free (XacobeoAnalysis *analysis) {
+	if (analysis == NULL) {
+		return;
+	}
+
+	xacobeo_index_free(analysis->index);
+	xacobeo_dataguide_free(analysis->dataguide);
+	xacobeo_preorder_unref(analysis->preorder);
+	g_array_free(analysis->depths, TRUE);
+	g_hash_table_destroy(analysis->ids);
+	SvREFCNT_dec(analysis->namespaces);
+	SvREFCNT_dec(analysis->document);
+	g_free(analysis);
+}
+
+
+
+//
+// Returns the document analyzed (an XML::LibXML::Document).
+//
+SV* xacobeo_analysis_document (XacobeoAnalysis *analysis) {
+	return newSVsv(analysis->document);
+}
+
+
+
+//
+// Returns the namespaces of the document in a Perl hash ref (key: uri, value:
+// prefix). The prefixes are the same as the ones of xacobeo_get_namespaces().
+//
+SV* xacobeo_analysis_namespaces (XacobeoAnalysis *analysis) {
+	return newSVsv(analysis->namespaces);
+}
+
+
+
+//
+// Returns the index built by the analysis (as a Xacobeo::XS::Index). The index
+// can be taken only once, the next calls return undef.
+//
+SV* xacobeo_analysis_take_index (XacobeoAnalysis *analysis) {
+	if (analysis->index == NULL) {
+		return &PL_sv_undef;
+	}
+
+	SV *sv = sv_setref_pv(newSV(0), "Xacobeo::XS::Index", analysis->index);
+	analysis->index = NULL;
+	return sv;
+}
+
+
+
+//
+// Returns the summary of the paths built by the analysis (as a
+// Xacobeo::XS::DataGuide). The summary can be taken only once, the next calls
+// return undef.
+//
+SV* xacobeo_analysis_take_dataguide (XacobeoAnalysis *analysis) {
+	if (analysis->dataguide == NULL) {
+		return &PL_sv_undef;
+	}
+
+	SV *sv = sv_setref_pv(newSV(0), "Xacobeo::XS::DataGuide", analysis->dataguide);
+	analysis->dataguide = NULL;
+	return sv;
+}
+
+
+
+//
+// Returns the preorder mirror built by the analysis (as a
+// Xacobeo::XS::Preorder). The mirror is shared, it's released once the
+// analysis and all the Perl objects that use it are gone.
+//
+SV* xacobeo_analysis_preorder (XacobeoAnalysis *analysis) {
+	return xacobeo_preorder_to_sv(analysis->preorder);
+}
+
+
+
+//
+// Returns the statistics of the document in a Perl hash ref: the number of
+// nodes of each kind, the number of IDs, the maximal depth, the number of
+// elements at each depth (an array ref starting at depth 1) and the time spent
+// by the analysis.
+//
+SV* xacobeo_analysis_statistics (XacobeoAnalysis *analysis) {
+
+	AV *depths = newAV();
+	for (guint i = 0; i < analysis->depths->len; ++i) {
+		av_push(depths, newSVuv(g_array_index(analysis->depths, guint, i)));
+	}
+
+	HV *statistics = newHV();
+	hv_store(statistics, "elements", 8, newSVuv(analysis->elements), 0);
+	hv_store(statistics, "attributes", 10, newSVuv(analysis->attributes), 0);
+	hv_store(statistics, "texts", 5, newSVuv(analysis->texts), 0);
+	hv_store(statistics, "comments", 8, newSVuv(analysis->comments), 0);
+	hv_store(statistics, "processing_instructions", 23, newSVuv(analysis->pis), 0);
+	hv_store(statistics, "ids", 3, newSVuv(g_hash_table_size(analysis->ids)), 0);
+	hv_store(statistics, "depth", 5, newSVuv(analysis->depths->len), 0);
+	hv_store(statistics, "depths", 6, newRV_noinc((SV *) depths), 0);
+	hv_store(statistics, "elapsed", 7, newSVnv(analysis->elapsed), 0);
+
+	return newRV_noinc((SV *) statistics);
+}
+
+
+
+//
+// Returns the element that has the given ID or undef if there's no such
+// element. If many elements have the same ID the first one is returned.
+//
+SV* xacobeo_analysis_find_id (XacobeoAnalysis *analysis, const gchar *id) {
+	xmlNode *node = id ? g_hash_table_lookup(analysis->ids, id) : NULL;
+	if (node == NULL) {
+		return &PL_sv_undef;
+	}
+
+	ProxyNode *owner = PmmOWNERPO(PmmPROXYNODE(((xmlNode *) analysis->doc)));
+	return PmmNodeToSv(node, owner);
+}
+
+
+
+//
+// Starts an analysis of the given document, the nodes are then given to
+// my_add_node() in document order. Perl is not involved until the analysis is
+// ended, the nodes can be added by any thread.
+//
+static XacobeoAnalysis* my_analysis_begin (xmlDoc *doc, AnalysisWalk *walk) {
+
+	XacobeoAnalysis *analysis = g_new0(XacobeoAnalysis, 1);
+	analysis->doc = doc;
+	analysis->preorder = xacobeo_preorder_begin(doc);
+	analysis->index = xacobeo_index_begin(doc, analysis->preorder->positions);
+	analysis->dataguide = xacobeo_dataguide_begin();
+	analysis->depths = g_array_new(FALSE, TRUE, sizeof(guint));
+	analysis->ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	walk->analysis = analysis;
+	walk->namespaces = xacobeo_namespace_list_new();
+	walk->paths = g_ptr_array_new();
+	walk->path = NULL;
+	walk->position = 0;
+	g_ptr_array_add(walk->paths, analysis->dataguide->root);
+
+	return analysis;
+}
+
+
+
+//
+// Gives all the nodes of the document to the analysis. The document is walked
+// without recursion, only the elements are descended.
+//
+static void my_analysis_walk (XacobeoAnalysis *analysis, AnalysisWalk *walk) {
+
+	xmlNode *top = (xmlNode *) analysis->doc;
+	xmlNode *node = top->children;
+	while (node) {
+		my_add_node(analysis, walk, node);
+
+		if (node->type == XML_ELEMENT_NODE && node->children) {
+			my_open_element(analysis, walk);
+			node = node->children;
+			continue;
+		}
+
+		// Go to the next node, closing the elements that are done
+		while (node != top && node->next == NULL) {
+			node = node->parent;
+			if (node != top) {
+				my_close_element(analysis, walk);
+			}
+		}
+		node = node == top ? NULL : node->next;
+	}
+}
+
+
+
+//
+// Completes the analysis once all the nodes were given. The namespaces are
+// known, the structures that use them can be completed. The structures keep
+// the given document (an XML::LibXML::Document) alive.
+//
+static void my_analysis_end (XacobeoAnalysis *analysis, AnalysisWalk *walk, SV *document) {
+
+	analysis->document = newSVsv(document);
+	xacobeo_preorder_end(analysis->preorder, document);
+	analysis->namespaces = xacobeo_namespace_list_to_sv(walk->namespaces);
+	HV *namespaces = (HV *) SvRV(analysis->namespaces);
+	xacobeo_index_end(analysis->index, document, namespaces);
+	xacobeo_dataguide_end(analysis->dataguide, namespaces);
+
+	xacobeo_namespace_list_free(walk->namespaces);
+	g_ptr_array_free(walk->paths, TRUE);
+	walk->analysis = NULL;
+	walk->namespaces = NULL;
+	walk->paths = NULL;
+}
+
+
+
+//
+// Completes the analysis of a document that was parsed. If the parser couldn't
+// feed all the nodes the partial analysis is dropped and the document is
+// walked instead.
+//
+static XacobeoAnalysis* my_analysis_parsed (xmlDoc *doc, AnalysisWalk *walk, gboolean fed, GTimer *timer) {
+
+	XacobeoAnalysis *analysis = walk->analysis;
+	if (doc == NULL) {
+		g_timer_destroy(timer);
+		my_analysis_abort(walk);
+		return NULL;
+	}
+
+	// The wrapper of the document is created once the parser is done, this way
+	// it knows the encoding of the document
+	SV *document = PmmNodeToSv((xmlNode *) doc, NULL);
+
+	if (analysis && fed) {
+		my_analysis_end(analysis, walk, document);
+		SvREFCNT_dec(document);
+		analysis->elapsed = g_timer_elapsed(timer, NULL);
+		g_timer_destroy(timer);
+		INFO("Parsed and analyzed %lu elements in %.3fs", analysis->elements, analysis->elapsed);
+		return analysis;
+	}
+	g_timer_destroy(timer);
+
+	DEBUG("The parser didn't give all the nodes, walking the document");
+	my_analysis_abort(walk);
+	analysis = xacobeo_analysis_new(document);
+	SvREFCNT_dec(document);
+
+	return analysis;
+}
+
+
+
+//
+// Drops the analysis in progress, if any.
+//
+static void my_analysis_abort (AnalysisWalk *walk) {
+	if (walk->analysis == NULL) {
+		return;
+	}
+
+	xacobeo_namespace_list_free(walk->namespaces);
+	g_ptr_array_free(walk->paths, TRUE);
+	xacobeo_analysis_free(walk->analysis);
+	walk->analysis = NULL;
+}
+
+
+
+//
+// Feeds a node to all the structures. An element becomes the parent of the
+// nodes added next once it's opened with my_open_element().
+//
+static void my_add_node (XacobeoAnalysis *analysis, AnalysisWalk *walk, xmlNode *node) {
+
+	walk->position = xacobeo_preorder_add(analysis->preorder, node);
+	switch (node->type) {
+		case XML_ELEMENT_NODE:
+			my_add_element(analysis, walk, node);
+		break;
+
+		case XML_TEXT_NODE:
+		case XML_CDATA_SECTION_NODE:
+			++analysis->texts;
+		break;
+
+		case XML_COMMENT_NODE:
+			++analysis->comments;
+		break;
+
+		case XML_PI_NODE:
+			++analysis->pis;
+		break;
+
+		default:
+		break;
+	}
+}
+
+
+
+//
+// Feeds an element to all the structures.
+//
+static void my_add_element (XacobeoAnalysis *analysis, AnalysisWalk *walk, xmlNode *element) {
+
+	++analysis->elements;
+	guint depth = walk->paths->len;
+
+	xacobeo_index_add(analysis->index, element);
+
+	// The first element brings the namespaces in scope, the others only the
+	// namespaces that they declare
+	if (analysis->elements == 1) {
+		xacobeo_namespace_list_add_scope(walk->namespaces, element);
+	}
+	else {
+		xacobeo_namespace_list_add_element(walk->namespaces, element);
+	}
+
+	if (analysis->depths->len < depth) {
+		g_array_set_size(analysis->depths, depth);
+	}
+	++g_array_index(analysis->depths, guint, depth - 1);
+
+	for (xmlAttr *attr = element->properties; attr; attr = attr->next) {
+		++analysis->attributes;
+		if (xmlIsID(element->doc, element, attr)) {
+			my_add_id(analysis, element, attr);
+		}
+	}
+
+	DataGuideNode *parent = g_ptr_array_index(walk->paths, depth - 1);
+	walk->path = xacobeo_dataguide_add(analysis->dataguide, parent, element);
+}
+
+
+
+//
+// Opens the last element added, the nodes added next are its children until
+// it's closed.
+//
+static void my_open_element (XacobeoAnalysis *analysis, AnalysisWalk *walk) {
+	xacobeo_preorder_enter(analysis->preorder, walk->position);
+	g_ptr_array_add(walk->paths, walk->path);
+}
+
+
+
+//
+// Closes the last element opened, all its children were visited.
+//
+static void my_close_element (XacobeoAnalysis *analysis, AnalysisWalk *walk) {
+	xacobeo_preorder_leave(analysis->preorder);
+	g_ptr_array_set_size(walk->paths, walk->paths->len - 1);
+}
+
+
+
+//
+// Adds the ID of an element to the ID table. The first element seen with an ID
+// keeps it.
+//
+static void my_add_id (XacobeoAnalysis *analysis, xmlNode *element, xmlAttr *attr) {
+	xmlChar *value = xmlNodeListGetString(element->doc, attr->children, 1);
+	if (value == NULL) {
+		return;
+	}
+
+	if (! g_hash_table_lookup(analysis->ids, value)) {
+		g_hash_table_insert(analysis->ids, g_strdup((const gchar *) value), element);
+	}
+	xmlFree(value);
+}
+
+
+
+//
+// Parser hook: the document was created, its analysis starts.
+//
+static void my_hook_start (xmlDoc *doc, gpointer data) {
+	AnalysisWalk *walk = (AnalysisWalk *) data;
+	my_analysis_begin(doc, walk);
+}
+
+
+
+//
+// Parser hook: an element starts.
+//
+static void my_hook_open (xmlNode *element, gpointer data) {
+	AnalysisWalk *walk = (AnalysisWalk *) data;
+	my_add_node(walk->analysis, walk, element);
+	my_open_element(walk->analysis, walk);
+}
+
+
+
+//
+// Parser hook: a node that's not an element.
+//
+static void my_hook_node (xmlNode *node, gpointer data) {
+	AnalysisWalk *walk = (AnalysisWalk *) data;
+	my_add_node(walk->analysis, walk, node);
+}
+
+
+
+//
+// Parser hook: an element ends.
+//
+static void my_hook_close (xmlNode *element, gpointer data) {
+	AnalysisWalk *walk = (AnalysisWalk *) data;
+	my_close_element(walk->analysis, walk);
+}
+
+
+
+//
+// Parser hook: gives the progress of the parse to the Perl callback. A callback
+// that dies is not called anymore.
+//
+static void my_hook_progress (goffset consumed, goffset total, gpointer data) {
+	AnalysisWalk *walk = (AnalysisWalk *) data;
+	if (walk->progress == NULL) {
+		return;
+	}
+
+	dSP;
+	ENTER;
+	SAVETMPS;
+
+	PUSHMARK(SP);
+	XPUSHs(sv_2mortal(newSVnv((NV) consumed)));
+	XPUSHs(sv_2mortal(newSVnv((NV) total)));
+	PUTBACK;
+
+	call_sv(walk->progress, G_DISCARD | G_EVAL);
+	if (SvTRUE(ERRSV)) {
+		WARN("Progress callback failed: %s", SvPV_nolen(ERRSV));
+		walk->progress = NULL;
+	}
+
+	FREETMPS;
+	LEAVE;
+}
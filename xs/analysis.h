@@ -0,0 +1,98 @@
+#ifndef __XACOBEO_ANALYSIS_H__
+#define __XACOBEO_ANALYSIS_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <glib.h>
+#include <libxml/tree.h>
+
+#include "index.h"
+#include "dataguide.h"
+#include "preorder.h"
+
+
+//
+// The information collected about a document when it's loaded. The document is
+// walked once and each element feeds all the structures at the same time: the
+// namespaces, the preorder mirror, the index of the element names, the
+// DataGuide, the ID table and the statistics. The index and the DataGuide are
+// then handed over to the document. When the document is parsed natively the
+// structures are fed by the parser instead of a walk.
+//
+typedef struct _XacobeoAnalysis {
+
+	// The document analyzed
+	xmlDoc *doc;
+
+	// The Perl document (XML::LibXML::Document), it's kept in order to ensure
+	// that the document is not freed while the analysis is alive.
+	SV *document;
+
+	// The namespaces of the document (a Perl hash ref of type uri => prefix)
+	SV *namespaces;
+
+	// The index and the summary of the paths built by the walk, they are NULL
+	// once taken
+	XacobeoIndex *index;
+	XacobeoDataGuide *dataguide;
+
+	// The mirror of the nodes in preorder, its positions are shared with the
+	// index
+	XacobeoPreorder *preorder;
+
+	// The number of elements found at each depth (the root element is at
+	// depth 1 and its count is stored at offset 0)
+	GArray *depths;
+
+	// The elements that have an ID (key: value of the ID, value: xmlNode*)
+	GHashTable *ids;
+
+	// The number of nodes found by kind
+	gulong elements;
+	gulong attributes;
+	gulong texts;
+	gulong comments;
+	gulong pis;
+
+	// The time spent walking the document, or parsing it when the analysis is
+	// done by the parser, in seconds
+	gdouble elapsed;
+
+} XacobeoAnalysis;
+
+
+//
+// An analysis done while a document is parsed by chunks, this way the document
+// can be loaded progressively (for instance from a pipe).
+//
+typedef struct _XacobeoAnalysisLoader XacobeoAnalysisLoader;
+
+
+// Public prototypes
+XacobeoAnalysis* xacobeo_analysis_new              (SV *document);
+XacobeoAnalysis* xacobeo_analysis_parse_file       (const gchar *filename, SV *progress);
+XacobeoAnalysis* xacobeo_analysis_parse_string     (const gchar *buffer, gsize size);
+void             xacobeo_analysis_free             (XacobeoAnalysis *analysis);
+SV*              xacobeo_analysis_document         (XacobeoAnalysis *analysis);
+SV*              xacobeo_analysis_namespaces       (XacobeoAnalysis *analysis);
+SV*              xacobeo_analysis_take_index       (XacobeoAnalysis *analysis);
+SV*              xacobeo_analysis_take_dataguide   (XacobeoAnalysis *analysis);
+SV*              xacobeo_analysis_preorder         (XacobeoAnalysis *analysis);
+SV*              xacobeo_analysis_statistics       (XacobeoAnalysis *analysis);
+SV*              xacobeo_analysis_find_id          (XacobeoAnalysis *analysis, const gchar *id);
+
+XacobeoAnalysisLoader* xacobeo_analysis_loader_new      (const gchar *filename);
+void                   xacobeo_analysis_loader_set_encoding (XacobeoAnalysisLoader *loader, const gchar *encoding);
+gboolean               xacobeo_analysis_loader_push     (XacobeoAnalysisLoader *loader, const gchar *buffer, gsize size);
+xmlDoc*                xacobeo_analysis_loader_copy     (XacobeoAnalysisLoader *loader);
+SV*                    xacobeo_analysis_loader_snapshot (XacobeoAnalysisLoader *loader);
+gboolean               xacobeo_analysis_loader_close    (XacobeoAnalysisLoader *loader);
+void                   xacobeo_analysis_loader_take     (XacobeoAnalysisLoader *loader, xmlDoc *doc);
+SV*                    xacobeo_analysis_loader_finish   (XacobeoAnalysisLoader *loader);
+void                   xacobeo_analysis_loader_free     (XacobeoAnalysisLoader *loader);
+
+
+#endif
@@ -119,6 +119,39 @@ typedef struct _TreeRenderCtx {
 } TreeRenderCtx;
 
 
+//
+// The context used for computing the paths of multiple nodes.
+//
+typedef struct _PathsCtx {
+
+	// Perl hash with the namespaces to use (key: uri, value: prefix)
+	HV *namespaces;
+
+	// The paths computed so far (key: xmlNode*, value: gchar*)
+	GHashTable *paths;
+
+	// The position of each element among its siblings with the same name (key:
+	// xmlNode*, value: position). Elements with a unique name are not stored.
+	GHashTable *positions;
+
+	// The parents for which the positions of the children have been computed
+	GHashTable *parents;
+
+	// Statistics used for debugging purposes
+	gsize  calls;
+} PathsCtx;
+
+
+//
+// Identifies the siblings that share the same name and namespace.
+//
+typedef struct _SiblingKey {
+	const xmlChar *name;
+	xmlNs         *ns;
+	guint          count;
+} SiblingKey;
+
+
 
 //
 // Function prototypes
@@ -130,8 +163,15 @@ static void         my_display_document_syntax (TextRenderCtx *xargs, xmlNode *n
 static gchar*       my_get_node_name_prefixed  (xmlNode *node, HV *namespaces);
 static const gchar* my_get_uri_prefix          (const xmlChar *uri, HV *namespaces);
 static void         my_render_buffer           (TextRenderCtx *xargs);
+static void         my_display_result_ns       (TextRenderCtx *xargs, xmlNs *ns);
 static void         my_add_text_and_entity     (TextRenderCtx *xargs, GString *buffer, GtkTextTag *markup, const gchar *entity);
 static void         my_populate_tree_store     (TreeRenderCtx *xargs, xmlNode *node, GtkTreeIter *parent, gint pos);
+static const gchar* my_get_cached_path         (PathsCtx *xargs, xmlNode *node, gboolean *has_element);
+static guint        my_get_sibling_position    (PathsCtx *xargs, xmlNode *node);
+static guint        my_sibling_key_hash        (gconstpointer data);
+static gboolean     my_sibling_key_equal       (gconstpointer a, gconstpointer b);
+static guint        my_sibling_key_hash_dict   (gconstpointer data);
+static gboolean     my_sibling_key_equal_dict  (gconstpointer a, gconstpointer b);
 
 static void         my_XML_DOCUMENT_NODE       (TextRenderCtx *xargs, xmlNode *node);
 static void         my_XML_HTML_DOCUMENT_NODE  (TextRenderCtx *xargs, xmlNode *node);
@@ -367,6 +407,107 @@ void xacobeo_populate_gtk_text_buffer (GtkTextBuffer *buffer, xmlNode *node, HV
 
 
 
+//
+// Displays the nodes in the range [offset, offset + count) of an XPath node set
+// into a GtkTextBuffer. Each node is preceded by its position in the whole set
+// (style 'result_count') and the nodes are separated by a new line. The nodes
+// are rendered as with xacobeo_populate_gtk_text_buffer() but all the text is
+// added to the buffer in a single pass.
+//
+// The range has to be within the node set.
+//
+void xacobeo_populate_gtk_text_buffer_nodes (GtkTextBuffer *buffer, xmlNodeSet *set, gint offset, gint count, HV *namespaces) {
+
+	////
+	// Parameters validation
+	if (buffer == NULL) {
+		WARN("GtkTextBuffer is NULL");
+		return;
+	}
+	if (set == NULL || count <= 0) {
+		return;
+	}
+
+	TextRenderCtx xargs = {
+		.buffer = buffer,
+		.markup = my_get_buffer_tags(buffer),
+		.namespaces = namespaces,
+		.xml_data = g_string_sized_new(5 * 1024),
+		.buffer_pos = 0,
+		.tags = g_array_sized_new(TRUE, TRUE, sizeof(ApplyTag), 10 * count),
+		.calls = 0,
+	};
+
+	// Compute the current position in the buffer
+	GtkTextIter iter;
+	gtk_text_buffer_get_end_iter(buffer, &iter);
+	xargs.buffer_pos = gtk_text_iter_get_offset(&iter);
+
+	// The counters are as wide as the number of results
+	gint width = 1;
+	for (gint i = set->nodeNr; i >= 10; i /= 10) {
+		++width;
+	}
+
+	gint last = offset + count - 1;
+	for (gint i = offset; i <= last; ++i) {
+		xmlNode *node = set->nodeTab[i];
+
+		gchar *counter = g_strdup_printf(" %*d. ", width, i + 1);
+		buffer_add(&xargs, xargs.markup->result_count, counter);
+		g_free(counter);
+
+		if (node->type == XML_NAMESPACE_DECL) {
+			my_display_result_ns(&xargs, (xmlNs *) node);
+		}
+		else {
+			my_display_document_syntax(&xargs, node);
+		}
+
+		if (i != last) {
+			buffer_add(&xargs, xargs.markup->syntax, "\n");
+		}
+	}
+	g_free(xargs.markup);
+
+	gsize tags = xargs.tags->len;
+	my_render_buffer(&xargs);
+	INFO("Nodes = %d, Calls = %lu, Tags = %lu", count, (gulong) xargs.calls, (gulong) tags);
+}
+
+
+
+//
+// Displays a namespace returned by an XPath query. Unlike the namespace
+// declarations of an element, the namespace is displayed with its own prefix.
+//
+static void my_display_result_ns (TextRenderCtx *xargs, xmlNs *ns) {
+
+	gchar *name = ns->prefix ? g_strconcat("xmlns:", (gchar *) ns->prefix, NULL) : g_strdup("xmlns");
+	buffer_add(xargs, xargs->markup->syntax, " ");
+	buffer_add(xargs, xargs->markup->namespace_name, name);
+	g_free(name);
+
+	// The URI is escaped as an attribute value
+	GString *uri = g_string_sized_new(64);
+	for (const gchar *p = (gchar *) ns->href; p && *p; ++p) {
+		switch (*p) {
+			case '<':  g_string_append(uri, "&lt;");   break;
+			case '>':  g_string_append(uri, "&gt;");   break;
+			case '&':  g_string_append(uri, "&amp;");  break;
+			case '\'': g_string_append(uri, "&apos;"); break;
+			case '"':  g_string_append(uri, "&quot;"); break;
+			default:   g_string_append_c(uri, *p);     break;
+		}
+	}
+	buffer_add(xargs, xargs->markup->syntax, "=\"");
+	buffer_add(xargs, xargs->markup->namespace_uri, uri->str);
+	buffer_add(xargs, xargs->markup->syntax, "\"");
+	g_string_free(uri, TRUE);
+}
+
+
+
 //
 // Adds the contents of the XML document to the buffer and applies the syntax
 // highlighting.
@@ -1073,6 +1214,225 @@ gchar* xacobeo_get_node_path (xmlNode *origin, HV *namespaces) {
 }
 
 
+
+//
+// Returns the paths of all the nodes in the given list. The paths are the same
+// as the ones returned by xacobeo_get_node_path() but they are computed in a
+// single batch.
+//
+// Instead of scanning the siblings of each node at each level, the positions of
+// the elements among their siblings with the same name are computed only once
+// per parent. The path of each ancestor is also computed only once and shared
+// by all its descendants.
+//
+// This function returns a Perl array ref with the paths (undef is used for the
+// entries that are not nodes).
+//
+SV* xacobeo_get_node_paths (AV *nodes, HV *namespaces) {
+
+	PathsCtx xargs = {
+		.namespaces = namespaces,
+		.paths      = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free),
+		.positions  = g_hash_table_new(g_direct_hash, g_direct_equal),
+		.parents    = g_hash_table_new(g_direct_hash, g_direct_equal),
+		.calls      = 0,
+	};
+
+	AV *paths = newAV();
+	SSize_t last = av_len(nodes);
+	av_extend(paths, last);
+
+	for (SSize_t i = 0; i <= last; ++i) {
+		SV **svPtr = av_fetch(nodes, i, FALSE);
+		xmlNode *node = svPtr ? PmmSvNode(*svPtr) : NULL;
+		if (node == NULL) {
+			av_push(paths, newSV(0));
+			continue;
+		}
+
+		const gchar *path = my_get_cached_path(&xargs, node, NULL);
+		SV *sv = newSVpv(path, 0);
+		SvUTF8_on(sv);
+		av_push(paths, sv);
+	}
+
+	INFO("Nodes = %ld, Calls = %lu, Parents = %u", (long) (last + 1), (gulong) xargs.calls, g_hash_table_size(xargs.parents));
+
+	g_hash_table_destroy(xargs.paths);
+	g_hash_table_destroy(xargs.positions);
+	g_hash_table_destroy(xargs.parents);
+
+	return newRV_noinc((SV *) paths);
+}
+
+
+
+//
+// Returns the path of the given node from the cache. If the path wasn't yet
+// computed then it will be built from the path of its parent, which is also
+// cached.
+//
+// The parameter 'has_element' is set to TRUE if the path contains an element,
+// this is needed in order to know if a separator has to be used.
+//
+// The string returned by this function shouldn't be modified nor freed.
+//
+static const gchar* my_get_cached_path (PathsCtx *xargs, xmlNode *node, gboolean *has_element) {
+
+	if (has_element) {
+		*has_element = FALSE;
+	}
+
+	if (node == NULL) {
+		return "";
+	}
+
+	switch (node->type) {
+		case XML_DOCUMENT_NODE:
+		case XML_HTML_DOCUMENT_NODE:
+			return "/";
+		break;
+
+		case XML_ELEMENT_NODE:
+			// Handled below
+		break;
+
+		default:
+			WARN("Unknown XML type %d for %s", node->type, node->name);
+			return my_get_cached_path(xargs, node->parent, has_element);
+		break;
+	}
+
+	if (has_element) {
+		*has_element = TRUE;
+	}
+
+	gchar *path = g_hash_table_lookup(xargs->paths, node);
+	if (path) {
+		return path;
+	}
+	++xargs->calls;
+
+
+	// Build the path based on the parent's path
+	gboolean use_separator = FALSE;
+	const gchar *parent_path = my_get_cached_path(xargs, node->parent, &use_separator);
+	gchar *name = my_get_node_name_prefixed(node, xargs->namespaces);
+
+	guint position = my_get_sibling_position(xargs, node);
+	if (position) {
+		gchar index[16];
+		g_snprintf(index, sizeof(index), "[%u]", position);
+		path = g_strconcat(parent_path, use_separator ? "/" : "", name, index, NULL);
+	}
+	else {
+		path = g_strconcat(parent_path, use_separator ? "/" : "", name, NULL);
+	}
+	g_free(name);
+
+	g_hash_table_insert(xargs->paths, node, path);
+	return path;
+}
+
+
+
+//
+// Returns the position of an element among the siblings that have the same name
+// and namespace. If the element has no such siblings then 0 is returned.
+//
+// The positions of all the children of the parent are computed the first time
+// that one of them is requested. The element names are compared through their
+// pointers when the document uses a dictionary (libxml2 interns the names).
+//
+static guint my_get_sibling_position (PathsCtx *xargs, xmlNode *node) {
+
+	xmlNode *parent = node->parent;
+	if (parent == NULL) {
+		return 0;
+	}
+
+	if (g_hash_table_lookup(xargs->parents, parent)) {
+		return GPOINTER_TO_UINT(g_hash_table_lookup(xargs->positions, node));
+	}
+	g_hash_table_insert(xargs->parents, parent, parent);
+
+
+	// Count the elements with the same name and keep their position
+	gboolean use_dict = parent->doc && parent->doc->dict;
+	GHashTable *counts = use_dict
+		? g_hash_table_new_full(my_sibling_key_hash_dict, my_sibling_key_equal_dict, g_free, NULL)
+		: g_hash_table_new_full(my_sibling_key_hash, my_sibling_key_equal, g_free, NULL)
+	;
+	for (xmlNode *child = parent->children; child; child = child->next) {
+		if (child->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		SiblingKey key = {
+			.name  = child->name,
+			.ns    = child->ns,
+			.count = 0,
+		};
+		SiblingKey *counter = g_hash_table_lookup(counts, &key);
+		if (counter == NULL) {
+			counter = g_new(SiblingKey, 1);
+			*counter = key;
+			g_hash_table_insert(counts, counter, counter);
+		}
+		g_hash_table_insert(xargs->positions, child, GUINT_TO_POINTER(++counter->count));
+	}
+
+
+	// The elements with a unique name don't need a position
+	for (xmlNode *child = parent->children; child; child = child->next) {
+		if (child->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		SiblingKey key = {
+			.name  = child->name,
+			.ns    = child->ns,
+			.count = 0,
+		};
+		SiblingKey *counter = g_hash_table_lookup(counts, &key);
+		if (counter->count == 1) {
+			g_hash_table_remove(xargs->positions, child);
+		}
+	}
+	g_hash_table_destroy(counts);
+
+	return GPOINTER_TO_UINT(g_hash_table_lookup(xargs->positions, node));
+}
+
+
+
+//
+// Hash functions used for grouping the siblings that have the same name. The
+// '_dict' versions rely on the names being interned by libxml2.
+//
+static guint my_sibling_key_hash (gconstpointer data) {
+	const SiblingKey *key = data;
+	return g_str_hash(key->name) ^ g_direct_hash(key->ns);
+}
+
+static gboolean my_sibling_key_equal (gconstpointer a, gconstpointer b) {
+	const SiblingKey *key_a = a;
+	const SiblingKey *key_b = b;
+	return key_a->ns == key_b->ns && xmlStrEqual(key_a->name, key_b->name);
+}
+
+static guint my_sibling_key_hash_dict (gconstpointer data) {
+	const SiblingKey *key = data;
+	return g_direct_hash(key->name) ^ g_direct_hash(key->ns);
+}
+
+static gboolean my_sibling_key_equal_dict (gconstpointer a, gconstpointer b) {
+	const SiblingKey *key_a = a;
+	const SiblingKey *key_b = b;
+	return key_a->ns == key_b->ns && key_a->name == key_b->name;
+}
+
+
 //
 // Returns a unique identifier for a give node.
 //
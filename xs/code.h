@@ -8,6 +8,7 @@
 
 #include <gtk/gtk.h>
 #include <libxml/tree.h>
+#include <libxml/xpath.h>
 
 
 // The columns in the DOM Tree View
@@ -24,7 +25,9 @@ typedef enum DomModelColumns DomModelColumnsEnum;
 // Public prototypes
 void xacobeo_populate_gtk_text_buffer (GtkTextBuffer *buffer, xmlNode *node, HV *namespaces);
 void xacobeo_populate_gtk_tree_store  (GtkTreeStore *store,   xmlNode *node, HV *namespaces);
+void xacobeo_populate_gtk_text_buffer_nodes (GtkTextBuffer *buffer, xmlNodeSet *set, gint offset, gint count, HV *namespaces);
 gchar* xacobeo_get_node_path          (xmlNode *node, HV *namespaces);
+SV*    xacobeo_get_node_paths         (AV *nodes, HV *namespaces);
 gchar* xacobeo_get_node_mark          (xmlNode *node);
 
 
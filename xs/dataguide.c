@@ -0,0 +1,619 @@
+//
+// DataGuide: a summary of the paths of a document.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "dataguide.h"
+#include "logger.h"
+#include "libxml.h"
+
+#include <string.h>
+
+
+// The maximal number of paths kept in a summary
+#define DATAGUIDE_MAX_SIZE 50000
+
+
+//
+// The name and the namespace of a node, used as a key while building the
+// summary. The strings belong to the document.
+//
+typedef struct _GuideKey {
+	const gchar *name;
+	const gchar *uri;
+} GuideKey;
+
+
+//
+// An attribute seen at a given path.
+//
+typedef struct _GuideAttribute {
+	GuideKey key;
+	gchar *label;
+	guint count;
+} GuideAttribute;
+
+
+//
+// Function prototypes
+//
+static DataGuideNode*  my_node_new             (XacobeoDataGuide *guide, DataGuideNode *parent);
+static void            my_node_free            (DataGuideNode *node);
+static DataGuideNode*  my_get_child            (XacobeoDataGuide *guide, DataGuideNode *parent, xmlNode *node);
+static void            my_add_attributes       (XacobeoDataGuide *guide, DataGuideNode *node, xmlNode *element);
+static gchar*          my_get_label            (XacobeoDataGuide *guide, const gchar *name, const gchar *uri);
+static void            my_finish_node          (XacobeoDataGuide *guide, DataGuideNode *node);
+static void            my_summary_add          (AV *summary, DataGuideNode *node, guint depth);
+static GPtrArray*      my_resolve_context      (XacobeoDataGuide *guide, const gchar *p, const gchar *end, gboolean *descendant);
+static void            my_collect_descendants  (DataGuideNode *node, GPtrArray *nodes, gboolean self);
+static void            my_add_completion       (GHashTable *seen, GPtrArray *order, const gchar *label, guint count);
+static guint           my_guide_key_hash       (gconstpointer data);
+static gboolean        my_guide_key_equal      (gconstpointer a, gconstpointer b);
+
+
+
+//
+// Builds the summary of the paths of the given document in a single walk. The
+// namespaces are the ones used by the application (key: uri, value: prefix),
+// they are used for naming the paths.
+//
+// The summary has to be freed with xacobeo_dataguide_free().
+//
+XacobeoDataGuide* xacobeo_dataguide_new (SV *document, HV *namespaces) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL) {
+		WARN("Document has no node");
+		return NULL;
+	}
+
+	XacobeoDataGuide *guide = xacobeo_dataguide_begin();
+
+
+	// Walk the elements, the current path follows the walk
+	xmlNode *top = (xmlNode *) node->doc;
+	DataGuideNode *path = guide->root;
+	node = top;
+	while (node) {
+		DataGuideNode *child_path = NULL;
+		if (node->type == XML_ELEMENT_NODE) {
+			child_path = xacobeo_dataguide_add(guide, path, node);
+		}
+
+		// Descend into the elements that have a path (the paths dropped because
+		// of the size limit are not followed)
+		if (node == top && node->children) {
+			node = node->children;
+		}
+		else if (child_path && node->children) {
+			path = child_path;
+			node = node->children;
+		}
+		else {
+			while (node != top && node->next == NULL) {
+				node = node->parent;
+				path = path->parent ? path->parent : path;
+			}
+			node = node == top ? NULL : node->next;
+		}
+	}
+
+	xacobeo_dataguide_end(guide, namespaces);
+
+	return guide;
+}
+
+
+
+//
+// Creates an empty summary. The elements are added by the caller with
+// xacobeo_dataguide_add() while it walks the document and the summary is
+// completed with xacobeo_dataguide_end(). This way the summary can be built by
+// a walk that collects other information at the same time.
+//
+// The summary has to be freed with xacobeo_dataguide_free().
+//
+XacobeoDataGuide* xacobeo_dataguide_begin (void) {
+	XacobeoDataGuide *guide = g_new0(XacobeoDataGuide, 1);
+	guide->prefixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	guide->root = my_node_new(guide, NULL);
+	guide->root->label = g_strdup("");
+	guide->size = 0;
+	return guide;
+}
+
+
+
+//
+// Adds an element found under the given path (the path of its parent, the root
+// of the summary for the root element). The elements have to be added in
+// document order.
+//
+// Returns the path of the element, the children of the element are added
+// under it. If the summary is full or if the parent has no path NULL is
+// returned.
+//
+DataGuideNode* xacobeo_dataguide_add (XacobeoDataGuide *guide, DataGuideNode *parent, xmlNode *element) {
+	if (parent == NULL) {
+		return NULL;
+	}
+
+	DataGuideNode *path = my_get_child(guide, parent, element);
+	if (path) {
+		++path->count;
+		my_add_attributes(guide, path, element);
+	}
+	return path;
+}
+
+
+
+//
+// Completes a summary once all the elements were added. The namespaces are the
+// ones used by the application (key: uri, value: prefix), they are used for
+// naming the paths.
+//
+void xacobeo_dataguide_end (XacobeoDataGuide *guide, HV *namespaces) {
+
+	if (namespaces) {
+		hv_iterinit(namespaces);
+		HE *entry;
+		while ((entry = hv_iternext(namespaces)) != NULL) {
+			I32 length;
+			gchar *uri = hv_iterkey(entry, &length);
+			SV *prefix = hv_iterval(namespaces, entry);
+			if (! SvPOK(prefix)) {
+				continue;
+			}
+			g_hash_table_insert(guide->prefixes, g_strndup(uri, length), g_strdup(SvPV_nolen(prefix)));
+		}
+	}
+
+	// The keys point to the document, they are replaced by the labels
+	my_finish_node(guide, guide->root);
+	INFO("DataGuide with %u paths%s", guide->size, guide->truncated ? " (truncated)" : "");
+}
+
+
+
+//
+// Frees the summary.
+//
+void xacobeo_dataguide_free (XacobeoDataGuide *guide) {
+	if (guide == NULL) {
+		return;
+	}
+	my_node_free(guide->root);
+	g_hash_table_destroy(guide->prefixes);
+	g_free(guide);
+}
+
+
+
+//
+// Returns the paths of the summary in preorder as a Perl array ref. Each path is
+// an array ref with: the depth of the path (1 for the root element), the name
+// of the element, the number of elements found at that path and the names of
+// the attributes with their count ("id (12), name (3)").
+//
+SV* xacobeo_dataguide_summary (XacobeoDataGuide *guide) {
+	AV *summary = newAV();
+	for (guint i = 0; i < guide->root->children->len; ++i) {
+		my_summary_add(summary, g_ptr_array_index(guide->root->children, i), 1);
+	}
+	return newRV_noinc((SV *) summary);
+}
+
+
+
+//
+// Returns the completions of the last step of the given XPath expression. The
+// expression has to be an absolute path (/a/b/ or //a/b/c); the predicates are
+// ignored. The completions are the names of the elements (or of the attributes
+// if the last step starts with '@') that follow the path and that start with the
+// text of the last step.
+//
+// The completions are returned as a Perl array ref of pairs (expression,
+// count) where the expression is the given expression with the last step
+// completed.
+//
+SV* xacobeo_dataguide_complete (XacobeoDataGuide *guide, const gchar *expression) {
+
+	AV *completions = newAV();
+	SV *result = newRV_noinc((SV *) completions);
+
+	const gchar *slash = expression ? strrchr(expression, '/') : NULL;
+	if (slash == NULL) {
+		return result;
+	}
+
+	// The path followed and the step being typed
+	const gchar *partial = slash + 1;
+	gboolean descendant = FALSE;
+	GPtrArray *nodes = my_resolve_context(guide, expression, partial, &descendant);
+	if (nodes == NULL) {
+		return result;
+	}
+
+	gboolean attribute = *partial == '@';
+	if (attribute) {
+		++partial;
+	}
+	gsize partial_length = strlen(partial);
+
+
+	// The candidates
+	GPtrArray *candidates = g_ptr_array_new();
+	for (guint i = 0; i < nodes->len; ++i) {
+		DataGuideNode *node = g_ptr_array_index(nodes, i);
+		if (descendant) {
+			// Attributes are taken from the node itself too (descendant-or-self)
+			my_collect_descendants(node, candidates, attribute && node->parent);
+		}
+		else if (attribute) {
+			g_ptr_array_add(candidates, node);
+		}
+		else {
+			for (guint j = 0; j < node->children->len; ++j) {
+				g_ptr_array_add(candidates, g_ptr_array_index(node->children, j));
+			}
+		}
+	}
+	g_ptr_array_free(nodes, TRUE);
+
+
+	// The names of the candidates matching the step typed, the counts are merged
+	GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+	GPtrArray *order = g_ptr_array_new();
+	for (guint i = 0; i < candidates->len; ++i) {
+		DataGuideNode *node = g_ptr_array_index(candidates, i);
+		if (attribute) {
+			for (guint j = 0; j < node->attributes->len; ++j) {
+				GuideAttribute *attr = g_ptr_array_index(node->attributes, j);
+				if (strncmp(attr->label, partial, partial_length) == 0) {
+					my_add_completion(seen, order, attr->label, attr->count);
+				}
+			}
+		}
+		else if (strncmp(node->label, partial, partial_length) == 0) {
+			my_add_completion(seen, order, node->label, node->count);
+		}
+	}
+	g_ptr_array_free(candidates, TRUE);
+
+	gsize prefix_length = (partial - expression) - (attribute ? 1 : 0);
+	for (guint i = 0; i < order->len; ++i) {
+		const gchar *label = g_ptr_array_index(order, i);
+		guint count = GPOINTER_TO_UINT(g_hash_table_lookup(seen, label));
+
+		SV *text = newSVpvn(expression, prefix_length);
+		sv_catpvf(text, "%s%s", attribute ? "@" : "", label);
+		SvUTF8_on(text);
+
+		AV *pair = newAV();
+		av_push(pair, text);
+		av_push(pair, newSVuv(count));
+		av_push(completions, newRV_noinc((SV *) pair));
+	}
+	g_ptr_array_free(order, TRUE);
+	g_hash_table_destroy(seen);
+
+	return result;
+}
+
+
+
+//
+// Creates a new path. Its label is set once the namespaces are known.
+//
+static DataGuideNode* my_node_new (XacobeoDataGuide *guide, DataGuideNode *parent) {
+	DataGuideNode *path = g_new0(DataGuideNode, 1);
+	path->parent = parent;
+	path->children = g_ptr_array_new();
+	path->children_by_name = g_hash_table_new_full(my_guide_key_hash, my_guide_key_equal, g_free, NULL);
+	path->attributes = g_ptr_array_new();
+	path->attributes_by_name = g_hash_table_new(my_guide_key_hash, my_guide_key_equal);
+	++guide->size;
+	return path;
+}
+
+
+
+//
+// Frees a path and its children.
+//
+static void my_node_free (DataGuideNode *node) {
+	for (guint i = 0; i < node->children->len; ++i) {
+		my_node_free(g_ptr_array_index(node->children, i));
+	}
+	for (guint i = 0; i < node->attributes->len; ++i) {
+		GuideAttribute *attr = g_ptr_array_index(node->attributes, i);
+		g_free(attr->label);
+		g_free(attr);
+	}
+	g_ptr_array_free(node->children, TRUE);
+	g_ptr_array_free(node->attributes, TRUE);
+	if (node->children_by_name) {
+		g_hash_table_destroy(node->children_by_name);
+	}
+	if (node->attributes_by_name) {
+		g_hash_table_destroy(node->attributes_by_name);
+	}
+	g_free(node->label);
+	g_free(node);
+}
+
+
+
+//
+// Returns the child path of the given path for an element. The child path is
+// created if needed. If the summary is full NULL is returned.
+//
+static DataGuideNode* my_get_child (XacobeoDataGuide *guide, DataGuideNode *parent, xmlNode *node) {
+
+	GuideKey key = {
+		.name = (const gchar *) node->name,
+		.uri  = node->ns ? (const gchar *) node->ns->href : NULL,
+	};
+	DataGuideNode *child = g_hash_table_lookup(parent->children_by_name, &key);
+	if (child) {
+		return child;
+	}
+
+	if (guide->size >= DATAGUIDE_MAX_SIZE) {
+		guide->truncated = TRUE;
+		return NULL;
+	}
+
+	child = my_node_new(guide, parent);
+	child->name = key.name;
+	child->uri = key.uri;
+	g_ptr_array_add(parent->children, child);
+	GuideKey *child_key = g_new(GuideKey, 1);
+	*child_key = key;
+	g_hash_table_insert(parent->children_by_name, child_key, child);
+
+	return child;
+}
+
+
+
+//
+// Counts the attributes of an element found at the given path.
+//
+static void my_add_attributes (XacobeoDataGuide *guide, DataGuideNode *node, xmlNode *element) {
+	for (xmlAttr *attr = element->properties; attr; attr = attr->next) {
+		GuideKey key = {
+			.name = (const gchar *) attr->name,
+			.uri  = attr->ns ? (const gchar *) attr->ns->href : NULL,
+		};
+
+		GuideAttribute *entry = g_hash_table_lookup(node->attributes_by_name, &key);
+		if (entry == NULL) {
+			entry = g_new0(GuideAttribute, 1);
+			entry->key = key;
+			g_ptr_array_add(node->attributes, entry);
+			g_hash_table_insert(node->attributes_by_name, &entry->key, entry);
+		}
+		++entry->count;
+	}
+}
+
+
+
+//
+// Returns the name of a node with the prefix used by the application.
+//
+static gchar* my_get_label (XacobeoDataGuide *guide, const gchar *name, const gchar *uri) {
+	const gchar *prefix = uri ? g_hash_table_lookup(guide->prefixes, uri) : NULL;
+	if (prefix) {
+		return g_strdup_printf("%s:%s", prefix, name);
+	}
+	return g_strdup(name);
+}
+
+
+
+//
+// Names a path and its attributes and frees the tables used while building the
+// summary, their keys belong to the document.
+//
+static void my_finish_node (XacobeoDataGuide *guide, DataGuideNode *node) {
+
+	if (node->name) {
+		node->label = my_get_label(guide, node->name, node->uri);
+		node->name = NULL;
+		node->uri = NULL;
+	}
+	g_hash_table_destroy(node->children_by_name);
+	node->children_by_name = NULL;
+
+	for (guint i = 0; i < node->attributes->len; ++i) {
+		GuideAttribute *attr = g_ptr_array_index(node->attributes, i);
+		attr->label = my_get_label(guide, attr->key.name, attr->key.uri);
+	}
+	g_hash_table_destroy(node->attributes_by_name);
+	node->attributes_by_name = NULL;
+
+	for (guint i = 0; i < node->children->len; ++i) {
+		my_finish_node(guide, g_ptr_array_index(node->children, i));
+	}
+}
+
+
+
+//
+// Adds a path and its children to the summary.
+//
+static void my_summary_add (AV *summary, DataGuideNode *node, guint depth) {
+
+	GString *attributes = g_string_new("");
+	for (guint i = 0; i < node->attributes->len; ++i) {
+		GuideAttribute *attr = g_ptr_array_index(node->attributes, i);
+		g_string_append_printf(attributes, "%s%s (%u)", i ? ", " : "", attr->label, attr->count);
+	}
+
+	AV *row = newAV();
+	av_push(row, newSVuv(depth));
+	SV *label = newSVpv(node->label, 0);
+	SvUTF8_on(label);
+	av_push(row, label);
+	av_push(row, newSVuv(node->count));
+	SV *text = newSVpvn(attributes->str, attributes->len);
+	SvUTF8_on(text);
+	av_push(row, text);
+	av_push(summary, newRV_noinc((SV *) row));
+	g_string_free(attributes, TRUE);
+
+	for (guint i = 0; i < node->children->len; ++i) {
+		my_summary_add(summary, g_ptr_array_index(node->children, i), depth + 1);
+	}
+}
+
+
+
+//
+// Returns the paths matching the location path in [p, end). The path has to be
+// absolute and made only of names (with optional predicates). If the path ends
+// with '//' then 'descendant' is set to TRUE.
+//
+// Returns NULL if the path is not supported.
+//
+static GPtrArray* my_resolve_context (XacobeoDataGuide *guide, const gchar *p, const gchar *end, gboolean *descendant) {
+
+	if (*p != '/') {
+		return NULL;
+	}
+
+	GPtrArray *nodes = g_ptr_array_new();
+	g_ptr_array_add(nodes, guide->root);
+
+	while (p < end) {
+		// The separator
+		*descendant = g_str_has_prefix(p, "//");
+		p += *descendant ? 2 : 1;
+		if (p >= end) {
+			break;
+		}
+
+		// The name of the step
+		const gchar *start = p;
+		while (p < end && *p != '/' && *p != '[') {
+			if (! (g_ascii_isalnum(*p) || strchr("_-.:*", *p) || (guchar) *p >= 0x80)) {
+				g_ptr_array_free(nodes, TRUE);
+				return NULL;
+			}
+			++p;
+		}
+		gchar *name = g_strndup(start, p - start);
+
+		// Skip the predicates
+		while (p < end && *p == '[') {
+			gint depth = 0;
+			gchar quote = 0;
+			for (; p < end; ++p) {
+				if (quote) {
+					if (*p == quote) quote = 0;
+				}
+				else if (*p == '\'' || *p == '"') {
+					quote = *p;
+				}
+				else if (*p == '[') {
+					++depth;
+				}
+				else if (*p == ']' && --depth == 0) {
+					++p;
+					break;
+				}
+			}
+		}
+
+		// Follow the step
+		GPtrArray *next = g_ptr_array_new();
+		GHashTable *seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+		for (guint i = 0; i < nodes->len; ++i) {
+			DataGuideNode *node = g_ptr_array_index(nodes, i);
+			GPtrArray *candidates = g_ptr_array_new();
+			if (*descendant) {
+				my_collect_descendants(node, candidates, FALSE);
+			}
+			else {
+				for (guint j = 0; j < node->children->len; ++j) {
+					g_ptr_array_add(candidates, g_ptr_array_index(node->children, j));
+				}
+			}
+
+			for (guint j = 0; j < candidates->len; ++j) {
+				DataGuideNode *candidate = g_ptr_array_index(candidates, j);
+				if ((strcmp(name, "*") == 0 || strcmp(name, candidate->label) == 0) && ! g_hash_table_lookup(seen, candidate)) {
+					g_hash_table_insert(seen, candidate, candidate);
+					g_ptr_array_add(next, candidate);
+				}
+			}
+			g_ptr_array_free(candidates, TRUE);
+		}
+		g_hash_table_destroy(seen);
+		g_ptr_array_free(nodes, TRUE);
+		g_free(name);
+		nodes = next;
+
+		// Only a separator can follow a step
+		if (p < end && *p != '/') {
+			g_ptr_array_free(nodes, TRUE);
+			return NULL;
+		}
+		*descendant = FALSE;
+	}
+
+	return nodes;
+}
+
+
+
+//
+// Adds the descendants of a path to the given array, the path itself is added
+// first if 'self' is TRUE.
+//
+static void my_collect_descendants (DataGuideNode *node, GPtrArray *nodes, gboolean self) {
+	if (self) {
+		g_ptr_array_add(nodes, node);
+	}
+	for (guint i = 0; i < node->children->len; ++i) {
+		my_collect_descendants(g_ptr_array_index(node->children, i), nodes, TRUE);
+	}
+}
+
+
+
+//
+// Adds a completion, the count of a completion seen before is increased.
+//
+static void my_add_completion (GHashTable *seen, GPtrArray *order, const gchar *label, guint count) {
+	gpointer previous = g_hash_table_lookup(seen, label);
+	if (previous == NULL) {
+		g_ptr_array_add(order, (gpointer) label);
+	}
+	g_hash_table_insert(seen, (gpointer) label, GUINT_TO_POINTER(GPOINTER_TO_UINT(previous) + count));
+}
+
+
+
+static guint my_guide_key_hash (gconstpointer data) {
+	const GuideKey *key = data;
+	return g_str_hash(key->name) ^ (key->uri ? g_str_hash(key->uri) : 0);
+}
+
+
+
+static gboolean my_guide_key_equal (gconstpointer a, gconstpointer b) {
+	const GuideKey *key_a = a;
+	const GuideKey *key_b = b;
+	return strcmp(key_a->name, key_b->name) == 0 && g_strcmp0(key_a->uri, key_b->uri) == 0;
+}
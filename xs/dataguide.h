@@ -0,0 +1,78 @@
+#ifndef __XACOBEO_DATAGUIDE_H__
+#define __XACOBEO_DATAGUIDE_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <glib.h>
+#include <libxml/tree.h>
+
+
+//
+// A node of the DataGuide: a distinct path of element names (/a/b/c) found in
+// the document.
+//
+typedef struct _DataGuideNode DataGuideNode;
+struct _DataGuideNode {
+
+	// The name of the element with the application's prefix (prefix:name)
+	gchar *label;
+
+	// The name and the namespace of the element, they belong to the document
+	// and are only used until the label is set
+	const gchar *name;
+	const gchar *uri;
+
+	// The number of elements found at this path
+	guint count;
+
+	// The children paths (by order of appearance) and the same children keyed
+	// by their name and namespace
+	GPtrArray *children;
+	GHashTable *children_by_name;
+
+	// The attributes seen at this path (by order of appearance) and their count
+	// keyed by their name and namespace
+	GPtrArray *attributes;
+	GHashTable *attributes_by_name;
+
+	DataGuideNode *parent;
+};
+
+
+//
+// A structural summary of a document (a DataGuide): each distinct path of
+// element names from the root is stored once with the number of elements found
+// at that path and the names of their attributes. The summary is usually tiny
+// compared to the document, its size only depends on the variety of the paths.
+//
+typedef struct _XacobeoDataGuide {
+
+	// The document node, it has the paths starting at the root element
+	DataGuideNode *root;
+
+	// The number of paths in the summary
+	guint size;
+
+	// TRUE if some paths were dropped because there were too many
+	gboolean truncated;
+
+	// The prefixes used by the application (key: uri, value: prefix)
+	GHashTable *prefixes;
+
+} XacobeoDataGuide;
+
+
+// Public prototypes
+XacobeoDataGuide* xacobeo_dataguide_new       (SV *document, HV *namespaces);
+XacobeoDataGuide* xacobeo_dataguide_begin     (void);
+DataGuideNode*    xacobeo_dataguide_add       (XacobeoDataGuide *guide, DataGuideNode *parent, xmlNode *element);
+void              xacobeo_dataguide_end       (XacobeoDataGuide *guide, HV *namespaces);
+void              xacobeo_dataguide_free      (XacobeoDataGuide *guide);
+SV*               xacobeo_dataguide_summary   (XacobeoDataGuide *guide);
+SV*               xacobeo_dataguide_complete  (XacobeoDataGuide *guide, const gchar *expression);
+
+
+#endif
@@ -0,0 +1,899 @@
+//
+// Native index of an XML document.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "index.h"
+#include "nodeset.h"
+#include "logger.h"
+#include "libxml.h"
+
+#include <libxml/xpathInternals.h>
+
+#include <string.h>
+
+
+//
+// Identifies a group of siblings that share the same local name and namespace.
+//
+typedef struct _SiblingGroupKey {
+	const gchar *name;
+	const gchar *uri;
+} SiblingGroupKey;
+
+
+//
+// An attribute with a given value.
+//
+typedef struct _AttributeKey {
+	const gchar *name;
+	const gchar *uri;
+	const gchar *value;
+} AttributeKey;
+
+
+//
+// The index of the values of an attribute. Each value is mapped to the elements
+// (in document order) that have the attribute with that value. If the index
+// exceeded the memory limit the values are NULL.
+//
+typedef struct _AttributeIndex {
+	SiblingGroupKey key;
+	GHashTable *values;
+	gsize size;
+} AttributeIndex;
+
+
+// The memory used for indexing a distinct attribute value (without the value)
+#define ATTRIBUTE_VALUE_OVERHEAD (sizeof(GPtrArray) + 4 * sizeof(gpointer))
+
+// The default memory limit for the indexes of the attribute values
+#define ATTRIBUTE_INDEX_LIMIT (64 * 1024 * 1024)
+
+
+//
+// Function prototypes
+//
+static GHashTable* my_get_sibling_groups     (XacobeoIndex *index, xmlNode *parent);
+static GPtrArray*  my_get_sibling_group      (XacobeoIndex *index, xmlNode *parent, const gchar *name, const gchar *uri);
+static void        my_index_elements         (XacobeoIndex *index);
+static xmlNode*    my_next_element           (xmlNode *top, xmlNode *node);
+static xmlNodeSet* my_find_by_attribute      (XacobeoIndex *index, const gchar *name, const gchar *uri, const gchar *attr_name, const gchar *attr_uri, const gchar *value);
+static xmlNodeSet* my_ptr_array_to_node_set  (GPtrArray *elements, SiblingGroupKey *name, AttributeKey *attribute);
+static SV*         my_node_set_to_sv         (XacobeoIndex *index, xmlNodeSet *set);
+static AttributeIndex* my_get_attribute_index (XacobeoIndex *index, const gchar *name, const gchar *uri);
+static void        my_trim_attribute_indexes (XacobeoIndex *index, gsize needed);
+static void        my_attribute_index_free   (AttributeIndex *attribute);
+static const gchar* my_parse_name            (XacobeoIndex *index, const gchar *p, gchar **name, const gchar **uri);
+static gboolean    my_attribute_equals       (xmlNode *node, const gchar *name, const gchar *uri, const gchar *value);
+static gboolean    my_is_name_char           (gchar c);
+static SV*         my_node_to_sv             (XacobeoIndex *index, xmlNode *node);
+static guint       my_sibling_group_hash     (gconstpointer data);
+static gboolean    my_sibling_group_equal    (gconstpointer a, gconstpointer b);
+static void        my_sibling_group_free     (gpointer data);
+
+
+
+//
+// Creates a new index for the given document. The namespaces are the ones used
+// by the application (key: uri, value: prefix).
+//
+// The index has to be freed with xacobeo_index_free().
+//
+XacobeoIndex* xacobeo_index_new (SV *document, HV *namespaces) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL) {
+		WARN("Document has no node");
+		return NULL;
+	}
+
+	XacobeoIndex *index = xacobeo_index_begin(node->doc, NULL);
+	my_index_elements(index);
+	xacobeo_index_end(index, document, namespaces);
+
+	return index;
+}
+
+
+
+//
+// Creates an empty index for the given document. The elements are added by the
+// caller with xacobeo_index_add() while it walks the document and the index is
+// completed with xacobeo_index_end(). This way the index can be built by a walk
+// that collects other information at the same time. If a table with the
+// positions of the nodes in document order is given (the positions of a
+// preorder mirror) it's used instead of numbering the elements. Only
+// xacobeo_index_end() involves Perl, the elements can be added by any thread.
+//
+// The index has to be freed with xacobeo_index_free().
+//
+XacobeoIndex* xacobeo_index_begin (xmlDoc *doc, GHashTable *order) {
+
+	XacobeoIndex *index = g_new0(XacobeoIndex, 1);
+	index->doc = doc;
+	index->prefixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	index->siblings = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) g_hash_table_destroy);
+	index->elements = g_hash_table_new_full(my_sibling_group_hash, my_sibling_group_equal, g_free, my_sibling_group_free);
+	index->order = order ? g_hash_table_ref(order) : g_hash_table_new(g_direct_hash, g_direct_equal);
+	index->shared_order = order != NULL;
+	index->attributes = g_hash_table_new(my_sibling_group_hash, my_sibling_group_equal);
+	index->attributes_lru = g_queue_new();
+	index->attributes_limit = ATTRIBUTE_INDEX_LIMIT;
+
+	return index;
+}
+
+
+
+//
+// Adds an element to the index. The elements have to be added in document
+// order.
+//
+void xacobeo_index_add (XacobeoIndex *index, xmlNode *element) {
+
+	++index->size;
+	if (! index->shared_order) {
+		g_hash_table_insert(index->order, element, GSIZE_TO_POINTER(index->size));
+	}
+
+	SiblingGroupKey key = {
+		.name = (const gchar *) element->name,
+		.uri  = element->ns ? (const gchar *) element->ns->href : NULL,
+	};
+	GPtrArray *group = g_hash_table_lookup(index->elements, &key);
+	if (group == NULL) {
+		group = g_ptr_array_new();
+		SiblingGroupKey *group_key = g_new(SiblingGroupKey, 1);
+		*group_key = key;
+		g_hash_table_insert(index->elements, group_key, group);
+	}
+	g_ptr_array_add(group, element);
+}
+
+
+
+//
+// Completes an index once all the elements were added. The index keeps the
+// given document (an XML::LibXML::Document) alive. The namespaces are the ones
+// used by the application (key: uri, value: prefix).
+//
+void xacobeo_index_end (XacobeoIndex *index, SV *document, HV *namespaces) {
+
+	index->document = newSVsv(document);
+
+	if (namespaces) {
+		hv_iterinit(namespaces);
+		HE *entry;
+		while ((entry = hv_iternext(namespaces)) != NULL) {
+			I32 length;
+			gchar *uri = hv_iterkey(entry, &length);
+			SV *prefix = hv_iterval(namespaces, entry);
+			if (! SvPOK(prefix)) {
+				continue;
+			}
+			g_hash_table_insert(index->prefixes, g_strdup(SvPV_nolen(prefix)), g_strndup(uri, length));
+		}
+	}
+
+	INFO("Indexed %u element names", g_hash_table_size(index->elements));
+}
+
+
+
+//
+// Frees the index. The document is not freed by this function, it's only
+// released.
+//
+void xacobeo_index_free (XacobeoIndex *index) {
+	if (index == NULL) {
+		return;
+	}
+
+	g_hash_table_destroy(index->prefixes);
+	g_hash_table_destroy(index->siblings);
+	g_hash_table_destroy(index->elements);
+	g_hash_table_unref(index->order);
+	g_hash_table_destroy(index->attributes);
+	for (GList *link = index->attributes_lru->head; link; link = link->next) {
+		my_attribute_index_free(link->data);
+	}
+	g_queue_free(index->attributes_lru);
+	SvREFCNT_dec(index->document);
+	g_free(index);
+}
+
+
+
+//
+// Resolves a path of the form /a/b[3]/c (the paths returned by
+// xacobeo_get_node_path()) by walking the document directly. The XPath engine
+// is not used. Each step is resolved in constant time thanks to a positional
+// index of the siblings.
+//
+// Returns the node found; if the path doesn't match a node then a false value
+// is returned. If the path is not supported (the path uses more than the
+// simple syntax or it matches more than one node) then undef is returned and
+// the caller has to use the XPath engine instead.
+//
+SV* xacobeo_index_resolve_path (XacobeoIndex *index, const gchar *path) {
+
+	if (index == NULL || path == NULL || *path != '/') {
+		return &PL_sv_undef;
+	}
+
+	xmlNode *node = (xmlNode *) index->doc;
+	const gchar *p = path + 1;
+	if (*p == '\0') {
+		return my_node_to_sv(index, node);
+	}
+
+	// The whole path is parsed even if a step has no match as the remaining steps
+	// could still be outside of the supported syntax.
+	while (TRUE) {
+
+		// Parse the name of the step (prefix:name)
+		gchar *name = NULL;
+		const gchar *uri = NULL;
+		p = my_parse_name(index, p, &name, &uri);
+		if (p == NULL) {
+			// Not a name or an undefined namespace, let XPath report the error
+			return &PL_sv_undef;
+		}
+
+		// Parse the position (optional)
+		guint position = 0;
+		if (*p == '[') {
+			++p;
+			while (g_ascii_isdigit(*p)) {
+				position = position * 10 + (*p - '0');
+				if (position > G_MAXINT / 10) {
+					g_free(name);
+					return &PL_sv_undef;
+				}
+				++p;
+			}
+			if (*p != ']' || position == 0) {
+				g_free(name);
+				return &PL_sv_undef;
+			}
+			++p;
+		}
+
+		// A step is followed by another step or by the end of the path
+		if (*p == '/') {
+			++p;
+			if (*p == '\0') {
+				g_free(name);
+				return &PL_sv_undef;
+			}
+		}
+		else if (*p != '\0') {
+			g_free(name);
+			return &PL_sv_undef;
+		}
+
+
+		// Resolve the step
+		if (node != NULL) {
+			GPtrArray *group = my_get_sibling_group(index, node, name, uri);
+
+			if (group == NULL || position > group->len) {
+				node = NULL;
+			}
+			else if (position) {
+				node = g_ptr_array_index(group, position - 1);
+			}
+			else if (group->len == 1) {
+				node = g_ptr_array_index(group, 0);
+			}
+			else {
+				// The path matches multiple nodes
+				g_free(name);
+				return &PL_sv_undef;
+			}
+		}
+		g_free(name);
+
+		if (*p == '\0') {
+			return node ? my_node_to_sv(index, node) : &PL_sv_no;
+		}
+	}
+}
+
+
+
+//
+// Evaluates the simple XPath expressions that can be answered by the indexes,
+// without using the XPath engine. The supported expressions are:
+//
+//   //name
+//   //name[@attribute='value']
+//   //*[@attribute='value']
+//   count() of any of the expressions above
+//
+// The names can have a prefix. The result is the same as the one of the XPath
+// engine: a node set (as a Xacobeo::XS::NodeSet) with the elements in document
+// order, or an XML::LibXML::Number for count().
+//
+// If the expression is not supported undef is returned and the caller has to
+// use the XPath engine instead.
+//
+SV* xacobeo_index_find (XacobeoIndex *index, const gchar *expression) {
+
+	if (index == NULL || expression == NULL) {
+		return &PL_sv_undef;
+	}
+
+	const gchar *p = expression;
+	gboolean count = FALSE;
+	if (g_str_has_prefix(p, "count(")) {
+		count = TRUE;
+		p += strlen("count(");
+	}
+	if (! g_str_has_prefix(p, "//")) {
+		return &PL_sv_undef;
+	}
+	p += 2;
+
+	// The element, any element (*) is only supported with a predicate
+	gchar *name = NULL;
+	const gchar *uri = NULL;
+	if (*p == '*' && p[1] == '[') {
+		++p;
+	}
+	else {
+		p = my_parse_name(index, p, &name, &uri);
+		if (p == NULL) {
+			return &PL_sv_undef;
+		}
+	}
+
+	// The attribute predicate (optional)
+	gchar *attr_name = NULL;
+	const gchar *attr_uri = NULL;
+	gchar *value = NULL;
+	if (*p == '[') {
+		if (p[1] == '@') {
+			p = my_parse_name(index, p + 2, &attr_name, &attr_uri);
+		}
+		else {
+			p = NULL;
+		}
+
+		if (p && *p == '=' && (p[1] == '\'' || p[1] == '"')) {
+			gchar quote = p[1];
+			const gchar *start = p + 2;
+			const gchar *end = strchr(start, quote);
+			if (end && end[1] == ']') {
+				value = g_strndup(start, end - start);
+				p = end + 2;
+			}
+		}
+
+		if (value == NULL) {
+			p = NULL;
+		}
+	}
+
+	if (count && p && *p == ')') {
+		++p;
+	}
+	else if (count) {
+		p = NULL;
+	}
+
+
+	SV *sv = &PL_sv_undef;
+	xmlNodeSet *set = NULL;
+	if (p && *p == '\0') {
+		if (value) {
+			set = my_find_by_attribute(index, name, uri, attr_name, attr_uri, value);
+		}
+		else {
+			SiblingGroupKey key = {
+				.name = name,
+				.uri  = uri,
+			};
+			set = my_ptr_array_to_node_set(g_hash_table_lookup(index->elements, &key), NULL, NULL);
+		}
+	}
+
+	if (set && count) {
+		sv = sv_bless(newRV_noinc(newSVnv(set->nodeNr)), gv_stashpv("XML::LibXML::Number", GV_ADD));
+		xmlXPathFreeNodeSet(set);
+	}
+	else if (set) {
+		sv = my_node_set_to_sv(index, set);
+	}
+
+	g_free(name);
+	g_free(attr_name);
+	g_free(value);
+
+	return sv;
+}
+
+
+
+//
+// Returns the elements that have an attribute with the given value, as done by
+// the XPath expression //*[@name='value']. The name of the attribute can have a
+// prefix.
+//
+// The elements are returned as a Xacobeo::XS::NodeSet. If the index of the
+// attribute values is not available (it exceeds the memory limit) or if the
+// prefix is not defined undef is returned and the caller has to use the XPath
+// engine instead.
+//
+SV* xacobeo_index_find_attribute (XacobeoIndex *index, const gchar *name, const gchar *value) {
+
+	if (index == NULL || name == NULL || value == NULL) {
+		return &PL_sv_undef;
+	}
+
+	gchar *attr_name = NULL;
+	const gchar *attr_uri = NULL;
+	const gchar *end = my_parse_name(index, name, &attr_name, &attr_uri);
+	if (end == NULL || *end != '\0') {
+		g_free(attr_name);
+		return &PL_sv_undef;
+	}
+
+	xmlNodeSet *set = my_find_by_attribute(index, NULL, NULL, attr_name, attr_uri, value);
+	g_free(attr_name);
+
+	return set ? my_node_set_to_sv(index, set) : &PL_sv_undef;
+}
+
+
+
+//
+// Sets the maximal number of bytes used by the indexes of the attribute values.
+// The indexes that were used the least recently are discarded in order to make
+// room for new ones. An attribute with an index that's bigger than the limit is
+// never indexed.
+//
+void xacobeo_index_set_attribute_limit (XacobeoIndex *index, gulong limit) {
+	index->attributes_limit = limit;
+
+	// Forget the attributes that were too big, they could fit now
+	GList *link = index->attributes_lru->head;
+	while (link) {
+		GList *next = link->next;
+		AttributeIndex *attribute = link->data;
+		if (attribute->values == NULL) {
+			g_hash_table_remove(index->attributes, &attribute->key);
+			g_queue_delete_link(index->attributes_lru, link);
+			my_attribute_index_free(attribute);
+		}
+		link = next;
+	}
+
+	my_trim_attribute_indexes(index, 0);
+}
+
+
+
+//
+// Sorts the nodes of the set in document order and removes the duplicates. The
+// elements are compared by their position in the document.
+//
+void xacobeo_index_sort (XacobeoIndex *index, XacobeoNodeSet *set) {
+	xacobeo_nodeset_sort(set, set->doc == index->doc ? index->order : NULL);
+}
+
+
+
+//
+// Returns the nodes that are in any of the sets as a new Xacobeo::XS::NodeSet in
+// document order. If the sets belong to different documents undef is returned.
+//
+SV* xacobeo_index_union (XacobeoIndex *index, XacobeoNodeSet *set, XacobeoNodeSet *other) {
+	XacobeoNodeSet *merged = xacobeo_nodeset_union(set, other, set->doc == index->doc ? index->order : NULL);
+	return merged ? sv_setref_pv(newSV(0), "Xacobeo::XS::NodeSet", (void *) merged) : &PL_sv_undef;
+}
+
+
+
+//
+// Returns the nodes that are in both sets as a new Xacobeo::XS::NodeSet in
+// document order. If the sets belong to different documents undef is returned.
+//
+SV* xacobeo_index_intersect (XacobeoIndex *index, XacobeoNodeSet *set, XacobeoNodeSet *other) {
+	XacobeoNodeSet *common = xacobeo_nodeset_intersect(set, other, set->doc == index->doc ? index->order : NULL);
+	return common ? sv_setref_pv(newSV(0), "Xacobeo::XS::NodeSet", (void *) common) : &PL_sv_undef;
+}
+
+
+
+//
+// Returns the elements matching //name[@attribute='value'] where the name of
+// the element is optional (NULL stands for any element). The index of the
+// attribute values is used when possible, otherwise the elements with the given
+// name are scanned.
+//
+// Returns NULL if the expression can't be answered by the indexes.
+//
+static xmlNodeSet* my_find_by_attribute (XacobeoIndex *index, const gchar *name, const gchar *uri, const gchar *attr_name, const gchar *attr_uri, const gchar *value) {
+
+	SiblingGroupKey key = {
+		.name = name,
+		.uri  = uri,
+	};
+
+	AttributeIndex *attribute = my_get_attribute_index(index, attr_name, attr_uri);
+	if (attribute) {
+		GPtrArray *elements = g_hash_table_lookup(attribute->values, value);
+		return my_ptr_array_to_node_set(elements, name ? &key : NULL, NULL);
+	}
+	else if (name) {
+		// The index is too big, scan the elements with the given name
+		AttributeKey filter = {
+			.name  = attr_name,
+			.uri   = attr_uri,
+			.value = value,
+		};
+		return my_ptr_array_to_node_set(g_hash_table_lookup(index->elements, &key), NULL, &filter);
+	}
+
+	return NULL;
+}
+
+
+
+//
+// Returns a node set with the elements of the given array (in the same order).
+// Only the elements with the given name (if any) and having the given attribute
+// (if any) are kept.
+//
+static xmlNodeSet* my_ptr_array_to_node_set (GPtrArray *elements, SiblingGroupKey *name, AttributeKey *attribute) {
+
+	xmlNodeSet *set = xmlXPathNodeSetCreate(NULL);
+	guint size = elements ? elements->len : 0;
+	for (guint i = 0; i < size; ++i) {
+		xmlNode *node = g_ptr_array_index(elements, i);
+
+		if (name) {
+			const gchar *uri = node->ns ? (const gchar *) node->ns->href : NULL;
+			if (strcmp((const gchar *) node->name, name->name) != 0 || g_strcmp0(uri, name->uri) != 0) {
+				continue;
+			}
+		}
+
+		if (attribute && ! my_attribute_equals(node, attribute->name, attribute->uri, attribute->value)) {
+			continue;
+		}
+
+		xmlXPathNodeSetAddUnique(set, node);
+	}
+
+	return set;
+}
+
+
+
+//
+// Wraps a node set into a Xacobeo::XS::NodeSet. The node set is owned by the
+// Perl object.
+//
+static SV* my_node_set_to_sv (XacobeoIndex *index, xmlNodeSet *set) {
+	XacobeoNodeSet *nodeset = xacobeo_nodeset_new(index->document, xmlXPathWrapNodeSet(set));
+	return sv_setref_pv(newSV(0), "Xacobeo::XS::NodeSet", (void *) nodeset);
+}
+
+
+
+//
+// Returns the index of the values of the given attribute. The index is built
+// the first time that it's requested by walking the whole document.
+//
+// Returns NULL if the index needs more memory than the limit.
+//
+static AttributeIndex* my_get_attribute_index (XacobeoIndex *index, const gchar *name, const gchar *uri) {
+
+	SiblingGroupKey key = {
+		.name = name,
+		.uri  = uri,
+	};
+	GList *link = g_hash_table_lookup(index->attributes, &key);
+	if (link) {
+		// Move the index to the front
+		g_queue_unlink(index->attributes_lru, link);
+		g_queue_push_head_link(index->attributes_lru, link);
+		AttributeIndex *attribute = link->data;
+		return attribute->values ? attribute : NULL;
+	}
+
+
+	// Build the index
+	AttributeIndex *attribute = g_new0(AttributeIndex, 1);
+	attribute->key.name = g_strdup(name);
+	attribute->key.uri = g_strdup(uri);
+	attribute->values = g_hash_table_new_full(g_str_hash, g_str_equal, xmlFree, my_sibling_group_free);
+
+	xmlNode *top = (xmlNode *) index->doc;
+	for (xmlNode *node = my_next_element(top, top); node; node = my_next_element(top, node)) {
+		for (xmlAttr *attr = node->properties; attr; attr = attr->next) {
+			const gchar *attr_uri = attr->ns ? (const gchar *) attr->ns->href : NULL;
+			if (strcmp((const gchar *) attr->name, name) != 0 || g_strcmp0(attr_uri, uri) != 0) {
+				continue;
+			}
+
+			xmlChar *value = xmlNodeGetContent((xmlNode *) attr);
+			if (value == NULL) {
+				value = xmlStrdup(BAD_CAST "");
+			}
+			GPtrArray *elements = g_hash_table_lookup(attribute->values, value);
+			if (elements == NULL) {
+				elements = g_ptr_array_new();
+				g_hash_table_insert(attribute->values, value, elements);
+				attribute->size += xmlStrlen(value) + 1 + ATTRIBUTE_VALUE_OVERHEAD;
+			}
+			else {
+				xmlFree(value);
+			}
+			g_ptr_array_add(elements, node);
+			attribute->size += sizeof(gpointer);
+			break;
+		}
+
+		if (attribute->size > index->attributes_limit) {
+			// Too big, remember that this attribute can't be indexed
+			g_hash_table_destroy(attribute->values);
+			attribute->values = NULL;
+			attribute->size = 0;
+			break;
+		}
+	}
+
+	DEBUG("Index of attribute %s: %lu bytes", name, (gulong) attribute->size);
+	my_trim_attribute_indexes(index, attribute->size);
+
+	g_queue_push_head(index->attributes_lru, attribute);
+	g_hash_table_insert(index->attributes, &attribute->key, index->attributes_lru->head);
+	index->attributes_size += attribute->size;
+
+	return attribute->values ? attribute : NULL;
+}
+
+
+
+//
+// Discards the indexes of the attribute values that were used the least
+// recently until there's enough room for 'needed' bytes.
+//
+static void my_trim_attribute_indexes (XacobeoIndex *index, gsize needed) {
+	GList *link = index->attributes_lru->tail;
+	while (link && index->attributes_size + needed > index->attributes_limit) {
+		GList *previous = link->prev;
+		AttributeIndex *attribute = link->data;
+		if (attribute->values) {
+			g_hash_table_remove(index->attributes, &attribute->key);
+			g_queue_delete_link(index->attributes_lru, link);
+			index->attributes_size -= attribute->size;
+			my_attribute_index_free(attribute);
+		}
+		link = previous;
+	}
+}
+
+
+
+//
+// Frees the index of the values of an attribute.
+//
+static void my_attribute_index_free (AttributeIndex *attribute) {
+	if (attribute->values) {
+		g_hash_table_destroy(attribute->values);
+	}
+	g_free((gchar *) attribute->key.name);
+	g_free((gchar *) attribute->key.uri);
+	g_free(attribute);
+}
+
+
+
+//
+// Returns the children of the given parent that have the given name and
+// namespace. The children are returned in document order. If there's no such
+// children then NULL is returned.
+//
+static GPtrArray* my_get_sibling_group (XacobeoIndex *index, xmlNode *parent, const gchar *name, const gchar *uri) {
+	SiblingGroupKey key = {
+		.name = name,
+		.uri  = uri,
+	};
+	GHashTable *groups = my_get_sibling_groups(index, parent);
+	return g_hash_table_lookup(groups, &key);
+}
+
+
+
+//
+// Returns the children of the given parent grouped by name and namespace. The
+// groups are computed the first time that a parent is visited.
+//
+static GHashTable* my_get_sibling_groups (XacobeoIndex *index, xmlNode *parent) {
+
+	GHashTable *groups = g_hash_table_lookup(index->siblings, parent);
+	if (groups) {
+		return groups;
+	}
+
+	groups = g_hash_table_new_full(my_sibling_group_hash, my_sibling_group_equal, g_free, my_sibling_group_free);
+	for (xmlNode *child = parent->children; child; child = child->next) {
+		if (child->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		SiblingGroupKey key = {
+			.name = (const gchar *) child->name,
+			.uri  = child->ns ? (const gchar *) child->ns->href : NULL,
+		};
+		GPtrArray *group = g_hash_table_lookup(groups, &key);
+		if (group == NULL) {
+			group = g_ptr_array_new();
+			SiblingGroupKey *group_key = g_new(SiblingGroupKey, 1);
+			*group_key = key;
+			g_hash_table_insert(groups, group_key, group);
+		}
+		g_ptr_array_add(group, child);
+	}
+
+	g_hash_table_insert(index->siblings, parent, groups);
+	return groups;
+}
+
+
+
+//
+// Builds the index of the elements by walking the whole document once. The
+// elements are added in document order.
+//
+static void my_index_elements (XacobeoIndex *index) {
+	xmlNode *top = (xmlNode *) index->doc;
+	for (xmlNode *node = my_next_element(top, top); node; node = my_next_element(top, node)) {
+		xacobeo_index_add(index, node);
+	}
+}
+
+
+
+//
+// Returns the element that follows the given node in document order or NULL if
+// there are no more elements under 'top'. The walk doesn't use recursion.
+//
+static xmlNode* my_next_element (xmlNode *top, xmlNode *node) {
+	do {
+		if ((node == top || node->type == XML_ELEMENT_NODE) && node->children) {
+			node = node->children;
+		}
+		else {
+			// Go to the next node, going up when all the children are done
+			while (node != top && node->next == NULL) {
+				node = node->parent;
+			}
+			if (node == top) {
+				return NULL;
+			}
+			node = node->next;
+		}
+	} while (node->type != XML_ELEMENT_NODE);
+
+	return node;
+}
+
+
+
+//
+// Parses a name (prefix:name) starting at the given position. The local name
+// is returned in 'name' (it has to be freed) and the namespace of the prefix in
+// 'uri' (NULL if the name has no prefix).
+//
+// Returns the position after the name or NULL if there's no name or if the
+// prefix is not defined.
+//
+static const gchar* my_parse_name (XacobeoIndex *index, const gchar *p, gchar **name, const gchar **uri) {
+
+	const gchar *start = p;
+	const gchar *colon = NULL;
+	while (my_is_name_char(*p) || (*p == ':' && colon == NULL)) {
+		if (*p == ':') {
+			colon = p;
+		}
+		++p;
+	}
+	if (p == start || colon == start || (colon && colon + 1 == p) || g_ascii_isdigit(*start)) {
+		return NULL;
+	}
+
+	*uri = NULL;
+	if (colon) {
+		gchar *prefix = g_strndup(start, colon - start);
+		*uri = g_hash_table_lookup(index->prefixes, prefix);
+		g_free(prefix);
+		if (*uri == NULL) {
+			return NULL;
+		}
+	}
+
+	const gchar *local = colon ? colon + 1 : start;
+	*name = g_strndup(local, p - local);
+	return p;
+}
+
+
+
+//
+// Returns TRUE if the element has the given attribute with the given value. As
+// with XPath the default values of the attributes declared in the DTD are not
+// taken into account.
+//
+static gboolean my_attribute_equals (xmlNode *node, const gchar *name, const gchar *uri, const gchar *value) {
+
+	for (xmlAttr *attr = node->properties; attr; attr = attr->next) {
+		if (strcmp((const gchar *) attr->name, name) != 0) {
+			continue;
+		}
+		const gchar *attr_uri = attr->ns ? (const gchar *) attr->ns->href : NULL;
+		if (g_strcmp0(attr_uri, uri) != 0) {
+			continue;
+		}
+
+		xmlChar *content = xmlNodeGetContent((xmlNode *) attr);
+		gboolean equals = content ? strcmp((const gchar *) content, value) == 0 : value[0] == '\0';
+		xmlFree(content);
+		return equals;
+	}
+
+	return FALSE;
+}
+
+
+
+//
+// Returns TRUE if the character can be used in the name of an element (the
+// colon used by the prefixes is not included). Non ASCII characters are
+// accepted as they are.
+//
+static gboolean my_is_name_char (gchar c) {
+	return g_ascii_isalnum(c) || c == '_' || c == '-' || c == '.' || (c & 0x80);
+}
+
+
+
+//
+// Returns the Perl representation of a node of the indexed document.
+//
+static SV* my_node_to_sv (XacobeoIndex *index, xmlNode *node) {
+	ProxyNode *owner = PmmOWNERPO(PmmPROXYNODE(((xmlNode *) index->doc)));
+	return PmmNodeToSv(node, owner);
+}
+
+
+
+//
+// Hash functions used for grouping the siblings.
+//
+static guint my_sibling_group_hash (gconstpointer data) {
+	const SiblingGroupKey *key = data;
+	return g_str_hash(key->name) ^ (key->uri ? g_str_hash(key->uri) : 0);
+}
+
+static gboolean my_sibling_group_equal (gconstpointer a, gconstpointer b) {
+	const SiblingGroupKey *key_a = a;
+	const SiblingGroupKey *key_b = b;
+	return strcmp(key_a->name, key_b->name) == 0 && g_strcmp0(key_a->uri, key_b->uri) == 0;
+}
+
+static void my_sibling_group_free (gpointer data) {
+	g_ptr_array_free((GPtrArray *) data, TRUE);
+}
@@ -0,0 +1,80 @@
+#ifndef __XACOBEO_INDEX_H__
+#define __XACOBEO_INDEX_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <glib.h>
+#include <libxml/tree.h>
+
+#include "nodeset.h"
+
+
+//
+// Native information about a document. The index is built from a document and
+// it's meant to speed up the navigation of the document. The index doesn't
+// modify the document; it keeps only references to its nodes.
+//
+typedef struct _XacobeoIndex {
+
+	// The document indexed
+	xmlDoc *doc;
+
+	// The Perl document (XML::LibXML::Document), it's kept in order to ensure
+	// that the document is not freed while the index is alive.
+	SV *document;
+
+	// The prefixes used by the application (key: prefix, value: uri)
+	GHashTable *prefixes;
+
+	// Positional index of the children of an element. The children are grouped
+	// by their name and namespace (key: xmlNode*, value: GHashTable*). This
+	// index is built lazily when a parent is visited for the first time.
+	GHashTable *siblings;
+
+	// All the elements of the document grouped by their name and namespace, each
+	// group is in document order. This index is built with the index.
+	GHashTable *elements;
+
+	// The position of each element in document order (key: xmlNode*, value:
+	// number starting at 1). It's used for sorting and merging node sets without
+	// walking the tree. The numbers are not stored in the document as done by
+	// xmlXPathOrderDocElems() since libxml2 then misplaces the text nodes. The
+	// table can be the positions of a preorder mirror, which also has the other
+	// nodes; it's then shared and filled by the mirror.
+	GHashTable *order;
+	gboolean shared_order;
+
+	// The number of elements indexed
+	gsize size;
+
+	// Inverted indexes of the attribute values (key: name and namespace of the
+	// attribute, value: GList* in attributes_lru). The index of an attribute is
+	// built the first time that the attribute is searched. The indexes used the
+	// least recently are discarded once the memory limit is reached.
+	GHashTable *attributes;
+	GQueue *attributes_lru;
+	gsize attributes_size;
+	gsize attributes_limit;
+
+} XacobeoIndex;
+
+
+// Public prototypes
+XacobeoIndex* xacobeo_index_new          (SV *document, HV *namespaces);
+XacobeoIndex* xacobeo_index_begin        (xmlDoc *doc, GHashTable *order);
+void          xacobeo_index_add          (XacobeoIndex *index, xmlNode *element);
+void          xacobeo_index_end          (XacobeoIndex *index, SV *document, HV *namespaces);
+void          xacobeo_index_free         (XacobeoIndex *index);
+SV*           xacobeo_index_resolve_path (XacobeoIndex *index, const gchar *path);
+SV*           xacobeo_index_find         (XacobeoIndex *index, const gchar *expression);
+SV*           xacobeo_index_find_attribute (XacobeoIndex *index, const gchar *name, const gchar *value);
+void          xacobeo_index_set_attribute_limit (XacobeoIndex *index, gulong limit);
+void          xacobeo_index_sort         (XacobeoIndex *index, XacobeoNodeSet *set);
+SV*           xacobeo_index_union        (XacobeoIndex *index, XacobeoNodeSet *set, XacobeoNodeSet *other);
+SV*           xacobeo_index_intersect    (XacobeoIndex *index, XacobeoNodeSet *set, XacobeoNodeSet *other);
+
+
+#endif
@@ -0,0 +1,814 @@
+//
+// XPath evaluation in a worker thread.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "job.h"
+#include "xpath.h"
+#include "nodeset.h"
+#include "logger.h"
+#include "libxml.h"
+
+#include <libxml/xmlversion.h>
+#include <libxml/xpathInternals.h>
+
+
+// The smallest number of elements under the root for a parallel evaluation and
+// the smallest number of elements evaluated by a thread
+#define PARTITION_MIN_ELEMENTS 256
+#define PARTITION_MIN_SIZE 64
+
+
+// Guards the partitions registered in the jobs
+G_LOCK_DEFINE_STATIC(partitions);
+
+
+//
+// A range of the elements under the root of the document evaluated by a
+// thread. Each partition has its own context and compiled expression, the
+// document is only read.
+//
+typedef struct _XPathPartition {
+
+	XacobeoXPathJob *job;
+	xmlXPathContext *context;
+	xmlXPathCompExpr *compiled;
+
+	// The elements evaluated
+	xmlNode **elements;
+	guint count;
+
+	// The nodes found in document order, the nodes found under elements[i] are
+	// nodes[offsets[i]] to nodes[offsets[i + 1] - 1]
+	xmlNodeSet *nodes;
+	guint *offsets;
+
+	// The first error raised by the evaluation (if any)
+	gchar *error;
+	gboolean failed;
+
+	// The number of operations already added to the progress of the job
+	gulong progress;
+
+	GThread *thread;
+
+} XPathPartition;
+
+
+// The names of the states as seen by Perl (indexed by XPathJobStateEnum)
+static const gchar *STATE_NAMES[] = {
+	"running",
+	"done",
+	"error",
+	"cancelled",
+	"timeout",
+	"limit",
+};
+
+
+//
+// Function prototypes
+//
+static XacobeoXPathJob* my_job_new     (SV *document, const gchar *expression, HV *namespaces, gdouble timeout);
+static void     my_job_start            (XacobeoXPathJob *job);
+static gpointer my_job_run              (gpointer data);
+static gboolean my_job_explain          (XacobeoXPathJob *job);
+static void     my_job_stop             (XacobeoXPathJob *job, XPathJobStateEnum reason);
+static void     my_job_error            (void *data, xmlError *error);
+static SV*      my_new_scalar_object    (const gchar *class, SV *value);
+static xmlXPathObject* my_eval_partitioned (XacobeoXPathJob *job, const gchar *step);
+static gpointer my_partition_run        (gpointer data);
+static void     my_partition_error      (void *data, xmlError *error);
+static void     my_partition_add_progress (XPathPartition *partition);
+static guint    my_get_partition_count  (guint elements, guint threads);
+static void     my_copy_namespace       (void *payload, void *data, const xmlChar *name);
+static gboolean my_append_result        (xmlNodeSet *set, xmlXPathObject *result);
+
+
+
+//
+// Creates a new job that evaluates the given expression on the document in a
+// worker thread. The job is started right away. The namespaces (key: uri,
+// value: prefix) are registered in the evaluation context.
+//
+// The evaluation is stopped once it takes more than 'timeout' seconds. If the
+// result is a node set with more than 'max_nodes' nodes it's discarded. A
+// value of 0 disables the corresponding limit. A parallel evaluation is stopped
+// as soon as its threads found more than 'max_nodes' nodes, a serial evaluation
+// can only be checked once it's over since libxml2 builds the node set
+// internally.
+//
+// The job has to be freed with xacobeo_xpath_job_free().
+//
+XacobeoXPathJob* xacobeo_xpath_job_new (SV *document, const gchar *expression, HV *namespaces, gdouble timeout, guint max_nodes, guint threads) {
+
+	XacobeoXPathJob *job = my_job_new(document, expression, namespaces, timeout);
+	if (job == NULL) {
+		return NULL;
+	}
+	job->max_nodes = max_nodes;
+	job->threads = threads;
+	my_job_start(job);
+
+	return job;
+}
+
+
+
+//
+// Creates a new job that explains the given expression step by step in a
+// worker thread, see xacobeo_xpath_explain(). An expression that can't be
+// explained by steps is explained by a single row: its normal evaluation. The
+// job is started right away and is stopped once it takes more than 'timeout'
+// seconds (0 for no timeout).
+//
+// The job has to be freed with xacobeo_xpath_job_free().
+//
+XacobeoXPathJob* xacobeo_xpath_job_new_explain (SV *document, const gchar *expression, HV *namespaces, gdouble timeout) {
+
+	XacobeoXPathJob *job = my_job_new(document, expression, namespaces, timeout);
+	if (job == NULL) {
+		return NULL;
+	}
+	job->explain = TRUE;
+	my_job_start(job);
+
+	return job;
+}
+
+
+
+//
+// Frees the job. If the job is still running it's cancelled and this function
+// waits for the worker thread to finish.
+//
+void xacobeo_xpath_job_free (XacobeoXPathJob *job) {
+	if (job == NULL) {
+		return;
+	}
+
+	if (job->thread) {
+		my_job_stop(job, XPATH_JOB_CANCELLED);
+		g_thread_join(job->thread);
+	}
+
+	if (job->result) {
+		xmlXPathFreeObject(job->result);
+	}
+	if (job->explanation) {
+		g_ptr_array_free(job->explanation, TRUE);
+	}
+	if (job->nodeset) {
+		SvREFCNT_dec(job->nodeset);
+	}
+	if (job->compiled) {
+		xmlXPathFreeCompExpr(job->compiled);
+	}
+	xmlXPathFreeContext(job->context);
+	g_timer_destroy(job->timer);
+	g_free(job->expression);
+	g_free(job->error);
+	SvREFCNT_dec(job->document);
+	g_free(job);
+}
+
+
+
+//
+// Creates a job that isn't started yet. Returns NULL if there's no document or
+// no expression.
+//
+static XacobeoXPathJob* my_job_new (SV *document, const gchar *expression, HV *namespaces, gdouble timeout) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL || expression == NULL) {
+		WARN("Can't create an XPath job without a document or an expression");
+		return NULL;
+	}
+
+	XacobeoXPathJob *job = g_new0(XacobeoXPathJob, 1);
+	job->doc = node->doc;
+	job->document = newSVsv(document);
+	job->timeout = timeout;
+	job->timer = g_timer_new();
+
+	job->expression = g_strdup(expression);
+	job->context = xacobeo_xpath_context_new(namespaces);
+	job->context->doc = job->doc;
+	job->context->node = (xmlNode *) job->doc;
+	// The errors are collected by the worker thread
+	job->context->error = NULL;
+#if LIBXML_VERSION >= 20911
+	// Operations are only counted when there's a limit, the limit is lowered when
+	// the job has to be stopped.
+	job->context->opLimit = G_MAXULONG;
+#endif
+
+	return job;
+}
+
+
+
+//
+// Starts the worker thread of a job.
+//
+static void my_job_start (XacobeoXPathJob *job) {
+	job->state = XPATH_JOB_RUNNING;
+#if GLIB_CHECK_VERSION(2, 32, 0)
+	job->thread = g_thread_new("xpath", my_job_run, job);
+#else
+	if (! g_thread_supported()) {
+		g_thread_init(NULL);
+	}
+	job->thread = g_thread_create(my_job_run, job, TRUE, NULL);
+#endif
+}
+
+
+
+//
+// Returns the state of the job: "running", "done", "error", "cancelled",
+// "timeout" or "limit" (too many results). The job is stopped if it exceeded
+// its timeout.
+//
+const gchar* xacobeo_xpath_job_poll (XacobeoXPathJob *job) {
+
+	gint state = g_atomic_int_get(&job->state);
+	if (state == XPATH_JOB_RUNNING) {
+		if (job->timeout > 0 && g_timer_elapsed(job->timer, NULL) > job->timeout) {
+			my_job_stop(job, XPATH_JOB_TIMEOUT);
+		}
+	}
+	else if (job->thread) {
+		g_thread_join(job->thread);
+		job->thread = NULL;
+	}
+
+	return STATE_NAMES[state];
+}
+
+
+
+//
+// Requests the job to stop. The job will be in the state "cancelled" once the
+// worker thread is done.
+//
+void xacobeo_xpath_job_cancel (XacobeoXPathJob *job) {
+	my_job_stop(job, XPATH_JOB_CANCELLED);
+}
+
+
+
+//
+// Returns the number of seconds spent evaluating the expression.
+//
+gdouble xacobeo_xpath_job_elapsed (XacobeoXPathJob *job) {
+	return g_timer_elapsed(job->timer, NULL);
+}
+
+
+
+//
+// Returns the number of operations performed so far by the XPath engine (each
+// node visited counts as an operation). The progress is only available with
+// libxml2 2.9.11 or later, with older versions 0 is returned.
+//
+gulong xacobeo_xpath_job_progress (XacobeoXPathJob *job) {
+#if LIBXML_VERSION >= 20911
+	return job->context->opCount + (gulong) g_atomic_pointer_get(&job->partitions_progress);
+#else
+	return 0;
+#endif
+}
+
+
+
+//
+// Returns the error message of a job that failed or NULL.
+//
+const gchar* xacobeo_xpath_job_error (XacobeoXPathJob *job) {
+	if (g_atomic_int_get(&job->state) != XPATH_JOB_ERROR) {
+		return NULL;
+	}
+	return job->error;
+}
+
+
+
+//
+// Returns the result of a job that's done, the values are the same as the ones
+// returned by XML::LibXML::XPathContext::find() except for the node sets which
+// are returned as a Xacobeo::XS::NodeSet. The result of an explanation is an
+// array ref of rows [label, count, seconds]. If the job is not done undef is
+// returned.
+//
+SV* xacobeo_xpath_job_result (XacobeoXPathJob *job) {
+
+	if (g_atomic_int_get(&job->state) != XPATH_JOB_DONE) {
+		return &PL_sv_undef;
+	}
+	if (job->explanation) {
+		return xacobeo_xpath_explain_to_sv(job->explanation);
+	}
+	if (job->nodeset) {
+		return newSVsv(job->nodeset);
+	}
+
+	xmlXPathObject *result = job->result;
+	if (result == NULL) {
+		return &PL_sv_undef;
+	}
+	switch (result->type) {
+		case XPATH_NODESET:
+		{
+			// The nodes are handed to a native node set, Perl nodes are created
+			// only when needed.
+			if (job->nodeset == NULL) {
+				XacobeoNodeSet *set = xacobeo_nodeset_new(job->document, result);
+				job->nodeset = sv_setref_pv(newSV(0), "Xacobeo::XS::NodeSet", (void *) set);
+				job->result = NULL;
+			}
+			return newSVsv(job->nodeset);
+		}
+
+		case XPATH_BOOLEAN:
+			return my_new_scalar_object("XML::LibXML::Boolean", newSViv(result->boolval ? 1 : 0));
+
+		case XPATH_NUMBER:
+			return my_new_scalar_object("XML::LibXML::Number", newSVnv(result->floatval));
+
+		case XPATH_STRING:
+		{
+			SV *value = newSVpv((const char *) result->stringval, 0);
+			SvUTF8_on(value);
+			return my_new_scalar_object("XML::LibXML::Literal", value);
+		}
+
+		default:
+			WARN("Unsupported XPath result type %d", result->type);
+			return &PL_sv_undef;
+	}
+}
+
+
+
+//
+// The worker thread. Evaluates the expression and sets the final state of the
+// job.
+//
+static gpointer my_job_run (gpointer data) {
+	XacobeoXPathJob *job = (XacobeoXPathJob *) data;
+
+	// The error handlers are per thread, the ones of the main thread are not
+	// affected.
+	xmlSetStructuredErrorFunc(job, my_job_error);
+
+	xmlXPathObject *result = NULL;
+	gboolean explained = FALSE;
+	job->compiled = xmlXPathCtxtCompile(job->context, BAD_CAST job->expression);
+	if (job->compiled && job->explain) {
+		explained = my_job_explain(job);
+	}
+	else if (job->compiled) {
+		// The queries //step[predicate] are split by the subtrees of the root
+		gchar *step = xacobeo_xpath_get_descendant_step(job->expression);
+		if (step) {
+			result = my_eval_partitioned(job, step);
+			g_free(step);
+		}
+
+		if (result == NULL && job->error == NULL && ! g_atomic_int_get(&job->stopped)) {
+			result = xmlXPathCompiledEval(job->compiled, job->context);
+		}
+	}
+	g_timer_stop(job->timer);
+
+	gint state = g_atomic_int_get(&job->stopped);
+	if (state) {
+		// Cancelled or timeout, the result (if any) is incomplete
+	}
+	else if (result == NULL && ! explained) {
+		state = XPATH_JOB_ERROR;
+		if (job->error == NULL) {
+			job->error = g_strdup("XPath evaluation failed");
+		}
+	}
+	else if (job->max_nodes && result && result->type == XPATH_NODESET && result->nodesetval && (guint) result->nodesetval->nodeNr > job->max_nodes) {
+		state = XPATH_JOB_LIMIT;
+	}
+	else {
+		state = XPATH_JOB_DONE;
+	}
+
+	if (state == XPATH_JOB_DONE) {
+		job->result = result;
+	}
+	else if (result) {
+		xmlXPathFreeObject(result);
+	}
+
+	g_atomic_int_set(&job->state, state);
+	return NULL;
+}
+
+
+
+//
+// Explains the expression of the job, the explanation is kept in the job.
+// Returns FALSE if the expression can't be evaluated.
+//
+static gboolean my_job_explain (XacobeoXPathJob *job) {
+
+	job->explanation = xacobeo_xpath_explain_rows(job->context, job->expression, &job->stopped);
+	if (job->explanation) {
+		return TRUE;
+	}
+	else if (g_atomic_int_get(&job->stopped)) {
+		return FALSE;
+	}
+
+	// An expression that isn't a location path is explained as a whole, the
+	// errors raised while splitting it in steps don't matter
+	g_free(job->error);
+	job->error = NULL;
+	GTimer *timer = g_timer_new();
+	xmlXPathObject *result = xmlXPathCompiledEval(job->compiled, job->context);
+	gdouble elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+	if (result == NULL) {
+		return FALSE;
+	}
+
+	gint count = (result->type == XPATH_NODESET && result->nodesetval) ? result->nodesetval->nodeNr : 1;
+	xmlXPathFreeObject(result);
+	job->explanation = xacobeo_xpath_explain_new();
+	xacobeo_xpath_explain_add(job->explanation, job->expression, count, elapsed);
+
+	return TRUE;
+}
+
+
+
+//
+// Stops the evaluation of the job. The reason is the final state of the job.
+// Only the first request is taken into account.
+//
+// 'stopped' is what stops the job: the threads check it between their steps
+// and the result of a stopped job is always discarded. Lowering the operation
+// limit of the contexts is only a best-effort hint that aborts the evaluation
+// in progress sooner, libxml2 reads the limit without synchronization so a
+// thread may not see it right away.
+//
+static void my_job_stop (XacobeoXPathJob *job, XPathJobStateEnum reason) {
+	if (! g_atomic_int_compare_and_exchange(&job->stopped, 0, reason)) {
+		return;
+	}
+
+#if LIBXML_VERSION >= 20911
+	// The XPath engine aborts the evaluation as soon as the limit is exceeded.
+	// With older versions of libxml2 the evaluation runs until its end and its
+	// result is discarded.
+	job->context->opLimit = 1;
+
+	G_LOCK(partitions);
+	for (guint i = 0; i < job->partitions_count; ++i) {
+		job->partitions[i].context->opLimit = 1;
+	}
+	G_UNLOCK(partitions);
+#endif
+}
+
+
+
+//
+// Keeps the first error raised by the XPath engine.
+//
+static void my_job_error (void *data, xmlError *error) {
+	XacobeoXPathJob *job = (XacobeoXPathJob *) data;
+	if (job->error == NULL && error->message) {
+		job->error = g_strchomp(g_strdup(error->message));
+	}
+}
+
+
+
+//
+// Creates an object that's a blessed reference to a scalar, this is how
+// XML::LibXML represents the literals, numbers and booleans.
+//
+static SV* my_new_scalar_object (const gchar *class, SV *value) {
+	return sv_bless(newRV_noinc(value), gv_stashpv(class, GV_ADD));
+}
+
+
+
+//
+// Evaluates //step (the expression of the job) by splitting the elements under
+// the root of the document in partitions that are evaluated by separate
+// threads. Each thread evaluates descendant-or-self::node()/step on its
+// elements. The nodes selected by the step from the document node and from the
+// root are found by the current thread. The node sets are then merged in
+// document order, this is done without sorting since the partitions are
+// ordered and disjoint.
+//
+// The partitions are registered in the job while their threads run, this way
+// my_job_stop() can abort their evaluations. The threads stop the job once they
+// found more than 'max_nodes' nodes.
+//
+// Returns NULL if the document is too small for a parallel evaluation or if the
+// evaluation failed or was stopped (the error is then set in the job).
+//
+static xmlXPathObject* my_eval_partitioned (XacobeoXPathJob *job, const gchar *step) {
+
+	xmlNode *root = xmlDocGetRootElement(job->doc);
+	if (root == NULL) {
+		return NULL;
+	}
+
+	GPtrArray *elements = g_ptr_array_new();
+	for (xmlNode *child = root->children; child; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE) {
+			g_ptr_array_add(elements, child);
+		}
+	}
+	guint count = my_get_partition_count(elements->len, job->threads);
+	if (count < 2) {
+		g_ptr_array_free(elements, TRUE);
+		return NULL;
+	}
+
+
+	// Prepare the partitions
+	gchar *expression = g_strconcat("descendant-or-self::node()/", step, NULL);
+	XPathPartition *partitions = g_new0(XPathPartition, count);
+	guint start = 0;
+	for (guint i = 0; i < count; ++i) {
+		guint end = (i == count - 1) ? elements->len : elements->len / count * (i + 1);
+
+		XPathPartition *partition = &partitions[i];
+		partition->job = job;
+		partition->elements = (xmlNode **) &elements->pdata[start];
+		partition->count = end - start;
+		partition->nodes = xmlXPathNodeSetCreate(NULL);
+		partition->offsets = g_new0(guint, partition->count + 1);
+
+		partition->context = xmlXPathNewContext(job->doc);
+		xmlHashScan(job->context->nsHash, my_copy_namespace, partition->context);
+		partition->context->error = NULL;
+#if LIBXML_VERSION >= 20911
+		partition->context->opLimit = G_MAXULONG;
+#endif
+		partition->compiled = xmlXPathCtxtCompile(partition->context, BAD_CAST expression);
+		start = end;
+	}
+	g_free(expression);
+
+
+	// Start the threads
+	G_LOCK(partitions);
+	job->partitions = partitions;
+	job->partitions_count = count;
+	G_UNLOCK(partitions);
+	for (guint i = 0; i < count; ++i) {
+		XPathPartition *partition = &partitions[i];
+#if GLIB_CHECK_VERSION(2, 32, 0)
+		partition->thread = g_thread_new("xpath-partition", my_partition_run, partition);
+#else
+		partition->thread = g_thread_create(my_partition_run, partition, TRUE, NULL);
+#endif
+	}
+
+
+	// The nodes selected by the step from the document node and from the root
+	xmlXPathObject *top = NULL;
+	xmlXPathObject *children = NULL;
+	xmlXPathCompExpr *compiled = xmlXPathCtxtCompile(job->context, BAD_CAST step);
+	if (compiled) {
+		top = xmlXPathCompiledEval(compiled, job->context);
+		job->context->node = root;
+		children = xmlXPathCompiledEval(compiled, job->context);
+		job->context->node = (xmlNode *) job->doc;
+		xmlXPathFreeCompExpr(compiled);
+	}
+
+	gboolean failed = FALSE;
+	for (guint i = 0; i < count; ++i) {
+		XPathPartition *partition = &partitions[i];
+		g_thread_join(partition->thread);
+		if (partition->failed) {
+			failed = TRUE;
+			if (job->error == NULL && partition->error) {
+				job->error = g_strdup(partition->error);
+			}
+		}
+	}
+	G_LOCK(partitions);
+	job->partitions = NULL;
+	job->partitions_count = 0;
+	G_UNLOCK(partitions);
+	if (top == NULL || top->type != XPATH_NODESET || children == NULL || children->type != XPATH_NODESET) {
+		failed = TRUE;
+	}
+	if (failed && job->error == NULL && ! g_atomic_int_get(&job->stopped)) {
+		job->error = g_strdup("XPath evaluation failed");
+	}
+
+
+	// Merge the nodes in document order: the nodes of the top level before the
+	// root, the root, its attributes, the children of the root each followed by
+	// the nodes found under it by its partition and the nodes after the root.
+	xmlNodeSet *set = xmlXPathNodeSetCreate(NULL);
+	xmlNodeSet *top_set = failed ? NULL : top->nodesetval;
+	xmlNodeSet *children_set = failed ? NULL : children->nodesetval;
+	gint t = 0;
+	gint c = 0;
+	for (xmlNode *node = job->doc->children; node && ! failed; node = node->next) {
+		if (top_set && t < top_set->nodeNr && top_set->nodeTab[t] == node) {
+			xmlXPathNodeSetAddUnique(set, top_set->nodeTab[t++]);
+		}
+		if (node != root) {
+			continue;
+		}
+
+		// The attributes of the root come before its children
+		while (children_set && c < children_set->nodeNr && children_set->nodeTab[c]->type == XML_ATTRIBUTE_NODE) {
+			xmlXPathNodeSetAddUnique(set, children_set->nodeTab[c++]);
+		}
+
+		guint p = 0;
+		guint e = 0;
+		for (xmlNode *child = root->children; child; child = child->next) {
+			if (children_set && c < children_set->nodeNr && children_set->nodeTab[c] == child) {
+				xmlXPathNodeSetAddUnique(set, children_set->nodeTab[c++]);
+			}
+			if (child->type != XML_ELEMENT_NODE) {
+				continue;
+			}
+
+			// The nodes found under this element by its partition
+			XPathPartition *partition = &partitions[p];
+			xmlNodeSet *nodes = partition->nodes;
+			for (guint j = partition->offsets[e]; j < partition->offsets[e + 1]; ++j) {
+				xmlXPathNodeSetAddUnique(set, nodes->nodeTab[j]);
+			}
+			if (++e == partition->count) {
+				e = 0;
+				++p;
+			}
+		}
+	}
+
+
+	for (guint i = 0; i < count; ++i) {
+		XPathPartition *partition = &partitions[i];
+		if (partition->compiled) {
+			xmlXPathFreeCompExpr(partition->compiled);
+		}
+		xmlXPathFreeContext(partition->context);
+		xmlXPathFreeNodeSet(partition->nodes);
+		g_free(partition->offsets);
+		g_free(partition->error);
+	}
+	g_free(partitions);
+	g_ptr_array_free(elements, TRUE);
+	if (top) {
+		xmlXPathFreeObject(top);
+	}
+	if (children) {
+		xmlXPathFreeObject(children);
+	}
+
+	if (failed) {
+		xmlXPathFreeNodeSet(set);
+		return NULL;
+	}
+
+	DEBUG("Evaluated %s in %u partitions: %d nodes", job->expression, count, set->nodeNr);
+	return xmlXPathWrapNodeSet(set);
+}
+
+
+
+//
+// A partition thread. Evaluates the expression on each element of the
+// partition and collects the nodes found. The evaluation stops as soon as the
+// job is stopped. The job is stopped once the partitions found more than
+// 'max_nodes' nodes.
+//
+static gpointer my_partition_run (gpointer data) {
+	XPathPartition *partition = (XPathPartition *) data;
+	XacobeoXPathJob *job = partition->job;
+
+	xmlSetStructuredErrorFunc(partition, my_partition_error);
+	partition->failed = partition->compiled == NULL;
+
+	for (guint i = 0; i < partition->count && ! partition->failed; ++i) {
+		partition->offsets[i] = partition->nodes->nodeNr;
+		if (g_atomic_int_get(&job->stopped)) {
+			partition->failed = TRUE;
+			break;
+		}
+
+		partition->context->node = partition->elements[i];
+		xmlXPathObject *result = xmlXPathCompiledEval(partition->compiled, partition->context);
+		partition->failed = ! my_append_result(partition->nodes, result);
+		if (result) {
+			xmlXPathFreeObject(result);
+		}
+		my_partition_add_progress(partition);
+
+		if (job->max_nodes) {
+			g_atomic_int_add(&job->partitions_found, partition->nodes->nodeNr - partition->offsets[i]);
+			if ((guint) g_atomic_int_get(&job->partitions_found) > job->max_nodes) {
+				my_job_stop(job, XPATH_JOB_LIMIT);
+			}
+		}
+	}
+	partition->offsets[partition->count] = partition->nodes->nodeNr;
+
+	return NULL;
+}
+
+
+
+//
+// Keeps the first error raised by the evaluation of a partition.
+//
+static void my_partition_error (void *data, xmlError *error) {
+	XPathPartition *partition = (XPathPartition *) data;
+	if (partition->error == NULL && error->message) {
+		partition->error = g_strchomp(g_strdup(error->message));
+	}
+}
+
+
+
+//
+// Adds the operations performed by a partition since the last call to the
+// progress of the job.
+//
+static void my_partition_add_progress (XPathPartition *partition) {
+#if LIBXML_VERSION >= 20911
+	gulong ops = partition->context->opCount;
+	g_atomic_pointer_add(&partition->job->partitions_progress, ops - partition->progress);
+	partition->progress = ops;
+#endif
+}
+
+
+
+//
+// Returns the number of partitions used for evaluating the given number of
+// elements with at most the given number of threads (processors if 0). A value
+// smaller than 2 means that the elements are not worth splitting.
+//
+static guint my_get_partition_count (guint elements, guint threads) {
+	if (threads == 0) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		threads = g_get_num_processors();
+#else
+		threads = 1;
+#endif
+	}
+	if (elements < PARTITION_MIN_ELEMENTS) {
+		return 1;
+	}
+	return MIN(elements / PARTITION_MIN_SIZE, threads);
+}
+
+
+
+//
+// Registers a namespace of the job's context (prefix -> uri) in the context of
+// a partition.
+//
+static void my_copy_namespace (void *payload, void *data, const xmlChar *name) {
+	xmlXPathRegisterNs((xmlXPathContext *) data, name, (const xmlChar *) payload);
+}
+
+
+
+//
+// Appends the nodes of a result to a node set. The nodes of a result are
+// distinct and follow the nodes already in the set.
+//
+// Returns FALSE if the result is not a node set.
+//
+static gboolean my_append_result (xmlNodeSet *set, xmlXPathObject *result) {
+	if (result == NULL || result->type != XPATH_NODESET) {
+		return FALSE;
+	}
+
+	xmlNodeSet *nodes = result->nodesetval;
+	for (gint i = 0; nodes && i < nodes->nodeNr; ++i) {
+		xmlXPathNodeSetAddUnique(set, nodes->nodeTab[i]);
+	}
+	return TRUE;
+}
@@ -0,0 +1,99 @@
+#ifndef __XACOBEO_JOB_H__
+#define __XACOBEO_JOB_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <glib.h>
+#include <libxml/xpath.h>
+
+
+// The states of an XPath job
+enum XPathJobState {
+	XPATH_JOB_RUNNING,
+	XPATH_JOB_DONE,
+	XPATH_JOB_ERROR,
+	XPATH_JOB_CANCELLED,
+	XPATH_JOB_TIMEOUT,
+	XPATH_JOB_LIMIT,
+};
+typedef enum XPathJobState XPathJobStateEnum;
+
+
+//
+// An XPath expression evaluated in a worker thread. The main thread polls the
+// job until it's finished. The expressions //step[predicate] are split by the
+// subtrees of the root and evaluated by more threads. A job can also explain
+// the expression step by step (see xacobeo_xpath_explain()). The worker never
+// touches Perl data, all Perl values are created by the main thread once the
+// job is over.
+//
+typedef struct _XacobeoXPathJob {
+
+	// The document searched; the Perl document is kept alive while the job exists
+	xmlDoc *doc;
+	SV *document;
+
+	// The expression being evaluated and its evaluation context
+	gchar *expression;
+	xmlXPathCompExpr *compiled;
+	xmlXPathContext *context;
+
+	// The worker thread (NULL if the job was never started)
+	GThread *thread;
+
+	// The state of the job (XPathJobStateEnum), it's set by the worker thread
+	volatile gint state;
+
+	// The reason why the job was stopped (XPathJobStateEnum) or 0 if running
+	volatile gint stopped;
+
+	// Limits (0 means no limit)
+	gdouble timeout;
+	guint max_nodes;
+
+	// The maximal number of threads of a parallel evaluation (0: processors)
+	guint threads;
+
+	GTimer *timer;
+
+	// The outcome of the evaluation
+	xmlXPathObject *result;
+	gchar *error;
+
+	// Set if the expression is explained, the rows of the explanation
+	// (XacobeoExplainRow) once done
+	gboolean explain;
+	GPtrArray *explanation;
+
+	// The node set (Xacobeo::XS::NodeSet) that took over a node set result
+	SV *nodeset;
+
+	// The partitions of a parallel evaluation while they run, they're only
+	// accessed under a lock, see my_job_stop()
+	struct _XPathPartition *partitions;
+	guint partitions_count;
+
+	// The operations performed and the nodes found by the threads of a parallel
+	// evaluation
+	volatile gsize partitions_progress;
+	volatile gint partitions_found;
+
+} XacobeoXPathJob;
+
+
+// Public prototypes
+XacobeoXPathJob* xacobeo_xpath_job_new      (SV *document, const gchar *expression, HV *namespaces, gdouble timeout, guint max_nodes, guint threads);
+XacobeoXPathJob* xacobeo_xpath_job_new_explain (SV *document, const gchar *expression, HV *namespaces, gdouble timeout);
+void             xacobeo_xpath_job_free     (XacobeoXPathJob *job);
+const gchar*     xacobeo_xpath_job_poll     (XacobeoXPathJob *job);
+void             xacobeo_xpath_job_cancel   (XacobeoXPathJob *job);
+gdouble          xacobeo_xpath_job_elapsed  (XacobeoXPathJob *job);
+gulong           xacobeo_xpath_job_progress (XacobeoXPathJob *job);
+const gchar*     xacobeo_xpath_job_error    (XacobeoXPathJob *job);
+SV*              xacobeo_xpath_job_result   (XacobeoXPathJob *job);
+
+
+#endif
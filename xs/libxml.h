@@ -23,6 +23,20 @@ struct _ProxyNode {
 typedef struct _ProxyNode ProxyNode;
 typedef ProxyNode* ProxyNodePtr;
 
+/* the proxy of a document has room for the state of its PSVI */
+struct _DocProxyNode {
+    xmlNodePtr node;
+    xmlNodePtr owner;
+    int count;
+    int encoding;
+    int psvi_status;
+};
+
+typedef struct _DocProxyNode DocProxyNode;
+typedef DocProxyNode* DocProxyNodePtr;
+
+#define Pmm_NO_PSVI 0
+
 xmlNodePtr
 PmmSvNodeExt(SV *perlnode, int copy);
 
@@ -0,0 +1,611 @@
+//
+// Loader of the documents: a parser that gives the nodes to hooks while the
+// document is built. The files are mapped in memory and given to a push parser
+// by chunks, this way the progress of the parse can be reported.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "loader.h"
+#include "logger.h"
+
+#include <libxml/SAX2.h>
+#include <libxml/parserInternals.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+
+// The number of nodes given to the hooks at once
+#define LOADER_BATCH_SIZE 4096
+
+// The number of bytes given to the parser at once, the progress is reported
+// after each chunk
+#define LOADER_CHUNK_SIZE (1024 * 1024)
+
+
+// The options of the parser, they are the same as the ones used by the
+// XML::LibXML parser of the documents (see Xacobeo::Document): the parser
+// recovers from the errors silently, the entities are not expanded and the
+// attributes are not completed from the DTD.
+#define PARSER_OPTIONS (XML_PARSE_RECOVER | XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_DTDLOAD)
+
+
+//
+// The kind of the events given to the hooks
+//
+enum LoaderEventKind {
+	LOADER_EVENT_OPEN,
+	LOADER_EVENT_NODE,
+	LOADER_EVENT_CLOSE,
+};
+
+
+//
+// A node waiting to be given to the hooks. The nodes are given by batches, this
+// way the hooks run for many nodes in a row while the nodes are still in the
+// cache instead of alternating with the parser for each node.
+//
+typedef struct _LoaderEvent {
+	xmlNode *node;
+	enum LoaderEventKind kind;
+} LoaderEvent;
+
+
+//
+// The state of a parse: the nodes opened (the document first) and for each one
+// the last child already given to the hooks. The hooks stop being called as
+// soon as the tree built by the parser doesn't match the nodes given so far,
+// which can happen when the parser recovers from an error.
+//
+// The parser is created once the first bytes are known, they are needed for
+// detecting the encoding of the document.
+//
+struct _XacobeoLoader {
+	xmlParserCtxt *ctxt;
+	gchar *filename;
+	gchar *encoding;
+	gchar head[4];
+	gsize head_size;
+	gboolean stopped;
+
+	const XacobeoLoaderHooks *hooks;
+	gpointer data;
+	GPtrArray *open;
+	GPtrArray *last;
+	gboolean fed;
+	LoaderEvent *batch;
+	guint batch_size;
+};
+
+
+//
+// Function prototypes
+//
+static xmlDoc*         my_parse              (const gchar *buffer, gsize size, const gchar *filename, const XacobeoLoaderHooks *hooks, gpointer data, gboolean *fed);
+static gboolean        my_create_parser      (XacobeoLoader *loader);
+static XacobeoLoader*  my_get_loader         (void *ctx);
+static void            my_give_children      (XacobeoLoader *loader, xmlNode *until);
+static void            my_add_event          (XacobeoLoader *loader, xmlNode *node, enum LoaderEventKind kind);
+static void            my_give_events        (XacobeoLoader *loader);
+static void            my_start_document     (void *ctx);
+static void            my_start_element      (void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri, int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes);
+static void            my_end_element        (void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri);
+static void            my_ignore_error       (void *data, xmlError *error);
+
+
+
+//
+// Parses the given file. The nodes are given to the hooks while the document is
+// built, if 'fed' is given it's set to TRUE if all the nodes of the document
+// were given to the hooks. Only local files are parsed, the other sources (URIs)
+// are left to the caller.
+//
+// The file is mapped in memory instead of being read by small chunks and the
+// kernel is told that it's read sequentially, this way it reads ahead of the
+// parser and can drop the pages already parsed.
+//
+// Returns the document or NULL if the file can't be parsed.
+//
+xmlDoc* xacobeo_loader_parse_file (const gchar *filename, const XacobeoLoaderHooks *hooks, gpointer data, gboolean *fed) {
+	if (fed) {
+		*fed = FALSE;
+	}
+
+	gsize size;
+	gchar *buffer = xacobeo_loader_map_file(filename, &size);
+	if (buffer == NULL) {
+		return NULL;
+	}
+
+	xmlDoc *doc = my_parse(buffer, size, filename, hooks, data, fed);
+	xacobeo_loader_unmap(buffer, size);
+
+	return doc;
+}
+
+
+
+//
+// Maps the given file in memory for reading it once from the start to the end.
+// The kernel is told that the file is read sequentially, this way it reads
+// ahead of the reader and can drop the pages already read.
+//
+// Returns NULL if the file can't be mapped: it's not a local file, it can't be
+// read or it's empty. The buffer has to be released with
+// xacobeo_loader_unmap().
+//
+gchar* xacobeo_loader_map_file (const gchar *filename, gsize *size) {
+
+	if (! g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
+		DEBUG("Can't map %s, it's not a file", filename);
+		return NULL;
+	}
+
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		DEBUG("Can't open %s: %s", filename, g_strerror(errno));
+		return NULL;
+	}
+
+	// An empty file has no document, the caller reports the error
+	struct stat info;
+	if (fstat(fd, &info) == -1 || info.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	*size = (gsize) info.st_size;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	gchar *buffer = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buffer == MAP_FAILED) {
+		DEBUG("Can't map %s: %s", filename, g_strerror(errno));
+		return NULL;
+	}
+#ifdef MADV_SEQUENTIAL
+	madvise(buffer, *size, MADV_SEQUENTIAL);
+#endif
+
+	return buffer;
+}
+
+
+
+//
+// Releases a buffer mapped by xacobeo_loader_map_file().
+//
+void xacobeo_loader_unmap (gchar *buffer, gsize size) {
+	munmap(buffer, size);
+}
+
+
+
+//
+// Parses the given buffer, see xacobeo_loader_parse_file().
+//
+xmlDoc* xacobeo_loader_parse_memory (const gchar *buffer, gsize size, const XacobeoLoaderHooks *hooks, gpointer data, gboolean *fed) {
+	if (fed) {
+		*fed = FALSE;
+	}
+
+	return my_parse(buffer, size, NULL, hooks, data, fed);
+}
+
+
+
+//
+// Parses the document in the given buffer. The buffer is given to a push parser
+// by chunks and the progress is reported after each chunk. The filename is used
+// for the URL of the document and for resolving the DTD, it can be NULL.
+//
+static xmlDoc* my_parse (const gchar *buffer, gsize size, const gchar *filename, const XacobeoLoaderHooks *hooks, gpointer data, gboolean *fed) {
+
+	XacobeoLoader *loader = xacobeo_loader_new(filename, hooks, data);
+
+	gsize offset = 0;
+	while (offset < size) {
+		gsize length = MIN(size - offset, LOADER_CHUNK_SIZE);
+		gboolean parsing = xacobeo_loader_push(loader, buffer + offset, length);
+		offset += length;
+		if (! parsing) {
+			break;
+		}
+
+		if (hooks && hooks->progress && offset < size) {
+			hooks->progress((goffset) offset, (goffset) size, data);
+		}
+	}
+	if (hooks && hooks->progress) {
+		hooks->progress((goffset) size, (goffset) size, data);
+	}
+
+	return xacobeo_loader_finish(loader, fed);
+}
+
+
+
+//
+// Creates a loader that parses a document given by chunks with
+// xacobeo_loader_push(). The nodes are given to the hooks while the document is
+// built. The filename is used for the URL of the document and for resolving the
+// DTD, it can be NULL.
+//
+// The loader has to be completed with xacobeo_loader_finish() or freed with
+// xacobeo_loader_free().
+//
+XacobeoLoader* xacobeo_loader_new (const gchar *filename, const XacobeoLoaderHooks *hooks, gpointer data) {
+	XacobeoLoader *loader = g_new0(XacobeoLoader, 1);
+	loader->filename = g_strdup(filename);
+	loader->hooks = hooks;
+	loader->data = data;
+	loader->open = g_ptr_array_new();
+	loader->last = g_ptr_array_new();
+	loader->fed = hooks != NULL;
+	loader->batch = hooks ? g_new(LoaderEvent, LOADER_BATCH_SIZE) : NULL;
+	return loader;
+}
+
+
+
+//
+// Sets the encoding of the document, the encoding declared by the document is
+// then ignored. This is needed for the documents that were already decoded,
+// like the text of the clipboard. The encoding has to be set before the first
+// bytes are given.
+//
+void xacobeo_loader_set_encoding (XacobeoLoader *loader, const gchar *encoding) {
+	g_free(loader->encoding);
+	loader->encoding = g_strdup(encoding);
+}
+
+
+
+//
+// Parses the next bytes of the document. The chunk can have any size, it's
+// split for the parser.
+//
+// Returns FALSE if the parser stopped (it can't recover from an error), the
+// next bytes are then ignored.
+//
+gboolean xacobeo_loader_push (XacobeoLoader *loader, const gchar *buffer, gsize size) {
+
+	if (loader->ctxt == NULL && ! loader->stopped) {
+		gsize length = MIN(size, sizeof(loader->head) - loader->head_size);
+		memcpy(loader->head + loader->head_size, buffer, length);
+		loader->head_size += length;
+		buffer += length;
+		size -= length;
+
+		if (loader->head_size < sizeof(loader->head)) {
+			return TRUE;
+		}
+		my_create_parser(loader);
+	}
+
+	while (size > 0 && ! loader->stopped) {
+		gsize length = MIN(size, LOADER_CHUNK_SIZE);
+		xmlParseChunk(loader->ctxt, buffer, (int) length, 0);
+		buffer += length;
+		size -= length;
+
+		// The parser stops when it can't recover from an error
+		if (loader->ctxt->instate == XML_PARSER_EOF) {
+			loader->stopped = TRUE;
+		}
+	}
+
+	return ! loader->stopped;
+}
+
+
+
+//
+// Returns the document being built or NULL if it wasn't started yet. The
+// document belongs to the loader, it can only be read between two calls to
+// xacobeo_loader_push().
+//
+xmlDoc* xacobeo_loader_peek (XacobeoLoader *loader) {
+	return loader->ctxt ? loader->ctxt->myDoc : NULL;
+}
+
+
+
+//
+// Completes the parse and frees the loader. If 'fed' is given it's set to TRUE
+// if all the nodes of the document were given to the hooks.
+//
+// Returns the document or NULL if there's no document.
+//
+xmlDoc* xacobeo_loader_finish (XacobeoLoader *loader, gboolean *fed) {
+	if (fed) {
+		*fed = FALSE;
+	}
+
+	// A document shorter than the bytes needed for detecting the encoding
+	if (loader->ctxt == NULL && loader->head_size > 0) {
+		my_create_parser(loader);
+	}
+
+	xmlParserCtxt *ctxt = loader->ctxt;
+	if (ctxt == NULL) {
+		xacobeo_loader_free(loader);
+		return NULL;
+	}
+
+	xmlParseChunk(ctxt, NULL, 0, 1);
+	xmlDoc *doc = ctxt->myDoc;
+	ctxt->myDoc = NULL;
+
+	// The nodes that follow the root element
+	if (loader->fed && doc && loader->open->len == 1) {
+		my_give_children(loader, NULL);
+		my_give_events(loader);
+	}
+	else {
+		loader->fed = FALSE;
+	}
+
+	if (fed) {
+		*fed = loader->fed;
+	}
+
+	xacobeo_loader_free(loader);
+
+	return doc;
+}
+
+
+
+//
+// Frees the loader. The document being built is freed as well unless a Perl
+// wrapper was created for it by a hook, the wrapper frees it then.
+//
+void xacobeo_loader_free (XacobeoLoader *loader) {
+	if (loader == NULL) {
+		return;
+	}
+
+	xmlParserCtxt *ctxt = loader->ctxt;
+	if (ctxt) {
+		if (ctxt->myDoc && ctxt->myDoc->_private == NULL) {
+			xmlFreeDoc(ctxt->myDoc);
+		}
+		ctxt->myDoc = NULL;
+		ctxt->_private = NULL;
+		xmlFreeParserCtxt(ctxt);
+	}
+
+	g_ptr_array_free(loader->open, TRUE);
+	g_ptr_array_free(loader->last, TRUE);
+	g_free(loader->batch);
+	g_free(loader->filename);
+	g_free(loader->encoding);
+	g_free(loader);
+}
+
+
+
+//
+// Creates the parser with the first bytes of the document. Returns FALSE if the
+// parser can't be created, the loader is then stopped.
+//
+static gboolean my_create_parser (XacobeoLoader *loader) {
+
+	xmlParserCtxt *ctxt = xmlCreatePushParserCtxt(NULL, NULL, loader->head, (int) loader->head_size, loader->filename);
+	if (ctxt == NULL) {
+		loader->stopped = TRUE;
+		return FALSE;
+	}
+	loader->ctxt = ctxt;
+
+	if (loader->encoding) {
+		xmlCtxtUseOptions(ctxt, PARSER_OPTIONS | XML_PARSE_IGNORE_ENC);
+		xmlSwitchToEncoding(ctxt, xmlFindCharEncodingHandler(loader->encoding));
+	}
+	else {
+		xmlCtxtUseOptions(ctxt, PARSER_OPTIONS);
+	}
+	ctxt->linenumbers = 1;
+	ctxt->sax->serror = my_ignore_error;
+
+	// The tree is still built by the default SAX2 handlers, they are only wrapped
+	if (loader->hooks) {
+		ctxt->_private = loader;
+		ctxt->sax->startDocument = my_start_document;
+		ctxt->sax->startElementNs = my_start_element;
+		ctxt->sax->endElementNs = my_end_element;
+	}
+
+	return TRUE;
+}
+
+
+
+//
+// Returns the loader if the hooks have to be called. The entities are parsed
+// with contexts of their own that share the handlers, their nodes are not part
+// of the document and are ignored.
+//
+static XacobeoLoader* my_get_loader (void *ctx) {
+	xmlParserCtxt *ctxt = (xmlParserCtxt *) ctx;
+	XacobeoLoader *loader = (XacobeoLoader *) ctxt->_private;
+	if (loader == NULL || loader->ctxt != ctxt || ! loader->fed) {
+		return NULL;
+	}
+	return loader;
+}
+
+
+
+//
+// Gives to the hooks the children of the last node opened that were not given
+// yet, up to the given node (excluded). The children are complete as a new
+// sibling follows them.
+//
+static void my_give_children (XacobeoLoader *loader, xmlNode *until) {
+	guint top = loader->open->len - 1;
+	xmlNode *parent = g_ptr_array_index(loader->open, top);
+	xmlNode *last = g_ptr_array_index(loader->last, top);
+
+	for (xmlNode *node = last ? last->next : parent->children; node && node != until; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE) {
+			// An element that was never opened
+			loader->fed = FALSE;
+			return;
+		}
+
+		my_add_event(loader, node, LOADER_EVENT_NODE);
+		last = node;
+	}
+
+	g_ptr_array_index(loader->last, top) = until ? until : last;
+}
+
+
+
+//
+// Queues a node for the hooks, the nodes are given once the batch is full.
+//
+static void my_add_event (XacobeoLoader *loader, xmlNode *node, enum LoaderEventKind kind) {
+	LoaderEvent *event = &loader->batch[loader->batch_size++];
+	event->node = node;
+	event->kind = kind;
+
+	if (loader->batch_size == LOADER_BATCH_SIZE) {
+		my_give_events(loader);
+	}
+}
+
+
+
+//
+// Gives the nodes queued to the hooks.
+//
+static void my_give_events (XacobeoLoader *loader) {
+	const XacobeoLoaderHooks *hooks = loader->hooks;
+	for (guint i = 0; i < loader->batch_size; ++i) {
+		LoaderEvent *event = &loader->batch[i];
+		switch (event->kind) {
+			case LOADER_EVENT_OPEN:
+				if (hooks->open) {
+					hooks->open(event->node, loader->data);
+				}
+			break;
+
+			case LOADER_EVENT_NODE:
+				if (hooks->node) {
+					hooks->node(event->node, loader->data);
+				}
+			break;
+
+			case LOADER_EVENT_CLOSE:
+				if (hooks->close) {
+					hooks->close(event->node, loader->data);
+				}
+			break;
+		}
+	}
+	loader->batch_size = 0;
+}
+
+
+
+//
+// Called when the document starts, the document is the first node opened.
+//
+static void my_start_document (void *ctx) {
+	xmlSAX2StartDocument(ctx);
+
+	XacobeoLoader *loader = my_get_loader(ctx);
+	xmlDoc *doc = ((xmlParserCtxt *) ctx)->myDoc;
+	if (loader == NULL || doc == NULL) {
+		return;
+	}
+
+	g_ptr_array_add(loader->open, doc);
+	g_ptr_array_add(loader->last, NULL);
+	if (loader->hooks->start) {
+		loader->hooks->start(doc, loader->data);
+	}
+}
+
+
+
+//
+// Called when an element starts. The element is built by libxml2 first, it's
+// then given to the hooks with its attributes and its namespaces.
+//
+static void my_start_element (void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri, int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes) {
+	xmlSAX2StartElementNs(ctx, localname, prefix, uri, nb_namespaces, namespaces, nb_attributes, nb_defaulted, attributes);
+
+	XacobeoLoader *loader = my_get_loader(ctx);
+	if (loader == NULL) {
+		return;
+	}
+
+	xmlNode *element = ((xmlParserCtxt *) ctx)->node;
+	guint depth = loader->open->len;
+	if (depth == 0 || element == NULL || element->parent != g_ptr_array_index(loader->open, depth - 1)) {
+		loader->fed = FALSE;
+		return;
+	}
+
+	my_give_children(loader, element);
+	if (! loader->fed) {
+		return;
+	}
+
+	my_add_event(loader, element, LOADER_EVENT_OPEN);
+	g_ptr_array_add(loader->open, element);
+	g_ptr_array_add(loader->last, NULL);
+}
+
+
+
+//
+// Called when an element ends. The element is closed before libxml2 goes back
+// to its parent.
+//
+static void my_end_element (void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri) {
+
+	XacobeoLoader *loader = my_get_loader(ctx);
+	if (loader != NULL) {
+		xmlNode *element = ((xmlParserCtxt *) ctx)->node;
+		guint depth = loader->open->len;
+		if (depth < 2 || element != g_ptr_array_index(loader->open, depth - 1)) {
+			loader->fed = FALSE;
+		}
+		else {
+			my_give_children(loader, NULL);
+			if (loader->fed) {
+				my_add_event(loader, element, LOADER_EVENT_CLOSE);
+			}
+			g_ptr_array_set_size(loader->open, depth - 1);
+			g_ptr_array_set_size(loader->last, depth - 1);
+		}
+	}
+
+	xmlSAX2EndElementNs(ctx, localname, prefix, uri);
+}
+
+
+
+//
+// Ignores the errors, the parser recovers from them silently.
+//
+static void my_ignore_error (void *data, xmlError *error) {
+}
@@ -0,0 +1,61 @@
+#ifndef __XACOBEO_LOADER_H__
+#define __XACOBEO_LOADER_H__
+
+
+#include <glib.h>
+#include <libxml/parser.h>
+
+
+//
+// Hooks called while a document is parsed, they receive the nodes as soon as
+// the parser has built them. This way the information about a document can be
+// collected while the nodes are still in the cache instead of walking the
+// document once it's parsed.
+//
+// The nodes are given in document order: an element is opened once its name,
+// its attributes and its namespaces are known; the other nodes are given when
+// they are complete (when their next sibling starts or when their parent is
+// closed); an element is closed after all its children. The progress of the
+// parse is reported as the input is consumed. All the hooks are optional.
+//
+typedef struct _XacobeoLoaderHooks {
+
+	// The document was created, no node was added yet
+	void (*start) (xmlDoc *doc, gpointer data);
+
+	// An element starts, the nodes given next are its children until it's closed
+	void (*open)  (xmlNode *element, gpointer data);
+
+	// A node that is not an element
+	void (*node)  (xmlNode *node, gpointer data);
+
+	// All the children of the element were given
+	void (*close) (xmlNode *element, gpointer data);
+
+	// The parser consumed the given number of bytes out of the total
+	void (*progress) (goffset consumed, goffset total, gpointer data);
+
+} XacobeoLoaderHooks;
+
+
+//
+// A parse in progress, the document is given by chunks as they become
+// available (see xacobeo_loader_push()).
+//
+typedef struct _XacobeoLoader XacobeoLoader;
+
+
+// Public prototypes
+xmlDoc*        xacobeo_loader_parse_file   (const gchar *filename, const XacobeoLoaderHooks *hooks, gpointer data, gboolean *fed);
+xmlDoc*        xacobeo_loader_parse_memory (const gchar *buffer, gsize size, const XacobeoLoaderHooks *hooks, gpointer data, gboolean *fed);
+gchar*         xacobeo_loader_map_file     (const gchar *filename, gsize *size);
+void           xacobeo_loader_unmap        (gchar *buffer, gsize size);
+XacobeoLoader* xacobeo_loader_new          (const gchar *filename, const XacobeoLoaderHooks *hooks, gpointer data);
+void           xacobeo_loader_set_encoding (XacobeoLoader *loader, const gchar *encoding);
+gboolean       xacobeo_loader_push         (XacobeoLoader *loader, const gchar *buffer, gsize size);
+xmlDoc*        xacobeo_loader_peek         (XacobeoLoader *loader);
+xmlDoc*        xacobeo_loader_finish       (XacobeoLoader *loader, gboolean *fed);
+void           xacobeo_loader_free         (XacobeoLoader *loader);
+
+
+#endif
@@ -10,6 +10,7 @@
 //
 
 #include "code.h"
+#include "loader.h"
 #include "logger.h"
 #include <glib/gprintf.h>
 
@@ -26,6 +27,17 @@ static GtkWidget*         my_create_textview    (void);
 static GtkWidget*         my_create_treeview    (void);
 static GtkWidget*         my_wrap_in_scrolls    (GtkWidget *widget);
 static xmlDoc*            my_parse_document     (const gchar *filename);
+static void               my_count_element      (xmlNode *element, gpointer data);
+static void               my_count_node         (xmlNode *node, gpointer data);
+
+
+//
+// The number of nodes seen by the parser.
+//
+typedef struct _ParseCounts {
+	gulong elements;
+	gulong nodes;
+} ParseCounts;
 
 
 int main (int argc, char **argv) {
@@ -343,23 +355,41 @@ static void my_create_buffer_tags (GtkTextBuffer *buffer) {
 
 //
 // Parses the XML document. Returns an XML document if the parsing was
-// successful otherwise NULL.
+// successful otherwise NULL. The nodes are counted while the document is
+// built, see loader.h.
 //
 // The document has to be	freed with xmlFreeDoc();
 //
 static xmlDoc* my_parse_document (const gchar *filename) {
 
-	// Construct a parser contenxt
-	xmlParserCtxt *parserCtxt = xmlCreateFileParserCtxt(filename);
-	parserCtxt->loadsubset = XML_DETECT_IDS;
-	
-	// Parse the document
-	xmlDoc *document = NULL;
-	if (xmlParseDocument(parserCtxt) == 0) {
-		document = parserCtxt->myDoc;
-		parserCtxt->myDoc = NULL;
+	XacobeoLoaderHooks hooks = {
+		.open = my_count_element,
+		.node = my_count_node,
+	};
+	ParseCounts counts = { 0, 0 };
+
+	xmlDoc *document = xacobeo_loader_parse_file(filename, &hooks, &counts, NULL);
+	if (document) {
+		INFO("Parsed %lu elements and %lu other nodes", counts.elements, counts.nodes);
 	}
 
-	xmlFreeParserCtxt(parserCtxt);
 	return document;
 }
+
+
+//
+// Parser hook: counts an element.
+//
+static void my_count_element (xmlNode *element, gpointer data) {
+	ParseCounts *counts = (ParseCounts *) data;
+	++counts->elements;
+}
+
+
+//
+// Parser hook: counts a node that's not an element.
+//
+static void my_count_node (xmlNode *node, gpointer data) {
+	ParseCounts *counts = (ParseCounts *) data;
+	++counts->nodes;
+}
@@ -0,0 +1,261 @@
+//
+// Discovery of the namespaces declared in a document.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "namespaces.h"
+#include "logger.h"
+
+#include <string.h>
+
+
+//
+// A namespace found in the document with the first decent prefix seen for it.
+// The strings belong to the document.
+//
+typedef struct _NamespaceRecord {
+	const gchar *prefix;
+	const gchar *uri;
+} NamespaceRecord;
+
+
+//
+// Function prototypes
+//
+static void     my_add_namespace    (XacobeoNamespaceList *list, xmlNs *ns);
+static void     my_add_declarations (XacobeoNamespaceList *list, xmlNs *ns);
+static xmlNode* my_next_element     (xmlNode *top, xmlNode *node);
+static gboolean my_is_prefix_unique (GHashTable *cleaned, const gchar *prefix);
+
+
+
+//
+// Finds every namespace declared in the subtree of the given node and returns
+// them in a Perl hash ref (key: uri, value: prefix). Each prefix is unique; the
+// first prefix seen for a namespace is used, the namespaces without a decent
+// prefix are given one of the form 'ns', 'ns1', 'ns2', etc. The namespace of
+// the prefix 'xml' is always returned.
+//
+// The namespaces are the same as the ones found through the XPath query
+// './/namespace::*' but the namespace declarations (nsDef) are read in a single
+// pass. The XPath query returns all the namespaces in scope of each element, a
+// namespace inherited from a parent doesn't change the outcome since it was
+// already seen on the parent. The namespace axis returns the declarations of an
+// element in reverse order, they are taken in the same order. The content of
+// the entities is not visited.
+//
+SV* xacobeo_get_namespaces (xmlNode *node) {
+
+	XacobeoNamespaceList *list = xacobeo_namespace_list_new();
+
+	if (node) {
+		// The namespaces in scope of the first element, including the ones
+		// declared by its ancestors
+		xmlNode *element = node->type == XML_ELEMENT_NODE ? node : my_next_element(node, node);
+		if (element) {
+			xacobeo_namespace_list_add_scope(list, element);
+		}
+
+		// The other elements only add their own declarations
+		while (element && (element = my_next_element(node, element)) != NULL) {
+			xacobeo_namespace_list_add_element(list, element);
+		}
+	}
+
+	SV *namespaces = xacobeo_namespace_list_to_sv(list);
+	xacobeo_namespace_list_free(list);
+
+	return namespaces;
+}
+
+
+
+//
+// Creates an empty list of namespaces, only the namespace of the prefix 'xml'
+// is known.
+//
+// The list has to be freed with xacobeo_namespace_list_free().
+//
+XacobeoNamespaceList* xacobeo_namespace_list_new (void) {
+	XacobeoNamespaceList *list = g_new0(XacobeoNamespaceList, 1);
+	list->seen = g_hash_table_new(g_str_hash, g_str_equal);
+	list->records = g_ptr_array_new_with_free_func(g_free);
+
+	NamespaceRecord *xml = g_new(NamespaceRecord, 1);
+	xml->prefix = "xml";
+	xml->uri = (const gchar *) XML_XML_NAMESPACE;
+	g_ptr_array_add(list->records, xml);
+	g_hash_table_insert(list->seen, (gpointer) xml->uri, xml);
+
+	return list;
+}
+
+
+
+//
+// Frees the list. The namespaces belong to the document.
+//
+void xacobeo_namespace_list_free (XacobeoNamespaceList *list) {
+	if (list == NULL) {
+		return;
+	}
+	g_hash_table_destroy(list->seen);
+	g_ptr_array_free(list->records, TRUE);
+	g_free(list);
+}
+
+
+
+//
+// Adds all the namespaces in scope of an element, including the ones declared
+// by its ancestors. This is used for the first element visited.
+//
+void xacobeo_namespace_list_add_scope (XacobeoNamespaceList *list, xmlNode *element) {
+	xmlNs **namespaces = xmlGetNsList(element->doc, element);
+	gint count = 0;
+	while (namespaces && namespaces[count]) {
+		++count;
+	}
+	for (gint i = count - 1; i >= 0; --i) {
+		my_add_namespace(list, namespaces[i]);
+	}
+	if (namespaces) {
+		xmlFree(namespaces);
+	}
+}
+
+
+
+//
+// Adds the namespaces declared by an element. The elements have to be added in
+// document order.
+//
+void xacobeo_namespace_list_add_element (XacobeoNamespaceList *list, xmlNode *element) {
+	my_add_declarations(list, element->nsDef);
+}
+
+
+
+//
+// Returns the namespaces in a Perl hash ref (key: uri, value: prefix) where
+// each prefix is unique.
+//
+SV* xacobeo_namespace_list_to_sv (XacobeoNamespaceList *list) {
+
+	HV *namespaces = newHV();
+	GHashTable *cleaned = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	guint index = 0;
+	for (guint i = 0; i < list->records->len; ++i) {
+		NamespaceRecord *record = g_ptr_array_index(list->records, i);
+
+		// Don't provide a namespace prefix for the default namespace (xmlns="")
+		if (record->prefix == NULL && *record->uri == '\0') {
+			continue;
+		}
+
+		gchar *prefix = g_strdup(record->prefix);
+		if (! my_is_prefix_unique(cleaned, prefix)) {
+			// Assign a new prefix until unique
+			do {
+				g_free(prefix);
+				prefix = index ? g_strdup_printf("ns%u", index) : g_strdup("ns");
+				++index;
+			} while (! my_is_prefix_unique(cleaned, prefix));
+		}
+		g_hash_table_insert(cleaned, prefix, (gpointer) record->uri);
+
+		SV *value = newSVpv(prefix, 0);
+		SvUTF8_on(value);
+		hv_store(namespaces, record->uri, -strlen(record->uri), value, 0);
+	}
+	g_hash_table_destroy(cleaned);
+
+	return newRV_noinc((SV *) namespaces);
+}
+
+
+
+//
+// Adds a namespace to the namespaces found. If the namespace was seen before
+// make sure that it has a decent prefix, maybe the previous time there was no
+// prefix associated.
+//
+static void my_add_namespace (XacobeoNamespaceList *list, xmlNs *ns) {
+	const gchar *prefix = (const gchar *) ns->prefix;
+	const gchar *uri = (const gchar *) ns->href;
+	if (uri == NULL) {
+		WARN("Namespace %s has no URI", prefix ? prefix : "");
+		uri = "";
+	}
+
+	NamespaceRecord *record = g_hash_table_lookup(list->seen, uri);
+	if (record) {
+		if (record->prefix == NULL || *record->prefix == '\0') {
+			record->prefix = prefix;
+		}
+		return;
+	}
+
+	// First time that this namespace is seen
+	record = g_new(NamespaceRecord, 1);
+	record->prefix = prefix;
+	record->uri = uri;
+	g_ptr_array_add(list->records, record);
+	g_hash_table_insert(list->seen, (gpointer) uri, record);
+}
+
+
+
+//
+// Adds the namespaces declared by an element, the declarations are taken in
+// reverse order as done by the XPath namespace axis.
+//
+static void my_add_declarations (XacobeoNamespaceList *list, xmlNs *ns) {
+	if (ns == NULL) {
+		return;
+	}
+	my_add_declarations(list, ns->next);
+	my_add_namespace(list, ns);
+}
+
+
+
+//
+// Returns the element that follows the given node in document order within the
+// subtree of 'top' or NULL if there are no more elements.
+//
+static xmlNode* my_next_element (xmlNode *top, xmlNode *node) {
+	do {
+		if ((node == top || node->type == XML_ELEMENT_NODE) && node->children) {
+			node = node->children;
+		}
+		else {
+			// Go to the next node, going up when all the children are done
+			while (node != top && node->next == NULL) {
+				node = node->parent;
+			}
+			if (node == top) {
+				return NULL;
+			}
+			node = node->next;
+		}
+	} while (node->type != XML_ELEMENT_NODE);
+
+	return node;
+}
+
+
+
+//
+// Returns TRUE if the prefix is defined and not used yet.
+//
+static gboolean my_is_prefix_unique (GHashTable *cleaned, const gchar *prefix) {
+	return prefix != NULL && ! g_hash_table_lookup_extended(cleaned, prefix, NULL, NULL);
+}
@@ -0,0 +1,37 @@
+#ifndef __XACOBEO_NAMESPACES_H__
+#define __XACOBEO_NAMESPACES_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <glib.h>
+#include <libxml/tree.h>
+
+
+//
+// The namespaces found while walking a document. The namespaces are added one
+// element at a time and the unique prefixes are assigned at the end.
+//
+typedef struct _XacobeoNamespaceList {
+
+	// The namespaces by order of appearance (NamespaceRecord*)
+	GPtrArray *records;
+
+	// The same namespaces keyed by their URI
+	GHashTable *seen;
+
+} XacobeoNamespaceList;
+
+
+// Public prototypes
+SV*                   xacobeo_get_namespaces              (xmlNode *node);
+XacobeoNamespaceList* xacobeo_namespace_list_new          (void);
+void                  xacobeo_namespace_list_free         (XacobeoNamespaceList *list);
+void                  xacobeo_namespace_list_add_scope    (XacobeoNamespaceList *list, xmlNode *element);
+void                  xacobeo_namespace_list_add_element  (XacobeoNamespaceList *list, xmlNode *element);
+SV*                   xacobeo_namespace_list_to_sv        (XacobeoNamespaceList *list);
+
+
+#endif
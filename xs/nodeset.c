@@ -0,0 +1,577 @@
+//
+// Native node sets returned by XPath queries.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "nodeset.h"
+#include "xpath.h"
+#include "code.h"
+#include "logger.h"
+#include "libxml.h"
+#include <libxml/xpathInternals.h>
+
+
+//
+// The position of a node in document order: the number of the element that
+// comes before the node (the node itself for an element), the rank of the node
+// relative to that element (see my_get_key()), the level and the position of
+// the node after that element.
+//
+typedef struct _NodeKey {
+	gsize order;
+	gint rank;
+	gint level;
+	gint position;
+	xmlNode *node;
+} NodeKey;
+
+
+//
+// Function prototypes
+//
+static gboolean        my_clamp_range   (XacobeoNodeSet *set, gint *offset, gint *count);
+static void            my_sort_nodes    (xmlNodeSet *nodes, GHashTable *order);
+static XacobeoNodeSet* my_merge         (XacobeoNodeSet *set, XacobeoNodeSet *other, GHashTable *order, gboolean intersect);
+static gboolean        my_get_key       (GHashTable *order, xmlNode *node, NodeKey *key);
+static xmlNode*        my_get_anchor    (xmlNode *node, gint *rank);
+static xmlNode*        my_get_preceding (xmlNode *node, gint *level, gint *position);
+static gint            my_compare_nodes (xmlNode *a, xmlNode *b, GHashTable *order);
+static gint            my_compare_keys  (gconstpointer a, gconstpointer b, gpointer data);
+static gint            my_compare_tree  (xmlNode *a, xmlNode *b);
+
+
+
+//
+// Creates a new node set from the result of an XPath query. The node set takes
+// ownership of the result, which is freed with the node set. If the result is
+// not a node set it's freed and NULL is returned.
+//
+// The node set has to be freed with xacobeo_nodeset_free().
+//
+XacobeoNodeSet* xacobeo_nodeset_new (SV *document, xmlXPathObject *result) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL || result == NULL || result->type != XPATH_NODESET) {
+		if (result) {
+			xmlXPathFreeObject(result);
+		}
+		return NULL;
+	}
+
+	XacobeoNodeSet *set = g_new0(XacobeoNodeSet, 1);
+	set->doc = node->doc;
+	set->document = newSVsv(document);
+	set->result = result;
+
+	return set;
+}
+
+
+
+//
+// Creates a new node set from a list of Perl nodes (ex: a XML::LibXML::NodeList
+// returned by XML::LibXML). The nodes are taken in the order of the list.
+//
+// Returns NULL if an entry of the list is not a node of the document (a
+// namespace, a node of another document, etc).
+//
+// The node set has to be freed with xacobeo_nodeset_free().
+//
+XacobeoNodeSet* xacobeo_nodeset_new_from_list (SV *document, AV *nodes) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL) {
+		return NULL;
+	}
+
+	xmlNodeSet *set = xmlXPathNodeSetCreate(NULL);
+	SSize_t last = av_len(nodes);
+	for (SSize_t i = 0; i <= last; ++i) {
+		SV **svPtr = av_fetch(nodes, i, FALSE);
+		xmlNode *item = svPtr && sv_derived_from(*svPtr, "XML::LibXML::Node") ? PmmSvNode(*svPtr) : NULL;
+		if (item == NULL || item->doc != node->doc) {
+			xmlXPathFreeNodeSet(set);
+			return NULL;
+		}
+		xmlXPathNodeSetAddUnique(set, item);
+	}
+
+	return xacobeo_nodeset_new(document, xmlXPathWrapNodeSet(set));
+}
+
+
+
+//
+// Evaluates the given expression on the document and returns the nodes found.
+// The namespaces (key: uri, value: prefix) are registered in the evaluation
+// context.
+//
+// If the expression can't be evaluated or if it doesn't return a node set NULL
+// is returned. In such case the caller should evaluate the expression through
+// XML::LibXML in order to get the value or the error message.
+//
+XacobeoNodeSet* xacobeo_nodeset_find (SV *document, const gchar *expression, HV *namespaces) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL || expression == NULL) {
+		return NULL;
+	}
+
+	xmlXPathContext *context = xacobeo_xpath_context_new(namespaces);
+	context->doc = node->doc;
+	context->node = (xmlNode *) node->doc;
+	xmlXPathObject *result = xmlXPathEvalExpression(BAD_CAST expression, context);
+	xmlXPathFreeContext(context);
+
+	return xacobeo_nodeset_new(document, result);
+}
+
+
+
+//
+// Frees the node set and the nodes copied by the XPath engine (namespaces).
+//
+void xacobeo_nodeset_free (XacobeoNodeSet *set) {
+	if (set == NULL) {
+		return;
+	}
+
+	xmlXPathFreeObject(set->result);
+	SvREFCNT_dec(set->document);
+	g_free(set);
+}
+
+
+
+//
+// Returns the number of nodes in the set. This doesn't create any Perl value.
+//
+gint xacobeo_nodeset_size (XacobeoNodeSet *set) {
+	xmlNodeSet *nodes = set->result->nodesetval;
+	return nodes ? nodes->nodeNr : 0;
+}
+
+
+
+//
+// Returns the nodes in the range [offset, offset + count) as a Perl
+// XML::LibXML::NodeList. Only the nodes in the range are converted to Perl
+// objects. The range is clamped to the size of the set.
+//
+SV* xacobeo_nodeset_slice (XacobeoNodeSet *set, gint offset, gint count) {
+
+	AV *nodes = newAV();
+	if (my_clamp_range(set, &offset, &count)) {
+		xmlNodeSet *result = set->result->nodesetval;
+		ProxyNode *owner = PmmOWNERPO(PmmPROXYNODE((xmlNode *) set->doc));
+		av_extend(nodes, count - 1);
+		for (gint i = offset; i < offset + count; ++i) {
+			xmlNode *node = result->nodeTab[i];
+			SV *sv;
+			if (node->type == XML_NAMESPACE_DECL) {
+				// The namespaces in the set belong to the set, Perl gets its own copy
+				xmlNs *ns = xmlCopyNamespace((xmlNs *) node);
+				sv = sv_setref_pv(newSV(0), "XML::LibXML::Namespace", (void *) ns);
+			}
+			else {
+				sv = PmmNodeToSv(node, owner);
+			}
+			av_push(nodes, sv);
+		}
+	}
+
+	return sv_bless(newRV_noinc((SV *) nodes), gv_stashpv("XML::LibXML::NodeList", GV_ADD));
+}
+
+
+
+//
+// Displays the nodes in the range [offset, offset + count) into the given
+// GtkTextBuffer. The nodes are displayed as XPath results (see
+// xacobeo_populate_gtk_text_buffer_nodes()) and are numbered according to their
+// position in the whole set.
+//
+void xacobeo_nodeset_render (XacobeoNodeSet *set, GtkTextBuffer *buffer, gint offset, gint count, HV *namespaces) {
+	if (! my_clamp_range(set, &offset, &count)) {
+		return;
+	}
+	xacobeo_populate_gtk_text_buffer_nodes(buffer, set->result->nodesetval, offset, count, namespaces);
+}
+
+
+
+//
+// Clamps the range [offset, offset + count) to the nodes available in the set.
+// Returns FALSE if the range is empty.
+//
+static gboolean my_clamp_range (XacobeoNodeSet *set, gint *offset, gint *count) {
+	gint size = xacobeo_nodeset_size(set);
+	*offset = CLAMP(*offset, 0, size);
+	*count = CLAMP(*count, 0, size - *offset);
+	return *count > 0;
+}
+
+
+
+//
+// Sorts the nodes of the set in document order and removes the duplicates. The
+// order is the position of each element in the document (key: xmlNode*, value:
+// number starting at 1, see XacobeoIndex); without it the positions of the
+// nodes are found by walking the tree.
+//
+void xacobeo_nodeset_sort (XacobeoNodeSet *set, GHashTable *order) {
+	my_sort_nodes(set->result->nodesetval, order);
+}
+
+
+
+//
+// Returns a new set with the nodes that are in any of the sets (the XPath union
+// operator '|'). Once sorted the sets are merged in a single pass.
+//
+// Returns NULL if the sets belong to different documents.
+//
+XacobeoNodeSet* xacobeo_nodeset_union (XacobeoNodeSet *set, XacobeoNodeSet *other, GHashTable *order) {
+	return my_merge(set, other, order, FALSE);
+}
+
+
+
+//
+// Returns a new set with the nodes that are in both sets.
+//
+// Returns NULL if the sets belong to different documents.
+//
+XacobeoNodeSet* xacobeo_nodeset_intersect (XacobeoNodeSet *set, XacobeoNodeSet *other, GHashTable *order) {
+	return my_merge(set, other, order, TRUE);
+}
+
+
+
+//
+// Sorts a libxml2 node set in document order and removes the duplicates. The
+// position of each node is computed once from the numbers of the elements,
+// which avoids walking the tree for each comparison as xmlXPathNodeSetSort()
+// does. The namespaces of an element are sorted by prefix (their order is not
+// defined by XPath).
+//
+static void my_sort_nodes (xmlNodeSet *nodes, GHashTable *order) {
+	if (nodes == NULL || nodes->nodeNr < 2) {
+		return;
+	}
+
+	// The XPath results are usually sorted already
+	gboolean sorted = TRUE;
+	for (int i = 1; i < nodes->nodeNr && sorted; ++i) {
+		sorted = my_compare_nodes(nodes->nodeTab[i - 1], nodes->nodeTab[i], order) < 0;
+	}
+	if (sorted) {
+		return;
+	}
+
+	// The nodes that can't be numbered (in an entity, outside of the document)
+	// are placed by walking the tree.
+	NodeKey *keys = g_new(NodeKey, nodes->nodeNr);
+	for (int i = 0; i < nodes->nodeNr; ++i) {
+		if (! my_get_key(order, nodes->nodeTab[i], &keys[i]) && order) {
+			// Start over without the numbers
+			order = NULL;
+			i = -1;
+		}
+	}
+	g_qsort_with_data(keys, nodes->nodeNr, sizeof(NodeKey), my_compare_keys, NULL);
+
+	// Remove the duplicates, they are now next to each other
+	int size = 0;
+	for (int i = 0; i < nodes->nodeNr; ++i) {
+		xmlNode *node = keys[i].node;
+		if (i > 0 && my_compare_keys(&keys[i - 1], &keys[i], NULL) == 0) {
+			if (node != keys[i - 1].node && node->type == XML_NAMESPACE_DECL) {
+				// The namespaces are copies owned by the set
+				xmlXPathNodeSetFreeNs((xmlNs *) node);
+			}
+			continue;
+		}
+		nodes->nodeTab[size++] = node;
+	}
+	nodes->nodeNr = size;
+	g_free(keys);
+}
+
+
+
+//
+// Merges two sets in a single pass over the nodes in document order. The nodes
+// found in both sets are kept for an intersection, all the nodes are kept for an
+// union.
+//
+static XacobeoNodeSet* my_merge (XacobeoNodeSet *set, XacobeoNodeSet *other, GHashTable *order, gboolean intersect) {
+	if (set->doc != other->doc) {
+		return NULL;
+	}
+
+	xmlNodeSet *a = set->result->nodesetval;
+	xmlNodeSet *b = other->result->nodesetval;
+	my_sort_nodes(a, order);
+	my_sort_nodes(b, order);
+	int size_a = a ? a->nodeNr : 0;
+	int size_b = b ? b->nodeNr : 0;
+
+	// The namespaces are copied by xmlXPathNodeSetAddUnique()
+	xmlNodeSet *merged = xmlXPathNodeSetCreate(NULL);
+	int i = 0, j = 0;
+	while (i < size_a && j < size_b) {
+		xmlNode *node_a = a->nodeTab[i];
+		xmlNode *node_b = b->nodeTab[j];
+		gint cmp = my_compare_nodes(node_a, node_b, order);
+		if (cmp == 0) {
+			xmlXPathNodeSetAddUnique(merged, node_a);
+			++i;
+			++j;
+		}
+		else if (cmp < 0) {
+			if (! intersect) {
+				xmlXPathNodeSetAddUnique(merged, node_a);
+			}
+			++i;
+		}
+		else {
+			if (! intersect) {
+				xmlXPathNodeSetAddUnique(merged, node_b);
+			}
+			++j;
+		}
+	}
+
+	if (! intersect) {
+		for (; i < size_a; ++i) {
+			xmlXPathNodeSetAddUnique(merged, a->nodeTab[i]);
+		}
+		for (; j < size_b; ++j) {
+			xmlXPathNodeSetAddUnique(merged, b->nodeTab[j]);
+		}
+	}
+
+	return xacobeo_nodeset_new(set->document, xmlXPathWrapNodeSet(merged));
+}
+
+
+
+//
+// Computes the position of the node in document order. The elements are placed
+// by their number, the namespaces (rank 1) and the attributes (rank 2) come
+// right after their element and the other nodes (rank 3) are placed after the
+// element that comes before them, unless they are numbered too.
+//
+// Returns FALSE if the node can't be placed with the numbers of the elements, in
+// which case the key only holds the node (or if there are no numbers at all).
+//
+static gboolean my_get_key (GHashTable *order, xmlNode *node, NodeKey *key) {
+	memset(key, 0, sizeof(NodeKey));
+	key->node = node;
+	if (order == NULL) {
+		return FALSE;
+	}
+
+	xmlNode *element;
+	switch (node->type) {
+		case XML_DOCUMENT_NODE:
+		case XML_HTML_DOCUMENT_NODE:
+			// The document comes first
+			return TRUE;
+
+		case XML_TEXT_NODE:
+		case XML_CDATA_SECTION_NODE:
+		case XML_COMMENT_NODE:
+		case XML_PI_NODE:
+			// The positions of a preorder mirror have all the nodes
+			key->order = GPOINTER_TO_SIZE(g_hash_table_lookup(order, node));
+			if (key->order > 0) {
+				return TRUE;
+			}
+
+			key->rank = 3;
+			element = my_get_preceding(node, &key->level, &key->position);
+			if (element == NULL) {
+				// Before the root element
+				return node->parent && node->parent->type == XML_DOCUMENT_NODE;
+			}
+		break;
+
+		default:
+			element = my_get_anchor(node, &key->rank);
+			if (element == NULL) {
+				return FALSE;
+			}
+			if (key->rank == 2) {
+				for (xmlAttr *attr = element->properties; attr && (xmlNode *) attr != node; attr = attr->next) {
+					++key->position;
+				}
+			}
+		break;
+	}
+
+	key->order = GPOINTER_TO_SIZE(g_hash_table_lookup(order, element));
+	return key->order > 0;
+}
+
+
+
+//
+// Returns the element next to which the node is placed in document order. The
+// attributes and the namespaces are placed right after their element (first the
+// namespaces), which is given by the rank: 0 for the node itself, 1 for a
+// namespace and 2 for an attribute.
+//
+static xmlNode* my_get_anchor (xmlNode *node, gint *rank) {
+	switch (node->type) {
+		case XML_NAMESPACE_DECL:
+			// The namespaces of a node set are copies that point to their element
+			*rank = 1;
+			return (xmlNode *) ((xmlNs *) node)->next;
+
+		case XML_ATTRIBUTE_NODE:
+			*rank = 2;
+			return node->parent;
+
+		default:
+			*rank = 0;
+			return node;
+	}
+}
+
+
+
+//
+// Returns the closest element that comes before the given node in document
+// order: either the last element within the closest previous sibling element or
+// the parent. The level is 0 when the element is the parent, otherwise it's the
+// number of levels between the node and that element plus one (the deeper nodes
+// come first). The position is the number of siblings between the node and
+// that element. Returns NULL if there's no element before the node.
+//
+static xmlNode* my_get_preceding (xmlNode *node, gint *level, gint *position) {
+	*level = 0;
+	*position = 0;
+	for (xmlNode *sibling = node->prev; sibling; sibling = sibling->prev) {
+		if (sibling->type != XML_ELEMENT_NODE) {
+			++*position;
+			continue;
+		}
+
+		// The last element of the subtree
+		xmlNode *last = sibling;
+		*level = 1;
+		for (;;) {
+			xmlNode *child = last->last;
+			while (child && child->type != XML_ELEMENT_NODE) {
+				child = child->prev;
+			}
+			if (child == NULL) {
+				break;
+			}
+			last = child;
+			++*level;
+		}
+		return last;
+	}
+
+	return node->parent && node->parent->type == XML_ELEMENT_NODE ? node->parent : NULL;
+}
+
+
+
+//
+// Compares two nodes by their position in the document. Returns a negative
+// value if the first node comes first, a positive value if it comes last and 0
+// if both nodes are the same.
+//
+static gint my_compare_nodes (xmlNode *a, xmlNode *b, GHashTable *order) {
+	if (a == b) {
+		return 0;
+	}
+
+	NodeKey key_a, key_b;
+	if (my_get_key(order, a, &key_a) && my_get_key(order, b, &key_b)) {
+		return my_compare_keys(&key_a, &key_b, NULL);
+	}
+
+	return my_compare_tree(a, b);
+}
+
+
+
+//
+// Comparison function of the positions for g_qsort_with_data(). The nodes that
+// have the same position are compared by walking the tree.
+//
+static gint my_compare_keys (gconstpointer a, gconstpointer b, gpointer data) {
+	const NodeKey *key_a = a;
+	const NodeKey *key_b = b;
+	if (key_a->order != key_b->order) {
+		return key_a->order < key_b->order ? -1 : 1;
+	}
+	else if (key_a->rank != key_b->rank) {
+		return key_a->rank - key_b->rank;
+	}
+	else if (key_a->level != key_b->level) {
+		return key_a->level - key_b->level;
+	}
+	else if (key_a->position != key_b->position) {
+		return key_a->position - key_b->position;
+	}
+	return my_compare_tree(key_a->node, key_b->node);
+}
+
+
+
+//
+// Compares two nodes by walking the tree (see my_compare_nodes()).
+//
+static gint my_compare_tree (xmlNode *a, xmlNode *b) {
+	if (a == b) {
+		return 0;
+	}
+
+	gint rank_a, rank_b;
+	xmlNode *anchor_a = my_get_anchor(a, &rank_a);
+	xmlNode *anchor_b = my_get_anchor(b, &rank_b);
+	if (anchor_a == NULL || anchor_b == NULL) {
+		// A namespace without element, there's no order
+		return a < b ? -1 : 1;
+	}
+
+	if (anchor_a != anchor_b) {
+		// xmlXPathCmpNodes() returns 1 if the first node comes first
+		gint cmp = xmlXPathCmpNodes(anchor_a, anchor_b);
+		return cmp == 1 ? -1 : cmp == -1 ? 1 : (a < b ? -1 : 1);
+	}
+	else if (rank_a != rank_b) {
+		return rank_a - rank_b;
+	}
+	else if (rank_a == 1) {
+		// Two copies of the namespaces of the same element
+		xmlNs *ns_a = (xmlNs *) a;
+		xmlNs *ns_b = (xmlNs *) b;
+		gint cmp = g_strcmp0((gchar *) ns_a->prefix, (gchar *) ns_b->prefix);
+		return cmp ? cmp : g_strcmp0((gchar *) ns_a->href, (gchar *) ns_b->href);
+	}
+
+	// Two attributes of the same element
+	for (xmlAttr *attr = anchor_a->properties; attr; attr = attr->next) {
+		if ((xmlNode *) attr == a) {
+			return -1;
+		}
+		else if ((xmlNode *) attr == b) {
+			return 1;
+		}
+	}
+	return a < b ? -1 : 1;
+}
@@ -0,0 +1,48 @@
+#ifndef __XACOBEO_NODESET_H__
+#define __XACOBEO_NODESET_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <libxml/xpath.h>
+
+
+//
+// The result of an XPath query kept as a native node set. Perl nodes are only
+// created for the parts of the result that are requested (see
+// xacobeo_nodeset_slice()), this way counting or paging through millions of
+// results doesn't require to create one Perl object per node.
+//
+typedef struct _XacobeoNodeSet {
+
+	// The document that owns the nodes
+	xmlDoc *doc;
+
+	// The Perl document, it's kept in order to ensure that the nodes are not
+	// freed while the node set is alive.
+	SV *document;
+
+	// The result of the XPath query (always of type XPATH_NODESET)
+	xmlXPathObject *result;
+
+} XacobeoNodeSet;
+
+
+// Public prototypes
+XacobeoNodeSet* xacobeo_nodeset_new       (SV *document, xmlXPathObject *result);
+XacobeoNodeSet* xacobeo_nodeset_new_from_list (SV *document, AV *nodes);
+XacobeoNodeSet* xacobeo_nodeset_find      (SV *document, const gchar *expression, HV *namespaces);
+void            xacobeo_nodeset_free      (XacobeoNodeSet *set);
+gint            xacobeo_nodeset_size      (XacobeoNodeSet *set);
+SV*             xacobeo_nodeset_slice     (XacobeoNodeSet *set, gint offset, gint count);
+void            xacobeo_nodeset_render    (XacobeoNodeSet *set, GtkTextBuffer *buffer, gint offset, gint count, HV *namespaces);
+void            xacobeo_nodeset_sort      (XacobeoNodeSet *set, GHashTable *order);
+XacobeoNodeSet* xacobeo_nodeset_union     (XacobeoNodeSet *set, XacobeoNodeSet *other, GHashTable *order);
+XacobeoNodeSet* xacobeo_nodeset_intersect (XacobeoNodeSet *set, XacobeoNodeSet *other, GHashTable *order);
+
+
+#endif
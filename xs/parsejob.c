@@ -0,0 +1,479 @@
+//
+// Parse of a document in a worker thread.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "parsejob.h"
+#include "loader.h"
+#include "records.h"
+#include "logger.h"
+#include "libxml.h"
+
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+
+// The number of bytes parsed at once, the job can be cancelled and its
+// progress is updated between two chunks
+#define PARSE_JOB_CHUNK_SIZE (256 * 1024)
+
+// The number of milliseconds that the worker waits for a stream before checking
+// if the job was cancelled
+#define PARSE_JOB_READ_TIMEOUT 100
+
+// The first copy of the part of the document parsed is made once this number of
+// bytes is parsed and then each time the number doubles, up to the maximal size
+#define PREVIEW_SIZE (1024 * 1024)
+#define MAX_PREVIEW_SIZE (64 * 1024 * 1024)
+
+// The size from which a file is parsed by records with all the processors
+#define PARALLEL_MIN_SIZE (16 * 1024 * 1024)
+
+
+// The names of the states as seen by Perl (indexed by ParseJobStateEnum)
+static const gchar *STATE_NAMES[] = {
+	"running",
+	"done",
+	"error",
+	"cancelled",
+};
+
+
+//
+// Function prototypes
+//
+static XacobeoParseJob* my_job_new         (const gchar *filename, gboolean previews);
+static void             my_job_start       (XacobeoParseJob *job);
+static gpointer         my_job_run         (gpointer data);
+static gboolean         my_job_parse_records (XacobeoParseJob *job);
+static gboolean         my_job_read_buffer (XacobeoParseJob *job);
+static gboolean         my_job_read_stream (XacobeoParseJob *job);
+static gboolean         my_job_feed        (XacobeoParseJob *job, const gchar *buffer, gsize size);
+static xmlDoc*          my_job_swap_preview (XacobeoParseJob *job, xmlDoc *preview);
+
+
+
+//
+// Creates a new job that parses and analyzes the given file in a worker thread.
+// The job is started right away. The file is mapped in memory. If 'previews' is
+// TRUE copies of the part of the document parsed are made while the parse goes
+// on, see xacobeo_parse_job_take_preview().
+//
+// A big file made of records is parsed by 'threads' threads (see records.c),
+// unless previews are requested: a parallel parse can't make them. With 0
+// threads the number of processors is used for the files of PARALLEL_MIN_SIZE
+// bytes or more, with 1 thread the file is always parsed serially.
+//
+// Returns NULL if the file can't be parsed natively (it's not a local file or
+// it's empty), the caller has to parse the file by other means.
+//
+// The job has to be freed with xacobeo_parse_job_free().
+//
+XacobeoParseJob* xacobeo_parse_job_new_from_file (const gchar *filename, gboolean previews, guint threads) {
+
+	gsize size;
+	gchar *buffer = xacobeo_loader_map_file(filename, &size);
+	if (buffer == NULL) {
+		return NULL;
+	}
+
+	XacobeoParseJob *job = my_job_new(filename, previews);
+	job->buffer = buffer;
+	job->size = size;
+	job->mapped = TRUE;
+	job->filename = g_strdup(filename);
+	job->threads = threads;
+	my_job_start(job);
+
+	return job;
+}
+
+
+
+//
+// Creates a new job that parses and analyzes the given string in a worker
+// thread, see xacobeo_parse_job_new_from_file(). The string is copied. A
+// character string is parsed as UTF-8, the encoding declared by the document
+// is ignored since the string was already decoded.
+//
+XacobeoParseJob* xacobeo_parse_job_new_from_string (SV *content) {
+
+	STRLEN size;
+	const gchar *bytes = SvPV(content, size);
+
+	XacobeoParseJob *job = my_job_new(NULL, FALSE);
+	job->buffer = g_malloc(size ? size : 1);
+	memcpy(job->buffer, bytes, size);
+	job->size = size;
+	if (SvUTF8(content)) {
+		xacobeo_analysis_loader_set_encoding(job->loader, "UTF-8");
+	}
+	my_job_start(job);
+
+	return job;
+}
+
+
+
+//
+// Creates a new job that parses and analyzes the document read from the given
+// file descriptor (a pipe, the standard input, etc) in a worker thread until
+// the end of the stream, see xacobeo_parse_job_new_from_file(). The file
+// descriptor is not closed by the job.
+//
+XacobeoParseJob* xacobeo_parse_job_new_from_fd (gint fd, gboolean previews) {
+	XacobeoParseJob *job = my_job_new(NULL, previews);
+	job->fd = fd;
+	my_job_start(job);
+	return job;
+}
+
+
+
+//
+// Frees the job. If the job is still running it's cancelled and this function
+// waits for the worker thread to finish.
+//
+void xacobeo_parse_job_free (XacobeoParseJob *job) {
+	if (job == NULL) {
+		return;
+	}
+
+	if (job->thread) {
+		xacobeo_parse_job_cancel(job);
+		g_thread_join(job->thread);
+	}
+
+	xmlDoc *preview = my_job_swap_preview(job, NULL);
+	if (preview) {
+		xmlFreeDoc(preview);
+	}
+	xacobeo_analysis_loader_free(job->loader);
+	if (job->mapped) {
+		xacobeo_loader_unmap(job->buffer, job->size);
+	}
+	else {
+		g_free(job->buffer);
+	}
+	g_timer_destroy(job->timer);
+	g_free(job->filename);
+	g_free(job->error);
+	if (job->analysis) {
+		SvREFCNT_dec(job->analysis);
+	}
+	g_free(job);
+}
+
+
+
+//
+// Returns the state of the job: "running", "done", "error" or "cancelled".
+//
+const gchar* xacobeo_parse_job_poll (XacobeoParseJob *job) {
+
+	gint state = g_atomic_int_get(&job->state);
+	if (state != PARSE_JOB_RUNNING && job->thread) {
+		g_thread_join(job->thread);
+		job->thread = NULL;
+	}
+
+	return STATE_NAMES[state];
+}
+
+
+
+//
+// Requests the job to stop. The job will be in the state "cancelled" once the
+// worker thread is done.
+//
+void xacobeo_parse_job_cancel (XacobeoParseJob *job) {
+	g_atomic_int_set(&job->cancelled, TRUE);
+}
+
+
+
+//
+// Returns the number of seconds spent by the job.
+//
+gdouble xacobeo_parse_job_elapsed (XacobeoParseJob *job) {
+	return g_timer_elapsed(job->timer, NULL);
+}
+
+
+
+//
+// Returns the number of bytes parsed so far.
+//
+gdouble xacobeo_parse_job_progress (XacobeoParseJob *job) {
+	return (gdouble) (gsize) g_atomic_pointer_get(&job->consumed);
+}
+
+
+
+//
+// Returns the size of the document in bytes or 0 if it's unknown (the document
+// is read from a stream).
+//
+gdouble xacobeo_parse_job_size (XacobeoParseJob *job) {
+	return (gdouble) job->size;
+}
+
+
+
+//
+// Returns the error message of a job that failed or NULL.
+//
+const gchar* xacobeo_parse_job_error (XacobeoParseJob *job) {
+	if (g_atomic_int_get(&job->state) != PARSE_JOB_ERROR) {
+		return NULL;
+	}
+	return job->error;
+}
+
+
+
+//
+// Returns the last copy of the part of the document parsed (an
+// XML::LibXML::Document) made since the previous call or undef if there's no
+// new copy.
+//
+SV* xacobeo_parse_job_take_preview (XacobeoParseJob *job) {
+	xmlDoc *preview = my_job_swap_preview(job, NULL);
+	if (preview == NULL) {
+		return &PL_sv_undef;
+	}
+	return PmmNodeToSv((xmlNode *) preview, NULL);
+}
+
+
+
+//
+// Returns the analysis of the document (an Xacobeo::XS::Analysis) once the job
+// is done or undef. The analysis is finished by the calling thread, the Perl
+// wrapper of the document is created there.
+//
+SV* xacobeo_parse_job_result (XacobeoParseJob *job) {
+
+	if (g_atomic_int_get(&job->state) != PARSE_JOB_DONE) {
+		return &PL_sv_undef;
+	}
+
+	if (job->analysis == NULL) {
+		SV *analysis = xacobeo_analysis_loader_finish(job->loader);
+		if (! SvOK(analysis)) {
+			return &PL_sv_undef;
+		}
+		job->analysis = analysis;
+	}
+
+	return newSVsv(job->analysis);
+}
+
+
+
+//
+// Creates a job that's not started yet.
+//
+static XacobeoParseJob* my_job_new (const gchar *filename, gboolean previews) {
+	XacobeoParseJob *job = g_new0(XacobeoParseJob, 1);
+	job->fd = -1;
+	job->loader = xacobeo_analysis_loader_new(filename);
+	job->next_preview = previews ? PREVIEW_SIZE : 0;
+	job->timer = g_timer_new();
+	job->state = PARSE_JOB_RUNNING;
+	return job;
+}
+
+
+
+//
+// Starts the worker thread of the job.
+//
+static void my_job_start (XacobeoParseJob *job) {
+#if GLIB_CHECK_VERSION(2, 32, 0)
+	job->thread = g_thread_new("parse", my_job_run, job);
+#else
+	if (! g_thread_supported()) {
+		g_thread_init(NULL);
+	}
+	job->thread = g_thread_create(my_job_run, job, TRUE, NULL);
+#endif
+}
+
+
+
+//
+// The worker thread. Parses the source by chunks and sets the final state of
+// the job.
+//
+static gpointer my_job_run (gpointer data) {
+	XacobeoParseJob *job = (XacobeoParseJob *) data;
+
+	gboolean complete = my_job_parse_records(job)
+		|| (job->fd == -1 ? my_job_read_buffer(job) : my_job_read_stream(job))
+	;
+
+	gint state;
+	if (g_atomic_int_get(&job->cancelled)) {
+		state = PARSE_JOB_CANCELLED;
+	}
+	else if (! complete) {
+		state = PARSE_JOB_ERROR;
+	}
+	else if (! xacobeo_analysis_loader_close(job->loader)) {
+		state = PARSE_JOB_ERROR;
+		job->error = g_strdup("No document found");
+	}
+	else {
+		state = PARSE_JOB_DONE;
+	}
+	g_timer_stop(job->timer);
+
+	g_atomic_int_set(&job->state, state);
+	return NULL;
+}
+
+
+
+//
+// Parses a mapped file by records with several threads. Returns FALSE if the
+// file has to be parsed serially: it's too small, there's only one processor,
+// previews are requested or the file is not made of records.
+//
+static gboolean my_job_parse_records (XacobeoParseJob *job) {
+
+	guint threads = job->threads;
+	if (threads == 0) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		threads = g_get_num_processors();
+#else
+		threads = 1;
+#endif
+		if (job->size < PARALLEL_MIN_SIZE) {
+			threads = 1;
+		}
+	}
+	if (threads < 2 || ! job->mapped || job->next_preview) {
+		return FALSE;
+	}
+
+	xmlDoc *doc = xacobeo_records_parse(job->buffer, job->size, job->filename, threads, &job->cancelled, &job->consumed);
+	if (doc == NULL) {
+		// The serial parse starts over, unless the job was cancelled
+		g_atomic_pointer_set(&job->consumed, 0);
+		return g_atomic_int_get(&job->cancelled);
+	}
+
+	xacobeo_analysis_loader_take(job->loader, doc);
+	return TRUE;
+}
+
+
+
+//
+// Gives the buffer of the job to the parser. Returns TRUE, a buffer can always
+// be read.
+//
+static gboolean my_job_read_buffer (XacobeoParseJob *job) {
+	gsize offset = 0;
+	while (offset < job->size && ! g_atomic_int_get(&job->cancelled)) {
+		gsize length = MIN(job->size - offset, PARSE_JOB_CHUNK_SIZE);
+		if (! my_job_feed(job, job->buffer + offset, length)) {
+			break;
+		}
+		offset += length;
+	}
+	return TRUE;
+}
+
+
+
+//
+// Reads the stream of the job and gives it to the parser until the end of the
+// stream. The worker doesn't block for more than PARSE_JOB_READ_TIMEOUT, this
+// way the job can be cancelled while the stream has no data. Returns FALSE if
+// the stream can't be read, the error is then set in the job.
+//
+static gboolean my_job_read_stream (XacobeoParseJob *job) {
+	gchar *chunk = g_malloc(PARSE_JOB_CHUNK_SIZE);
+	gboolean complete = TRUE;
+
+	while (! g_atomic_int_get(&job->cancelled)) {
+		struct pollfd pfd = { .fd = job->fd, .events = POLLIN };
+		int ready = poll(&pfd, 1, PARSE_JOB_READ_TIMEOUT);
+		if (ready == 0 || (ready == -1 && errno == EINTR)) {
+			continue;
+		}
+
+		ssize_t count = ready == -1 ? -1 : read(job->fd, chunk, PARSE_JOB_CHUNK_SIZE);
+		if (count == -1 && (errno == EINTR || errno == EAGAIN)) {
+			continue;
+		}
+		else if (count == -1) {
+			job->error = g_strdup(g_strerror(errno));
+			complete = FALSE;
+			break;
+		}
+		else if (count == 0 || ! my_job_feed(job, chunk, (gsize) count)) {
+			// The end of the stream or the parser stopped
+			break;
+		}
+	}
+
+	g_free(chunk);
+	return complete;
+}
+
+
+
+//
+// Gives the next bytes of the document to the parser and makes a copy of the
+// document if it's time for a preview. Returns FALSE once the parser stopped.
+//
+static gboolean my_job_feed (XacobeoParseJob *job, const gchar *buffer, gsize size) {
+
+	gboolean parsing = xacobeo_analysis_loader_push(job->loader, buffer, size);
+	gsize consumed = size + (gsize) g_atomic_pointer_add(&job->consumed, size);
+
+	if (job->next_preview && consumed >= job->next_preview) {
+		while (job->next_preview <= consumed) {
+			job->next_preview *= 2;
+		}
+		if (job->next_preview > MAX_PREVIEW_SIZE) {
+			job->next_preview = 0;
+		}
+
+		xmlDoc *preview = xacobeo_analysis_loader_copy(job->loader);
+		if (preview) {
+			xmlDoc *previous = my_job_swap_preview(job, preview);
+			if (previous) {
+				xmlFreeDoc(previous);
+			}
+		}
+	}
+
+	return parsing;
+}
+
+
+
+//
+// Replaces the preview of the job and returns the previous one (NULL if it was
+// taken). The preview is exchanged between the threads without locking.
+//
+static xmlDoc* my_job_swap_preview (XacobeoParseJob *job, xmlDoc *preview) {
+	xmlDoc *previous;
+	do {
+		previous = g_atomic_pointer_get(&job->preview);
+	} while (! g_atomic_pointer_compare_and_exchange(&job->preview, previous, preview));
+	return previous;
+}
@@ -0,0 +1,87 @@
+#ifndef __XACOBEO_PARSEJOB_H__
+#define __XACOBEO_PARSEJOB_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include "analysis.h"
+
+#include <glib.h>
+#include <libxml/tree.h>
+
+
+// The states of a parse job
+enum ParseJobState {
+	PARSE_JOB_RUNNING,
+	PARSE_JOB_DONE,
+	PARSE_JOB_ERROR,
+	PARSE_JOB_CANCELLED,
+};
+typedef enum ParseJobState ParseJobStateEnum;
+
+
+//
+// A document parsed and analyzed in a worker thread. The main thread polls the
+// job until it's finished and then takes the analysis. The worker never
+// touches Perl data, the Perl values are created by the main thread.
+//
+typedef struct _XacobeoParseJob {
+
+	// The source: a buffer (a file mapped in memory or a copy of a string) or a
+	// stream read by the worker
+	gchar *buffer;
+	gsize size;
+	gboolean mapped;
+	gint fd;
+	gchar *filename;
+
+	// The number of threads that parse a file by records (0 for automatic)
+	guint threads;
+
+	// The parser and the analysis fed by the worker
+	XacobeoAnalysisLoader *loader;
+
+	// The worker thread (NULL once joined)
+	GThread *thread;
+
+	// The state of the job (ParseJobStateEnum), it's set by the worker thread
+	volatile gint state;
+
+	// Set when the job has to stop
+	volatile gint cancelled;
+
+	// The number of bytes parsed so far
+	volatile gsize consumed;
+
+	// The copies of the part of the document parsed are made each time the
+	// number of bytes parsed reaches the next size (0 for no copies)
+	gsize next_preview;
+	xmlDoc * volatile preview;
+
+	GTimer *timer;
+	gchar *error;
+
+	// The analysis (Xacobeo::XS::Analysis) once taken by the main thread
+	SV *analysis;
+
+} XacobeoParseJob;
+
+
+// Public prototypes
+XacobeoParseJob* xacobeo_parse_job_new_from_file   (const gchar *filename, gboolean previews, guint threads);
+XacobeoParseJob* xacobeo_parse_job_new_from_string (SV *content);
+XacobeoParseJob* xacobeo_parse_job_new_from_fd     (gint fd, gboolean previews);
+void             xacobeo_parse_job_free            (XacobeoParseJob *job);
+const gchar*     xacobeo_parse_job_poll            (XacobeoParseJob *job);
+void             xacobeo_parse_job_cancel          (XacobeoParseJob *job);
+gdouble          xacobeo_parse_job_elapsed         (XacobeoParseJob *job);
+gdouble          xacobeo_parse_job_progress        (XacobeoParseJob *job);
+gdouble          xacobeo_parse_job_size            (XacobeoParseJob *job);
+const gchar*     xacobeo_parse_job_error           (XacobeoParseJob *job);
+SV*              xacobeo_parse_job_take_preview    (XacobeoParseJob *job);
+SV*              xacobeo_parse_job_result          (XacobeoParseJob *job);
+
+
+#endif
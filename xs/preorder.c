@@ -0,0 +1,319 @@
+//
+// Preorder mirror of a document.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "preorder.h"
+#include "logger.h"
+#include "libxml.h"
+
+#include <string.h>
+
+
+// The number of slots allocated at first in the arrays
+#define PREORDER_INITIAL_CAPACITY 1024
+
+
+//
+// The name of an element: its local name and its namespace. The strings belong
+// to the document.
+//
+typedef struct _PreorderName {
+	const gchar *name;
+	const gchar *uri;
+} PreorderName;
+
+
+//
+// Function prototypes
+//
+static void     my_grow            (XacobeoPreorder *preorder);
+static guint    my_get_name_id     (XacobeoPreorder *preorder, xmlNode *element);
+static guint    my_name_hash       (gconstpointer data);
+static gboolean my_name_equal      (gconstpointer a, gconstpointer b);
+
+
+
+//
+// Builds the mirror of the given document in a single walk.
+//
+// The mirror has to be released with xacobeo_preorder_unref().
+//
+XacobeoPreorder* xacobeo_preorder_new (SV *document) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL) {
+		WARN("Document has no node");
+		return NULL;
+	}
+
+	XacobeoPreorder *preorder = xacobeo_preorder_begin(node->doc);
+
+	xmlNode *top = (xmlNode *) node->doc;
+	node = top->children;
+	while (node) {
+		guint position = xacobeo_preorder_add(preorder, node);
+
+		// Only the elements are descended
+		if (node->type == XML_ELEMENT_NODE && node->children) {
+			xacobeo_preorder_enter(preorder, position);
+			node = node->children;
+			continue;
+		}
+
+		while (node != top && node->next == NULL) {
+			node = node->parent;
+			if (node != top) {
+				xacobeo_preorder_leave(preorder);
+			}
+		}
+		node = node == top ? NULL : node->next;
+	}
+
+	xacobeo_preorder_end(preorder, document);
+
+	return preorder;
+}
+
+
+
+//
+// Creates an empty mirror for the given document. The nodes are added by the
+// caller with xacobeo_preorder_add() while it walks the document in document
+// order. The caller enters a node before adding its children and leaves it
+// once they are all added. The mirror is completed with xacobeo_preorder_end().
+// Building the mirror doesn't involve Perl, it can be done by any thread.
+//
+XacobeoPreorder* xacobeo_preorder_begin (xmlDoc *doc) {
+	XacobeoPreorder *preorder = g_new0(XacobeoPreorder, 1);
+	preorder->doc = doc;
+	preorder->refs = 1;
+	preorder->positions = g_hash_table_new(g_direct_hash, g_direct_equal);
+	preorder->names_by_id = g_ptr_array_new_with_free_func(g_free);
+	preorder->ids_by_name = g_hash_table_new(my_name_hash, my_name_equal);
+	preorder->open = g_array_new(FALSE, FALSE, sizeof(guint));
+
+	// The id 0 is used by the nodes that are not elements
+	g_ptr_array_add(preorder->names_by_id, NULL);
+
+	return preorder;
+}
+
+
+
+//
+// Adds a node to the mirror, its parent is the last node entered. Returns the
+// position of the node.
+//
+guint xacobeo_preorder_add (XacobeoPreorder *preorder, xmlNode *node) {
+	if (preorder->size == preorder->capacity) {
+		my_grow(preorder);
+	}
+
+	guint position = preorder->size++;
+	guint depth = preorder->open->len;
+	preorder->types[position] = (guint8) node->type;
+	preorder->depths[position] = depth + 1;
+	preorder->names[position] = node->type == XML_ELEMENT_NODE ? my_get_name_id(preorder, node) : 0;
+	preorder->parents[position] = depth ? (gint) g_array_index(preorder->open, guint, depth - 1) : -1;
+	preorder->sizes[position] = 0;
+	preorder->nodes[position] = node;
+	g_hash_table_insert(preorder->positions, node, GUINT_TO_POINTER(position + 1));
+
+	return position;
+}
+
+
+
+//
+// Makes the node at the given position the parent of the nodes added next.
+//
+void xacobeo_preorder_enter (XacobeoPreorder *preorder, guint position) {
+	g_array_append_val(preorder->open, position);
+}
+
+
+
+//
+// Closes the last node entered, all its children were added.
+//
+void xacobeo_preorder_leave (XacobeoPreorder *preorder) {
+	guint last = preorder->open->len - 1;
+	guint position = g_array_index(preorder->open, guint, last);
+	preorder->sizes[position] = preorder->size - position - 1;
+	g_array_set_size(preorder->open, last);
+}
+
+
+
+//
+// Completes the mirror once all the nodes were added. The mirror keeps the
+// given document (an XML::LibXML::Document) alive.
+//
+void xacobeo_preorder_end (XacobeoPreorder *preorder, SV *document) {
+	preorder->document = newSVsv(document);
+	while (preorder->open->len) {
+		xacobeo_preorder_leave(preorder);
+	}
+	g_array_free(preorder->open, TRUE);
+	preorder->open = NULL;
+
+	// The tables used while building the mirror
+	g_hash_table_destroy(preorder->ids_by_name);
+	preorder->ids_by_name = NULL;
+
+	INFO("Preorder mirror with %u nodes and %u names", preorder->size, preorder->names_by_id->len - 1);
+}
+
+
+
+//
+// Adds a reference to the mirror.
+//
+XacobeoPreorder* xacobeo_preorder_ref (XacobeoPreorder *preorder) {
+	g_atomic_int_inc(&preorder->refs);
+	return preorder;
+}
+
+
+
+//
+// Releases a reference to the mirror, the mirror is freed with the last one.
+//
+void xacobeo_preorder_unref (XacobeoPreorder *preorder) {
+	if (preorder == NULL || ! g_atomic_int_dec_and_test(&preorder->refs)) {
+		return;
+	}
+
+	g_free(preorder->types);
+	g_free(preorder->depths);
+	g_free(preorder->names);
+	g_free(preorder->parents);
+	g_free(preorder->sizes);
+	g_free(preorder->nodes);
+	g_hash_table_destroy(preorder->positions);
+	g_ptr_array_free(preorder->names_by_id, TRUE);
+	if (preorder->ids_by_name) {
+		g_hash_table_destroy(preorder->ids_by_name);
+	}
+	if (preorder->open) {
+		g_array_free(preorder->open, TRUE);
+	}
+	SvREFCNT_dec(preorder->document);
+	g_free(preorder);
+}
+
+
+
+//
+// Returns the position of the node in the mirror or -1 if the node is not
+// mirrored (the document node, an attribute, a node of another document, etc).
+//
+gint xacobeo_preorder_position (XacobeoPreorder *preorder, xmlNode *node) {
+	return (gint) GPOINTER_TO_UINT(g_hash_table_lookup(preorder->positions, node)) - 1;
+}
+
+
+
+//
+// Returns TRUE if the first node is an ancestor of the second one. The test is
+// done on the positions without walking the tree. The attributes are placed
+// under their element and the document node is the ancestor of all the nodes.
+//
+gboolean xacobeo_preorder_is_ancestor (XacobeoPreorder *preorder, xmlNode *ancestor, xmlNode *node) {
+	if (node->type == XML_ATTRIBUTE_NODE) {
+		if (node->parent == ancestor) {
+			return TRUE;
+		}
+		node = node->parent;
+	}
+
+	gint position = xacobeo_preorder_position(preorder, node);
+	if (position < 0) {
+		return FALSE;
+	}
+	else if (ancestor == (xmlNode *) preorder->doc) {
+		return TRUE;
+	}
+
+	gint start = xacobeo_preorder_position(preorder, ancestor);
+	return start >= 0 && start < position && (guint) position <= start + preorder->sizes[start];
+}
+
+
+
+//
+// Returns the mirror as a Xacobeo::XS::Preorder, the Perl object holds its own
+// reference.
+//
+SV* xacobeo_preorder_to_sv (XacobeoPreorder *preorder) {
+	if (preorder == NULL) {
+		return &PL_sv_undef;
+	}
+	return sv_setref_pv(newSV(0), "Xacobeo::XS::Preorder", xacobeo_preorder_ref(preorder));
+}
+
+
+
+//
+// Makes room for more nodes in the arrays.
+//
+static void my_grow (XacobeoPreorder *preorder) {
+	guint capacity = preorder->capacity ? preorder->capacity * 2 : PREORDER_INITIAL_CAPACITY;
+	preorder->types = g_renew(guint8, preorder->types, capacity);
+	preorder->depths = g_renew(guint, preorder->depths, capacity);
+	preorder->names = g_renew(guint, preorder->names, capacity);
+	preorder->parents = g_renew(gint, preorder->parents, capacity);
+	preorder->sizes = g_renew(guint, preorder->sizes, capacity);
+	preorder->nodes = g_renew(xmlNode *, preorder->nodes, capacity);
+	preorder->capacity = capacity;
+}
+
+
+
+//
+// Returns the id of the name of an element, a new id is given to the names
+// seen for the first time.
+//
+static guint my_get_name_id (XacobeoPreorder *preorder, xmlNode *element) {
+	PreorderName key = {
+		.name = (const gchar *) element->name,
+		.uri  = element->ns ? (const gchar *) element->ns->href : NULL,
+	};
+
+	guint id = GPOINTER_TO_UINT(g_hash_table_lookup(preorder->ids_by_name, &key));
+	if (id) {
+		return id;
+	}
+
+	PreorderName *name = g_new(PreorderName, 1);
+	*name = key;
+	id = preorder->names_by_id->len;
+	g_ptr_array_add(preorder->names_by_id, name);
+	g_hash_table_insert(preorder->ids_by_name, name, GUINT_TO_POINTER(id));
+
+	return id;
+}
+
+
+
+//
+// Hash functions used for the names of the elements.
+//
+static guint my_name_hash (gconstpointer data) {
+	const PreorderName *key = data;
+	return g_str_hash(key->name) ^ (key->uri ? g_str_hash(key->uri) : 0);
+}
+
+static gboolean my_name_equal (gconstpointer a, gconstpointer b) {
+	const PreorderName *key_a = a;
+	const PreorderName *key_b = b;
+	return strcmp(key_a->name, key_b->name) == 0 && g_strcmp0(key_a->uri, key_b->uri) == 0;
+}
@@ -0,0 +1,88 @@
+#ifndef __XACOBEO_PREORDER_H__
+#define __XACOBEO_PREORDER_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <glib.h>
+#include <libxml/tree.h>
+
+
+//
+// A compact mirror of a document: the nodes in preorder (document order) with
+// their properties stored in parallel arrays. The arrays are walked instead of
+// following the pointers of the libxml2 tree, which are scattered in memory.
+// The subtree of the node at 'i' spans the positions (i, i + sizes[i]], this
+// way a subtree is skipped with a single jump and an ancestor is found with a
+// range test.
+//
+// The mirror includes the nodes under the document node (the document node
+// itself is not included) but not the attributes, the namespaces nor the
+// content of the entities. It's read only once built and it can be shared
+// between threads, it's released with xacobeo_preorder_unref().
+//
+typedef struct _XacobeoPreorder {
+
+	// The document mirrored and its Perl wrapper, the document is kept alive as
+	// long as the mirror exists
+	xmlDoc *doc;
+	SV *document;
+
+	// The number of nodes and the number of slots allocated in the arrays
+	guint size;
+	guint capacity;
+
+	// The type of each node (xmlElementType)
+	guint8 *types;
+
+	// The depth of each node, the children of the document are at depth 1
+	guint *depths;
+
+	// The name of each element as an id (0 for the other nodes), see 'names'
+	guint *names;
+
+	// The position of the parent of each node (-1 for the children of the
+	// document)
+	gint *parents;
+
+	// The number of nodes in the subtree of each node (without the node)
+	guint *sizes;
+
+	// The libxml2 node at each position
+	xmlNode **nodes;
+
+	// The position of each node (key: xmlNode*, value: position + 1). The
+	// positions are in document order and can be used for sorting the nodes.
+	GHashTable *positions;
+
+	// The names of the elements (the local name and the namespace) by id, the
+	// id 0 is not used. The strings belong to the document.
+	GPtrArray *names_by_id;
+	GHashTable *ids_by_name;
+
+	// The nodes that are open while the mirror is built
+	GArray *open;
+
+	// The number of references
+	volatile gint refs;
+
+} XacobeoPreorder;
+
+
+// Public prototypes
+XacobeoPreorder* xacobeo_preorder_new          (SV *document);
+XacobeoPreorder* xacobeo_preorder_begin        (xmlDoc *doc);
+guint            xacobeo_preorder_add          (XacobeoPreorder *preorder, xmlNode *node);
+void             xacobeo_preorder_enter        (XacobeoPreorder *preorder, guint position);
+void             xacobeo_preorder_leave        (XacobeoPreorder *preorder);
+void             xacobeo_preorder_end          (XacobeoPreorder *preorder, SV *document);
+XacobeoPreorder* xacobeo_preorder_ref          (XacobeoPreorder *preorder);
+void             xacobeo_preorder_unref        (XacobeoPreorder *preorder);
+gint             xacobeo_preorder_position     (XacobeoPreorder *preorder, xmlNode *node);
+gboolean         xacobeo_preorder_is_ancestor  (XacobeoPreorder *preorder, xmlNode *ancestor, xmlNode *node);
+SV*              xacobeo_preorder_to_sv        (XacobeoPreorder *preorder);
+
+
+#endif
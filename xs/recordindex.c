@@ -0,0 +1,537 @@
+//
+// Index of the records of a huge document: the offsets of the records are found
+// once by the prescan of the parallel parse (see records.c) and stored in a
+// side file. A window of records is then read from the document and wrapped by
+// the prolog and the root of the document, this way it can be parsed as a small
+// document whatever the size of the whole document.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "recordindex.h"
+#include "loader.h"
+#include "logger.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+
+// The signature of the index files, the last character is the version
+#define INDEX_MAGIC "XACOBEO-RECORDS2"
+
+// The number of offsets written to the index at once, the build can be
+// cancelled between two batches
+#define INDEX_BATCH_SIZE (64 * 1024)
+
+
+// The names of the states as seen by Perl (indexed by RecordIndexStateEnum)
+static const gchar *STATE_NAMES[] = {
+	"running",
+	"done",
+	"error",
+	"cancelled",
+};
+
+
+//
+// The header of an index file, followed by the offsets of the records (64 bits
+// each, in the byte order of the machine). The index is only valid for the
+// document that has the same size, modification time (with its nanoseconds) and
+// inode: a file rewritten in place within the same second or replaced by
+// another file of the same size is indexed again.
+//
+typedef struct _RecordIndexHeader {
+	gchar magic[16];
+	guint64 size;
+	gint64 mtime;
+	gint64 mtime_nsec;
+	guint64 inode;
+	guint64 root_start;
+	guint64 content_start;
+	guint64 content_end;
+	guint64 root_end;
+	guint64 count;
+} RecordIndexHeader;
+
+
+//
+// The state of a build: the offsets waiting to be written.
+//
+typedef struct _RecordIndexWriter {
+	XacobeoRecordIndex *index;
+	gint fd;
+	guint64 *offsets;
+	guint pending;
+	guint64 count;
+	gboolean failed;
+} RecordIndexWriter;
+
+
+//
+// Function prototypes
+//
+static gpointer my_index_run      (gpointer data);
+static gboolean my_index_build    (XacobeoRecordIndex *index, gchar *path);
+static gboolean my_index_add      (gsize start, gsize end, gpointer data);
+static gboolean my_index_flush    (RecordIndexWriter *writer);
+static gboolean my_index_load     (XacobeoRecordIndex *index);
+static gboolean my_read           (gint fd, gpointer buffer, gsize size, goffset offset);
+static gint64   my_get_mtime_nsec (struct stat *info);
+
+
+
+//
+// Opens the index of the records of the given document, stored in the file
+// 'path'. If the file is not a valid index for the document the index is built
+// by a worker thread right away, the index has then to be polled until it's
+// done. The index is replaced atomically once built.
+//
+// Returns NULL if the document is not a local file.
+//
+// The index has to be freed with xacobeo_record_index_free().
+//
+XacobeoRecordIndex* xacobeo_record_index_new (const gchar *filename, const gchar *path) {
+
+	gint source = open(filename, O_RDONLY);
+	if (source == -1) {
+		DEBUG("Can't open %s: %s", filename, g_strerror(errno));
+		return NULL;
+	}
+
+	struct stat info;
+	if (fstat(source, &info) == -1 || ! S_ISREG(info.st_mode)) {
+		close(source);
+		return NULL;
+	}
+
+	XacobeoRecordIndex *index = g_new0(XacobeoRecordIndex, 1);
+	index->filename = g_strdup(filename);
+	index->source = source;
+	index->size = (gsize) info.st_size;
+	index->mtime = (gint64) info.st_mtime;
+	index->mtime_nsec = my_get_mtime_nsec(&info);
+	index->inode = (guint64) info.st_ino;
+	index->path = g_strdup(path);
+	index->fd = -1;
+	index->timer = g_timer_new();
+
+	if (my_index_load(index)) {
+		DEBUG("Loaded the index of %lu records of %s", (gulong) index->count, filename);
+		g_timer_stop(index->timer);
+		index->consumed = index->size;
+		index->state = RECORD_INDEX_DONE;
+		return index;
+	}
+
+	index->state = RECORD_INDEX_RUNNING;
+#if GLIB_CHECK_VERSION(2, 32, 0)
+	index->thread = g_thread_new("record-index", my_index_run, index);
+#else
+	if (! g_thread_supported()) {
+		g_thread_init(NULL);
+	}
+	index->thread = g_thread_create(my_index_run, index, TRUE, NULL);
+#endif
+
+	return index;
+}
+
+
+
+//
+// Frees the index. If the index is still being built the build is cancelled
+// and this function waits for the worker thread to finish.
+//
+void xacobeo_record_index_free (XacobeoRecordIndex *index) {
+	if (index == NULL) {
+		return;
+	}
+
+	if (index->thread) {
+		xacobeo_record_index_cancel(index);
+		g_thread_join(index->thread);
+	}
+
+	if (index->fd != -1) {
+		close(index->fd);
+	}
+	close(index->source);
+	g_free(index->filename);
+	g_free(index->path);
+	g_timer_destroy(index->timer);
+	g_free(index->error);
+	g_free(index);
+}
+
+
+
+//
+// Returns the state of the index: "running", "done", "error" or "cancelled".
+//
+const gchar* xacobeo_record_index_poll (XacobeoRecordIndex *index) {
+
+	gint state = g_atomic_int_get(&index->state);
+	if (state != RECORD_INDEX_RUNNING && index->thread) {
+		g_thread_join(index->thread);
+		index->thread = NULL;
+	}
+
+	return STATE_NAMES[state];
+}
+
+
+
+//
+// Requests the build of the index to stop. The index will be in the state
+// "cancelled" once the worker thread is done.
+//
+void xacobeo_record_index_cancel (XacobeoRecordIndex *index) {
+	g_atomic_int_set(&index->cancelled, TRUE);
+}
+
+
+
+//
+// Returns the number of seconds spent building the index.
+//
+gdouble xacobeo_record_index_elapsed (XacobeoRecordIndex *index) {
+	return g_timer_elapsed(index->timer, NULL);
+}
+
+
+
+//
+// Returns the number of bytes of the document scanned so far.
+//
+gdouble xacobeo_record_index_progress (XacobeoRecordIndex *index) {
+	return (gdouble) (gsize) g_atomic_pointer_get(&index->consumed);
+}
+
+
+
+//
+// Returns the size of the document in bytes.
+//
+gdouble xacobeo_record_index_size (XacobeoRecordIndex *index) {
+	return (gdouble) index->size;
+}
+
+
+
+//
+// Returns the error message of an index that couldn't be built or NULL.
+//
+const gchar* xacobeo_record_index_error (XacobeoRecordIndex *index) {
+	if (g_atomic_int_get(&index->state) != RECORD_INDEX_ERROR) {
+		return NULL;
+	}
+	return index->error;
+}
+
+
+
+//
+// Returns the number of records of the document or 0 if the index is not
+// built.
+//
+guint xacobeo_record_index_count (XacobeoRecordIndex *index) {
+	if (g_atomic_int_get(&index->state) != RECORD_INDEX_DONE) {
+		return 0;
+	}
+	return (guint) MIN(index->count, G_MAXUINT);
+}
+
+
+
+//
+// Returns a document (a string of bytes) made of the records [first, first +
+// count) of the document wrapped by its prolog, the start tag and the end tag
+// of its root and its epilog. The content of the root between the records
+// (text, comments) is kept. Only these bytes are read from the document.
+//
+// Returns undef if the index is not built, if there's no such record or if
+// the document can't be read.
+//
+SV* xacobeo_record_index_window (XacobeoRecordIndex *index, guint first, guint count) {
+
+	if (g_atomic_int_get(&index->state) != RECORD_INDEX_DONE || first >= index->count || count == 0) {
+		return &PL_sv_undef;
+	}
+
+	guint64 last = MIN((guint64) first + count, index->count);
+	guint64 start;
+	guint64 end = index->layout.content_end;
+	if (! my_read(index->fd, &start, sizeof(start), sizeof(RecordIndexHeader) + first * sizeof(guint64))) {
+		return &PL_sv_undef;
+	}
+	if (last < index->count && ! my_read(index->fd, &end, sizeof(end), sizeof(RecordIndexHeader) + last * sizeof(guint64))) {
+		return &PL_sv_undef;
+	}
+
+	gsize prolog = index->layout.content_start;
+	gsize records = (gsize) (end - start);
+	gsize epilog = index->size - index->layout.content_end;
+	SV *window = newSV(prolog + records + epilog + 1);
+	gchar *buffer = SvPVX(window);
+
+	if (
+		! my_read(index->source, buffer, prolog, 0)
+		|| ! my_read(index->source, buffer + prolog, records, (goffset) start)
+		|| ! my_read(index->source, buffer + prolog + records, epilog, (goffset) index->layout.content_end)
+	) {
+		WARN("Can't read the records of %s", index->filename);
+		SvREFCNT_dec(window);
+		return &PL_sv_undef;
+	}
+
+	buffer[prolog + records + epilog] = '\0';
+	SvCUR_set(window, prolog + records + epilog);
+	SvPOK_on(window);
+
+	return window;
+}
+
+
+
+//
+// The worker thread. Builds the index and sets the final state.
+//
+static gpointer my_index_run (gpointer data) {
+	XacobeoRecordIndex *index = (XacobeoRecordIndex *) data;
+
+	// The index is written aside and replaces the previous one once complete,
+	// the name of the file written is unique (see my_index_build())
+	gchar *path = g_strdup_printf("%s.XXXXXX", index->path);
+	gboolean built = my_index_build(index, path);
+
+	gint state;
+	if (g_atomic_int_get(&index->cancelled)) {
+		state = RECORD_INDEX_CANCELLED;
+	}
+	else if (! built) {
+		state = RECORD_INDEX_ERROR;
+	}
+	else if (rename(path, index->path) == -1) {
+		state = RECORD_INDEX_ERROR;
+		index->error = g_strdup(g_strerror(errno));
+	}
+	else if (! my_index_load(index)) {
+		state = RECORD_INDEX_ERROR;
+		index->error = g_strdup("The index can't be read");
+		unlink(index->path);
+	}
+	else {
+		g_atomic_pointer_set(&index->consumed, index->size);
+		INFO("Indexed %lu records of %s in %.3fs", (gulong) index->count, index->filename, g_timer_elapsed(index->timer, NULL));
+		state = RECORD_INDEX_DONE;
+	}
+
+	if (state != RECORD_INDEX_DONE) {
+		unlink(path);
+	}
+	g_free(path);
+	g_timer_stop(index->timer);
+
+	g_atomic_int_set(&index->state, state);
+	return NULL;
+}
+
+
+
+//
+// Scans the document and writes its index in a new file. The name of the file
+// is made from 'path', a template ending in XXXXXX that is replaced by the name
+// of the file (see g_mkstemp()). Returns FALSE if the index can't be built, the
+// error is then set in the index.
+//
+static gboolean my_index_build (XacobeoRecordIndex *index, gchar *path) {
+
+	gsize size;
+	gchar *buffer = xacobeo_loader_map_file(index->filename, &size);
+	if (buffer == NULL) {
+		index->error = g_strdup("The document can't be read");
+		return FALSE;
+	}
+
+	RecordIndexWriter writer = {
+		.index = index,
+		.fd = g_mkstemp(path),
+		.offsets = g_new(guint64, INDEX_BATCH_SIZE),
+	};
+	if (writer.fd == -1) {
+		index->error = g_strdup(g_strerror(errno));
+		g_free(writer.offsets);
+		xacobeo_loader_unmap(buffer, size);
+		return FALSE;
+	}
+
+	// The header is written last, once the records are counted
+	RecordIndexHeader header;
+	memset(&header, 0, sizeof(header));
+	gboolean built = lseek(writer.fd, sizeof(header), SEEK_SET) != -1
+		&& xacobeo_records_scan(buffer, size, &index->layout, my_index_add, &writer)
+		&& my_index_flush(&writer)
+	;
+	xacobeo_loader_unmap(buffer, size);
+
+	if (built) {
+		memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+		header.size = index->size;
+		header.mtime = index->mtime;
+		header.mtime_nsec = index->mtime_nsec;
+		header.inode = index->inode;
+		header.root_start = index->layout.root_start;
+		header.content_start = index->layout.content_start;
+		header.content_end = index->layout.content_end;
+		header.root_end = index->layout.root_end;
+		header.count = writer.count;
+		built = pwrite(writer.fd, &header, sizeof(header), 0) == sizeof(header);
+		writer.failed = ! built;
+	}
+	if (close(writer.fd) == -1) {
+		built = FALSE;
+		writer.failed = TRUE;
+	}
+	g_free(writer.offsets);
+
+	if (! built && index->error == NULL && ! g_atomic_int_get(&index->cancelled)) {
+		index->error = g_strdup(writer.failed ? g_strerror(errno) : "The document is not a list of records");
+	}
+
+	return built;
+}
+
+
+
+//
+// Scan callback: adds the offset of a record to the index. The scan stops if
+// the build was cancelled or if the index can't be written.
+//
+static gboolean my_index_add (gsize start, gsize end, gpointer data) {
+	RecordIndexWriter *writer = (RecordIndexWriter *) data;
+
+	writer->offsets[writer->pending++] = start;
+	++writer->count;
+	if (writer->pending < INDEX_BATCH_SIZE) {
+		return TRUE;
+	}
+
+	g_atomic_pointer_set(&writer->index->consumed, end);
+	return ! g_atomic_int_get(&writer->index->cancelled) && my_index_flush(writer);
+}
+
+
+
+//
+// Writes the pending offsets. Returns FALSE if they can't be written.
+//
+static gboolean my_index_flush (RecordIndexWriter *writer) {
+
+	gsize size = writer->pending * sizeof(guint64);
+	const gchar *buffer = (const gchar *) writer->offsets;
+	while (size > 0) {
+		ssize_t count = write(writer->fd, buffer, size);
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		else if (count == -1) {
+			writer->failed = TRUE;
+			return FALSE;
+		}
+		buffer += count;
+		size -= count;
+	}
+
+	writer->pending = 0;
+	return TRUE;
+}
+
+
+
+//
+// Opens the file of the index. Returns FALSE if it's missing or if it's not
+// the index of the document as it is now.
+//
+static gboolean my_index_load (XacobeoRecordIndex *index) {
+
+	gint fd = open(index->path, O_RDONLY);
+	if (fd == -1) {
+		return FALSE;
+	}
+
+	RecordIndexHeader header;
+	struct stat info;
+	gboolean valid = my_read(fd, &header, sizeof(header), 0)
+		&& memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) == 0
+		&& header.size == index->size
+		&& header.mtime == index->mtime
+		&& header.mtime_nsec == index->mtime_nsec
+		&& header.inode == index->inode
+		&& fstat(fd, &info) == 0
+		&& (guint64) info.st_size == sizeof(header) + header.count * sizeof(guint64)
+	;
+	if (! valid) {
+		DEBUG("The index %s is not the one of %s", index->path, index->filename);
+		close(fd);
+		return FALSE;
+	}
+
+	index->fd = fd;
+	index->layout.root_start = header.root_start;
+	index->layout.content_start = header.content_start;
+	index->layout.content_end = header.content_end;
+	index->layout.root_end = header.root_end;
+	index->count = header.count;
+
+	return TRUE;
+}
+
+
+
+//
+// Reads exactly 'size' bytes at the given offset. Returns FALSE if the bytes
+// can't be read.
+//
+static gboolean my_read (gint fd, gpointer buffer, gsize size, goffset offset) {
+	gchar *p = (gchar *) buffer;
+	while (size > 0) {
+		ssize_t count = pread(fd, p, size, offset);
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		else if (count <= 0) {
+			return FALSE;
+		}
+		p += count;
+		size -= count;
+		offset += count;
+	}
+	return TRUE;
+}
+
+
+
+//
+// Returns the nanoseconds of the modification time of a file or 0 if the
+// system doesn't provide them.
+//
+static gint64 my_get_mtime_nsec (struct stat *info) {
+#if defined(__APPLE__)
+	return (gint64) info->st_mtimespec.tv_nsec;
+#elif defined(st_mtime)
+	// st_mtime is a macro when the time is a struct timespec (st_mtim)
+	return (gint64) info->st_mtim.tv_nsec;
+#else
+	return 0;
+#endif
+}
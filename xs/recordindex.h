@@ -0,0 +1,80 @@
+#ifndef __XACOBEO_RECORDINDEX_H__
+#define __XACOBEO_RECORDINDEX_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include "records.h"
+
+#include <glib.h>
+
+
+// The states of a record index
+enum RecordIndexState {
+	RECORD_INDEX_RUNNING,
+	RECORD_INDEX_DONE,
+	RECORD_INDEX_ERROR,
+	RECORD_INDEX_CANCELLED,
+};
+typedef enum RecordIndexState RecordIndexStateEnum;
+
+
+//
+// The offsets of the records of a huge document, stored in a side file. The
+// index is built once by a worker thread and then any window of records can be
+// read from the document without parsing what's before. Neither the document
+// nor the index are loaded in memory.
+//
+typedef struct _XacobeoRecordIndex {
+
+	// The document, open for reading the windows, and what identifies its
+	// version: the size, the modification time and the inode
+	gchar *filename;
+	gint source;
+	gsize size;
+	gint64 mtime;
+	gint64 mtime_nsec;
+	guint64 inode;
+
+	// The file of the index, open for reading the offsets once built
+	gchar *path;
+	gint fd;
+
+	// The layout of the document and its number of records
+	XacobeoRecordLayout layout;
+	guint64 count;
+
+	// The worker thread that builds the index (NULL once joined)
+	GThread *thread;
+
+	// The state of the index (RecordIndexStateEnum), it's set by the worker
+	volatile gint state;
+
+	// Set when the build has to stop
+	volatile gint cancelled;
+
+	// The number of bytes of the document scanned so far
+	volatile gsize consumed;
+
+	GTimer *timer;
+	gchar *error;
+
+} XacobeoRecordIndex;
+
+
+// Public prototypes
+XacobeoRecordIndex* xacobeo_record_index_new      (const gchar *filename, const gchar *path);
+void                xacobeo_record_index_free     (XacobeoRecordIndex *index);
+const gchar*        xacobeo_record_index_poll     (XacobeoRecordIndex *index);
+void                xacobeo_record_index_cancel   (XacobeoRecordIndex *index);
+gdouble             xacobeo_record_index_elapsed  (XacobeoRecordIndex *index);
+gdouble             xacobeo_record_index_progress (XacobeoRecordIndex *index);
+gdouble             xacobeo_record_index_size     (XacobeoRecordIndex *index);
+const gchar*        xacobeo_record_index_error    (XacobeoRecordIndex *index);
+guint               xacobeo_record_index_count    (XacobeoRecordIndex *index);
+SV*                 xacobeo_record_index_window   (XacobeoRecordIndex *index, guint first, guint count);
+
+
+#endif
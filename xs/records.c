@@ -0,0 +1,952 @@
+//
+// Parallel parse of the record-oriented documents: a root element with a long
+// list of children (the records), like a log, an export or a feed. A prescan
+// finds the boundaries of the records without parsing them, the records are
+// then split in chunks parsed by several threads and the nodes of the chunks
+// are spliced under the root of a single document.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "records.h"
+#include "logger.h"
+
+#include <libxml/parser.h>
+#include <libxml/valid.h>
+
+#include <string.h>
+
+
+// The number of bytes given to a parser at once, the progress is updated and
+// the cancellation is checked between two pushes
+#define RECORDS_PUSH_SIZE (256 * 1024)
+
+// The records are split in a few chunks per thread, this way the threads stay
+// busy even when the records don't all have the same size
+#define RECORDS_CHUNKS_PER_THREAD 4
+#define RECORDS_MIN_CHUNK_SIZE (64 * 1024)
+
+// The size of the first records parsed for seeding the dictionary of the
+// document before the threads start
+#define RECORDS_SEED_SIZE (64 * 1024)
+
+// The highest line number stored in a node, the parser doesn't use
+// XML_PARSE_BIG_LINES
+#define RECORDS_MAX_LINE 65535
+
+// The line delta of a chunk that starts after the highest line number
+#define LINE_DELTA_CAPPED G_MAXUINT
+
+
+// The options of the parser, the same as the ones of the loader (see loader.c)
+#define PARSER_OPTIONS (XML_PARSE_RECOVER | XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_DTDLOAD)
+
+
+// The encodings (prefixes of their names) where the markup is in ASCII and
+// where the bytes of a multibyte character are never ASCII, the prescan can
+// look for the markup byte by byte
+static const gchar *ASCII_ENCODINGS[] = {
+	"UTF-8",
+	"UTF8",
+	"US-ASCII",
+	"ASCII",
+	"ISO-8859-",
+	"ISO_8859-",
+	"LATIN",
+	"WINDOWS-125",
+	"CP125",
+	NULL,
+};
+
+
+//
+// A range of records parsed by a thread. The nodes parsed are linked together
+// but not to the root until all the chunks are parsed.
+//
+typedef struct _RecordsChunk {
+
+	// The bytes of the chunk
+	gsize start;
+	gsize end;
+
+	// The number of lines between the start of the content of the root and the
+	// start of the chunk (LINE_DELTA_CAPPED once beyond the highest line)
+	guint line_delta;
+
+	// The nodes parsed
+	xmlNode *first;
+	xmlNode *last;
+
+	// The attributes of type ID followed by their values, they are registered in
+	// the document once the chunks are spliced, in document order
+	GPtrArray *ids;
+
+} RecordsChunk;
+
+
+//
+// A parallel parse. The document built by the main thread has the prolog, the
+// root and the epilog, its dictionary is seeded with the first records and
+// only read by the threads: each thread parses with a sub-dictionary and
+// copies the strings that are not in the dictionary of the document.
+//
+typedef struct _RecordsParse {
+
+	const gchar *buffer;
+	gsize size;
+	const gchar *filename;
+	XacobeoRecordLayout layout;
+
+	// The chunks and the state of the scan that builds them
+	GArray *chunks;
+	gsize chunk_size;
+	gsize chunk_start;
+	gsize seed_end;
+
+	// The document and the namespaces that the chunks refer to
+	xmlDoc *doc;
+	xmlNode *root;
+	xmlNs **root_ns;
+	guint root_ns_count;
+	xmlNs *xml_ns;
+
+	// The next chunk to parse, the chunks are taken by the threads in order
+	volatile gint next;
+
+	// Set when a chunk can't be parsed, the document is then parsed serially
+	volatile gint failed;
+
+	volatile gint *cancelled;
+	volatile gsize *consumed;
+
+} RecordsParse;
+
+
+//
+// A thread of the parse, it has its own dictionary.
+//
+typedef struct _RecordsWorker {
+	RecordsParse *parse;
+	xmlDict *dict;
+	GThread *thread;
+} RecordsWorker;
+
+
+//
+// A chunk parsed by a thread whose nodes are moved to the document.
+//
+typedef struct _RecordsAdoption {
+	RecordsParse *parse;
+	RecordsChunk *chunk;
+	xmlDict *dict;
+	xmlNs *root_ns;
+	xmlNs *xml_ns;
+} RecordsAdoption;
+
+
+//
+// Function prototypes
+//
+static const gchar*   my_scan_prolog        (const gchar *p, const gchar *end);
+static gboolean       my_is_ascii_decl      (const gchar *decl, const gchar *end);
+static const gchar*   my_find_tag_end       (const gchar *p, const gchar *end);
+static const gchar*   my_skip_past          (const gchar *p, const gchar *end, const gchar *string);
+static gboolean       my_has_prefix         (const gchar *p, const gchar *end, const gchar *prefix);
+static gboolean       my_parse_records      (RecordsParse *parse, guint threads);
+static gboolean       my_add_record         (gsize start, gsize end, gpointer data);
+static void           my_count_chunk_lines  (RecordsParse *parse);
+static guint          my_count_lines        (const gchar *p, const gchar *end, guint max);
+static xmlDoc*        my_parse              (RecordsParse *parse, xmlDict *dict, gsize start, gsize end, gsize tail_end, gboolean progress);
+static gboolean       my_push               (RecordsParse *parse, xmlParserCtxt *ctxt, gsize start, gsize end, gboolean progress);
+static gpointer       my_worker_run         (gpointer data);
+static gboolean       my_parse_chunk        (RecordsParse *parse, RecordsChunk *chunk, xmlDict *dict);
+static void           my_adopt_tree         (RecordsAdoption *adoption, xmlNode *top);
+static void           my_adopt_node         (RecordsAdoption *adoption, xmlNode *node);
+static const xmlChar* my_adopt_string       (RecordsAdoption *adoption, const xmlChar *string);
+static xmlNs*         my_adopt_ns           (RecordsAdoption *adoption, xmlNs *ns);
+static guint          my_adopt_line         (guint line, guint delta);
+static void           my_splice_chunks      (RecordsParse *parse);
+static void           my_ignore_error       (void *data, xmlError *error);
+
+
+
+//
+// Scans a document for its records without parsing it: only the markup that
+// can hide a '<' or a '>' is followed (comments, CDATA sections, processing
+// instructions and quoted attribute values). The search for the markup relies
+// on memchr(), which the C library implements with vector instructions.
+//
+// The layout is filled and the function is called for each record. Returns
+// FALSE if the document doesn't look like a list of records that can be
+// parsed apart: it has a DOCTYPE (the entities and the default attributes
+// apply to all the records), its encoding is not a superset of ASCII, its root
+// is empty or its markup is broken.
+//
+gboolean xacobeo_records_scan (const gchar *buffer, gsize size, XacobeoRecordLayout *layout, XacobeoRecordFunc func, gpointer data) {
+
+	const gchar *end = buffer + size;
+	const gchar *p = my_scan_prolog(buffer, end);
+	if (p == NULL) {
+		return FALSE;
+	}
+
+	const gchar *tag_end = my_find_tag_end(p + 1, end);
+	if (tag_end == NULL || tag_end[-1] == '/') {
+		return FALSE;
+	}
+	layout->root_start = p - buffer;
+	layout->content_start = tag_end + 1 - buffer;
+
+
+	// The depth is relative to the root, a record starts and ends at depth 0
+	guint depth = 0;
+	const gchar *record = NULL;
+	p = tag_end + 1;
+	while ((p = memchr(p, '<', end - p)) != NULL) {
+		if (end - p < 2) {
+			return FALSE;
+		}
+
+		const gchar *next;
+		const gchar *record_end = NULL;
+		switch (p[1]) {
+			case '!':
+				if (my_has_prefix(p, end, "<!--")) {
+					next = my_skip_past(p + 4, end, "-->");
+				}
+				else if (my_has_prefix(p, end, "<![CDATA[")) {
+					next = my_skip_past(p + 9, end, "]]>");
+				}
+				else {
+					return FALSE;
+				}
+			break;
+
+			case '?':
+				next = my_skip_past(p + 2, end, "?>");
+			break;
+
+			case '/':
+				next = memchr(p, '>', end - p);
+				if (next == NULL) {
+					return FALSE;
+				}
+				++next;
+
+				if (depth == 0) {
+					// The end of the root
+					layout->content_end = p - buffer;
+					layout->root_end = next - buffer;
+					return TRUE;
+				}
+				if (--depth == 0) {
+					record_end = next;
+				}
+			break;
+
+			default:
+				next = my_find_tag_end(p + 1, end);
+				if (next == NULL) {
+					return FALSE;
+				}
+
+				if (depth == 0) {
+					record = p;
+				}
+				if (next[-1] != '/') {
+					++depth;
+				}
+				else if (depth == 0) {
+					record_end = next + 1;
+				}
+				++next;
+			break;
+		}
+
+		if (next == NULL) {
+			return FALSE;
+		}
+		if (record_end && func && ! func(record - buffer, record_end - buffer, data)) {
+			return FALSE;
+		}
+		p = next;
+	}
+
+	return FALSE;
+}
+
+
+
+//
+// Parses a record-oriented document with the given number of threads. The
+// document built is the same as the one built by the loader (see loader.c):
+// same nodes, same line numbers, same IDs. The threads stop as soon as the
+// flag 'cancelled' is set and the number of bytes parsed is added to
+// 'consumed'.
+//
+// Returns NULL if the parse was cancelled or if the document can't be parsed
+// by records (see xacobeo_records_scan() and a chunk that's not well-formed),
+// the document has then to be parsed serially.
+//
+// The document has to be freed with xmlFreeDoc().
+//
+xmlDoc* xacobeo_records_parse (const gchar *buffer, gsize size, const gchar *filename, guint threads, volatile gint *cancelled, volatile gsize *consumed) {
+
+	xmlInitParser();
+	GTimer *timer = g_timer_new();
+
+	RecordsParse parse = {
+		.buffer = buffer,
+		.size = size,
+		.filename = filename,
+		.chunks = g_array_new(FALSE, TRUE, sizeof(RecordsChunk)),
+		.chunk_size = MAX(size / (MAX(threads, 1) * RECORDS_CHUNKS_PER_THREAD), RECORDS_MIN_CHUNK_SIZE),
+		.cancelled = cancelled,
+		.consumed = consumed,
+	};
+
+	xmlDoc *doc = NULL;
+	if (my_parse_records(&parse, MAX(threads, 1))) {
+		doc = parse.doc;
+		parse.doc = NULL;
+		INFO("Parsed %u chunks of records in %.3fs", parse.chunks->len, g_timer_elapsed(timer, NULL));
+	}
+
+	for (guint i = 0; i < parse.chunks->len; ++i) {
+		RecordsChunk *chunk = &g_array_index(parse.chunks, RecordsChunk, i);
+		if (chunk->ids == NULL) {
+			continue;
+		}
+		for (guint j = 0; j < chunk->ids->len; j += 2) {
+			xmlFree(g_ptr_array_index(chunk->ids, j + 1));
+		}
+		g_ptr_array_free(chunk->ids, TRUE);
+	}
+	g_array_free(parse.chunks, TRUE);
+	g_free(parse.root_ns);
+	if (parse.doc) {
+		xmlFreeDoc(parse.doc);
+	}
+	g_timer_destroy(timer);
+
+	return doc;
+}
+
+
+
+//
+// Does the parse: the scan, the parse of the document without the records,
+// the parse of the chunks by the threads and the splice of the chunks. Returns
+// FALSE if the parse failed or was cancelled.
+//
+static gboolean my_parse_records (RecordsParse *parse, guint threads) {
+
+	if (! xacobeo_records_scan(parse->buffer, parse->size, &parse->layout, my_add_record, parse)) {
+		DEBUG("The document is not a list of records");
+		return FALSE;
+	}
+	if (parse->chunk_start < parse->layout.content_start) {
+		parse->chunk_start = parse->layout.content_start;
+	}
+	if (parse->chunk_start < parse->layout.content_end) {
+		RecordsChunk chunk = {
+			.start = parse->chunk_start,
+			.end = parse->layout.content_end,
+		};
+		g_array_append_val(parse->chunks, chunk);
+	}
+
+
+	// The document without the records and its dictionary seeded with the first
+	// records, the threads only read it
+	parse->doc = my_parse(parse, NULL, parse->layout.content_end, parse->layout.content_end, parse->size, FALSE);
+	if (parse->doc == NULL) {
+		return FALSE;
+	}
+	if (parse->seed_end) {
+		xmlDoc *seed = my_parse(parse, parse->doc->dict, parse->layout.content_start, parse->seed_end, parse->layout.root_end, FALSE);
+		if (seed == NULL) {
+			return FALSE;
+		}
+		xmlFreeDoc(seed);
+	}
+
+	parse->root = xmlDocGetRootElement(parse->doc);
+	for (xmlNs *ns = parse->root->nsDef; ns; ns = ns->next) {
+		++parse->root_ns_count;
+	}
+	parse->root_ns = g_new(xmlNs *, parse->root_ns_count + 1);
+	guint i = 0;
+	for (xmlNs *ns = parse->root->nsDef; ns; ns = ns->next) {
+		parse->root_ns[i++] = ns;
+	}
+	// The namespace of the prefix 'xml' is created on demand
+	parse->xml_ns = xmlSearchNs(parse->doc, parse->root, BAD_CAST "xml");
+	my_count_chunk_lines(parse);
+
+
+	// Each thread has its own sub-dictionary
+	guint count = MIN(threads, parse->chunks->len);
+	RecordsWorker *workers = g_new0(RecordsWorker, count);
+	for (i = 0; i < count; ++i) {
+		RecordsWorker *worker = &workers[i];
+		worker->parse = parse;
+		worker->dict = xmlDictCreateSub(parse->doc->dict);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+		worker->thread = g_thread_new("records", my_worker_run, worker);
+#else
+		worker->thread = g_thread_create(my_worker_run, worker, TRUE, NULL);
+#endif
+	}
+	for (i = 0; i < count; ++i) {
+		g_thread_join(workers[i].thread);
+		xmlDictFree(workers[i].dict);
+	}
+	g_free(workers);
+
+	// The nodes belong to the document even if the parse failed, this way
+	// they're freed with it
+	my_splice_chunks(parse);
+	if (g_atomic_int_get(&parse->failed) || g_atomic_int_get(parse->cancelled)) {
+		DEBUG("The parse of the records was %s", g_atomic_int_get(parse->cancelled) ? "cancelled" : "not possible");
+		return FALSE;
+	}
+
+
+	// The IDs in document order, a value already taken keeps its first attribute
+	for (i = 0; i < parse->chunks->len; ++i) {
+		RecordsChunk *chunk = &g_array_index(parse->chunks, RecordsChunk, i);
+		for (guint j = 0; chunk->ids && j < chunk->ids->len; j += 2) {
+			xmlAttr *attr = (xmlAttr *) g_ptr_array_index(chunk->ids, j);
+			xmlChar *value = (xmlChar *) g_ptr_array_index(chunk->ids, j + 1);
+			xmlAddID(NULL, parse->doc, value, attr);
+		}
+	}
+
+	// The nodes after the root are moved down by the lines of the records
+	if (parse->root->next) {
+		const gchar *buffer = parse->buffer;
+		guint base = 1 + my_count_lines(buffer, buffer + parse->layout.content_start, RECORDS_MAX_LINE);
+		guint delta = my_count_lines(buffer + parse->layout.content_start, buffer + parse->layout.content_end, RECORDS_MAX_LINE);
+		if (base + delta >= RECORDS_MAX_LINE) {
+			delta = LINE_DELTA_CAPPED;
+		}
+		for (xmlNode *node = parse->root->next; node; node = node->next) {
+			node->line = my_adopt_line(node->line, delta);
+		}
+	}
+
+	return TRUE;
+}
+
+
+
+//
+// Skips the prolog of the document. Returns the start tag of the root or NULL
+// if the document can't be scanned.
+//
+static const gchar* my_scan_prolog (const gchar *p, const gchar *end) {
+
+	// The byte order mark of UTF-8 is the only one allowed, the other encodings
+	// without one are detected by their first bytes
+	if (my_has_prefix(p, end, "\xEF\xBB\xBF")) {
+		p += 3;
+	}
+	else if (end - p >= 2 && (p[0] == '\0' || p[1] == '\0' || (guchar) p[0] == 0xFE || (guchar) p[0] == 0xFF)) {
+		return NULL;
+	}
+
+	while (p < end) {
+		if (g_ascii_isspace(*p)) {
+			++p;
+			continue;
+		}
+		if (*p != '<' || end - p < 2) {
+			return NULL;
+		}
+
+		if (p[1] == '?') {
+			const gchar *next = my_skip_past(p + 2, end, "?>");
+			if (next == NULL) {
+				return NULL;
+			}
+			if (my_has_prefix(p, end, "<?xml") && g_ascii_isspace(p[5]) && ! my_is_ascii_decl(p, next)) {
+				return NULL;
+			}
+			p = next;
+		}
+		else if (my_has_prefix(p, end, "<!--")) {
+			p = my_skip_past(p + 4, end, "-->");
+			if (p == NULL) {
+				return NULL;
+			}
+		}
+		else if (p[1] == '!') {
+			// A DOCTYPE
+			return NULL;
+		}
+		else {
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+
+
+//
+// Returns TRUE if the XML declaration has no encoding or an encoding listed in
+// ASCII_ENCODINGS.
+//
+static gboolean my_is_ascii_decl (const gchar *decl, const gchar *end) {
+
+	const gchar *p = my_skip_past(decl, end, "encoding");
+	if (p == NULL) {
+		return TRUE;
+	}
+
+	while (p < end && (g_ascii_isspace(*p) || *p == '=')) {
+		++p;
+	}
+	if (p >= end || (*p != '"' && *p != '\'')) {
+		return FALSE;
+	}
+
+	const gchar *name = p + 1;
+	const gchar *name_end = memchr(name, *p, end - name);
+	if (name_end == NULL) {
+		return FALSE;
+	}
+
+	gsize length = name_end - name;
+	for (const gchar **encoding = ASCII_ENCODINGS; *encoding; ++encoding) {
+		gsize prefix = strlen(*encoding);
+		if (length >= prefix && g_ascii_strncasecmp(name, *encoding, prefix) == 0) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+
+
+//
+// Finds the '>' that ends a tag, the quoted values of the attributes are
+// skipped. Returns NULL if the tag doesn't end.
+//
+static const gchar* my_find_tag_end (const gchar *p, const gchar *end) {
+	while (p < end) {
+		const gchar *gt = memchr(p, '>', end - p);
+		if (gt == NULL) {
+			return NULL;
+		}
+
+		// The first quote before the '>', if any, starts a value that can have a '>'
+		const gchar *quote = memchr(p, '"', gt - p);
+		const gchar *single = memchr(p, '\'', (quote ? quote : gt) - p);
+		if (single) {
+			quote = single;
+		}
+		if (quote == NULL) {
+			return gt;
+		}
+
+		const gchar *closing = memchr(quote + 1, *quote, end - quote - 1);
+		if (closing == NULL) {
+			return NULL;
+		}
+		p = closing + 1;
+	}
+
+	return NULL;
+}
+
+
+
+//
+// Returns the byte after the next occurrence of the string or NULL if the
+// string is not found.
+//
+static const gchar* my_skip_past (const gchar *p, const gchar *end, const gchar *string) {
+	gsize length = strlen(string);
+	while (end - p >= (gssize) length) {
+		p = memchr(p, string[0], end - p - length + 1);
+		if (p == NULL) {
+			return NULL;
+		}
+		if (memcmp(p, string, length) == 0) {
+			return p + length;
+		}
+		++p;
+	}
+	return NULL;
+}
+
+
+
+//
+// Returns TRUE if the bytes start with the given prefix.
+//
+static gboolean my_has_prefix (const gchar *p, const gchar *end, const gchar *prefix) {
+	gsize length = strlen(prefix);
+	return end - p >= (gssize) length && memcmp(p, prefix, length) == 0;
+}
+
+
+
+//
+// Scan callback: groups the records in chunks and finds the end of the records
+// that seed the dictionary.
+//
+static gboolean my_add_record (gsize start, gsize end, gpointer data) {
+	RecordsParse *parse = (RecordsParse *) data;
+
+	gsize content_start = parse->layout.content_start;
+	if (parse->chunk_start < content_start) {
+		parse->chunk_start = content_start;
+	}
+	if (parse->seed_end == 0 || end - content_start <= RECORDS_SEED_SIZE) {
+		parse->seed_end = end;
+	}
+
+	if (end - parse->chunk_start >= parse->chunk_size) {
+		RecordsChunk chunk = {
+			.start = parse->chunk_start,
+			.end = end,
+		};
+		g_array_append_val(parse->chunks, chunk);
+		parse->chunk_start = end;
+	}
+
+	return TRUE;
+}
+
+
+
+//
+// Computes the line delta of each chunk. The lines are only counted until the
+// highest line number, in a big document this is a small part of it.
+//
+static void my_count_chunk_lines (RecordsParse *parse) {
+
+	guint base = 1 + my_count_lines(parse->buffer, parse->buffer + parse->layout.content_start, RECORDS_MAX_LINE);
+	guint delta = 0;
+	gsize offset = parse->layout.content_start;
+
+	for (guint i = 0; i < parse->chunks->len; ++i) {
+		RecordsChunk *chunk = &g_array_index(parse->chunks, RecordsChunk, i);
+		if (base + delta < RECORDS_MAX_LINE) {
+			delta += my_count_lines(parse->buffer + offset, parse->buffer + chunk->start, RECORDS_MAX_LINE);
+			offset = chunk->start;
+		}
+		chunk->line_delta = base + delta < RECORDS_MAX_LINE ? delta : LINE_DELTA_CAPPED;
+	}
+}
+
+
+
+//
+// Returns the number of line feeds in the bytes, the count stops at 'max'.
+//
+static guint my_count_lines (const gchar *p, const gchar *end, guint max) {
+	guint count = 0;
+	while (count < max && p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+		++count;
+		++p;
+	}
+	return count;
+}
+
+
+
+//
+// Parses the prolog and the start tag of the root followed by the bytes from
+// 'start' to 'end' and by the bytes from the end tag of the root to
+// 'tail_end'. The parser uses the given dictionary, if any. If 'progress' is
+// TRUE the bytes from 'start' to 'end' are counted as consumed. Returns NULL
+// if the document is not well-formed or if the parse was stopped.
+//
+static xmlDoc* my_parse (RecordsParse *parse, xmlDict *dict, gsize start, gsize end, gsize tail_end, gboolean progress) {
+
+	xmlParserCtxt *ctxt = xmlCreatePushParserCtxt(NULL, NULL, NULL, 0, parse->filename);
+	if (ctxt == NULL) {
+		return NULL;
+	}
+	if (dict) {
+		// The strings of the parser are looked up again in the new dictionary by
+		// xmlCtxtResetPush()
+		xmlDictFree(ctxt->dict);
+		ctxt->dict = dict;
+		xmlDictReference(dict);
+	}
+
+	// The first bytes are given at once, they are needed for detecting the
+	// encoding of the document
+	gsize head = MIN(4, parse->layout.content_start);
+	xmlCtxtResetPush(ctxt, parse->buffer, (int) head, parse->filename, NULL);
+	xmlCtxtUseOptions(ctxt, PARSER_OPTIONS);
+	ctxt->linenumbers = 1;
+	ctxt->sax->serror = my_ignore_error;
+
+	gboolean complete = my_push(parse, ctxt, head, parse->layout.content_start, FALSE)
+		&& my_push(parse, ctxt, start, end, progress)
+		&& my_push(parse, ctxt, parse->layout.content_end, tail_end, FALSE)
+	;
+	xmlParseChunk(ctxt, NULL, 0, 1);
+
+	xmlDoc *doc = ctxt->myDoc;
+	ctxt->myDoc = NULL;
+	if (doc && (! complete || ! ctxt->wellFormed || xmlDocGetRootElement(doc) == NULL)) {
+		xmlFreeDoc(doc);
+		doc = NULL;
+	}
+	xmlFreeParserCtxt(ctxt);
+
+	return doc;
+}
+
+
+
+//
+// Gives the bytes from 'start' to 'end' to the parser. Returns FALSE if the
+// parse has to stop.
+//
+static gboolean my_push (RecordsParse *parse, xmlParserCtxt *ctxt, gsize start, gsize end, gboolean progress) {
+	while (start < end) {
+		if (g_atomic_int_get(parse->cancelled) || g_atomic_int_get(&parse->failed)) {
+			return FALSE;
+		}
+
+		gsize length = MIN(end - start, RECORDS_PUSH_SIZE);
+		if (xmlParseChunk(ctxt, parse->buffer + start, (int) length, 0) != XML_ERR_OK && ! ctxt->wellFormed) {
+			return FALSE;
+		}
+		if (progress) {
+			g_atomic_pointer_add(parse->consumed, length);
+		}
+		start += length;
+	}
+	return TRUE;
+}
+
+
+
+//
+// A thread of the parse: takes the next chunk until all the chunks are parsed
+// or the parse failed.
+//
+static gpointer my_worker_run (gpointer data) {
+	RecordsWorker *worker = (RecordsWorker *) data;
+	RecordsParse *parse = worker->parse;
+
+	while (! g_atomic_int_get(&parse->failed)) {
+		guint i = (guint) g_atomic_int_add(&parse->next, 1);
+		if (i >= parse->chunks->len) {
+			break;
+		}
+		if (! my_parse_chunk(parse, &g_array_index(parse->chunks, RecordsChunk, i), worker->dict)) {
+			g_atomic_int_set(&parse->failed, TRUE);
+		}
+	}
+
+	return NULL;
+}
+
+
+
+//
+// Parses a chunk and moves its nodes to the document: they belong to the
+// document, use its namespaces and its dictionary and have the line numbers
+// of the document. The nodes are linked to the root by the main thread.
+//
+static gboolean my_parse_chunk (RecordsParse *parse, RecordsChunk *chunk, xmlDict *dict) {
+
+	xmlDoc *doc = my_parse(parse, dict, chunk->start, chunk->end, parse->layout.root_end, TRUE);
+	if (doc == NULL) {
+		return FALSE;
+	}
+	xmlNode *root = xmlDocGetRootElement(doc);
+
+	RecordsAdoption adoption = {
+		.parse = parse,
+		.chunk = chunk,
+		.dict = dict,
+		.root_ns = root->nsDef,
+		.xml_ns = doc->oldNs,
+	};
+	chunk->ids = g_ptr_array_new();
+	for (xmlNode *node = root->children; node; node = node->next) {
+		my_adopt_tree(&adoption, node);
+		node->parent = parse->root;
+	}
+
+	chunk->first = root->children;
+	chunk->last = root->last;
+	root->children = NULL;
+	root->last = NULL;
+
+	// The IDs are dropped from the document of the chunk before it's freed
+	for (guint i = 0; i < chunk->ids->len; i += 2) {
+		xmlRemoveID(doc, (xmlAttr *) g_ptr_array_index(chunk->ids, i));
+	}
+	xmlFreeDoc(doc);
+
+	return TRUE;
+}
+
+
+
+//
+// Moves a node and its descendants to the document, without recursion.
+//
+static void my_adopt_tree (RecordsAdoption *adoption, xmlNode *top) {
+
+	xmlNode *node = top;
+	while (node) {
+		my_adopt_node(adoption, node);
+
+		if (node->type == XML_ELEMENT_NODE) {
+			node->ns = my_adopt_ns(adoption, node->ns);
+
+			for (xmlAttr *attr = node->properties; attr; attr = attr->next) {
+				attr->doc = adoption->parse->doc;
+				attr->name = my_adopt_string(adoption, attr->name);
+				attr->ns = my_adopt_ns(adoption, attr->ns);
+				for (xmlNode *text = attr->children; text; text = text->next) {
+					my_adopt_node(adoption, text);
+				}
+
+				if (attr->atype == XML_ATTRIBUTE_ID) {
+					g_ptr_array_add(adoption->chunk->ids, attr);
+					g_ptr_array_add(adoption->chunk->ids, xmlNodeListGetString(NULL, attr->children, 1));
+				}
+			}
+
+			if (node->children) {
+				node = node->children;
+				continue;
+			}
+		}
+
+		while (node != top && node->next == NULL) {
+			node = node->parent;
+		}
+		node = node == top ? NULL : node->next;
+	}
+}
+
+
+
+//
+// Moves a node to the document, its namespaces and attributes are left.
+//
+static void my_adopt_node (RecordsAdoption *adoption, xmlNode *node) {
+	node->doc = adoption->parse->doc;
+	node->name = my_adopt_string(adoption, node->name);
+	if (node->content) {
+		node->content = (xmlChar *) my_adopt_string(adoption, node->content);
+	}
+	node->line = my_adopt_line(node->line, adoption->chunk->line_delta);
+}
+
+
+
+//
+// Returns a string that outlives the dictionary of the thread: either the
+// string is in the dictionary of the document or a copy of it is made.
+//
+static const xmlChar* my_adopt_string (RecordsAdoption *adoption, const xmlChar *string) {
+	if (string == NULL || xmlDictOwns(adoption->parse->doc->dict, string) == 1) {
+		return string;
+	}
+	if (xmlDictOwns(adoption->dict, string) == 1) {
+		return xmlStrdup(string);
+	}
+	return string;
+}
+
+
+
+//
+// Returns the namespace of the document that matches a namespace of the
+// chunk. The namespaces declared by the root of the chunk match the ones of
+// the root of the document by position.
+//
+static xmlNs* my_adopt_ns (RecordsAdoption *adoption, xmlNs *ns) {
+	if (ns == NULL) {
+		return NULL;
+	}
+	if (ns == adoption->xml_ns) {
+		return adoption->parse->xml_ns;
+	}
+
+	guint i = 0;
+	for (xmlNs *cur = adoption->root_ns; cur && i < adoption->parse->root_ns_count; cur = cur->next, ++i) {
+		if (cur == ns) {
+			return adoption->parse->root_ns[i];
+		}
+	}
+
+	// Declared in the chunk
+	return ns;
+}
+
+
+
+//
+// Returns the line number in the document of a line of a chunk.
+//
+static guint my_adopt_line (guint line, guint delta) {
+	if (line == 0) {
+		return 0;
+	}
+	if (delta == LINE_DELTA_CAPPED || line >= RECORDS_MAX_LINE || line + delta >= RECORDS_MAX_LINE) {
+		return RECORDS_MAX_LINE;
+	}
+	return line + delta;
+}
+
+
+
+//
+// Links the nodes of the chunks under the root of the document.
+//
+static void my_splice_chunks (RecordsParse *parse) {
+	xmlNode *root = parse->root;
+	if (root == NULL) {
+		return;
+	}
+
+	for (guint i = 0; i < parse->chunks->len; ++i) {
+		RecordsChunk *chunk = &g_array_index(parse->chunks, RecordsChunk, i);
+		if (chunk->first == NULL) {
+			continue;
+		}
+
+		if (root->last) {
+			root->last->next = chunk->first;
+			chunk->first->prev = root->last;
+		}
+		else {
+			root->children = chunk->first;
+		}
+		root->last = chunk->last;
+	}
+}
+
+
+
+//
+// Silences the errors of the parser, the errors are reported by the serial
+// parse if any.
+//
+static void my_ignore_error (void *data, xmlError *error) {
+}
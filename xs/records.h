@@ -0,0 +1,39 @@
+#ifndef __XACOBEO_RECORDS_H__
+#define __XACOBEO_RECORDS_H__
+
+
+#include <glib.h>
+#include <libxml/tree.h>
+
+
+//
+// The layout of a record-oriented document: a root element whose children (the
+// records) follow each other. The offsets are in bytes from the start of the
+// document.
+//
+typedef struct _XacobeoRecordLayout {
+
+	// The start tag of the root, from its '<' to the byte after its '>'
+	gsize root_start;
+	gsize content_start;
+
+	// The end tag of the root, from its '<' to the byte after its '>'
+	gsize content_end;
+	gsize root_end;
+
+} XacobeoRecordLayout;
+
+
+//
+// Called by the scan for each record with the offset of its '<' and the offset
+// of the byte after its last '>'. The scan stops if FALSE is returned.
+//
+typedef gboolean (*XacobeoRecordFunc) (gsize start, gsize end, gpointer data);
+
+
+// Public prototypes
+gboolean xacobeo_records_scan  (const gchar *buffer, gsize size, XacobeoRecordLayout *layout, XacobeoRecordFunc func, gpointer data);
+xmlDoc*  xacobeo_records_parse (const gchar *buffer, gsize size, const gchar *filename, guint threads, volatile gint *cancelled, volatile gsize *consumed);
+
+
+#endif
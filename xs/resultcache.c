@@ -0,0 +1,311 @@
+//
+// Cache of the results of XPath queries.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "resultcache.h"
+#include "logger.h"
+#include "libxml.h"
+
+#include <libxml/xpathInternals.h>
+
+#include <string.h>
+
+
+//
+// A cached result: the nodes matched by an expression in document order.
+//
+typedef struct _ResultCacheEntry {
+	gchar *key;
+	xmlNode **nodes;
+	gint count;
+	gsize size;
+} ResultCacheEntry;
+
+
+// The memory used by an entry besides its key and its nodes
+#define RESULT_ENTRY_OVERHEAD (sizeof(ResultCacheEntry) + sizeof(GList) + 4 * sizeof(gpointer))
+
+
+//
+// Function prototypes
+//
+static gchar*   my_normalize_expression (const gchar *expression);
+static gboolean my_is_name_char         (gchar c);
+static void     my_set_generation       (XacobeoResultCache *cache, guint generation);
+static void     my_trim                 (XacobeoResultCache *cache, gsize needed);
+static void     my_entry_free           (ResultCacheEntry *entry);
+
+
+
+//
+// Creates a new cache for the results of the queries made on the given
+// document. The results use at most 'limit' bytes.
+//
+// The cache has to be freed with xacobeo_result_cache_free().
+//
+XacobeoResultCache* xacobeo_result_cache_new (SV *document, gulong limit) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL) {
+		WARN("Document has no node");
+		return NULL;
+	}
+
+	XacobeoResultCache *cache = g_new0(XacobeoResultCache, 1);
+	cache->doc = node->doc;
+	cache->document = newSVsv(document);
+	cache->entries = g_hash_table_new(g_str_hash, g_str_equal);
+	cache->lru = g_queue_new();
+	cache->limit = limit;
+	return cache;
+}
+
+
+
+//
+// Frees the cache. The document is not freed by this function, it's only
+// released.
+//
+void xacobeo_result_cache_free (XacobeoResultCache *cache) {
+	if (cache == NULL) {
+		return;
+	}
+
+	INFO("Result cache hits = %u, misses = %u", cache->hits, cache->misses);
+
+	xacobeo_result_cache_clear(cache);
+	g_hash_table_destroy(cache->entries);
+	g_queue_free(cache->lru);
+	SvREFCNT_dec(cache->document);
+	g_free(cache);
+}
+
+
+
+//
+// Returns the cached result of the given expression as a new
+// Xacobeo::XS::NodeSet. The result has to be from the given generation of the
+// document.
+//
+// Returns undef if the result is not in the cache.
+//
+SV* xacobeo_result_cache_lookup (XacobeoResultCache *cache, const gchar *expression, guint generation) {
+
+	if (cache == NULL || expression == NULL) {
+		return &PL_sv_undef;
+	}
+	my_set_generation(cache, generation);
+
+	gchar *key = my_normalize_expression(expression);
+	GList *link = g_hash_table_lookup(cache->entries, key);
+	g_free(key);
+	if (link == NULL) {
+		++cache->misses;
+		return &PL_sv_undef;
+	}
+	++cache->hits;
+
+	// Move the entry to the front
+	g_queue_unlink(cache->lru, link);
+	g_queue_push_head_link(cache->lru, link);
+	ResultCacheEntry *entry = link->data;
+
+	// The node set owns its table of nodes
+	xmlNodeSet *set = xmlXPathNodeSetCreate(NULL);
+	if (entry->count) {
+		set->nodeTab = (xmlNode **) xmlMalloc(entry->count * sizeof(xmlNode *));
+		memcpy(set->nodeTab, entry->nodes, entry->count * sizeof(xmlNode *));
+		set->nodeNr = set->nodeMax = entry->count;
+	}
+
+	XacobeoNodeSet *nodeset = xacobeo_nodeset_new(cache->document, xmlXPathWrapNodeSet(set));
+	return sv_setref_pv(newSV(0), "Xacobeo::XS::NodeSet", (void *) nodeset);
+}
+
+
+
+//
+// Stores the result of the given expression evaluated on the given generation
+// of the document. The least recently used results are discarded in order to
+// make room for the new result.
+//
+// Returns FALSE if the result can't be cached: it belongs to another document,
+// it's bigger than the memory limit or it has namespace nodes (they are copies
+// owned by the node set).
+//
+gboolean xacobeo_result_cache_store (XacobeoResultCache *cache, const gchar *expression, guint generation, XacobeoNodeSet *set) {
+
+	if (cache == NULL || expression == NULL || set == NULL || set->doc != cache->doc) {
+		return FALSE;
+	}
+	my_set_generation(cache, generation);
+
+	xmlNodeSet *nodes = set->result->nodesetval;
+	gint count = nodes ? nodes->nodeNr : 0;
+	for (gint i = 0; i < count; ++i) {
+		if (nodes->nodeTab[i]->type == XML_NAMESPACE_DECL) {
+			return FALSE;
+		}
+	}
+
+	gchar *key = my_normalize_expression(expression);
+	gsize size = strlen(key) + 1 + count * sizeof(xmlNode *) + RESULT_ENTRY_OVERHEAD;
+	if (size > cache->limit) {
+		g_free(key);
+		return FALSE;
+	}
+
+	// Replace the previous result of the expression
+	GList *link = g_hash_table_lookup(cache->entries, key);
+	if (link) {
+		ResultCacheEntry *old = link->data;
+		g_hash_table_remove(cache->entries, old->key);
+		g_queue_delete_link(cache->lru, link);
+		cache->size -= old->size;
+		my_entry_free(old);
+	}
+	my_trim(cache, size);
+
+	ResultCacheEntry *entry = g_new(ResultCacheEntry, 1);
+	entry->key = key;
+	entry->nodes = g_new(xmlNode *, count);
+	if (count) {
+		memcpy(entry->nodes, nodes->nodeTab, count * sizeof(xmlNode *));
+	}
+	entry->count = count;
+	entry->size = size;
+
+	g_queue_push_head(cache->lru, entry);
+	g_hash_table_insert(cache->entries, entry->key, cache->lru->head);
+	cache->size += size;
+
+	return TRUE;
+}
+
+
+
+//
+// Sets the maximal number of bytes used by the cached results. The results used
+// the least recently are discarded if the cache is bigger than the new limit.
+//
+void xacobeo_result_cache_set_limit (XacobeoResultCache *cache, gulong limit) {
+	cache->limit = limit;
+	my_trim(cache, 0);
+}
+
+
+
+//
+// Discards all the cached results.
+//
+void xacobeo_result_cache_clear (XacobeoResultCache *cache) {
+	g_hash_table_remove_all(cache->entries);
+	for (GList *link = cache->lru->head; link; link = link->next) {
+		my_entry_free(link->data);
+	}
+	g_queue_clear(cache->lru);
+	cache->size = 0;
+}
+
+
+
+//
+// Normalizes an expression by removing the white space that's not needed. The
+// white space between two names is kept (ex: "a or b") and so is the one in
+// string literals.
+//
+// The normalized expression has to be freed with g_free().
+//
+static gchar* my_normalize_expression (const gchar *expression) {
+	GString *normalized = g_string_sized_new(strlen(expression));
+	gchar quote = '\0';
+	gboolean space = FALSE;
+
+	for (const gchar *p = expression; *p; ++p) {
+		if (quote) {
+			if (*p == quote) {
+				quote = '\0';
+			}
+			g_string_append_c(normalized, *p);
+			continue;
+		}
+
+		if (g_ascii_isspace(*p)) {
+			space = TRUE;
+			continue;
+		}
+
+		// Keep a single space between two names
+		if (space && normalized->len && my_is_name_char(normalized->str[normalized->len - 1]) && my_is_name_char(*p)) {
+			g_string_append_c(normalized, ' ');
+		}
+		space = FALSE;
+
+		if (*p == '\'' || *p == '"') {
+			quote = *p;
+		}
+		g_string_append_c(normalized, *p);
+	}
+
+	return g_string_free(normalized, FALSE);
+}
+
+
+
+//
+// Returns TRUE if the character can be part of a name or of a number. The non
+// ASCII characters are considered as part of a name.
+//
+static gboolean my_is_name_char (gchar c) {
+	return g_ascii_isalnum(c) || c == '_' || c == '-' || c == '.' || c == ':' || (c & 0x80);
+}
+
+
+
+//
+// Moves the cache to the given generation of the document, the results of the
+// previous generations are discarded.
+//
+static void my_set_generation (XacobeoResultCache *cache, guint generation) {
+	if (generation == cache->generation) {
+		return;
+	}
+
+	DEBUG("Document generation %u -> %u, discarding %u results", cache->generation, generation, cache->lru->length);
+	xacobeo_result_cache_clear(cache);
+	cache->generation = generation;
+}
+
+
+
+//
+// Discards the results used the least recently until there's enough room for
+// 'needed' bytes.
+//
+static void my_trim (XacobeoResultCache *cache, gsize needed) {
+	while (cache->lru->tail && cache->size + needed > cache->limit) {
+		ResultCacheEntry *entry = g_queue_pop_tail(cache->lru);
+		g_hash_table_remove(cache->entries, entry->key);
+		cache->size -= entry->size;
+		my_entry_free(entry);
+	}
+}
+
+
+
+//
+// Frees a cached result.
+//
+static void my_entry_free (ResultCacheEntry *entry) {
+	g_free(entry->key);
+	g_free(entry->nodes);
+	g_free(entry);
+}
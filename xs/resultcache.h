@@ -0,0 +1,61 @@
+#ifndef __XACOBEO_RESULTCACHE_H__
+#define __XACOBEO_RESULTCACHE_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <glib.h>
+#include <libxml/tree.h>
+
+#include "nodeset.h"
+
+
+//
+// Cache of the results of the XPath queries made on a document. The results are
+// kept as plain arrays of nodes (no Perl objects) and keyed by the normalized
+// expression and the generation of the document. A result is only valid for
+// the generation of the document that produced it; the results of the previous
+// generations are discarded as soon as a newer generation is seen. The results
+// used the least recently are discarded once the memory limit is reached.
+//
+typedef struct _XacobeoResultCache {
+
+	// The document queried
+	xmlDoc *doc;
+
+	// The Perl document, it's kept in order to ensure that the cached nodes are
+	// not freed while the cache is alive.
+	SV *document;
+
+	// The generation of the document of the cached results
+	guint generation;
+
+	// The cached results (key: normalized expression, value: GList* in lru)
+	GHashTable *entries;
+
+	// The results sorted by their last use, the most recent is the head
+	GQueue *lru;
+
+	// The memory used by the results and its limit (in bytes)
+	gsize size;
+	gsize limit;
+
+	// Statistics
+	guint hits;
+	guint misses;
+
+} XacobeoResultCache;
+
+
+// Public prototypes
+XacobeoResultCache* xacobeo_result_cache_new       (SV *document, gulong limit);
+void                xacobeo_result_cache_free      (XacobeoResultCache *cache);
+SV*                 xacobeo_result_cache_lookup    (XacobeoResultCache *cache, const gchar *expression, guint generation);
+gboolean            xacobeo_result_cache_store     (XacobeoResultCache *cache, const gchar *expression, guint generation, XacobeoNodeSet *set);
+void                xacobeo_result_cache_set_limit (XacobeoResultCache *cache, gulong limit);
+void                xacobeo_result_cache_clear     (XacobeoResultCache *cache);
+
+
+#endif
@@ -0,0 +1,505 @@
+//
+// Parallel text search in a GtkTextBuffer.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "search.h"
+#include "logger.h"
+
+#include <string.h>
+
+
+// The smallest chunk of text scanned by a thread (in bytes)
+#define CHUNK_MIN_SIZE (1024 * 1024)
+
+
+//
+// A chunk of the text scanned by a thread. Only the matches starting within
+// the chunk are collected but a match can end after the chunk.
+//
+typedef struct _SearchChunk {
+
+	// The whole text
+	const gchar *text;
+	gsize length;
+
+	// The range of bytes where the matches can start
+	gsize start;
+	gsize end;
+
+	// The string searched or the regular expression (if any)
+	const gchar *pattern;
+	gsize pattern_length;
+	GRegex *regex;
+
+	// The matches found (pairs of byte offsets: start, end)
+	GArray *matches;
+
+	// The matches as pairs of character offsets relative to the start of the
+	// chunk and the number of characters in the chunk
+	GArray *offsets;
+	gint length_chars;
+
+	GThread *thread;
+
+} SearchChunk;
+
+
+//
+// Function prototypes
+//
+static gpointer my_search_chunk       (gpointer data);
+static void     my_search_string      (SearchChunk *chunk);
+static void     my_search_regex       (SearchChunk *chunk);
+static void     my_convert_offsets    (SearchChunk *chunk);
+static gint     my_count_chars        (const gchar *text, gsize length);
+static guint    my_get_chunk_count    (gsize length, guint threads);
+static void     my_merge_matches      (XacobeoTextSearch *search, SearchChunk *chunks, guint count);
+static guint    my_resync_regex       (XacobeoTextSearch *search, SearchChunk *chunk, gint chunk_offset, gsize *last_end);
+static gint     my_find_first_after   (XacobeoTextSearch *search, gint offset);
+
+
+
+//
+// Finds all the occurrences of the given pattern in the buffer. The pattern is
+// a plain string unless 'is_regex' is TRUE, in which case it's compiled as a
+// regular expression (see GRegex). The matches don't overlap; they are the same
+// as the ones found by scanning the text from its start.
+//
+// If the regular expression is invalid NULL is returned and the error message
+// is stored in 'error'.
+//
+// The text is scanned by at most 'threads' threads, 0 means one thread per
+// processor.
+//
+// The search has to be freed with xacobeo_text_search_free().
+//
+XacobeoTextSearch* xacobeo_text_search_new (GtkTextBuffer *buffer, const gchar *pattern, gboolean is_regex, guint threads, gchar **error) {
+
+	GRegex *regex = NULL;
+	if (is_regex) {
+		GError *regex_error = NULL;
+		regex = g_regex_new(pattern, G_REGEX_OPTIMIZE | G_REGEX_MULTILINE, 0, &regex_error);
+		if (regex == NULL) {
+			*error = g_strdup(regex_error->message);
+			g_error_free(regex_error);
+			return NULL;
+		}
+	}
+
+	XacobeoTextSearch *search = g_new0(XacobeoTextSearch, 1);
+	search->matches = g_array_new(FALSE, FALSE, sizeof(gint));
+	if (*pattern == '\0') {
+		if (regex) {
+			g_regex_unref(regex);
+		}
+		return search;
+	}
+
+	GtkTextIter iter_start, iter_end;
+	gtk_text_buffer_get_start_iter(buffer, &iter_start);
+	gtk_text_buffer_get_end_iter(buffer, &iter_end);
+	gchar *text = gtk_text_buffer_get_text(buffer, &iter_start, &iter_end, TRUE);
+	gsize length = strlen(text);
+
+
+	// Split the text in chunks, each chunk starts at a character boundary
+	guint count = my_get_chunk_count(length, threads);
+	SearchChunk *chunks = g_new0(SearchChunk, count);
+	gsize start = 0;
+	for (guint i = 0; i < count; ++i) {
+		gsize end = (i == count - 1) ? length : length / count * (i + 1);
+		while (end < length && (text[end] & 0xC0) == 0x80) {
+			++end;
+		}
+
+		SearchChunk *chunk = &chunks[i];
+		chunk->text = text;
+		chunk->length = length;
+		chunk->start = start;
+		chunk->end = end;
+		chunk->pattern = pattern;
+		chunk->pattern_length = strlen(pattern);
+		chunk->regex = regex;
+		chunk->matches = g_array_new(FALSE, FALSE, sizeof(gsize));
+		chunk->offsets = g_array_new(FALSE, FALSE, sizeof(gint));
+		start = end;
+	}
+
+
+	// Scan the chunks, the first one is scanned by the current thread
+	for (guint i = 1; i < count; ++i) {
+#if GLIB_CHECK_VERSION(2, 32, 0)
+		chunks[i].thread = g_thread_new("search", my_search_chunk, &chunks[i]);
+#else
+		if (! g_thread_supported()) {
+			g_thread_init(NULL);
+		}
+		chunks[i].thread = g_thread_create(my_search_chunk, &chunks[i], TRUE, NULL);
+#endif
+	}
+	my_search_chunk(&chunks[0]);
+	for (guint i = 1; i < count; ++i) {
+		g_thread_join(chunks[i].thread);
+	}
+
+	my_merge_matches(search, chunks, count);
+	DEBUG("Found %d matches in %u chunks", xacobeo_text_search_size(search), count);
+
+	for (guint i = 0; i < count; ++i) {
+		g_array_free(chunks[i].matches, TRUE);
+		g_array_free(chunks[i].offsets, TRUE);
+	}
+	g_free(chunks);
+	g_free(text);
+	if (regex) {
+		g_regex_unref(regex);
+	}
+
+	return search;
+}
+
+
+
+//
+// Frees the search.
+//
+void xacobeo_text_search_free (XacobeoTextSearch *search) {
+	if (search == NULL) {
+		return;
+	}
+	g_array_free(search->matches, TRUE);
+	g_free(search);
+}
+
+
+
+//
+// Returns the number of matches found.
+//
+gint xacobeo_text_search_size (XacobeoTextSearch *search) {
+	return search->matches->len / 2;
+}
+
+
+
+//
+// Returns the position of the match that follows the given character offset or
+// the position of the match that precedes it when 'forward' is FALSE. The search
+// wraps around the end of the text. If there are no matches -1 is returned.
+//
+gint xacobeo_text_search_find (XacobeoTextSearch *search, gint offset, gboolean forward) {
+
+	gint size = xacobeo_text_search_size(search);
+	if (size == 0) {
+		return -1;
+	}
+
+	gint i;
+	if (forward) {
+		i = my_find_first_after(search, offset);
+		return i < size ? i : 0;
+	}
+
+	// The last match starting before the offset
+	i = my_find_first_after(search, offset) - 1;
+	return i >= 0 ? i : size - 1;
+}
+
+
+
+//
+// Returns the character offsets of the match at the given position.
+//
+void xacobeo_text_search_get_match (XacobeoTextSearch *search, gint i, gint *start, gint *end) {
+	if (i < 0 || i >= xacobeo_text_search_size(search)) {
+		*start = *end = -1;
+		return;
+	}
+	*start = g_array_index(search->matches, gint, i * 2);
+	*end = g_array_index(search->matches, gint, i * 2 + 1);
+}
+
+
+
+//
+// Applies the given tag to the matches within the range of characters
+// [start, end). The tag is first removed from the range. This is meant to be
+// called with the region of the buffer that's displayed.
+//
+void xacobeo_text_search_highlight (XacobeoTextSearch *search, GtkTextBuffer *buffer, const gchar *tag, gint start, gint end) {
+
+	GtkTextIter iter_start, iter_end;
+	gtk_text_buffer_get_iter_at_offset(buffer, &iter_start, start);
+	gtk_text_buffer_get_iter_at_offset(buffer, &iter_end, end);
+	gtk_text_buffer_remove_tag_by_name(buffer, tag, &iter_start, &iter_end);
+
+	// The first match ending in the range, matches can't overlap
+	gint size = xacobeo_text_search_size(search);
+	gint i = my_find_first_after(search, start);
+	if (i > 0 && g_array_index(search->matches, gint, i * 2 - 1) > start) {
+		--i;
+	}
+
+	for (; i < size; ++i) {
+		gint match_start, match_end;
+		xacobeo_text_search_get_match(search, i, &match_start, &match_end);
+		if (match_start >= end) {
+			break;
+		}
+		gtk_text_buffer_get_iter_at_offset(buffer, &iter_start, match_start);
+		gtk_text_buffer_get_iter_at_offset(buffer, &iter_end, match_end);
+		gtk_text_buffer_apply_tag_by_name(buffer, tag, &iter_start, &iter_end);
+	}
+}
+
+
+
+//
+// Scans a chunk of text. This function is called from a worker thread; it
+// doesn't access any Perl or GTK data.
+//
+static gpointer my_search_chunk (gpointer data) {
+	SearchChunk *chunk = (SearchChunk *) data;
+	if (chunk->regex) {
+		my_search_regex(chunk);
+	}
+	else {
+		my_search_string(chunk);
+	}
+	my_convert_offsets(chunk);
+	return NULL;
+}
+
+
+
+//
+// Converts the byte offsets of the matches into character offsets relative to
+// the start of the chunk. Counting the characters is as expensive as the search
+// itself, thus it's also done by the worker threads.
+//
+static void my_convert_offsets (SearchChunk *chunk) {
+
+	gsize byte_offset = chunk->start;
+	gint char_offset = 0;
+	for (guint i = 0; i < chunk->matches->len; i += 2) {
+		gsize start = g_array_index(chunk->matches, gsize, i);
+		gsize end = g_array_index(chunk->matches, gsize, i + 1);
+
+		char_offset += my_count_chars(chunk->text + byte_offset, start - byte_offset);
+		gint char_end = char_offset + my_count_chars(chunk->text + start, end - start);
+		g_array_append_val(chunk->offsets, char_offset);
+		g_array_append_val(chunk->offsets, char_end);
+		byte_offset = start;
+	}
+
+	chunk->length_chars = char_offset + my_count_chars(chunk->text + byte_offset, chunk->end - byte_offset);
+}
+
+
+
+//
+// Finds the occurrences of a string. All the occurrences are collected, even
+// the ones that overlap, the overlapping matches are discarded once all the
+// chunks are merged. memmem() is vectorized by the C library.
+//
+static void my_search_string (SearchChunk *chunk) {
+
+	// Matches starting in the chunk can end in the next chunk
+	gsize limit = MIN(chunk->end + chunk->pattern_length - 1, chunk->length);
+	const gchar *p = chunk->text + chunk->start;
+	const gchar *stop = chunk->text + limit;
+
+	while (p < stop) {
+		const gchar *hit = memmem(p, stop - p, chunk->pattern, chunk->pattern_length);
+		if (hit == NULL) {
+			break;
+		}
+
+		gsize offset = hit - chunk->text;
+		gsize offset_end = offset + chunk->pattern_length;
+		g_array_append_val(chunk->matches, offset);
+		g_array_append_val(chunk->matches, offset_end);
+		p = hit + 1;
+	}
+}
+
+
+
+//
+// Finds the matches of a regular expression. The whole text is given to the
+// regular expression engine, this way the anchors and the look behinds work
+// across the chunks. The scan starts at the start of the chunk, if a match of
+// the previous chunk ends after it the first matches can differ from the ones
+// of a serial scan, they are fixed by my_resync_regex().
+//
+static void my_search_regex (SearchChunk *chunk) {
+
+	GMatchInfo *info = NULL;
+	g_regex_match_full(chunk->regex, chunk->text, chunk->length, chunk->start, 0, &info, NULL);
+	while (g_match_info_matches(info)) {
+		gint start, end;
+		g_match_info_fetch_pos(info, 0, &start, &end);
+		if ((gsize) start >= chunk->end) {
+			break;
+		}
+
+		// Empty matches can't be highlighted
+		if (end > start) {
+			gsize offset = start;
+			gsize offset_end = end;
+			g_array_append_val(chunk->matches, offset);
+			g_array_append_val(chunk->matches, offset_end);
+		}
+		g_match_info_next(info, NULL);
+	}
+	g_match_info_free(info);
+}
+
+
+
+//
+// Returns the number of chunks in which a text of the given size is split. There
+// are no more chunks than threads (processors if 'threads' is 0).
+//
+static guint my_get_chunk_count (gsize length, guint threads) {
+	if (threads == 0) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		threads = g_get_num_processors();
+#else
+		threads = 1;
+#endif
+	}
+	gsize count = length / CHUNK_MIN_SIZE + 1;
+	return (guint) MIN(count, threads);
+}
+
+
+
+//
+// Returns the number of characters in the given UTF-8 text; the continuation
+// bytes are skipped. Unlike g_utf8_strlen() this loop can be vectorized by the
+// compiler.
+//
+static gint my_count_chars (const gchar *text, gsize length) {
+	gint count = 0;
+	for (gsize i = 0; i < length; ++i) {
+		count += (text[i] & 0xC0) != 0x80;
+	}
+	return count;
+}
+
+
+
+//
+// Merges the matches of each chunk into the search. The matches that overlap a
+// previous match are dropped. When a regular expression matches across the
+// start of a chunk the scan of the chunk is resumed where that match ends.
+//
+static void my_merge_matches (XacobeoTextSearch *search, SearchChunk *chunks, guint count) {
+
+	// The end of the last match (in bytes)
+	gsize last_end = 0;
+	gint chunk_offset = 0;
+
+	for (guint i = 0; i < count; ++i) {
+		SearchChunk *chunk = &chunks[i];
+
+		guint j = 0;
+		if (chunk->regex && last_end > chunk->start) {
+			j = my_resync_regex(search, chunk, chunk_offset, &last_end);
+		}
+
+		for (; j < chunk->matches->len; j += 2) {
+			if (g_array_index(chunk->matches, gsize, j) < last_end) {
+				continue;
+			}
+			gint start = chunk_offset + g_array_index(chunk->offsets, gint, j);
+			gint end = chunk_offset + g_array_index(chunk->offsets, gint, j + 1);
+			g_array_append_val(search->matches, start);
+			g_array_append_val(search->matches, end);
+			last_end = g_array_index(chunk->matches, gsize, j + 1);
+		}
+		chunk_offset += chunk->length_chars;
+	}
+}
+
+
+
+//
+// Scans a chunk again from the end of the last match, which is after the start
+// of the chunk, until a match is the same as one of the matches found by the
+// scan of the chunk; from there both scans find the same matches. The matches
+// found are added to the search. Returns the position in the matches of the
+// chunk where the merge resumes (all of them are skipped if the scans never
+// meet).
+//
+static guint my_resync_regex (XacobeoTextSearch *search, SearchChunk *chunk, gint chunk_offset, gsize *last_end) {
+
+	guint j = 0;
+	gboolean met = FALSE;
+
+	GMatchInfo *info = NULL;
+	g_regex_match_full(chunk->regex, chunk->text, chunk->length, *last_end, 0, &info, NULL);
+	while (g_match_info_matches(info)) {
+		gint start, end;
+		g_match_info_fetch_pos(info, 0, &start, &end);
+		if ((gsize) start >= chunk->end) {
+			break;
+		}
+
+		// Skip the matches of the chunk that the serial scan doesn't find
+		while (j < chunk->matches->len && g_array_index(chunk->matches, gsize, j) < (gsize) start) {
+			j += 2;
+		}
+		if (
+			j < chunk->matches->len
+			&& g_array_index(chunk->matches, gsize, j) == (gsize) start
+			&& g_array_index(chunk->matches, gsize, j + 1) == (gsize) end
+		) {
+			met = TRUE;
+			break;
+		}
+
+		if (end > start) {
+			gint char_start = chunk_offset + my_count_chars(chunk->text + chunk->start, start - chunk->start);
+			gint char_end = char_start + my_count_chars(chunk->text + start, end - start);
+			g_array_append_val(search->matches, char_start);
+			g_array_append_val(search->matches, char_end);
+			*last_end = end;
+		}
+		g_match_info_next(info, NULL);
+	}
+	g_match_info_free(info);
+
+	return met ? j : chunk->matches->len;
+}
+
+
+
+//
+// Returns the position of the first match starting at the given character
+// offset or after it. If there's no such match the number of matches is
+// returned.
+//
+static gint my_find_first_after (XacobeoTextSearch *search, gint offset) {
+	gint first = 0;
+	gint last = xacobeo_text_search_size(search);
+	while (first < last) {
+		gint middle = first + (last - first) / 2;
+		if (g_array_index(search->matches, gint, middle * 2) < offset) {
+			first = middle + 1;
+		}
+		else {
+			last = middle;
+		}
+	}
+	return first;
+}
@@ -0,0 +1,36 @@
+#ifndef __XACOBEO_SEARCH_H__
+#define __XACOBEO_SEARCH_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+
+//
+// A text search in the contents of a GtkTextBuffer. All the matches are found
+// at once by splitting the text in chunks that are scanned in parallel, the
+// matches are then highlighted on demand (only the region being displayed needs
+// to be highlighted).
+//
+typedef struct _XacobeoTextSearch {
+
+	// The matches (pairs of character offsets: start, end) in the buffer's order
+	GArray *matches;
+
+} XacobeoTextSearch;
+
+
+// Public prototypes
+XacobeoTextSearch* xacobeo_text_search_new       (GtkTextBuffer *buffer, const gchar *pattern, gboolean is_regex, guint threads, gchar **error);
+void               xacobeo_text_search_free      (XacobeoTextSearch *search);
+gint               xacobeo_text_search_size      (XacobeoTextSearch *search);
+gint               xacobeo_text_search_find      (XacobeoTextSearch *search, gint offset, gboolean forward);
+void               xacobeo_text_search_get_match (XacobeoTextSearch *search, gint i, gint *start, gint *end);
+void               xacobeo_text_search_highlight (XacobeoTextSearch *search, GtkTextBuffer *buffer, const gchar *tag, gint start, gint end);
+
+
+#endif
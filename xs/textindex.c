@@ -0,0 +1,578 @@
+//
+// Trigram index of the text of a document built in a worker thread.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "textindex.h"
+#include "nodeset.h"
+#include "logger.h"
+#include "libxml.h"
+
+#include <string.h>
+#include <libxml/xpathInternals.h>
+
+
+// The names of the states as seen by Perl (indexed by TextIndexStateEnum)
+static const gchar *STATE_NAMES[] = {
+	"building",
+	"ready",
+	"cancelled",
+	"limit",
+};
+
+
+// The kinds of entries matched by a search
+enum TextEntryKind {
+	TEXT_ENTRY_TEXT      = 1 << 0,
+	TEXT_ENTRY_ATTRIBUTE = 1 << 1,
+};
+
+
+// Packs 3 bytes into a trigram key
+#define TRIGRAM(p) GUINT_TO_POINTER( \
+	((guint)(guchar) (p)[0] << 16) | ((guint)(guchar) (p)[1] << 8) | (guint)(guchar) (p)[2] \
+)
+
+// The memory used for indexing a distinct trigram (without its postings)
+#define TRIGRAM_OVERHEAD (sizeof(GArray) + 4 * sizeof(gpointer))
+
+
+//
+// Function prototypes
+//
+static gpointer    my_text_index_run     (gpointer data);
+static void        my_index_node         (XacobeoTextIndex *index, xmlNode *node);
+static void        my_index_text         (XacobeoTextIndex *index, xmlNode *node, const gchar *text);
+static GArray*     my_get_candidates     (XacobeoTextIndex *index, const gchar *text);
+static gint        my_compare_postings   (gconstpointer a, gconstpointer b);
+static xmlNodeSet* my_search             (XacobeoTextIndex *index, const gchar *text, gint kinds, gboolean owners);
+static SV*         my_node_set_to_sv     (XacobeoTextIndex *index, xmlNodeSet *set);
+static gchar*      my_parse_contains     (const gchar *p, const gchar **end);
+static void        my_postings_free      (gpointer data);
+
+
+
+//
+// Creates a new text index for the given document. The index is built in a
+// worker thread that's started right away. If the preorder mirror of the
+// document is given the worker walks the mirror instead of the tree.
+//
+// The index is dropped if it uses more than 'limit' bytes (0 for no limit), its
+// state is then "limit".
+//
+// The index has to be freed with xacobeo_text_index_free().
+//
+XacobeoTextIndex* xacobeo_text_index_new (SV *document, gulong limit, XacobeoPreorder *preorder) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL) {
+		WARN("Can't create a text index without a document");
+		return NULL;
+	}
+
+	XacobeoTextIndex *index = g_new0(XacobeoTextIndex, 1);
+	index->doc = node->doc;
+	index->document = newSVsv(document);
+	index->preorder = preorder && preorder->doc == index->doc ? xacobeo_preorder_ref(preorder) : NULL;
+	index->entries = g_ptr_array_new();
+	index->trigrams = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, my_postings_free);
+	index->limit = limit;
+	index->timer = g_timer_new();
+
+	index->state = TEXT_INDEX_BUILDING;
+#if GLIB_CHECK_VERSION(2, 32, 0)
+	index->thread = g_thread_new("text-index", my_text_index_run, index);
+#else
+	if (! g_thread_supported()) {
+		g_thread_init(NULL);
+	}
+	index->thread = g_thread_create(my_text_index_run, index, TRUE, NULL);
+#endif
+
+	return index;
+}
+
+
+
+//
+// Frees the index. If the index is still being built the worker thread is
+// stopped.
+//
+void xacobeo_text_index_free (XacobeoTextIndex *index) {
+	if (index == NULL) {
+		return;
+	}
+
+	if (index->thread) {
+		g_atomic_int_set(&index->cancelled, TRUE);
+		g_thread_join(index->thread);
+	}
+
+	g_hash_table_destroy(index->trigrams);
+	g_ptr_array_free(index->entries, TRUE);
+	g_timer_destroy(index->timer);
+	xacobeo_preorder_unref(index->preorder);
+	SvREFCNT_dec(index->document);
+	g_free(index);
+}
+
+
+
+//
+// Returns the state of the index: "building", "ready", "cancelled" or "limit"
+// (the index was dropped because it exceeded its memory limit).
+//
+const gchar* xacobeo_text_index_poll (XacobeoTextIndex *index) {
+
+	gint state = g_atomic_int_get(&index->state);
+	if (state != TEXT_INDEX_BUILDING && index->thread) {
+		g_thread_join(index->thread);
+		index->thread = NULL;
+	}
+
+	return STATE_NAMES[state];
+}
+
+
+
+//
+// Waits until the index is built.
+//
+void xacobeo_text_index_wait (XacobeoTextIndex *index) {
+	if (index->thread) {
+		g_thread_join(index->thread);
+		index->thread = NULL;
+	}
+}
+
+
+
+//
+// Returns the number of seconds spent building the index.
+//
+gdouble xacobeo_text_index_elapsed (XacobeoTextIndex *index) {
+	return g_timer_elapsed(index->timer, NULL);
+}
+
+
+
+//
+// Returns the elements having a text node or an attribute that contains the
+// given text. The elements are returned in document order as a
+// Xacobeo::XS::NodeSet. This is the same as the XPath expression:
+//
+//   //*[text()[contains(., 'text')] or @*[contains(., 'text')]]
+//
+// If the index is not ready undef is returned.
+//
+SV* xacobeo_text_index_search (XacobeoTextIndex *index, const gchar *text) {
+
+	if (text == NULL || g_atomic_int_get(&index->state) != TEXT_INDEX_READY) {
+		return &PL_sv_undef;
+	}
+
+	xmlNodeSet *set = my_search(index, text, TEXT_ENTRY_TEXT | TEXT_ENTRY_ATTRIBUTE, TRUE);
+	return my_node_set_to_sv(index, set);
+}
+
+
+
+//
+// Evaluates the XPath expressions doing a substring search that can be answered
+// by the index. The supported expressions are:
+//
+//   //text()[contains(., 'text')]
+//   //@*[contains(., 'text')]
+//   count() of any of the expressions above
+//
+// The result is the same as the one of the XPath engine: a node set (as a
+// Xacobeo::XS::NodeSet) with the nodes in document order, or an
+// XML::LibXML::Number for count().
+//
+// If the expression is not supported or if the index is not ready undef is
+// returned and the caller has to use the XPath engine instead.
+//
+SV* xacobeo_text_index_find (XacobeoTextIndex *index, const gchar *expression) {
+
+	if (expression == NULL || g_atomic_int_get(&index->state) != TEXT_INDEX_READY) {
+		return &PL_sv_undef;
+	}
+
+	const gchar *p = expression;
+	gboolean count = FALSE;
+	if (g_str_has_prefix(p, "count(")) {
+		count = TRUE;
+		p += strlen("count(");
+	}
+
+	gint kinds;
+	if (g_str_has_prefix(p, "//text()")) {
+		kinds = TEXT_ENTRY_TEXT;
+		p += strlen("//text()");
+	}
+	else if (g_str_has_prefix(p, "//@*")) {
+		kinds = TEXT_ENTRY_ATTRIBUTE;
+		p += strlen("//@*");
+	}
+	else {
+		return &PL_sv_undef;
+	}
+
+	gchar *text = my_parse_contains(p, &p);
+	if (text == NULL) {
+		return &PL_sv_undef;
+	}
+	if (count && *p == ')') {
+		++p;
+	}
+	else if (count) {
+		p = NULL;
+	}
+
+	SV *sv = &PL_sv_undef;
+	if (p && *p == '\0') {
+		xmlNodeSet *set = my_search(index, text, kinds, FALSE);
+		if (count) {
+			sv = sv_bless(newRV_noinc(newSVnv(set->nodeNr)), gv_stashpv("XML::LibXML::Number", GV_ADD));
+			xmlXPathFreeNodeSet(set);
+		}
+		else {
+			sv = my_node_set_to_sv(index, set);
+		}
+	}
+	g_free(text);
+
+	return sv;
+}
+
+
+
+//
+// The worker thread. Walks the document and indexes the trigrams of each text
+// node and attribute value. The nodes are indexed in document order. The index
+// is emptied as soon as it exceeds its memory limit.
+//
+static gpointer my_text_index_run (gpointer data) {
+	XacobeoTextIndex *index = (XacobeoTextIndex *) data;
+
+	XacobeoPreorder *preorder = index->preorder;
+	if (preorder) {
+		// The nodes are already in document order, only the types are scanned
+		for (guint i = 0; i < preorder->size; ++i) {
+			if (g_atomic_int_get(&index->cancelled) || (index->limit && index->size > index->limit)) {
+				break;
+			}
+
+			switch (preorder->types[i]) {
+				case XML_ELEMENT_NODE:
+				case XML_TEXT_NODE:
+				case XML_CDATA_SECTION_NODE:
+					my_index_node(index, preorder->nodes[i]);
+				break;
+
+				default:
+				break;
+			}
+		}
+	}
+	else {
+		xmlNode *top = (xmlNode *) index->doc;
+		xmlNode *node = top;
+		while (node) {
+
+			if (g_atomic_int_get(&index->cancelled) || (index->limit && index->size > index->limit)) {
+				break;
+			}
+			my_index_node(index, node);
+
+			// Next node in document order, only the document and the elements are
+			// traversed
+			if ((node == top || node->type == XML_ELEMENT_NODE) && node->children) {
+				node = node->children;
+			}
+			else {
+				while (node != top && node->next == NULL) {
+					node = node->parent;
+				}
+				node = node == top ? NULL : node->next;
+			}
+		}
+	}
+	g_timer_stop(index->timer);
+
+	gint state = TEXT_INDEX_READY;
+	if (g_atomic_int_get(&index->cancelled)) {
+		state = TEXT_INDEX_CANCELLED;
+	}
+	else if (index->limit && index->size > index->limit) {
+		INFO("Text index: dropped, more than %lu bytes", (gulong) index->limit);
+		g_hash_table_remove_all(index->trigrams);
+		g_ptr_array_set_size(index->entries, 0);
+		index->size = 0;
+		state = TEXT_INDEX_LIMIT;
+	}
+	INFO("Text index: %u nodes, %u trigrams in %.3fs",
+		index->entries->len,
+		g_hash_table_size(index->trigrams),
+		g_timer_elapsed(index->timer, NULL)
+	);
+	g_atomic_int_set(&index->state, state);
+
+	return NULL;
+}
+
+
+
+//
+// Indexes the attribute values of an element or the content of a text node.
+//
+static void my_index_node (XacobeoTextIndex *index, xmlNode *node) {
+	if (node->type == XML_ELEMENT_NODE) {
+		for (xmlAttr *attr = node->properties; attr; attr = attr->next) {
+			xmlChar *value = xmlNodeGetContent((xmlNode *) attr);
+			my_index_text(index, (xmlNode *) attr, (const gchar *) value);
+			xmlFree(value);
+		}
+	}
+	else if (node->type == XML_TEXT_NODE || node->type == XML_CDATA_SECTION_NODE) {
+		my_index_text(index, node, (const gchar *) node->content);
+	}
+}
+
+
+
+//
+// Adds the given node (a text node or an attribute) to the index.
+//
+static void my_index_text (XacobeoTextIndex *index, xmlNode *node, const gchar *text) {
+
+	guint32 position = index->entries->len;
+	g_ptr_array_add(index->entries, node);
+	index->size += sizeof(gpointer);
+	if (text == NULL) {
+		return;
+	}
+
+	gsize length = strlen(text);
+	for (gsize i = 0; i + 3 <= length; ++i) {
+		gpointer trigram = TRIGRAM(text + i);
+		GArray *postings = g_hash_table_lookup(index->trigrams, trigram);
+		if (postings == NULL) {
+			postings = g_array_new(FALSE, FALSE, sizeof(guint32));
+			g_hash_table_insert(index->trigrams, trigram, postings);
+			index->size += TRIGRAM_OVERHEAD;
+		}
+		else if (g_array_index(postings, guint32, postings->len - 1) == position) {
+			// The trigram appears more than once in the same node
+			continue;
+		}
+		g_array_append_val(postings, position);
+		index->size += sizeof(guint32);
+	}
+}
+
+
+
+//
+// Returns the positions of the nodes that could contain the given text: the
+// nodes that have all the trigrams of the text. If the text is too short to
+// have a trigram all the nodes are candidates.
+//
+static GArray* my_get_candidates (XacobeoTextIndex *index, const gchar *text) {
+
+	GArray *candidates = g_array_new(FALSE, FALSE, sizeof(guint32));
+	gsize length = strlen(text);
+
+	if (length < 3) {
+		for (guint32 i = 0; i < index->entries->len; ++i) {
+			g_array_append_val(candidates, i);
+		}
+		return candidates;
+	}
+
+
+	// Collect the postings of each trigram, the rarest trigrams first
+	GPtrArray *postings = g_ptr_array_new();
+	for (gsize i = 0; i + 3 <= length; ++i) {
+		GArray *list = g_hash_table_lookup(index->trigrams, TRIGRAM(text + i));
+		if (list == NULL) {
+			g_ptr_array_free(postings, TRUE);
+			return candidates;
+		}
+		g_ptr_array_add(postings, list);
+	}
+	g_ptr_array_sort(postings, my_compare_postings);
+
+
+	// Intersect the postings, they are all sorted
+	GArray *first = g_ptr_array_index(postings, 0);
+	g_array_append_vals(candidates, first->data, first->len);
+	for (guint i = 1; i < postings->len && candidates->len; ++i) {
+		GArray *list = g_ptr_array_index(postings, i);
+		if (list == g_ptr_array_index(postings, i - 1)) {
+			continue;
+		}
+
+		guint kept = 0;
+		guint j = 0;
+		for (guint k = 0; k < candidates->len; ++k) {
+			guint32 position = g_array_index(candidates, guint32, k);
+			while (j < list->len && g_array_index(list, guint32, j) < position) {
+				++j;
+			}
+			if (j == list->len) {
+				break;
+			}
+			if (g_array_index(list, guint32, j) == position) {
+				g_array_index(candidates, guint32, kept++) = position;
+			}
+		}
+		g_array_set_size(candidates, kept);
+	}
+	g_ptr_array_free(postings, TRUE);
+
+	return candidates;
+}
+
+
+
+//
+// Compares two postings by their size.
+//
+static gint my_compare_postings (gconstpointer a, gconstpointer b) {
+	const GArray *list_a = *((GArray **) a);
+	const GArray *list_b = *((GArray **) b);
+	if (list_a->len == list_b->len) {
+		// Keep the same lists together
+		return list_a < list_b ? -1 : list_a > list_b;
+	}
+	return list_a->len < list_b->len ? -1 : 1;
+}
+
+
+
+//
+// Returns the nodes of the given kinds that contain the text. The candidates
+// found by the index are verified against the real content of the nodes.
+//
+// If 'owners' is TRUE the elements owning the nodes are returned instead of the
+// nodes, in document order and without duplicates.
+//
+static xmlNodeSet* my_search (XacobeoTextIndex *index, const gchar *text, gint kinds, gboolean owners) {
+
+	xmlNodeSet *set = xmlXPathNodeSetCreate(NULL);
+	GHashTable *seen = owners ? g_hash_table_new(g_direct_hash, g_direct_equal) : NULL;
+
+	GArray *candidates = my_get_candidates(index, text);
+	for (guint i = 0; i < candidates->len; ++i) {
+		xmlNode *node = g_ptr_array_index(index->entries, g_array_index(candidates, guint32, i));
+
+		gboolean found;
+		if (node->type == XML_ATTRIBUTE_NODE) {
+			if (! (kinds & TEXT_ENTRY_ATTRIBUTE)) {
+				continue;
+			}
+			xmlChar *value = xmlNodeGetContent(node);
+			found = strstr(value ? (const gchar *) value : "", text) != NULL;
+			xmlFree(value);
+		}
+		else {
+			if (! (kinds & TEXT_ENTRY_TEXT)) {
+				continue;
+			}
+			found = strstr(node->content ? (const gchar *) node->content : "", text) != NULL;
+		}
+
+		if (! found) {
+			continue;
+		}
+		else if (owners) {
+			node = node->parent;
+			if (g_hash_table_lookup(seen, node)) {
+				continue;
+			}
+			g_hash_table_insert(seen, node, node);
+		}
+		xmlXPathNodeSetAddUnique(set, node);
+	}
+	g_array_free(candidates, TRUE);
+
+	if (owners) {
+		// An element can own nodes placed after the nodes of its children
+		xmlXPathNodeSetSort(set);
+		g_hash_table_destroy(seen);
+	}
+
+	return set;
+}
+
+
+
+//
+// Wraps a node set into a Xacobeo::XS::NodeSet. The node set is owned by the
+// Perl object.
+//
+static SV* my_node_set_to_sv (XacobeoTextIndex *index, xmlNodeSet *set) {
+	XacobeoNodeSet *nodeset = xacobeo_nodeset_new(index->document, xmlXPathWrapNodeSet(set));
+	return sv_setref_pv(newSV(0), "Xacobeo::XS::NodeSet", (void *) nodeset);
+}
+
+
+
+//
+// Parses the predicate "[contains(., 'text')]" and returns the text searched
+// or NULL if the predicate is not in the expected form. The position after the
+// predicate is stored in 'end'.
+//
+static gchar* my_parse_contains (const gchar *p, const gchar **end) {
+
+	if (! g_str_has_prefix(p, "[contains(")) {
+		return NULL;
+	}
+	p += strlen("[contains(");
+
+	while (g_ascii_isspace(*p)) ++p;
+	if (*p++ != '.') {
+		return NULL;
+	}
+	while (g_ascii_isspace(*p)) ++p;
+	if (*p++ != ',') {
+		return NULL;
+	}
+	while (g_ascii_isspace(*p)) ++p;
+
+	gchar quote = *p++;
+	if (quote != '\'' && quote != '"') {
+		return NULL;
+	}
+	const gchar *start = p;
+	p = strchr(start, quote);
+	if (p == NULL) {
+		return NULL;
+	}
+	const gchar *stop = p++;
+
+	while (g_ascii_isspace(*p)) ++p;
+	if (*p++ != ')' || *p++ != ']') {
+		return NULL;
+	}
+
+	*end = p;
+	return g_strndup(start, stop - start);
+}
+
+
+
+//
+// Frees the postings of a trigram.
+//
+static void my_postings_free (gpointer data) {
+	g_array_free((GArray *) data, TRUE);
+}
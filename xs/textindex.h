@@ -0,0 +1,79 @@
+#ifndef __XACOBEO_TEXTINDEX_H__
+#define __XACOBEO_TEXTINDEX_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <glib.h>
+#include <libxml/tree.h>
+
+#include "preorder.h"
+
+
+// The states of a text index
+enum TextIndexState {
+	TEXT_INDEX_BUILDING,
+	TEXT_INDEX_READY,
+	TEXT_INDEX_CANCELLED,
+	TEXT_INDEX_LIMIT,
+};
+typedef enum TextIndexState TextIndexStateEnum;
+
+
+//
+// Trigram index of the text nodes and of the attribute values of a document.
+// Each trigram (3 consecutive bytes) is mapped to the text nodes and attributes
+// containing it. A substring search only has to verify the nodes that have all
+// the trigrams of the string searched.
+//
+// The index is built in a worker thread. The index can only be searched once
+// it's ready; until then the searches have to go through the XPath engine. An
+// index that exceeds its memory limit is dropped.
+//
+typedef struct _XacobeoTextIndex {
+
+	// The document indexed; the Perl document is kept alive while the index exists
+	xmlDoc *doc;
+	SV *document;
+
+	// The preorder mirror of the document (optional), its arrays are walked
+	// instead of the tree
+	XacobeoPreorder *preorder;
+
+	// The text nodes and attributes indexed (in document order)
+	GPtrArray *entries;
+
+	// The postings (key: trigram, value: GArray of guint32 positions in entries)
+	GHashTable *trigrams;
+
+	// The memory used by the index in bytes and its limit (0 for no limit)
+	gsize size;
+	gsize limit;
+
+	// The worker thread (NULL once it's joined)
+	GThread *thread;
+
+	// The state of the index (TextIndexStateEnum), it's set by the worker thread
+	volatile gint state;
+
+	// Set to TRUE in order to stop the worker thread
+	volatile gint cancelled;
+
+	GTimer *timer;
+
+} XacobeoTextIndex;
+
+
+// Public prototypes
+XacobeoTextIndex* xacobeo_text_index_new     (SV *document, gulong limit, XacobeoPreorder *preorder);
+void              xacobeo_text_index_free    (XacobeoTextIndex *index);
+const gchar*      xacobeo_text_index_poll    (XacobeoTextIndex *index);
+void              xacobeo_text_index_wait    (XacobeoTextIndex *index);
+gdouble           xacobeo_text_index_elapsed (XacobeoTextIndex *index);
+SV*               xacobeo_text_index_search  (XacobeoTextIndex *index, const gchar *text);
+SV*               xacobeo_text_index_find    (XacobeoTextIndex *index, const gchar *expression);
+
+
+#endif
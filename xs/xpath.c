@@ -0,0 +1,1136 @@
+//
+// XPath helpers.
+//
+// Copyright (C) 2008 Emmanuel Rodriguez
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the same terms as Perl itself, either Perl version 5.8.8 or, at your option,
+// any later version of Perl 5 you may have available.
+//
+//
+
+
+#include "xpath.h"
+#include "logger.h"
+#include "libxml.h"
+
+#include <libxml/xpathInternals.h>
+#include <libxml/pattern.h>
+
+#include <string.h>
+
+
+//
+// An entry in the cache of compiled expressions.
+//
+typedef struct _XPathCacheEntry {
+	gchar *key;
+	SV    *expression;
+} XPathCacheEntry;
+
+
+//
+// A location step of an expression being explained: the step and its
+// predicates compiled one more at the time (compiled[0] is the step without
+// predicates).
+//
+typedef struct _XPathStep {
+	gchar *label;
+	GPtrArray *predicates;
+	GPtrArray *compiled;
+} XPathStep;
+
+
+//
+// Function prototypes
+//
+static gchar*           my_get_cache_key         (const gchar *expression, HV *namespaces);
+static gint             my_compare_strings       (gconstpointer a, gconstpointer b);
+static void             my_ignore_error          (void *data, xmlError *error);
+static void             my_cache_entry_free      (XPathCacheEntry *entry);
+static xmlPattern*      my_compile_pattern       (const gchar *expression, HV *namespaces);
+static const gchar*     my_find_top_level        (const gchar *p, const gchar *chars);
+static GPtrArray*       my_split_top_level       (const gchar *expression, const gchar *separator);
+static GPtrArray*       my_parse_steps           (xmlXPathContext *context, const gchar *branch, gboolean first);
+static gboolean         my_add_step              (xmlXPathContext *context, GPtrArray *steps, const gchar *label, const gchar *text);
+static xmlNodeSet*      my_eval_step             (xmlXPathContext *context, xmlXPathCompExpr *compiled, xmlNodeSet *contexts);
+static void             my_explain_row_free      (XacobeoExplainRow *row);
+static void             my_step_free             (XPathStep *step);
+static gboolean         my_is_name_test          (const gchar *test);
+static glong            my_find_unknown_function (xmlXPathContext *context, const gchar *expression);
+static const gchar*     my_skip_qname            (const gchar *p);
+
+
+
+//
+// Creates a new cache that can hold up to 'size' compiled expressions.
+//
+// The cache has to be freed with xacobeo_xpath_cache_free().
+//
+XacobeoXPathCache* xacobeo_xpath_cache_new (guint size) {
+	XacobeoXPathCache *cache = g_new0(XacobeoXPathCache, 1);
+	cache->size = size ? size : 1;
+	cache->entries = g_hash_table_new(g_str_hash, g_str_equal);
+	cache->lru = g_queue_new();
+	return cache;
+}
+
+
+
+//
+// Frees the cache and releases the compiled expressions.
+//
+void xacobeo_xpath_cache_free (XacobeoXPathCache *cache) {
+	if (cache == NULL) {
+		return;
+	}
+
+	INFO("XPath cache hits = %u, misses = %u", cache->hits, cache->misses);
+
+	g_hash_table_destroy(cache->entries);
+	for (GList *link = cache->lru->head; link; link = link->next) {
+		my_cache_entry_free(link->data);
+	}
+	g_queue_free(cache->lru);
+	g_free(cache);
+}
+
+
+
+//
+// Returns the compiled version of the given expression (an instance of
+// XML::LibXML::XPathExpression). The expression is compiled with the given
+// namespaces (key: uri, value: prefix) and kept in the cache.
+//
+// If the expression can't be compiled undef is returned. In such case the caller
+// should evaluate the raw expression in order to get the error message.
+//
+SV* xacobeo_xpath_cache_compile (XacobeoXPathCache *cache, const gchar *expression, HV *namespaces) {
+
+	if (cache == NULL || expression == NULL) {
+		return &PL_sv_undef;
+	}
+
+	gchar *key = my_get_cache_key(expression, namespaces);
+	GList *link = g_hash_table_lookup(cache->entries, key);
+	if (link) {
+		// Move the entry to the front
+		++cache->hits;
+		g_free(key);
+		g_queue_unlink(cache->lru, link);
+		g_queue_push_head_link(cache->lru, link);
+		XPathCacheEntry *entry = link->data;
+		return newSVsv(entry->expression);
+	}
+	++cache->misses;
+
+
+	// Compile the expression
+	xmlXPathContext *context = xacobeo_xpath_context_new(namespaces);
+	xmlXPathCompExpr *compiled = xmlXPathCtxtCompile(context, BAD_CAST expression);
+	xmlXPathFreeContext(context);
+	if (compiled == NULL) {
+		g_free(key);
+		return &PL_sv_undef;
+	}
+
+	XPathCacheEntry *entry = g_new(XPathCacheEntry, 1);
+	entry->key = key;
+	entry->expression = sv_setref_pv(newSV(0), "XML::LibXML::XPathExpression", (void *) compiled);
+	g_queue_push_head(cache->lru, entry);
+	g_hash_table_insert(cache->entries, entry->key, cache->lru->head);
+
+
+	// Discard the least recently used entries
+	while (cache->lru->length > cache->size) {
+		XPathCacheEntry *old = g_queue_pop_tail(cache->lru);
+		g_hash_table_remove(cache->entries, old->key);
+		my_cache_entry_free(old);
+	}
+
+	return newSVsv(entry->expression);
+}
+
+
+
+//
+// Checks the syntax of the given XPath expression. The expression is only
+// compiled, it's never evaluated. The namespaces (key: uri, value: prefix) are
+// registered in the compilation context and the use of an unknown prefix is
+// reported as an error. libxml2 only resolves the functions when the
+// expression is evaluated, the calls to unknown functions are found here.
+//
+// Returns the position (in characters) where the syntax error was found or -1
+// if the expression is valid.
+//
+gint xacobeo_xpath_get_error_offset (const gchar *expression, HV *namespaces) {
+
+	if (expression == NULL) {
+		return 0;
+	}
+
+	xmlXPathContext *context = xacobeo_xpath_context_new(namespaces);
+#ifdef XML_XPATH_CHECKNS
+	context->flags |= XML_XPATH_CHECKNS;
+#endif
+
+	gint offset = -1;
+	xmlXPathCompExpr *compiled = xmlXPathCtxtCompile(context, BAD_CAST expression);
+	if (compiled) {
+		xmlXPathFreeCompExpr(compiled);
+		glong position = my_find_unknown_function(context, expression);
+		if (position >= 0) {
+			offset = g_utf8_strlen(expression, position);
+		}
+	}
+	else {
+		// The error's position is given in bytes
+		glong length = strlen(expression);
+		glong position = context->lastError.domain == XML_FROM_XPATH ? context->lastError.int1 : 0;
+		position = CLAMP(position, 0, length);
+		offset = g_utf8_strlen(expression, position);
+	}
+	xmlXPathFreeContext(context);
+
+	return offset;
+}
+
+
+
+//
+// Returns the first 'max' nodes matched by the given expression as a Perl
+// XML::LibXML::NodeList. The nodes are returned in document order, as done by
+// the XPath engine.
+//
+// This function only supports the expressions that libxml2 can evaluate as a
+// stream (see xmlPatterncompile()): absolute location paths made of element and
+// attribute names, wildcards and the descendant operator (ex: //a/b, /a//@c,
+// //a | //b). The document is walked only until 'max' nodes are found.
+//
+// The walk also stops after 'visits' nodes (elements and attributes) when it's
+// not 0, this way a name that's rare in a big document doesn't block the
+// caller. If the walk stops before 'max' nodes are found undef is returned.
+//
+// If the expression can't be streamed undef is returned. In such case the
+// expression has to be evaluated by the XPath engine.
+//
+SV* xacobeo_xpath_preview (SV *document, const gchar *expression, HV *namespaces, guint max, guint visits) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL || expression == NULL) {
+		return &PL_sv_undef;
+	}
+
+	xmlPattern *pattern = my_compile_pattern(expression, namespaces);
+	if (pattern == NULL) {
+		return &PL_sv_undef;
+	}
+	xmlStreamCtxt *stream = xmlPatternGetStreamCtxt(pattern);
+	if (stream == NULL) {
+		xmlFreePattern(pattern);
+		return &PL_sv_undef;
+	}
+
+	ProxyNode *owner = PmmOWNERPO(PmmPROXYNODE((xmlNode *) node->doc));
+	AV *nodes = newAV();
+	guint found = 0;
+	guint visited = 0;
+	gboolean stopped = FALSE;
+
+	// The document node starts the stream, the root is matched by the first step
+	xmlStreamPush(stream, NULL, NULL);
+
+	// Walk the elements in document order without recursion
+	xmlNode *current = node->doc->children;
+	while (current && found < max) {
+
+		if (visits && visited >= visits) {
+			stopped = TRUE;
+			break;
+		}
+		++visited;
+
+		if (current->type == XML_ELEMENT_NODE) {
+			const xmlChar *uri = current->ns ? current->ns->href : NULL;
+			if (xmlStreamPush(stream, current->name, uri) == 1) {
+				av_push(nodes, PmmNodeToSv(current, owner));
+				++found;
+			}
+
+			for (xmlAttr *attr = current->properties; attr && found < max; attr = attr->next) {
+				const xmlChar *attr_uri = attr->ns ? attr->ns->href : NULL;
+				if (xmlStreamPushAttr(stream, attr->name, attr_uri) == 1) {
+					av_push(nodes, PmmNodeToSv((xmlNode *) attr, owner));
+					++found;
+				}
+				xmlStreamPop(stream);
+				++visited;
+			}
+
+			if (current->children) {
+				current = current->children;
+				continue;
+			}
+			xmlStreamPop(stream);
+		}
+
+		// Go to the next node, closing the elements that are done
+		while (current && current->next == NULL) {
+			current = current->parent;
+			if (current == NULL || current->type != XML_ELEMENT_NODE) {
+				current = NULL;
+				break;
+			}
+			xmlStreamPop(stream);
+		}
+		if (current) {
+			current = current->next;
+		}
+	}
+
+	xmlFreeStreamCtxt(stream);
+	xmlFreePattern(pattern);
+
+	if (stopped) {
+		SvREFCNT_dec((SV *) nodes);
+		return &PL_sv_undef;
+	}
+
+	return sv_bless(newRV_noinc((SV *) nodes), gv_stashpv("XML::LibXML::NodeList", GV_ADD));
+}
+
+
+
+//
+// Explains the evaluation of an XPath expression: each location step of the
+// expression is evaluated on the nodes selected by the previous step and the
+// number of nodes selected by the step and the time spent are reported. Each
+// predicate is reported separately, its time is the extra time spent by the
+// step because of the predicate. This shows which step of a slow query is
+// responsible.
+//
+// Each step and each predicate is compiled once and then evaluated for every
+// context node. The branches of an union are explained one after the other.
+// The last row is the normal evaluation of the whole expression.
+//
+// The explanation is returned as a Perl array ref of rows [label, count,
+// seconds]. If the expression isn't a location path (or an union of location
+// paths), if it can't be compiled or if a step doesn't return nodes undef is
+// returned.
+//
+// The expression is evaluated right away, see XacobeoXPathJob for explaining an
+// expression in a worker thread.
+//
+SV* xacobeo_xpath_explain (SV *document, const gchar *expression, HV *namespaces) {
+
+	xmlNode *node = PmmSvNode(document);
+	if (node == NULL || expression == NULL) {
+		return &PL_sv_undef;
+	}
+
+	xmlXPathContext *context = xacobeo_xpath_context_new(namespaces);
+	context->doc = node->doc;
+	context->node = (xmlNode *) node->doc;
+
+	GPtrArray *rows = xacobeo_xpath_explain_rows(context, expression, NULL);
+	xmlXPathFreeContext(context);
+	if (rows == NULL) {
+		return &PL_sv_undef;
+	}
+
+	SV *explanation = xacobeo_xpath_explain_to_sv(rows);
+	g_ptr_array_free(rows, TRUE);
+
+	return explanation;
+}
+
+
+
+//
+// Explains an XPath expression (see xacobeo_xpath_explain()) with the given
+// context, which holds the document and the namespaces. This function doesn't
+// use Perl, it can be called from a worker thread. The explanation stops early
+// once 'stopped' (if not NULL) is set.
+//
+// Returns the rows of the explanation (XacobeoExplainRow) or NULL if the
+// expression can't be explained or if the explanation was stopped. The rows have
+// to be freed with g_ptr_array_free().
+//
+GPtrArray* xacobeo_xpath_explain_rows (xmlXPathContext *context, const gchar *expression, volatile gint *stopped) {
+
+	// The steps change the position in the context, it's restored at the end
+	xmlDoc *doc = context->doc;
+	gint size = context->contextSize;
+	gint position = context->proximityPosition;
+	context->node = (xmlNode *) doc;
+
+	xmlXPathCompExpr *whole = xmlXPathCtxtCompile(context, BAD_CAST expression);
+	if (whole == NULL) {
+		return NULL;
+	}
+
+
+	// Compile the steps of each branch before evaluating anything
+	GPtrArray *branches = my_split_top_level(expression, "|");
+	GPtrArray *plans = g_ptr_array_new_with_free_func((GDestroyNotify) g_ptr_array_unref);
+	gboolean supported = TRUE;
+	for (guint i = 0; i < branches->len && supported; ++i) {
+		GPtrArray *steps = my_parse_steps(context, g_ptr_array_index(branches, i), i == 0);
+		if (steps) {
+			g_ptr_array_add(plans, steps);
+		}
+		else {
+			supported = FALSE;
+		}
+	}
+
+
+	GPtrArray *rows = xacobeo_xpath_explain_new();
+	GTimer *timer = g_timer_new();
+	for (guint i = 0; i < plans->len && supported; ++i) {
+		GPtrArray *steps = g_ptr_array_index(plans, i);
+
+		// The paths start at the document node
+		xmlNodeSet *contexts = xmlXPathNodeSetCreate((xmlNode *) doc);
+		for (guint j = 0; j < steps->len && supported; ++j) {
+			XPathStep *step = g_ptr_array_index(steps, j);
+
+			// The step alone and then with one more predicate at the time
+			gdouble previous = 0.0;
+			xmlNodeSet *selected = NULL;
+			for (guint k = 0; k < step->compiled->len; ++k) {
+				if (selected) {
+					xmlXPathFreeNodeSet(selected);
+				}
+
+				g_timer_start(timer);
+				selected = my_eval_step(context, g_ptr_array_index(step->compiled, k), contexts);
+				gdouble elapsed = g_timer_elapsed(timer, NULL);
+				if (selected == NULL || (stopped && g_atomic_int_get(stopped))) {
+					supported = FALSE;
+					break;
+				}
+
+				const gchar *label = k ? g_ptr_array_index(step->predicates, k - 1) : step->label;
+				xacobeo_xpath_explain_add(rows, label, selected->nodeNr, k ? MAX(elapsed - previous, 0.0) : elapsed);
+				previous = elapsed;
+			}
+
+			xmlXPathFreeNodeSet(contexts);
+			contexts = selected;
+		}
+		if (contexts) {
+			xmlXPathFreeNodeSet(contexts);
+		}
+	}
+
+
+	// The whole expression as evaluated normally
+	if (supported) {
+		context->node = (xmlNode *) doc;
+		g_timer_start(timer);
+		xmlXPathObject *result = xmlXPathCompiledEval(whole, context);
+		gdouble elapsed = g_timer_elapsed(timer, NULL);
+		if (result && result->type == XPATH_NODESET && ! (stopped && g_atomic_int_get(stopped))) {
+			xacobeo_xpath_explain_add(rows, expression, result->nodesetval ? result->nodesetval->nodeNr : 0, elapsed);
+		}
+		else {
+			supported = FALSE;
+		}
+		if (result) {
+			xmlXPathFreeObject(result);
+		}
+	}
+	g_timer_destroy(timer);
+
+
+	g_ptr_array_free(plans, TRUE);
+	g_ptr_array_free(branches, TRUE);
+	xmlXPathFreeCompExpr(whole);
+	context->node = (xmlNode *) doc;
+	context->contextSize = size;
+	context->proximityPosition = position;
+
+	if (! supported) {
+		g_ptr_array_free(rows, TRUE);
+		return NULL;
+	}
+
+	return rows;
+}
+
+
+
+//
+// Returns an empty explanation. The rows are freed with the array.
+//
+GPtrArray* xacobeo_xpath_explain_new (void) {
+	return g_ptr_array_new_with_free_func((GDestroyNotify) my_explain_row_free);
+}
+
+
+
+//
+// Adds a row to the explanation of an expression.
+//
+void xacobeo_xpath_explain_add (GPtrArray *rows, const gchar *label, gint count, gdouble elapsed) {
+	XacobeoExplainRow *row = g_new(XacobeoExplainRow, 1);
+	row->label = g_strdup(label);
+	row->count = count;
+	row->elapsed = elapsed;
+	g_ptr_array_add(rows, row);
+}
+
+
+
+//
+// Returns the rows of an explanation as a Perl array ref of rows [label, count,
+// seconds].
+//
+SV* xacobeo_xpath_explain_to_sv (GPtrArray *rows) {
+	AV *explanation = newAV();
+	for (guint i = 0; i < rows->len; ++i) {
+		XacobeoExplainRow *row = g_ptr_array_index(rows, i);
+
+		AV *values = newAV();
+		SV *label = newSVpv(row->label, 0);
+		SvUTF8_on(label);
+		av_push(values, label);
+		av_push(values, newSViv(row->count));
+		av_push(values, newSVnv(row->elapsed));
+		av_push(explanation, newRV_noinc((SV *) values));
+	}
+	return newRV_noinc((SV *) explanation);
+}
+
+
+
+//
+// Returns the step of an expression of the form //step[predicate]... where the
+// step selects children or attributes (ex: //trade[amount > 1000], //@id).
+// Such an expression selects the nodes matched by the step from each node of
+// the document, the step can thus be evaluated on separate subtrees in
+// parallel.
+//
+// Returns the step with its predicates or NULL if the expression is not of this
+// form. The step has to be freed with g_free().
+//
+gchar* xacobeo_xpath_get_descendant_step (const gchar *expression) {
+
+	while (g_ascii_isspace(*expression)) {
+		++expression;
+	}
+	if (! g_str_has_prefix(expression, "//")) {
+		return NULL;
+	}
+
+	gchar *step = g_strstrip(g_strdup(expression + 2));
+	gboolean supported = *step != '\0' && *my_find_top_level(step, "/|") == '\0';
+
+	// The node test
+	const gchar *p = my_find_top_level(step, "[");
+	gchar *test = g_strstrip(g_strndup(step, p - step));
+	supported = supported && my_is_name_test(test);
+	g_free(test);
+
+	// The predicates
+	while (supported && *p) {
+		if (*p == '[') {
+			const gchar *close = my_find_top_level(p + 1, "]");
+			supported = *close == ']';
+			p = close + 1;
+		}
+		else {
+			supported = g_ascii_isspace(*p);
+			++p;
+		}
+	}
+
+	if (! supported) {
+		g_free(step);
+		return NULL;
+	}
+	return step;
+}
+
+
+
+//
+// Creates an XPath context with the given namespaces (key: uri, value: prefix)
+// registered. The errors raised while using the context are ignored.
+//
+xmlXPathContext* xacobeo_xpath_context_new (HV *namespaces) {
+
+	xmlXPathContext *context = xmlXPathNewContext(NULL);
+	context->error = my_ignore_error;
+
+	if (namespaces) {
+		hv_iterinit(namespaces);
+		HE *entry;
+		while ((entry = hv_iternext(namespaces)) != NULL) {
+			I32 length;
+			gchar *uri = hv_iterkey(entry, &length);
+			SV *prefix = hv_iterval(namespaces, entry);
+			if (! SvPOK(prefix)) {
+				continue;
+			}
+			xmlXPathRegisterNs(context, BAD_CAST SvPV_nolen(prefix), BAD_CAST uri);
+		}
+	}
+
+	return context;
+}
+
+
+
+//
+// Returns the key used to identify an expression in the cache. The key is made
+// of the namespaces, sorted by prefix, followed by the expression.
+//
+static gchar* my_get_cache_key (const gchar *expression, HV *namespaces) {
+
+	GPtrArray *pairs = g_ptr_array_new();
+	if (namespaces) {
+		hv_iterinit(namespaces);
+		HE *entry;
+		while ((entry = hv_iternext(namespaces)) != NULL) {
+			I32 length;
+			gchar *uri = hv_iterkey(entry, &length);
+			SV *prefix = hv_iterval(namespaces, entry);
+			if (! SvPOK(prefix)) {
+				continue;
+			}
+			g_ptr_array_add(pairs, g_strdup_printf("%s\x1f%s\x1e", SvPV_nolen(prefix), uri));
+		}
+	}
+	g_ptr_array_sort(pairs, my_compare_strings);
+
+	GString *key = g_string_sized_new(64);
+	for (guint i = 0; i < pairs->len; ++i) {
+		gchar *pair = g_ptr_array_index(pairs, i);
+		g_string_append(key, pair);
+		g_free(pair);
+	}
+	g_ptr_array_free(pairs, TRUE);
+
+	g_string_append_c(key, '\x1d');
+	g_string_append(key, expression);
+
+	return g_string_free(key, FALSE);
+}
+
+
+
+//
+// Compares two strings stored in a GPtrArray.
+//
+static gint my_compare_strings (gconstpointer a, gconstpointer b) {
+	return strcmp(*(const gchar **) a, *(const gchar **) b);
+}
+
+
+
+//
+// Error handler that doesn't report the errors.
+//
+static void my_ignore_error (void *data, xmlError *error) {
+}
+
+
+
+//
+// Frees an entry of the cache and releases its expression.
+//
+static void my_cache_entry_free (XPathCacheEntry *entry) {
+	SvREFCNT_dec(entry->expression);
+	g_free(entry->key);
+	g_free(entry);
+}
+
+
+
+//
+// Compiles the given XPath expression as a streamable pattern. The namespaces
+// (key: uri, value: prefix) are used for resolving the prefixes.
+//
+// Only absolute paths are accepted, libxml2 matches relative patterns at any
+// depth (as XSLT does) which is not the meaning of a relative XPath expression.
+// The document is streamed as elements and attributes, the paths that can
+// select other nodes are also refused.
+//
+// Returns NULL if the expression is not streamable.
+//
+static xmlPattern* my_compile_pattern (const gchar *expression, HV *namespaces) {
+
+	// Each branch of an union has to be absolute and has to select elements or
+	// attributes. A path ending with '.' can select any kind of node.
+	gchar **branches = g_strsplit(expression, "|", -1);
+	gboolean supported = branches[0] != NULL;
+	for (gchar **branch = branches; *branch; ++branch) {
+		gchar *path = g_strstrip(*branch);
+		if (path[0] != '/' || g_str_has_suffix(path, "/.") || g_str_has_suffix(path, "/..")) {
+			supported = FALSE;
+			break;
+		}
+	}
+	g_strfreev(branches);
+	if (! supported) {
+		return NULL;
+	}
+
+
+	// The namespaces are given as an array of pairs (uri, prefix)
+	GPtrArray *pairs = g_ptr_array_new();
+	if (namespaces) {
+		hv_iterinit(namespaces);
+		HE *entry;
+		while ((entry = hv_iternext(namespaces)) != NULL) {
+			I32 length;
+			gchar *uri = hv_iterkey(entry, &length);
+			SV *prefix = hv_iterval(namespaces, entry);
+			if (! SvPOK(prefix)) {
+				continue;
+			}
+			g_ptr_array_add(pairs, uri);
+			g_ptr_array_add(pairs, SvPV_nolen(prefix));
+		}
+	}
+	g_ptr_array_add(pairs, NULL);
+	g_ptr_array_add(pairs, NULL);
+
+	xmlPattern *pattern = xmlPatterncompile(
+		BAD_CAST expression, NULL, XML_PATTERN_XPATH, (const xmlChar **) pairs->pdata
+	);
+	g_ptr_array_free(pairs, TRUE);
+
+	if (pattern && xmlPatternStreamable(pattern) != 1) {
+		xmlFreePattern(pattern);
+		pattern = NULL;
+	}
+
+	return pattern;
+}
+
+
+
+//
+// Returns the first character of the expression that is one of the given
+// characters and that is not within quotes, brackets or parentheses. If there's
+// no such character the end of the string is returned.
+//
+static const gchar* my_find_top_level (const gchar *p, const gchar *chars) {
+	gint depth = 0;
+	gchar quote = '\0';
+	for (; *p; ++p) {
+		if (quote) {
+			if (*p == quote) {
+				quote = '\0';
+			}
+			continue;
+		}
+
+		if (depth == 0 && strchr(chars, *p)) {
+			break;
+		}
+
+		switch (*p) {
+			case '\'':
+			case '"':
+				quote = *p;
+			break;
+
+			case '[':
+			case '(':
+				++depth;
+			break;
+
+			case ']':
+			case ')':
+				--depth;
+			break;
+		}
+	}
+	return p;
+}
+
+
+
+//
+// Splits the expression at each top level separator (see my_find_top_level()).
+// The parts are stripped and freed with the array.
+//
+static GPtrArray* my_split_top_level (const gchar *expression, const gchar *separator) {
+	GPtrArray *parts = g_ptr_array_new_with_free_func(g_free);
+	const gchar *p = expression;
+	for (;;) {
+		const gchar *end = my_find_top_level(p, separator);
+		g_ptr_array_add(parts, g_strstrip(g_strndup(p, end - p)));
+		if (*end == '\0') {
+			break;
+		}
+		p = end + 1;
+	}
+	return parts;
+}
+
+
+
+//
+// Splits a location path in steps and compiles them. The abbreviation '//' is a
+// step of its own (descendant-or-self::node()). The steps of all but the first
+// branch of an union are labeled with '|'.
+//
+// Returns NULL if the branch is not a location path.
+//
+static GPtrArray* my_parse_steps (xmlXPathContext *context, const gchar *branch, gboolean first) {
+	GPtrArray *steps = g_ptr_array_new_with_free_func((GDestroyNotify) my_step_free);
+	const gchar *p = branch;
+	gchar *separator = g_strdup(first ? "" : "| ");
+	gboolean supported = TRUE;
+
+	if (*p == '/') {
+		++p;
+		if (*p == '/') {
+			++p;
+			gchar *label = g_strconcat(separator, "//", NULL);
+			supported = my_add_step(context, steps, label, "descendant-or-self::node()");
+			g_free(label);
+			g_free(separator);
+			separator = g_strdup("");
+		}
+		else {
+			g_free(separator);
+			separator = g_strdup(first ? "/" : "| /");
+		}
+	}
+
+	while (*p && supported) {
+		const gchar *end = my_find_top_level(p, "/");
+		gchar *text = g_strstrip(g_strndup(p, end - p));
+		gchar *label = g_strconcat(separator, text, NULL);
+		supported = *text && my_add_step(context, steps, label, text);
+		g_free(label);
+		g_free(text);
+		g_free(separator);
+		separator = NULL;
+
+		if (*end == '\0' || ! supported) {
+			break;
+		}
+		else if (end[1] == '/') {
+			supported = my_add_step(context, steps, "//", "descendant-or-self::node()");
+			p = end + 2;
+			separator = g_strdup("");
+		}
+		else {
+			p = end + 1;
+			separator = g_strdup("/");
+		}
+
+		// A path can't end with a separator
+		supported = supported && *p;
+	}
+	g_free(separator);
+
+	if (! supported) {
+		g_ptr_array_free(steps, TRUE);
+		return NULL;
+	}
+	return steps;
+}
+
+
+
+//
+// Adds a step to the steps of a path. The step is split in its node test and its
+// predicates and compiled once for each predicate.
+//
+// Returns FALSE if the text is not a step or if it can't be compiled.
+//
+static gboolean my_add_step (xmlXPathContext *context, GPtrArray *steps, const gchar *label, const gchar *text) {
+
+	XPathStep *step = g_new0(XPathStep, 1);
+	step->predicates = g_ptr_array_new_with_free_func(g_free);
+	step->compiled = g_ptr_array_new_with_free_func((GDestroyNotify) xmlXPathFreeCompExpr);
+	g_ptr_array_add(steps, step);
+
+	// The node test ends where the first predicate starts
+	const gchar *end = my_find_top_level(text, "[");
+	gchar *base = g_strstrip(g_strndup(text, end - text));
+	if (*end && g_str_has_suffix(label, text)) {
+		// The label shows the step without its predicates
+		step->label = g_strndup(label, strlen(label) - strlen(text) + strlen(base));
+	}
+	else {
+		step->label = g_strdup(label);
+	}
+
+	const gchar *p = end;
+	gboolean supported = *base != '\0';
+	GString *prefix = g_string_new(base);
+	g_free(base);
+
+	while (supported) {
+		xmlXPathCompExpr *compiled = xmlXPathCtxtCompile(context, BAD_CAST prefix->str);
+		if (compiled == NULL) {
+			supported = FALSE;
+			break;
+		}
+		g_ptr_array_add(step->compiled, compiled);
+
+		while (g_ascii_isspace(*p)) {
+			++p;
+		}
+		if (*p == '\0') {
+			break;
+		}
+		else if (*p != '[') {
+			// Something else than a predicate (an operator, a function call, etc)
+			supported = FALSE;
+			break;
+		}
+
+		const gchar *close = my_find_top_level(p + 1, "]");
+		if (*close == '\0') {
+			supported = FALSE;
+			break;
+		}
+		gchar *predicate = g_strndup(p, close - p + 1);
+		g_string_append(prefix, predicate);
+		g_ptr_array_add(step->predicates, predicate);
+		p = close + 1;
+	}
+	g_string_free(prefix, TRUE);
+
+	return supported;
+}
+
+
+
+//
+// Evaluates a compiled step for each context node and returns the distinct nodes
+// selected. The nodes are not sorted, the explanation only needs their count.
+//
+// Returns NULL if the step doesn't return nodes.
+//
+static xmlNodeSet* my_eval_step (xmlXPathContext *context, xmlXPathCompExpr *compiled, xmlNodeSet *contexts) {
+	xmlNodeSet *selected = xmlXPathNodeSetCreate(NULL);
+	GHashTable *seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+	gint size = contexts ? contexts->nodeNr : 0;
+
+	for (gint i = 0; i < size; ++i) {
+		context->node = contexts->nodeTab[i];
+		context->contextSize = size;
+		context->proximityPosition = i + 1;
+
+		xmlXPathObject *result = xmlXPathCompiledEval(compiled, context);
+		if (result == NULL || result->type != XPATH_NODESET) {
+			if (result) {
+				xmlXPathFreeObject(result);
+			}
+			xmlXPathFreeNodeSet(selected);
+			selected = NULL;
+			break;
+		}
+
+		xmlNodeSet *nodes = result->nodesetval;
+		for (gint j = 0; nodes && j < nodes->nodeNr; ++j) {
+			xmlNode *node = nodes->nodeTab[j];
+			if (node->type == XML_NAMESPACE_DECL || ! g_hash_table_lookup(seen, node)) {
+				g_hash_table_insert(seen, node, node);
+				xmlXPathNodeSetAddUnique(selected, node);
+			}
+		}
+		xmlXPathFreeObject(result);
+	}
+	g_hash_table_destroy(seen);
+
+	return selected;
+}
+
+
+
+//
+// Frees a row of an explanation.
+//
+static void my_explain_row_free (XacobeoExplainRow *row) {
+	g_free(row->label);
+	g_free(row);
+}
+
+
+
+//
+// Frees a step and its compiled expressions.
+//
+static void my_step_free (XPathStep *step) {
+	g_ptr_array_free(step->compiled, TRUE);
+	g_ptr_array_free(step->predicates, TRUE);
+	g_free(step->label);
+	g_free(step);
+}
+
+
+
+//
+// Returns TRUE if the given node test selects children or attributes: a name
+// (prefix:name, prefix:*, *) or a node type test, optionally with the axis
+// child or attribute.
+//
+static gboolean my_is_name_test (const gchar *test) {
+	if (*test == '@') {
+		++test;
+	}
+	else if (g_str_has_prefix(test, "child::")) {
+		test += strlen("child::");
+	}
+	else if (g_str_has_prefix(test, "attribute::")) {
+		test += strlen("attribute::");
+	}
+
+	if (
+		strcmp(test, "node()") == 0 ||
+		strcmp(test, "text()") == 0 ||
+		strcmp(test, "comment()") == 0 ||
+		strcmp(test, "processing-instruction()") == 0
+	) {
+		return TRUE;
+	}
+
+	// A name, the abbreviations '.' and '..' and the other axes are excluded
+	if (! (g_ascii_isalpha(*test) || *test == '_' || *test == '*' || (*test & 0x80))) {
+		return FALSE;
+	}
+	for (const gchar *p = test; *p; ++p) {
+		if (! (g_ascii_isalnum(*p) || strchr("_-.:*", *p) || (*p & 0x80))) {
+			return FALSE;
+		}
+	}
+	return strstr(test, "::") == NULL;
+}
+
+
+
+//
+// Returns the position (in bytes) of the first call to a function that's not
+// registered in the context or -1 if all the functions are known. The
+// expression must be valid. The tokens are told apart as done by the XPath
+// specification (section 3.7): a name is an operator (and, or, div, mod) when
+// it follows an operand, otherwise a name followed by '(' is a function call
+// unless it's a node type.
+//
+static glong my_find_unknown_function (xmlXPathContext *context, const gchar *expression) {
+
+	// TRUE if the previous token ends an operand
+	gboolean operand = FALSE;
+
+	const gchar *p = expression;
+	while (*p) {
+		if (g_ascii_isspace(*p)) {
+			++p;
+		}
+		else if (*p == '\'' || *p == '"') {
+			const gchar *end = strchr(p + 1, *p);
+			p = end ? end + 1 : p + strlen(p);
+			operand = TRUE;
+		}
+		else if (g_ascii_isdigit(*p) || (*p == '.' && g_ascii_isdigit(p[1]))) {
+			while (g_ascii_isdigit(*p) || *p == '.') {
+				++p;
+			}
+			operand = TRUE;
+		}
+		else if (*p == '$') {
+			p = my_skip_qname(p + 1);
+			operand = TRUE;
+		}
+		else if (*p == '*') {
+			// A multiplication after an operand, a name test otherwise
+			++p;
+			operand = ! operand;
+		}
+		else if (*p == ')' || *p == ']' || *p == '.') {
+			++p;
+			operand = TRUE;
+		}
+		else if (g_ascii_isalpha(*p) || *p == '_' || (*p & 0x80)) {
+			const gchar *name = p;
+			p = my_skip_qname(p);
+			if (operand) {
+				operand = FALSE;
+				continue;
+			}
+
+			const gchar *next = p;
+			while (g_ascii_isspace(*next)) {
+				++next;
+			}
+			if (*next == ':' && next[1] == ':') {
+				// An axis
+				p = next + 2;
+				continue;
+			}
+			operand = TRUE;
+			if (*next != '(') {
+				continue;
+			}
+			operand = FALSE;
+
+			gchar *qname = g_strndup(name, p - name);
+			const gchar *local = strchr(qname, ':');
+			const xmlChar *uri = NULL;
+			if (local) {
+				qname[local - qname] = '\0';
+				uri = xmlXPathNsLookup(context, BAD_CAST qname);
+				++local;
+			}
+			else {
+				local = qname;
+			}
+
+			gboolean known = uri == NULL && (
+				strcmp(local, "node") == 0 ||
+				strcmp(local, "text") == 0 ||
+				strcmp(local, "comment") == 0 ||
+				strcmp(local, "processing-instruction") == 0
+			);
+			if (! known) {
+				known = xmlXPathFunctionLookupNS(context, BAD_CAST local, uri) != NULL;
+			}
+			g_free(qname);
+
+			if (! known) {
+				return name - expression;
+			}
+		}
+		else {
+			// An operator or a delimiter: @ :: ( [ , / // | + - = != < <= > >=
+			++p;
+			operand = FALSE;
+		}
+	}
+
+	return -1;
+}
+
+
+
+//
+// Returns the position after the QName (or the NCName) that starts at the
+// given position. A wildcard after a prefix (prefix:*) is part of the name.
+//
+static const gchar* my_skip_qname (const gchar *p) {
+	while (g_ascii_isalnum(*p) || (*p && strchr("_-.", *p)) || (*p & 0x80)) {
+		++p;
+	}
+	if (*p == ':' && p[1] == '*') {
+		p += 2;
+	}
+	else if (*p == ':' && (g_ascii_isalpha(p[1]) || p[1] == '_' || (p[1] & 0x80))) {
+		++p;
+		while (g_ascii_isalnum(*p) || (*p && strchr("_-.", *p)) || (*p & 0x80)) {
+			++p;
+		}
+	}
+	return p;
+}
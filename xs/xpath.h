@@ -0,0 +1,63 @@
+#ifndef __XACOBEO_XPATH_H__
+#define __XACOBEO_XPATH_H__
+
+
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <glib.h>
+#include <libxml/xpath.h>
+
+
+//
+// Cache of compiled XPath expressions. The expressions are kept as Perl objects
+// (XML::LibXML::XPathExpression) this way they can be evaluated directly by
+// XML::LibXML. The least recently used expressions are discarded once the cache
+// is full.
+//
+typedef struct _XacobeoXPathCache {
+
+	// The maximum number of expressions in the cache
+	guint size;
+
+	// The cached entries (key: namespaces + expression, value: GList* in lru)
+	GHashTable *entries;
+
+	// The entries sorted by their last use, the most recent is the head
+	GQueue *lru;
+
+	// Statistics
+	guint hits;
+	guint misses;
+
+} XacobeoXPathCache;
+
+
+//
+// A row of the explanation of an XPath expression: a step, a predicate or the
+// whole expression with the number of nodes selected and the time spent.
+//
+typedef struct _XacobeoExplainRow {
+	gchar *label;
+	gint count;
+	gdouble elapsed;
+} XacobeoExplainRow;
+
+
+// Public prototypes
+XacobeoXPathCache* xacobeo_xpath_cache_new     (guint size);
+void               xacobeo_xpath_cache_free    (XacobeoXPathCache *cache);
+SV*                xacobeo_xpath_cache_compile (XacobeoXPathCache *cache, const gchar *expression, HV *namespaces);
+gint               xacobeo_xpath_get_error_offset (const gchar *expression, HV *namespaces);
+xmlXPathContext*   xacobeo_xpath_context_new      (HV *namespaces);
+SV*                xacobeo_xpath_preview          (SV *document, const gchar *expression, HV *namespaces, guint max, guint visits);
+SV*                xacobeo_xpath_explain          (SV *document, const gchar *expression, HV *namespaces);
+GPtrArray*         xacobeo_xpath_explain_new      (void);
+GPtrArray*         xacobeo_xpath_explain_rows     (xmlXPathContext *context, const gchar *expression, volatile gint *stopped);
+void               xacobeo_xpath_explain_add      (GPtrArray *rows, const gchar *label, gint count, gdouble elapsed);
+SV*                xacobeo_xpath_explain_to_sv    (GPtrArray *rows);
+gchar*             xacobeo_xpath_get_descendant_step (const gchar *expression);
+
+
+#endif